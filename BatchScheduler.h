@@ -0,0 +1,235 @@
+/**
+ * @File  : BatchScheduler.h
+ * @brief : Pipelined decode -> filter -> encode scheduler for batches of files.
+ *
+ * Each stage has its own worker threads and hands images to the next stage
+ * through a bounded queue. While one image is being filtered the next ones are
+ * already decoding and earlier ones encoding, and a full queue blocks the
+ * stage in front of it, so the number of decoded images alive at once is
+ * bounded by the queue depths plus the number of workers.
+ *
+ * With a memory ceiling set (memory::Accounting::setLimit) decoding also waits
+ * while the images alive are over it, as long as any are still in flight.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "ImageInput.h"
+#include "ImageOutput.h"
+#include "MemoryAccounting.h"
+#include "ThreadPool.h"
+
+
+/**
+ * @class BoundedQueue
+ * @brief Blocking FIFO with a fixed capacity; close() releases waiting consumers.
+ */
+template <typename T>
+class BoundedQueue {
+    std::deque<T> items;
+    std::mutex mutex;
+    std::condition_variable notEmpty, notFull;
+    size_t capacity;
+    bool closed = false;
+
+public:
+    explicit BoundedQueue(size_t maxItems) : capacity(std::max<size_t>(1, maxItems)) {}
+
+    void push(T item) {
+        std::unique_lock<std::mutex> lock(mutex);
+        notFull.wait(lock, [this] { return items.size() < capacity; });
+        items.push_back(std::move(item));
+        notEmpty.notify_one();
+    }
+
+    // Returns false once the queue is closed and drained.
+    bool pop(T& item) {
+        std::unique_lock<std::mutex> lock(mutex);
+        notEmpty.wait(lock, [this] { return closed || !items.empty(); });
+        if (items.empty()) return false;
+        item = std::move(items.front());
+        items.pop_front();
+        notFull.notify_one();
+        return true;
+    }
+
+    void close() {
+        std::lock_guard<std::mutex> lock(mutex);
+        closed = true;
+        notEmpty.notify_all();
+    }
+};
+
+
+/**
+ * @struct BatchResult
+ * @brief What happened to one file; handed to the report callback after encode.
+ */
+struct BatchResult {
+    size_t index = 0;
+    std::string input;
+    std::string output;
+    int width = 0;
+    int height = 0;
+    double decodeMs = 0;
+    double filterMs = 0;
+    double encodeMs = 0;
+    std::string error; ///< Empty on success.
+};
+
+
+/**
+ * @class BatchScheduler
+ * @brief Runs filter over every (input, output) pair with overlapping stages.
+ */
+class BatchScheduler {
+public:
+    using DecodeFn = std::function<Image(const std::string&)>;
+
+    struct Config {
+        unsigned decodeThreads = ThreadPool::defaultThreadCount();
+        unsigned filterThreads = ThreadPool::defaultThreadCount();
+        unsigned encodeThreads = ThreadPool::defaultThreadCount();
+        size_t queueDepth = ThreadPool::defaultThreadCount(); ///< Images waiting between two stages.
+        DecodeFn decode; ///< Empty means decodeImage().
+        EncodeOptions encode;
+    };
+
+    using FilterFn = std::function<void(Image&)>;
+    using ReportFn = std::function<void(const BatchResult&)>;
+
+private:
+    struct Item {
+        BatchResult result;
+        std::unique_ptr<Image> image;
+    };
+
+    Config config;
+
+    static double millisecondsSince(std::chrono::steady_clock::time_point start) {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    // Starts count threads running body and returns them. Each gets 1/count of
+    // the cores, so a filter's own pool inside a stage stays within the stage.
+    static std::vector<std::thread> startStage(unsigned count, const std::function<void()>& body) {
+        count = std::max(1u, count);
+        unsigned share = ThreadPool::availableThreads() / count;
+        std::vector<std::thread> threads;
+        for (unsigned i = 0; i < count; i++) {
+            threads.emplace_back([body, share] {
+                ThreadPool::Share scope(share);
+                body();
+            });
+        }
+        return threads;
+    }
+
+    static void join(std::vector<std::thread>& threads) {
+        for (auto& thread : threads) thread.join();
+    }
+
+public:
+    BatchScheduler() = default;
+    explicit BatchScheduler(Config cfg) : config(cfg) {}
+
+    void run(const std::vector<std::pair<std::string, std::string>>& jobs, const FilterFn& filter, const ReportFn& report) {
+        BoundedQueue<Item> decoded(config.queueDepth);
+        BoundedQueue<Item> filtered(config.queueDepth);
+        std::atomic<size_t> nextJob{ 0 };
+        std::mutex reportMutex;
+        std::mutex memoryMutex;
+        std::condition_variable memoryFreed;
+        size_t inFlight = 0;  // decoded and not yet through the encode stage
+
+        // Over the ceiling, hold off until an image leaves the pipeline. One is
+        // always let through so a single oversized image cannot stall the batch.
+        auto waitForMemory = [&]() {
+            std::unique_lock<std::mutex> lock(memoryMutex);
+            memoryFreed.wait(lock, [&] { return inFlight == 0 || !memory::accounting().exceedsLimit(); });
+            inFlight++;
+        };
+        auto leavePipeline = [&]() {
+            std::lock_guard<std::mutex> lock(memoryMutex);
+            inFlight--;
+            memoryFreed.notify_all();
+        };
+
+        // Decode: each worker claims the next file, so files are read in order.
+        auto decodeThreads = startStage(config.decodeThreads, [&]() {
+            for (size_t index; (index = nextJob++) < jobs.size();) {
+                waitForMemory();
+                Item item;
+                item.result.index = index;
+                item.result.input = jobs[index].first;
+                item.result.output = jobs[index].second;
+                auto start = std::chrono::steady_clock::now();
+                try {
+                    const std::string& path = jobs[index].first;
+                    item.image = std::make_unique<Image>(config.decode ? config.decode(path) : decodeImage(path));
+                    item.image->setOwner(memory::Owner::Current);
+                    item.result.width = item.image->width;
+                    item.result.height = item.image->height;
+                } catch (const std::exception& e) {
+                    item.result.error = e.what();
+                }
+                item.result.decodeMs = millisecondsSince(start);
+                decoded.push(std::move(item));
+            }
+        });
+
+        auto filterThreads = startStage(config.filterThreads, [&]() {
+            Item item;
+            while (decoded.pop(item)) {
+                if (item.image) {
+                    auto start = std::chrono::steady_clock::now();
+                    try {
+                        filter(*item.image);
+                    } catch (const std::exception& e) {
+                        item.result.error = e.what();
+                        item.image.reset();
+                    }
+                    item.result.filterMs = millisecondsSince(start);
+                }
+                filtered.push(std::move(item));
+            }
+        });
+
+        auto encodeThreads = startStage(config.encodeThreads, [&]() {
+            Item item;
+            while (filtered.pop(item)) {
+                if (item.image) {
+                    auto start = std::chrono::steady_clock::now();
+                    try {
+                        encodeImage(*item.image, item.result.output, config.encode);
+                    } catch (const std::exception& e) {
+                        item.result.error = e.what();
+                    }
+                    item.result.encodeMs = millisecondsSince(start);
+                    item.image.reset();
+                }
+                leavePipeline();
+                std::lock_guard<std::mutex> lock(reportMutex);
+                report(item.result);
+            }
+        });
+
+        join(decodeThreads);
+        decoded.close();
+        join(filterThreads);
+        filtered.close();
+        join(encodeThreads);
+    }
+};
@@ -0,0 +1,159 @@
+/**
+ * @File  : BilateralGrid.h
+ * @brief : Edge-preserving smoothing of an 8-bit RGB image through a bilateral
+ *          grid (Paris and Durand; Chen, Paris and Durand): splat into a coarse
+ *          (x, y, grey) grid, blur the grid, slice it back at every pixel.
+ *
+ * Each pixel is summed, as (r, g, b, 1), into the cell sigmaSpace pixels
+ * across and sigmaRange grey levels deep that is nearest to it. The grid is
+ * then blurred along x, y and grey in turn with the binomial kernel 1 4 6 4 1,
+ * a Gaussian of about one cell; like Blur's box filter, the 3-D blur is done
+ * as separate 1-D passes. Every pixel reads its colour back by trilinear
+ * interpolation at (x, y, grey) and divides by the interpolated count, so
+ * pixels on either side of an edge, being far apart in grey, do not mix.
+ *
+ * The cost is a splat and a slice per pixel plus blurring the grid, which
+ * has about 256 / (sigmaSpace^2 * sigmaRange) cells per pixel, so wide sigmas
+ * are cheaper rather than dearer. Cells are aligned to the full picture's
+ * coordinates (the origin passed in), so a tile filtered with margin() pixels
+ * of context gives the same result as the whole image.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "MemoryAccounting.h"
+#include "ThreadPool.h"
+#include "third_party/Image_Class.h"
+
+
+namespace bilateral {
+
+/// The most cells a grid may have (16 bytes each).
+constexpr size_t maxCells = size_t(1) << 24;
+
+/// Pixels of context either side a tile needs: the blur's two cells, the
+/// interpolation's one and the splat's half.
+inline int margin(int sigmaSpace) { return 4 * sigmaSpace; }
+
+/**
+ * @brief Blurs n cells of 4 floats, step floats apart, with 1 4 6 4 1; cells
+ *        beyond either end count as empty.
+ */
+inline void blurLine(float* cells, size_t step, int n, std::vector<float>& line) {
+    line.assign(size_t(n + 4) * 4, 0.f);
+    for (int i = 0; i < n; i++) {
+        for (int k = 0; k < 4; k++) line[size_t(i + 2) * 4 + k] = cells[i * step + k];
+    }
+    for (int i = 0; i < n; i++) {
+        const float* t = &line[size_t(i) * 4];
+        for (int k = 0; k < 4; k++) {
+            cells[i * step + k] = t[k] + 4 * t[4 + k] + 6 * t[8 + k] + 4 * t[12 + k] + t[16 + k];
+        }
+    }
+}
+
+/**
+ * @brief Smooths image (RGB8) in place; (originX, originY) is where its
+ *        top-left pixel sits in the full picture.
+ * @throws std::invalid_argument If the grid would have more than maxCells cells.
+ */
+inline void filter(Image& image, int sigmaSpace, int sigmaRange, int originX = 0, int originY = 0) {
+    const int width = image.width, height = image.height;
+    if (width <= 0 || height <= 0) return;
+    sigmaSpace = std::max(1, sigmaSpace);
+    sigmaRange = std::max(1, sigmaRange);
+    const float space = float(sigmaSpace), range = float(sigmaRange);
+
+    // The cells a pixel splats into (nearest) and slices from (the two around it).
+    auto nearest = [](int p, float size) { return int(float(p) / size + 0.5f); };
+    const int x0 = int(float(originX) / space) - 1, y0 = int(float(originY) / space) - 1;
+    const int nx = nearest(originX + width - 1, space) + 2 - x0;
+    const int ny = nearest(originY + height - 1, space) + 2 - y0;
+    const int nz = nearest(255, range) + 2;
+    const size_t cells = size_t(nx) * ny * nz;
+    if (cells > maxCells) {
+        throw std::invalid_argument("Bilateral grid of " + std::to_string(cells) +
+                                    " cells is too large; use a larger spatial sigma");
+    }
+    std::vector<float> grid(cells * 4, 0.f);
+    memory::Charge charge(memory::Owner::Temporary, grid.size() * sizeof(float));
+    const size_t rowFloats = size_t(nx) * nz * 4;
+    auto cell = [&](int gx, int gy, int gz) { return &grid[((size_t(gy) * nx + gx) * nz + gz) * 4]; };
+
+    std::vector<int> splatX(width), splatY(height), splatZ(256);
+    for (int x = 0; x < width; x++) splatX[x] = nearest(originX + x, space) - x0;
+    for (int y = 0; y < height; y++) splatY[y] = nearest(originY + y, space) - y0;
+    for (int g = 0; g < 256; g++) splatZ[g] = nearest(g, range);
+
+    // Splat, a band of grid rows per task so no two tasks share a cell.
+    forEachBand(ny, size_t(width) * space, [&](int gy0, int gy1) {
+        for (int y = 0; y < height; y++) {
+            if (splatY[y] < gy0 || splatY[y] >= gy1) continue;
+            const unsigned char* px = image.imageData + size_t(y) * width * 3;
+            for (int x = 0; x < width; x++, px += 3) {
+                float* c = cell(splatX[x], splatY[y], splatZ[(px[0] + px[1] + px[2]) / 3]);
+                c[0] += px[0];
+                c[1] += px[1];
+                c[2] += px[2];
+                c[3] += 1;
+            }
+        }
+    });
+
+    // Blur along grey and x within each grid row, then along y within each column.
+    forEachBand(ny, rowFloats, [&](int gy0, int gy1) {
+        std::vector<float> line;
+        for (int gy = gy0; gy < gy1; gy++) {
+            for (int gx = 0; gx < nx; gx++) blurLine(cell(gx, gy, 0), 4, nz, line);
+            for (int gz = 0; gz < nz; gz++) blurLine(cell(0, gy, gz), size_t(nz) * 4, nx, line);
+        }
+    });
+    forEachBand(nx, size_t(ny) * nz * 4, [&](int gx0, int gx1) {
+        std::vector<float> line;
+        for (int gx = gx0; gx < gx1; gx++) {
+            for (int gz = 0; gz < nz; gz++) blurLine(cell(gx, 0, gz), rowFloats, ny, line);
+        }
+    });
+
+    // Slice: trilinear interpolation between the cells either side of (x, y, grey).
+    struct Sample { int at; float weight; };  ///< lower cell, and the upper cell's share
+    auto between = [](int p, float size, int first) {
+        float position = float(p) / size;
+        int below = int(position);
+        return Sample{ below - first, position - float(below) };
+    };
+    std::vector<Sample> sliceX(width), sliceZ(256);
+    for (int x = 0; x < width; x++) sliceX[x] = between(originX + x, space, x0);
+    for (int g = 0; g < 256; g++) sliceZ[g] = between(g, range, 0);
+
+    forEachBand(height, size_t(width) * 64, [&](int ya, int yb) {
+        for (int y = ya; y < yb; y++) {
+            Sample sy = between(originY + y, space, y0);
+            unsigned char* px = image.imageData + size_t(y) * width * 3;
+            for (int x = 0; x < width; x++, px += 3) {
+                Sample sx = sliceX[x], sz = sliceZ[(px[0] + px[1] + px[2]) / 3];
+                float sum[4] = { 0, 0, 0, 0 };
+                for (int corner = 0; corner < 8; corner++) {
+                    int dx = corner & 1, dy = (corner >> 1) & 1, dz = corner >> 2;
+                    float w = (dx ? sx.weight : 1 - sx.weight) * (dy ? sy.weight : 1 - sy.weight) *
+                              (dz ? sz.weight : 1 - sz.weight);
+                    const float* c = cell(sx.at + dx, sy.at + dy, sz.at + dz);
+                    for (int k = 0; k < 4; k++) sum[k] += w * c[k];
+                }
+                if (sum[3] <= 0) continue;
+                for (int k = 0; k < 3; k++) {
+                    px[k] = static_cast<unsigned char>(std::min(255.f, sum[k] / sum[3] + 0.5f));
+                }
+            }
+        }
+    });
+}
+
+} // namespace bilateral
@@ -0,0 +1,219 @@
+/**
+ * @File  : Blend.h
+ * @brief : Compositing of one 8-bit image over another with blend modes,
+ *          opacity, overlay alpha, scaling and placement, in one pass.
+ *
+ * compose() builds the result a canvas row at a time. Each source row is
+ * resampled to its placed width on the fly (nearest neighbour, the same mapping
+ * as Filter::resizeImage), so neither image is resized into a copy. When the
+ * canvas is the base image itself, which is the usual case of an overlay that
+ * fits inside the base, the base is blended in place and nothing is allocated
+ * beyond a row of scratch.
+ *
+ * The kernels are plain loops over samples, instantiated per mode, that the
+ * compiler vectorizes. With full opacity and no overlay alpha they are one flat
+ * loop over the row.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <stdexcept>
+#include <type_traits>
+#include <vector>
+
+#include "third_party/Image_Class.h"
+
+
+namespace blend {
+
+enum class Mode { Average = 1, Alpha, Multiply, Screen, Overlay, Difference };
+
+/// round(x / 255) for 0 <= x <= 255 * 255.
+inline int div255(int x) {
+    x += 128;
+    return (x + (x >> 8)) >> 8;
+}
+
+/**
+ * @brief The mode's result for base sample a under overlay sample b, before
+ *        opacity and alpha are applied.
+ */
+template <Mode M>
+inline int combine(int a, int b) {
+    if constexpr (M == Mode::Average) return (a + b) >> 1;
+    else if constexpr (M == Mode::Alpha) return b;
+    else if constexpr (M == Mode::Multiply) return div255(a * b);
+    else if constexpr (M == Mode::Screen) return 255 - div255((255 - a) * (255 - b));
+    else if constexpr (M == Mode::Overlay) return a < 128 ? div255(2 * a * b) : 255 - div255(2 * (255 - a) * (255 - b));
+    else return a > b ? a - b : b - a;
+}
+
+/**
+ * @brief out = base + (combine(base, over) - base) * weight / 255 over n RGB
+ *        pixels; a null weight means 255 everywhere. out may be base.
+ */
+template <Mode M>
+void blendRow(const unsigned char* base, const unsigned char* over, const unsigned char* weight,
+              unsigned char* out, size_t pixels) {
+    if (!weight) {
+        for (size_t i = 0; i < pixels * 3; i++) out[i] = static_cast<unsigned char>(combine<M>(base[i], over[i]));
+        return;
+    }
+    for (size_t i = 0; i < pixels; i++) {
+        int w = weight[i];
+        for (int c = 0; c < 3; c++) {
+            int a = base[i * 3 + c];
+            out[i * 3 + c] = static_cast<unsigned char>(div255(a * (255 - w) + combine<M>(a, over[i * 3 + c]) * w));
+        }
+    }
+}
+
+/**
+ * @brief The overlay alone, over black: out = over * weight / 255, or a copy
+ *        when weight is null.
+ */
+inline void fadeRow(const unsigned char* over, const unsigned char* weight, unsigned char* out, size_t pixels) {
+    if (!weight) {
+        memcpy(out, over, pixels * 3);
+        return;
+    }
+    for (size_t i = 0; i < pixels; i++) {
+        for (int c = 0; c < 3; c++) out[i * 3 + c] = static_cast<unsigned char>(div255(over[i * 3 + c] * weight[i]));
+    }
+}
+
+/**
+ * @brief Calls fn with std::integral_constant<Mode, mode>, so kernels are
+ *        picked once per image rather than per sample.
+ */
+template <typename Fn>
+decltype(auto) visitMode(Mode mode, Fn&& fn) {
+    switch (mode) {
+        case Mode::Alpha:      return fn(std::integral_constant<Mode, Mode::Alpha>{});
+        case Mode::Multiply:   return fn(std::integral_constant<Mode, Mode::Multiply>{});
+        case Mode::Screen:     return fn(std::integral_constant<Mode, Mode::Screen>{});
+        case Mode::Overlay:    return fn(std::integral_constant<Mode, Mode::Overlay>{});
+        case Mode::Difference: return fn(std::integral_constant<Mode, Mode::Difference>{});
+        default:               return fn(std::integral_constant<Mode, Mode::Average>{});
+    }
+}
+
+/**
+ * @brief Source index for each of dst positions when src are stretched over
+ *        them: int(i * src / dst), as Filter::resizeImage picks them.
+ */
+inline std::vector<int> nearestMap(int src, int dst) {
+    std::vector<int> map(std::max(dst, 0));
+    double ratio = static_cast<double>(src) / dst;
+    for (int i = 0; i < dst; i++) map[i] = std::min(static_cast<int>(i * ratio), src - 1);
+    return map;
+}
+
+/// Where an image lands on the canvas and at what size.
+struct Placement {
+    int x = 0, y = 0, width = 0, height = 0;
+};
+
+struct Options {
+    Mode mode = Mode::Average;
+    int opacity = 255;  ///< 0-255, multiplied with the overlay's alpha
+};
+
+/**
+ * @brief Composites overlay (RGB8 or RGBA8) over base (RGB8) on a canvas of
+ *        canvasWidth x canvasHeight.
+ *
+ * Each image is stretched to its placement; placements may reach past the
+ * canvas and are clipped. Where both cover a pixel it is blended; where only
+ * one does, that one shows (the overlay faded by its weight, over black); the
+ * rest of the canvas is black.
+ */
+inline void compose(Image& base, Placement basePlace, const Image& overlay, Placement overPlace,
+                    int canvasWidth, int canvasHeight, Options options) {
+    if (base.format != PixelFormat::RGB8 ||
+        (overlay.format != PixelFormat::RGB8 && overlay.format != PixelFormat::RGBA8)) {
+        throw std::invalid_argument("blend::compose: base must be RGB8, the overlay RGB8 or RGBA8");
+    }
+    const int W = canvasWidth, H = canvasHeight;
+    const int overChannels = overlay.format == PixelFormat::RGBA8 ? 4 : 3;
+    const bool uniform = overChannels == 3 && options.opacity >= 255;
+
+    // Columns each image covers on the canvas, clipped.
+    int bx0 = std::max(0, basePlace.x), bx1 = std::min(W, basePlace.x + basePlace.width);
+    int ox0 = std::max(0, overPlace.x), ox1 = std::min(W, overPlace.x + overPlace.width);
+    const bool baseScaled = basePlace.width != base.width;
+    const bool overScaled = overPlace.width != overlay.width || overChannels != 3;
+    // Source rows and columns, only built for the dimensions that are stretched.
+    std::vector<int> baseCols, baseRows, overCols, overRows;
+    if (baseScaled) baseCols = nearestMap(base.width, basePlace.width);
+    if (basePlace.height != base.height) baseRows = nearestMap(base.height, basePlace.height);
+    if (overScaled) overCols = nearestMap(overlay.width, overPlace.width);
+    if (overPlace.height != overlay.height) overRows = nearestMap(overlay.height, overPlace.height);
+
+    // Blend into base itself when it is the whole canvas, unscaled.
+    const bool inPlace = basePlace.x == 0 && basePlace.y == 0 && basePlace.width == base.width &&
+                         basePlace.height == base.height && W == base.width && H == base.height;
+    Image canvas;
+    if (!inPlace) canvas = Image(W, H, PixelFormat::RGB8);
+    Image& out = inPlace ? base : canvas;
+
+    // Scratch for one row of the resampled overlay and its weights, if needed.
+    size_t span = size_t(std::max(0, ox1 - ox0));
+    std::vector<unsigned char> overRow(overScaled ? span * 3 : 0), weightRow(uniform ? 0 : span);
+    if (!uniform && overChannels == 3) std::fill(weightRow.begin(), weightRow.end(), static_cast<unsigned char>(options.opacity));
+
+    visitMode(options.mode, [&](auto mode) {
+        constexpr Mode M = decltype(mode)::value;
+        for (int y = 0; y < H; y++) {
+            unsigned char* row = out.imageData + size_t(y) * W * 3;
+            int by = y - basePlace.y, oy = y - overPlace.y;
+            bool hasBase = by >= 0 && by < basePlace.height && bx0 < bx1;
+            bool hasOver = oy >= 0 && oy < overPlace.height && ox0 < ox1;
+
+            if (!inPlace) {
+                memset(row, 0, size_t(W) * 3);
+                if (hasBase) {
+                    const unsigned char* src = base.imageData + size_t(baseRows.empty() ? by : baseRows[by]) * base.width * 3;
+                    if (!baseScaled) {
+                        memcpy(row + size_t(bx0) * 3, src + size_t(bx0 - basePlace.x) * 3, size_t(bx1 - bx0) * 3);
+                    } else {
+                        for (int x = bx0; x < bx1; x++) memcpy(row + size_t(x) * 3, src + size_t(baseCols[x - basePlace.x]) * 3, 3);
+                    }
+                }
+            }
+            if (!hasOver) continue;
+
+            // The overlay's samples (and weights) for canvas columns ox0..ox1.
+            const unsigned char* srcRow = overlay.imageData + size_t(overRows.empty() ? oy : overRows[oy]) * overlay.width * overChannels;
+            const unsigned char* over = overRow.data();
+            const unsigned char* weight = uniform ? nullptr : weightRow.data();
+            if (!overScaled) {
+                over = srcRow + size_t(ox0 - overPlace.x) * 3;
+            } else {
+                for (int x = ox0; x < ox1; x++) {
+                    const unsigned char* px = srcRow + size_t(overCols[x - overPlace.x]) * overChannels;
+                    memcpy(overRow.data() + size_t(x - ox0) * 3, px, 3);
+                    if (overChannels == 4) weightRow[x - ox0] = static_cast<unsigned char>(div255(px[3] * options.opacity));
+                }
+            }
+
+            // Blend where the base is under the overlay, the overlay alone elsewhere.
+            int cx0 = hasBase ? std::max(ox0, bx0) : ox1, cx1 = hasBase ? std::min(ox1, bx1) : ox1;
+            if (cx0 >= cx1) cx0 = cx1 = ox1;
+            auto at = [&](int x) { return size_t(x - ox0); };
+            auto weightAt = [&](int x) { return weight ? weight + at(x) : nullptr; };
+            if (cx0 > ox0) fadeRow(over, weight, row + size_t(ox0) * 3, at(cx0));
+            if (cx1 > cx0) {
+                blendRow<M>(row + size_t(cx0) * 3, over + at(cx0) * 3, weightAt(cx0), row + size_t(cx0) * 3,
+                            size_t(cx1 - cx0));
+            }
+            if (ox1 > cx1) fadeRow(over + at(cx1) * 3, weightAt(cx1), row + size_t(cx1) * 3, size_t(ox1 - cx1));
+        }
+    });
+    if (!inPlace) base = std::move(canvas);
+}
+
+} // namespace blend
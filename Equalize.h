@@ -0,0 +1,178 @@
+/**
+ * @File  : Equalize.h
+ * @brief : Brightness histograms of an 8-bit RGB image, whole or in a grid of
+ *          tiles, and what is built on them: histogram equalization, CLAHE
+ *          (contrast-limited adaptive histogram equalization) and an adaptive
+ *          threshold.
+ *
+ * Brightness is (r + g + b) / 3, as everywhere else. Equalizing maps it
+ * through a table made from the histogram and moves all three channels by the
+ * same amount, so colours keep their hue.
+ *
+ * The adaptive filters measure a TileGrid: a histogram per tile, the tiles
+ * counted in parallel. Each tile then yields a value per brightness level (a
+ * CLAHE table, or a threshold), and every pixel blends the values of the four
+ * tiles whose centres surround it, bilinearly, in 8-bit fixed point, so there
+ * are no seams at tile edges. The blend is integer arithmetic on the four
+ * table entries; the table lookups themselves are gathers and stay scalar.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "ThreadPool.h"
+#include "third_party/Image_Class.h"
+
+
+namespace equalize {
+
+using Histogram = std::array<uint32_t, 256>;
+using Table = std::array<unsigned char, 256>;
+
+inline int brightness(const unsigned char* px) { return (px[0] + px[1] + px[2]) / 3; }
+
+/**
+ * @brief Equalization table for hist: level v maps to
+ *        round(255 * (cdf(v) - cdf(darkest)) / (pixels - cdf(darkest))).
+ *
+ * With clipLimit > 0, bins are first cut to clipLimit and what was cut is
+ * spread evenly over all 256 bins (the remainder one each from level 0 up),
+ * which caps the contrast gain. A histogram of a single level maps to itself.
+ */
+inline Table equalizationTable(Histogram hist, uint32_t clipLimit = 0) {
+    if (clipLimit > 0) {
+        uint32_t excess = 0;
+        for (uint32_t& bin : hist) {
+            if (bin > clipLimit) {
+                excess += bin - clipLimit;
+                bin = clipLimit;
+            }
+        }
+        for (int v = 0; v < 256; v++) hist[v] += excess / 256 + (uint32_t(v) < excess % 256 ? 1 : 0);
+    }
+    uint64_t total = 0, darkest = 0;
+    for (uint32_t bin : hist) {
+        if (total == 0) darkest = bin;
+        total += bin;
+    }
+    Table table;
+    if (total == darkest) {
+        for (int v = 0; v < 256; v++) table[v] = static_cast<unsigned char>(v);
+        return table;
+    }
+    uint64_t cdf = 0, span = total - darkest;
+    for (int v = 0; v < 256; v++) {
+        cdf += hist[v];
+        table[v] = static_cast<unsigned char>(cdf < darkest ? 0 : ((cdf - darkest) * 255 + span / 2) / span);
+    }
+    return table;
+}
+
+/// Moves every channel of px by level - brightness(px), clamped.
+inline void shiftTo(unsigned char* px, int from, int level) {
+    int shift = level - from;
+    for (int c = 0; c < 3; c++) px[c] = static_cast<unsigned char>(std::min(255, std::max(0, px[c] + shift)));
+}
+
+/**
+ * @struct TileGrid
+ * @brief An image cut into columns x rows tiles, with the brightness
+ *        histogram of each.
+ */
+struct TileGrid {
+    int width = 0, height = 0;
+    int columns = 0, rows = 0;
+    std::vector<Histogram> histograms;  ///< row by row
+
+    /// For each pixel along one axis: the tile whose centre is at or before
+    /// it, and the next tile's weight out of 256 (0 past the outer centres).
+    struct Axis {
+        std::vector<int> tile, weight;
+    };
+
+    static int start(int tile, int tiles, int size) { return int(int64_t(tile) * size / tiles); }
+
+    int tileWidth(int i) const { return start(i + 1, columns, width) - start(i, columns, width); }
+    int tileHeight(int j) const { return start(j + 1, rows, height) - start(j, rows, height); }
+    const Histogram& histogram(int i, int j) const { return histograms[size_t(j) * columns + i]; }
+
+    static Axis axis(int size, int tiles) {
+        Axis axis;
+        axis.tile.resize(size);
+        axis.weight.resize(size);
+        // Twice each tile's centre, so centres between two pixels stay integers.
+        auto centre = [&](int t) { return start(t, tiles, size) + start(t + 1, tiles, size) - 1; };
+        int t = 0;
+        for (int p = 0; p < size; p++) {
+            while (t + 1 < tiles && centre(t + 1) <= 2 * p) t++;
+            axis.tile[p] = t;
+            int from = centre(t), to = t + 1 < tiles ? centre(t + 1) : from;
+            axis.weight[p] = 2 * p <= from || to == from ? 0 : ((2 * p - from) * 256 + (to - from) / 2) / (to - from);
+        }
+        return axis;
+    }
+
+    /**
+     * @brief Counts the histograms of image (RGB8) cut into up to
+     *        columns x rows tiles (no more than one per pixel), in parallel.
+     */
+    static TileGrid measure(const Image& image, int columns, int rows) {
+        TileGrid grid;
+        grid.width = image.width;
+        grid.height = image.height;
+        grid.columns = std::max(1, std::min(columns, image.width));
+        grid.rows = std::max(1, std::min(rows, image.height));
+        grid.histograms.assign(size_t(grid.columns) * grid.rows, Histogram{});
+        forEachBand(grid.columns * grid.rows, size_t(image.width) * image.height / (grid.columns * grid.rows) + 1,
+                    [&](int first, int last) {
+            for (int t = first; t < last; t++) {
+                int i = t % grid.columns, j = t / grid.columns;
+                int x0 = start(i, grid.columns, image.width), x1 = start(i + 1, grid.columns, image.width);
+                Histogram& hist = grid.histograms[t];
+                for (int y = start(j, grid.rows, image.height); y < start(j + 1, grid.rows, image.height); y++) {
+                    const unsigned char* px = image.imageData + (size_t(y) * image.width + x0) * 3;
+                    for (int x = x0; x < x1; x++, px += 3) hist[brightness(px)]++;
+                }
+            }
+        });
+        return grid;
+    }
+
+    /**
+     * @brief Calls fn(px, level, value) for every pixel of image, where level
+     *        is its brightness and value the bilinear blend, rounded, of
+     *        perTile[tile][level] over the four tiles around it. Rows run in
+     *        parallel bands.
+     *
+     * perTile holds 256 values for each tile, row by row.
+     */
+    template <typename Fn>
+    void blend(Image& image, const std::vector<std::array<int, 256>>& perTile, Fn&& fn) const {
+        Axis across = axis(width, columns), down = axis(height, rows);
+        forEachBand(height, size_t(width) * 16, [&](int y0, int y1) {
+            std::vector<int> level(width), value(width);
+            for (int y = y0; y < y1; y++) {
+                int j = down.tile[y], wy = down.weight[y];
+                int below = std::min(j + 1, rows - 1);
+                unsigned char* row = image.imageData + size_t(y) * width * 3;
+                for (int x = 0; x < width; x++) level[x] = brightness(row + x * 3);
+                for (int x = 0; x < width; x++) {
+                    int i = across.tile[x], wx = across.weight[x];
+                    int right = std::min(i + 1, columns - 1), v = level[x];
+                    int top = perTile[size_t(j) * columns + i][v] * (256 - wx) + perTile[size_t(j) * columns + right][v] * wx;
+                    int bottom = perTile[size_t(below) * columns + i][v] * (256 - wx) +
+                                 perTile[size_t(below) * columns + right][v] * wx;
+                    value[x] = (top * (256 - wy) + bottom * wy + 32768) >> 16;
+                }
+                for (int x = 0; x < width; x++) fn(row + x * 3, level[x], value[x]);
+            }
+        });
+    }
+};
+
+} // namespace equalize
@@ -1,8 +1,21 @@
+#pragma once
 #include <complex>
 #include <map>
 #include<stack>
 #include <memory>
 #include "third_party/Image_Class.h"
+#include "BilateralGrid.h"
+#include "Blend.h"
+#include "Equalize.h"
+#include "ImageView.h"
+#include "PointTransform.h"
+#include "PlanarImage.h"
+#include "SeamCarving.h"
+#include "Sharpen.h"
+#include "SummedArea.h"
+#include "Trace.h"
+#include "Random.h"
+#include "ThreadPool.h"
 #include <stdexcept>
 #include <vector>
 #include<cmath>
@@ -11,6 +24,7 @@
 #define M_PI 3.14159265358979323846
 #endif
 #include <variant>
+#include <functional>
 #include "iostream"
 #include <filesystem>
 #include<algorithm>
@@ -42,6 +56,7 @@ protected:
     Image& image;
     double threshold = 127;
     unordered_map<string, FilterParam> params;
+    int originX = 0, originY = 0; // where image's top-left pixel sits in the full picture
     // static string id;
     // string outputFolderPath = "../../output/";
 public:
@@ -60,10 +75,16 @@ public:
     virtual void setParam(const std::string &name, bool val) {
         params[name].value = val;
     }
-    void setParam(const std::string& name, const Image& img){
+    virtual void setParam(const std::string& name, const Image& img){
         // params[name].value = img;
     }
 
+    // An image parameter shared with other filters (the CLI decodes each file
+    // once for all its chains); filters that keep the image just hold on to it.
+    virtual void setParam(const std::string& name, const shared_ptr<const Image>& img) {
+        if (img) setParam(name, *img);
+    }
+
     virtual void setParam(const std::string &name, const std::string &val) {
         params[name].value = val;
     }
@@ -80,31 +101,38 @@ public:
 
     virtual string getName() = 0;
 
-    double computeThreshold() {
-        vector<int> intensities(image.width * image.height);
-
-        for (int x = 0; x < image.width; x++) {
-            for (int y = 0; y < image.height; y++) {
-                int r = image(x, y, 0);
-                int g = image(x, y, 1);
-                int b = image(x, y, 2);
-                intensities.push_back(((r + g + b) / 3));
-            }
-        }
-
-        double sum = 0;
-        for (int& val : intensities) sum += val;
+    // Pixels of context each side of a tile needs for the filter to run on that
+    // tile alone (see applyTiled); -1 means it needs the whole image at once.
+    virtual int tileHalo() { return -1; }
 
-        double mean = sum / intensities.size();
+    // Set while the filter runs on a tile, so filters whose output depends on
+    // the pixel position (noise) stay seamless across tiles.
+    void setOrigin(int x, int y) { originX = x; originY = y; }
 
-        double variance = 0;
-        for (int& val : intensities) variance += pow(val - mean, 2);
+    Image& getImage() { return image; }
 
-        variance /= intensities.size();
+    // mean + 0.6 * standard deviation of the per-pixel intensities. The
+    // statistics are taken over 2 * width * height samples, half of them zero,
+    // which is how the threshold has always been computed; kept for identical output.
+    static double thresholdFromMoments(double sum, double sumSquares, double pixelCount) {
+        double samples = 2 * pixelCount;
+        double mean = sum / samples;
+        double variance = sumSquares / samples - mean * mean;
+        if (variance < 0) variance = 0;
+        return mean + 0.6 * sqrt(variance);
+    }
 
-        double standardDeviation = sqrt(variance);
+    double computeThreshold() {
+        unsigned long long sum = 0, sumSquares = 0;
+        const unsigned char* data = image.imageData;
+        size_t pixels = size_t(image.width) * image.height;
+        for (size_t i = 0; i < pixels; i++, data += 3) {
+            unsigned long long intensity = (data[0] + data[1] + data[2]) / 3;
+            sum += intensity;
+            sumSquares += intensity * intensity;
+        }
 
-        threshold = mean + 0.6 * standardDeviation;
+        threshold = thresholdFromMoments(double(sum), double(sumSquares), double(pixels));
 
         return threshold;
     }
@@ -145,74 +173,123 @@ public:
     // static string getId() {};
 };
 
-class Sunlight : public Filter
+// Filters whose output pixel depends only on the same input pixel. They describe
+// themselves as a PointTransform so FilterPipeline can fuse neighbours into one pass.
+class PointFilter : public Filter
 {
 public:
-    Sunlight(Image& img) : Filter(img) {};
-    string getName() { return "Sunlight"; };
-    static string getId() { return "13"; };
-    void apply()
+    PointFilter(Image& img) : Filter(img) {};
+    virtual PointTransform transform() = 0;
+    void apply() override { transform().run(image); }
+    int tileHalo() override { return 0; }
+};
+
+// Runs a chain of filters bound to the same image. Adjacent point filters are
+// fused into a single traversal; any other filter flushes the fused run first.
+// Point filters run in the image's own pixel format; the others are written for
+// 8-bit RGB and see a narrowed copy (see withRgb8).
+class FilterPipeline
+{
+    Image& image;
+    vector<shared_ptr<Filter>> stages;
+public:
+    FilterPipeline(Image& img) : image(img) {};
+    void add(const shared_ptr<Filter>& filter) { stages.push_back(filter); }
+    void clear() { stages.clear(); }
+    size_t size() const { return stages.size(); }
+
+    void run()
     {
-        for (int i = 0; i < image.width; i++)
-        {
-            for (int j = 0; j < image.height; j++)
-            {
-                double r = 1.1 * image(i, j, 0);
-                if (r > 255)
-                {
-                    r = 255;
-                }
-                image(i, j, 0) = r;
-                double g = 1.2 * image(i, j, 1);
-                if (g > 255)
-                {
-                    g = 255;
-                }
-                image(i, j, 1) = g;
-                double b = 0.7 * image(i, j, 2);
-                if (b < 0)
-                {
-                    b = 0;
-                }
-                image(i, j, 2) = b;
+        PointTransform fused;
+        string fusedName;  // "Sunlight + Invert", only kept while tracing
+        auto runFused = [&] {
+            trace::Scope scope("filter", fusedName);
+            fused.run(image);
+            fused = PointTransform();
+            fusedName.clear();
+        };
+        for (auto& stage : stages) {
+            if (auto* point = dynamic_cast<PointFilter*>(stage.get())) {
+                fused.then(point->transform());
+                if (trace::enabled()) fusedName += (fusedName.empty() ? "" : " + ") + stage->getName();
+                continue;
             }
+            if (!fused.empty()) runFused();
+            trace::Scope scope("filter", trace::enabled() ? stage->getName() : string());
+            withRgb8(image, [&] { stage->apply(); });
         }
+        if (!fused.empty()) runFused();
+    }
+};
+
+// Runs filter on region alone; region is a view of the image the filter is
+// bound to. Point filters run on the view in place. Any other filter runs on a
+// copy of the region with tileHalo() pixels of context each side (clipped at
+// the border), swapped into the image it is bound to, and only the region is
+// written back, so pixels outside it never change.
+inline void applyToView(Filter& filter, const ImageView& region)
+{
+    if (region.empty()) return;
+    if (auto* point = dynamic_cast<PointFilter*>(&filter)) {
+        point->transform().run(region);
+        return;
+    }
+    int halo = filter.tileHalo();
+    if (halo < 0) {
+        throw invalid_argument(filter.getName() + " needs the whole image and cannot run on a selection");
+    }
+    Image& image = filter.getImage();
+    int x0 = max(0, region.x - halo), y0 = max(0, region.y - halo);
+    int x1 = min(image.width, region.x + region.width + halo), y1 = min(image.height, region.y + region.height + halo);
+    ImageView context = ImageView::of(image).region(x0, y0, x1 - x0, y1 - y0);
+
+    Image whole = std::move(image);
+    image = context.toImage();
+    try {
+        filter.setOrigin(x0, y0);
+        withRgb8(image, [&] { filter.apply(); });
+    } catch (...) {
+        filter.setOrigin(0, 0);
+        image = std::move(whole);
+        throw;
+    }
+    filter.setOrigin(0, 0);
+    Image filtered = std::move(image);
+    image = std::move(whole);
+    if (filtered.width != context.width || filtered.height != context.height || filtered.format != context.format) {
+        throw logic_error(filter.getName() + " changed the size of the selection");
+    }
+    region.copyFrom(filtered.imageData + (size_t(region.y - y0) * context.width + (region.x - x0)) * region.pixelBytes(),
+                    context.rowBytes());
+}
+
+class Sunlight : public PointFilter
+{
+public:
+    Sunlight(Image& img) : PointFilter(img) {};
+    string getName() { return "Sunlight"; };
+    static string getId() { return "13"; };
+    PointTransform transform() override
+    {
+        const double gain[3] = { 1.1, 1.2, 0.7 };
+        return PointTransform().lut(ChannelLut::fromFunction([&](int v, int c) {
+            return min(gain[c] * v, 255.0);
+        }));
     }
     vector<FilterParam> getNeeds() override {return {};};
 };
-class Night : public Filter
+class Night : public PointFilter
 {
 public:
-    Night(Image& img) : Filter(img) {};
+    Night(Image& img) : PointFilter(img) {};
     string getName() { return "Night"; };
     static string getId() { return "16"; };
-    void apply()
+    PointTransform transform() override
     {
-        for (int i = 0; i < image.width; i++)
-        {
-            for (int j = 0; j < image.height; j++)
-            {
-                double r = 1.4 * image(i, j, 0);
-                if (r > 255)
-                {
-                    r = 255;
-                }
-                image(i, j, 0) = r;
-                double g = 0.7 * image(i, j, 1);
-                if (g < 0)
-                {
-                    g = 0;
-                }
-                image(i, j, 1) = g;
-                double b = 1.6 * image(i, j, 2);
-                if (b > 255)
-                {
-                    b = 255;
-                }
-                image(i, j, 2) = b;
-            }
-        }
-
+        const double gain[3] = { 1.4, 0.7, 1.6 };
+        return PointTransform().lut(ChannelLut::fromFunction([&](int v, int c) {
+            return min(gain[c] * v, 255.0);
+        }));
     }
     vector<FilterParam> getNeeds() override {return {};};
 };
@@ -223,6 +300,7 @@ public:
     Blur(Image& img, int r = 10) : Filter(img), radius(r) {};
     string getName() { return "Blur"; };
     static string getId() { return "12"; };
+    int getRadius() const { return radius; }
     void setParam(const std::string& name, double value) {
         if (name == "Blur Strength (0:100)") radius = value;
     }
@@ -230,65 +308,245 @@ public:
     vector<FilterParam> getNeeds() {
         return { {"Blur Strength (0:100)", "float", "5", 0.0, 100.0} };
     }
+    int tileHalo() override { return radius; }
 
-    void Prefix_sum(Image& image, vector<vector<ll>>& prefixR, vector<vector<ll>>& prefixG, vector<vector<ll>>& prefixB)
-    {
-        for (int i = 1; i <= image.width; i++)
-        {
-            for (int j = 1; j <= image.height; j++)
-            {
-                ll r = image(i - 1, j - 1, 0);
-                ll g = image(i - 1, j - 1, 1);
-                ll b = image(i - 1, j - 1, 2);
-                prefixR[i][j] = r + prefixR[i - 1][j] + prefixR[i][j - 1] - prefixR[i - 1][j - 1];
-                prefixG[i][j] = g + prefixG[i - 1][j] + prefixG[i][j - 1] - prefixG[i - 1][j - 1];
-                prefixB[i][j] = b + prefixB[i - 1][j] + prefixB[i][j - 1] - prefixB[i - 1][j - 1];
-            }
-        }
-    }
+    // Each channel is blurred on its own plane; see planar::boxBlur for the
+    // (clipped sum) / (2r+1)^2 rule this has always used at the borders.
     void apply() override
     {
         try
         {
-            Image Blured_image(image.width, image.height);
-            vector<vector<ll>> PrefixR(image.width + 1, vector<ll>(image.height + 1, 0));
-            vector<vector<ll>> PrefixG(image.width + 1, vector<ll>(image.height + 1, 0));
-            vector<vector<ll>> PrefixB(image.width + 1, vector<ll>(image.height + 1, 0));
-            Prefix_sum(image, PrefixR, PrefixG, PrefixB);
-            for (int i = 0; i < image.width; i++)
-            {
-                for (int j = 0; j < image.height; j++)
-                {
-                    int x1, x2, y1, y2;
+            withRgb8(image, [&] {
+                PlanarImage planes = PlanarImage::fromImage(image);
+                PlanarImage blurred(image.width, image.height, 3);
+                for (int c = 0; c < 3; c++) {
+                    planar::boxBlur(planes.plane(c), planes.stride, blurred.plane(c), blurred.stride,
+                                    image.width, image.height, radius);
+                }
+                blurred.toImage(image);
+            });
+        }
+        catch (const std::exception& e)
+        {
+            std::cerr << "Error: " << e.what() << std::endl;
+        }
+    }
+};
+// Removes speckle and salt-and-pepper noise but keeps edges sharp, so it suits
+// noisy scans ahead of Edge Detection or White and Black. Each channel is the
+// median of its (2r+1)^2 window (planar::median), worked out in vertical
+// strips on several threads; the time per pixel is the same for any radius.
+class Median : public Filter {
+    int radius = 2;
 
-                    x1 = max(0, i - radius);
-                    x2 = min(image.width - 1, i + radius);
-                    y1 = max(0, j - radius);
-                    y2 = min(image.height - 1, j + radius);
+public:
+    Median(Image& img) : Filter(img) {};
+    string getName() { return "Median"; };
+    static string getId() { return "29"; };
+    void setParam(const std::string& name, double value) {
+        if (name == "Radius (1:100)") radius = int(min(max(value, 0.0), 127.0));
+    }
 
-                    x1++, x2++, y1++, y2++;
+    vector<FilterParam> getNeeds() {
+        return { {"Radius (1:100)", "int", "2", 1.0, 100.0} };
+    }
+    int tileHalo() override { return radius; }
 
+    void apply() override {
+        withRgb8(image, [&] {
+            PlanarImage planes = PlanarImage::fromImage(image);
+            PlanarImage filtered(image.width, image.height, 3);
+            auto strip = [&](int c, int x0, int x1) {
+                planar::median(planes.plane(c), planes.stride, filtered.plane(c), filtered.stride,
+                               image.width, image.height, radius, x0, x1);
+            };
+
+            // Strips narrow enough that their column histograms stay in cache;
+            // each also reads radius columns beyond its edges.
+            const int stripWidth = max(256, 2 * radius);
+            const int strips = (image.width + stripWidth - 1) / stripWidth;
+            unsigned threads = min<unsigned>(ThreadPool::availableThreads(), unsigned(3 * strips));
+            if (threads < 2 || size_t(image.width) * image.height < (size_t(1) << 16)) {
+                for (int c = 0; c < 3; c++) {
+                    for (int x = 0; x < image.width; x += stripWidth) strip(c, x, x + stripWidth);
+                }
+            } else {
+                ThreadPool pool(threads);
+                for (int c = 0; c < 3; c++) {
+                    for (int x = 0; x < image.width; x += stripWidth) pool.submit([=] { strip(c, x, x + stripWidth); });
+                }
+                pool.wait();
+            }
+            filtered.toImage(image);
+        });
+    }
+};
+// Sharpens by adding back the detail a box blur removes: each sample moves
+// away from its local mean by Amount percent of the difference, unless the
+// difference is under Threshold. The mean comes a row at a time from
+// sharpen::boxMeanRows and is used at once, so the whole filter is one pass
+// over the image, in place.
+class UnsharpMask : public Filter {
+    int radius = 2, amount = 100, limit = 0;
 
-                    ll SUM_R, SUM_G, SUM_B;
-                    SUM_R = PrefixR[x2][y2] + PrefixR[x1 - 1][y1 - 1] - PrefixR[x2][y1 - 1] - PrefixR[x1 - 1][y2];
-                    SUM_G = PrefixG[x2][y2] + PrefixG[x1 - 1][y1 - 1] - PrefixG[x2][y1 - 1] - PrefixG[x1 - 1][y2];
-                    SUM_B = PrefixB[x2][y2] + PrefixB[x1 - 1][y1 - 1] - PrefixB[x2][y1 - 1] - PrefixB[x1 - 1][y2];
+public:
+    UnsharpMask(Image& img) : Filter(img) {};
+    string getName() { return "Unsharp Mask"; };
+    static string getId() { return "32"; };
+    void setParam(const std::string& name, double value) {
+        if (name == "Radius (1:100)") radius = int(min(max(value, 0.0), 127.0));
+        else if (name == "Amount (0:500)") amount = int(min(max(value, 0.0), 1000.0));
+        else if (name == "Threshold (0:255)") limit = int(min(max(value, 0.0), 255.0));
+    }
 
+    vector<FilterParam> getNeeds() {
+        return { {"Radius (1:100)", "int", "2", 1.0, 100.0},
+                 {"Amount (0:500)", "int", "100", 0.0, 500.0},
+                 {"Threshold (0:255)", "int", "0", 0.0, 255.0} };
+    }
+    int tileHalo() override { return radius; }
 
-                    ll A = (2 * radius + 1) * (2 * radius + 1);
+    void apply() override {
+        withRgb8(image, [&] {
+            size_t rowBytes = size_t(image.width) * 3;
+            sharpen::boxMeanRows(image.imageData, image.width, image.height, radius,
+                                 [&](int y, const unsigned char* mean) {
+                unsigned char* row = image.imageData + size_t(y) * rowBytes;
+                for (size_t i = 0; i < rowBytes; i++) {
+                    int detail = row[i] - mean[i];
+                    if (abs(detail) < limit) continue;
+                    row[i] = static_cast<unsigned char>(min(255, max(0, row[i] + sharpen::roundedShare(detail, amount, 100))));
+                }
+            });
+        });
+    }
+};
+// Local contrast: the unsharp mask idea at a wide radius, on brightness only
+// and mostly in the midtones. Every channel of a pixel moves by the same
+// Amount percent of its brightness minus the local mean brightness, scaled
+// down towards black and white, so colours keep their hue and highlights do
+// not clip. A negative amount softens instead. One pass, like UnsharpMask.
+class Clarity : public Filter {
+    int radius = 30, amount = 40;
 
+public:
+    Clarity(Image& img) : Filter(img) {};
+    string getName() { return "Clarity"; };
+    static string getId() { return "33"; };
+    void setParam(const std::string& name, double value) {
+        if (name == "Radius (1:100)") radius = int(min(max(value, 0.0), 127.0));
+        else if (name == "Amount (-100:100)") amount = int(min(max(value, -500.0), 500.0));
+    }
 
-                    Blured_image(i, j, 0) = static_cast<unsigned char>(SUM_R / A);
-                    Blured_image(i, j, 1) = static_cast<unsigned char>(SUM_G / A);
-                    Blured_image(i, j, 2) = static_cast<unsigned char>(SUM_B / A);
+    vector<FilterParam> getNeeds() {
+        return { {"Radius (1:100)", "int", "30", 1.0, 100.0},
+                 {"Amount (-100:100)", "int", "40", -100.0, 100.0} };
+    }
+    int tileHalo() override { return radius; }
+
+    void apply() override {
+        withRgb8(image, [&] {
+            sharpen::boxMeanRows(image.imageData, image.width, image.height, radius,
+                                 [&](int y, const unsigned char* mean) {
+                unsigned char* px = image.imageData + size_t(y) * image.width * 3;
+                for (int x = 0; x < image.width; x++, px += 3, mean += 3) {
+                    int brightness = (px[0] + px[1] + px[2]) / 3;
+                    int detail = brightness - (mean[0] + mean[1] + mean[2]) / 3;
+                    int midtones = 255 - abs(2 * brightness - 255);
+                    int shift = sharpen::roundedShare(detail * midtones, amount, 100 * 255);
+                    for (int c = 0; c < 3; c++) px[c] = static_cast<unsigned char>(min(255, max(0, px[c] + shift)));
                 }
+            });
+        });
+    }
+};
+// Histogram equalization of brightness: the levels the image uses are spread
+// over the whole range, each in proportion to how many pixels have it.
+class Equalize : public Filter {
+public:
+    Equalize(Image& img) : Filter(img) {};
+    string getName() { return "Equalize"; };
+    static string getId() { return "34"; };
+    vector<FilterParam> getNeeds() override { return {}; };
+
+    void apply() override {
+        withRgb8(image, [&] {
+            equalize::Histogram hist{};
+            size_t pixels = size_t(image.width) * image.height;
+            for (size_t i = 0; i < pixels; i++) hist[equalize::brightness(image.imageData + i * 3)]++;
+            equalize::Table table = equalize::equalizationTable(hist);
+            for (size_t i = 0; i < pixels; i++) {
+                unsigned char* px = image.imageData + i * 3;
+                int level = equalize::brightness(px);
+                equalize::shiftTo(px, level, table[level]);
             }
-            image = Blured_image;
-        }
-        catch (const std::exception& e)
-        {
-            std::cerr << "Error: " << e.what() << std::endl;
-        }
+        });
+    }
+};
+// Contrast-limited adaptive histogram equalization: every tile of a
+// tiles x tiles grid is equalized on its own, with each histogram bin capped
+// at Clip Limit times the tile's average bin so noise in flat areas is not
+// blown up, and pixels blend the tables of the four nearest tiles. Brings out
+// detail in both the dark and bright parts of an unevenly lit picture.
+class CLAHE : public Filter {
+    int tiles = 8;
+    double clipLimit = 2;
+
+public:
+    CLAHE(Image& img) : Filter(img) {};
+    string getName() { return "CLAHE"; };
+    static string getId() { return "35"; };
+    void setParam(const std::string& name, double value) {
+        if (name == "Tiles (2:16)") tiles = int(min(max(value, 1.0), 64.0));
+        else if (name == "Clip Limit (1:10)") clipLimit = max(value, 0.0);
+    }
+
+    vector<FilterParam> getNeeds() {
+        return { {"Tiles (2:16)", "int", "8", 2.0, 16.0},
+                 {"Clip Limit (1:10)", "float", "2", 1.0, 10.0} };
+    }
+
+    void apply() override {
+        withRgb8(image, [&] {
+            equalize::TileGrid grid = equalize::TileGrid::measure(image, tiles, tiles);
+            vector<array<int, 256>> tables(grid.histograms.size());
+            for (int j = 0; j < grid.rows; j++) {
+                for (int i = 0; i < grid.columns; i++) {
+                    double averageBin = double(grid.tileWidth(i)) * grid.tileHeight(j) / 256;
+                    uint32_t limit = uint32_t(max(1.0, clipLimit * averageBin));
+                    equalize::Table table = equalize::equalizationTable(grid.histogram(i, j), limit);
+                    copy(table.begin(), table.end(), tables[size_t(j) * grid.columns + i].begin());
+                }
+            }
+            grid.blend(image, tables, [](unsigned char* px, int level, int value) {
+                equalize::shiftTo(px, level, value);
+            });
+        });
+    }
+};
+// Smooths skin and noise but keeps edges: a bilateral filter (neighbours
+// weighted by nearness in both position and grey) over a bilateral grid; see
+// BilateralGrid.h. The time falls as the sigmas grow.
+class Bilateral : public Filter {
+    int sigmaSpace = 16, sigmaRange = 20;
+
+public:
+    Bilateral(Image& img) : Filter(img) {};
+    string getName() { return "Bilateral"; };
+    static string getId() { return "31"; };
+    void setParam(const std::string& name, double value) {
+        if (name == "Spatial Sigma (4:100)") sigmaSpace = int(min(max(value, 1.0), 1000.0));
+        else if (name == "Range Sigma (4:100)") sigmaRange = int(min(max(value, 1.0), 255.0));
+    }
+
+    vector<FilterParam> getNeeds() {
+        return { {"Spatial Sigma (4:100)", "int", "16", 4.0, 100.0},
+                 {"Range Sigma (4:100)", "int", "20", 4.0, 100.0} };
+    }
+    int tileHalo() override { return bilateral::margin(sigmaSpace); }
+
+    void apply() override {
+        withRgb8(image, [&] { bilateral::filter(image, sigmaSpace, sigmaRange, originX, originY); });
     }
 };
 class Skewing : public Filter
@@ -372,52 +630,66 @@ public:
     }
     vector<FilterParam> getNeeds() override {return {};};
 };
-class GreyScale : public Filter
+class GreyScale : public PointFilter
 {
 public:
-    GreyScale(Image& img) : Filter(img) {};
+    GreyScale(Image& img) : PointFilter(img) {};
     string getName() { return "Grey Scale"; };
     static string getId() { return "1"; };
-    void apply() override
+    PointTransform transform() override
     {
-        try
-        {
-            for (int i = 0; i < image.width; i++)
-            {
-                for (int j = 0; j < image.height; j++)
-                {
-
-                    unsigned int avg = 0;
-
-                    for (int k = 0; k < 3; k++)
-                    {
-                        avg += image(i, j, k);
-                    }
-
-                    avg /= image.channels; // average
-                    for (int k = 0; k < image.channels; k++)
-                    {
-                        image(i, j, k) = avg;
-                    }
-                }
+        return PointTransform().span([](unsigned char* rgb, size_t count) {
+            for (size_t i = 0; i < count; i++, rgb += 3) {
+                unsigned int avg = (rgb[0] + rgb[1] + rgb[2]) / 3; // average
+                rgb[0] = rgb[1] = rgb[2] = avg;
             }
-        }
-        catch (const exception& e)
-        {
-            cerr << "Error: " << e.what() << endl;
-            throw;
-        }
+        });
     }
     vector<FilterParam> getNeeds() override {return {};};
 };
+// Global mode thresholds every pixel at computeThreshold(). Adaptive mode is
+// for unevenly lit scans: each of tiles x tiles tiles has its own threshold,
+// its mean brightness less Offset, blended between tile centres (see
+// equalize::TileGrid), so text stays black in shadows and paper white in glare.
 class WhiteAndBlack : public Filter
 {
+    int mode = 1, tiles = 8, offset = 10;
 public:
     WhiteAndBlack(Image& img) : Filter(img) {};
     string getName() { return "White and Black"; };
     static string getId() { return "2"; };
+    void setParam(const std::string& name, double value) {
+        if (name == "Mode (1=Global, 2=Adaptive)") mode = int(value);
+        else if (name == "Tiles (2:16)") tiles = int(min(max(value, 1.0), 64.0));
+        else if (name == "Offset (0:50)") offset = int(min(max(value, -255.0), 255.0));
+    }
+
+    void applyAdaptive()
+    {
+        withRgb8(image, [&] {
+            equalize::TileGrid grid = equalize::TileGrid::measure(image, tiles, tiles);
+            vector<array<int, 256>> thresholds(grid.histograms.size());
+            for (size_t t = 0; t < thresholds.size(); t++) {
+                uint64_t sum = 0, count = 0;
+                for (int v = 0; v < 256; v++) {
+                    sum += uint64_t(v) * grid.histograms[t][v];
+                    count += grid.histograms[t][v];
+                }
+                int mean = int((sum + count / 2) / count);
+                thresholds[t].fill(min(255, max(0, mean - offset)));
+            }
+            grid.blend(image, thresholds, [](unsigned char* px, int level, int threshold) {
+                px[0] = px[1] = px[2] = level >= threshold ? 255 : 0;
+            });
+        });
+    }
+
     void apply() override
     {
+        if (mode == 2) {
+            applyAdaptive();
+            return;
+        }
         computeThreshold();
         for (int i = 0; i < image.width; i++)
         {
@@ -438,12 +710,19 @@ public:
             }
         }
     };
-    vector<FilterParam> getNeeds() override {return {};};
+    vector<FilterParam> getNeeds() override {
+        return { {"Mode (1=Global, 2=Adaptive)", "int", "1", 1.0, 2.0},
+                 {"Tiles (2:16)", "int", "8", 2.0, 16.0},
+                 {"Offset (0:50)", "int", "10", 0.0, 50.0} };
+    };
 };
 class Merge : public Filter
 {
-    Image overlay;
+    shared_ptr<const Image> overlay;
     int mergeType = 1;
+    int mode = 1;
+    double opacity = 100;
+    int offset[2]{ 0, 0 };
 
 public:
     Merge(Image& img) : Filter(img) {};
@@ -453,106 +732,59 @@ public:
     vector<FilterParam> getNeeds() {
         return {
             {"Enter Merge type (1: Stretch to fit, 2: Common):", "int", "1",1, 2},
+            {"Blend Mode (1=Average, 2=Alpha, 3=Multiply, 4=Screen, 5=Overlay, 6=Difference)", "int", "1", 1, 6},
+            {"Opacity (0:100)", "float", "100", 0, 100},
+            {"Overlay X Offset", "int", "0", -double(image.width), double(image.width)},
+            {"Overlay Y Offset", "int", "0", -double(image.height), double(image.height)},
             {"Overlay Image", "image", ""}
 
         };
     }
     void setParam(const std::string& name, double value) {
         if (name == "Enter Merge type (1: Stretch to fit, 2: Common):") mergeType = (int)value;
+        else if (name.rfind("Blend Mode", 0) == 0) mode = (int)value;
+        else if (name == "Opacity (0:100)") opacity = value;
+        else if (name == "Overlay X Offset") offset[0] = (int)value;
+        else if (name == "Overlay Y Offset") offset[1] = (int)value;
+    }
+    void setParam(const string& name, const Image& img) override {
+        if (name == "Overlay Image") overlay = make_shared<const Image>(img);
     }
-    void setParam(const string& name, const Image& img) {
+    void setParam(const string& name, const shared_ptr<const Image>& img) override {
         if (name == "Overlay Image") overlay = img;
     }
+
+    // Type 1 stretches both images to the larger width and height, type 2 keeps
+    // their sizes on a canvas that holds both; the overlay sits at its offset
+    // either way. One pass through blend::compose, scaling on the fly: the
+    // stored overlay is never modified, so applying again gives the same result.
     void apply() override
     {
-        Image& ov = this->overlay;
-        Image& base = image;
-        try
-        {
-            int height;
-            int width;
-
-            if (base.width == overlay.width && base.height == overlay.height)
-            {
-                height = base.height;
-                width = base.width;
-                for (int i = 0; i < width; i++)
-                {
-                    for (int j = 0; j < height; j++)
-                    {
-                        for (int k = 0; k < 3; k++)
-                        {
-                            base(i, j, k) = (base(i, j, k) + overlay(i, j, k)) / 2;
-                        }
-                    }
-                }
-            }
-            else
-            {
-                switch (mergeType)
-                {
-                case 1:
-                { // max
-                    /* Max */
-                    width = std::max(base.width, overlay.width);
-                    height = std::max(base.height, overlay.height);
-                    resizeImage(base, width, height);
-                    resizeImage(overlay, width, height);
-                    for (int i = 0; i < width; i++)
-                    {
-                        for (int j = 0; j < height; j++)
-                        {
-                            for (int k = 0; k < 3; k++)
-                            {
-                                base(i, j, k) = (base(i, j, k) + overlay(i, j, k)) / 2;
-                            }
-                        }
-                    }
-                    break;
-                }
-                case 2:
-                { // both
-                    Image img(std::max(base.width, overlay.width),
-                              std::max(base.height, overlay.height));
-                    for (int i = 0; i < base.width; i++)
-                    {
-                        for (int j = 0; j < base.height; j++)
-                        {
-                            for (int k = 0; k < 3; k++)
-                            {
-                                img(i, j, k) = base(i, j, k);
-                            }
-                        }
-                    }
-                    for (int i = 0; i < overlay.width; i++)
-                    {
-                        for (int j = 0; j < overlay.height; j++)
-                        {
-                            for (int k = 0; k < 3; k++)
-                            {
-                                if (i < base.width && j < base.height)
-                                {
-                                    img(i, j, k) = (img(i, j, k) + overlay(i, j, k)) / 2;
-                                }
-                                else
-                                {
-                                    img(i, j, k) = overlay(i, j, k);
-                                }
-                            }
-                        }
-                    }
-
-                    base = img;
-                }
-                default:
-                    break;
-                }
-            }
+        if (!overlay || overlay->width == 0) throw invalid_argument("Merge needs an overlay image");
+        Image narrowed;
+        const Image* over = overlay.get();  // alpha is kept: it weights the blend
+        if (overlay->format == PixelFormat::RGB16) {
+            narrowed = convertImage(*overlay, PixelFormat::RGB8);
+            over = &narrowed;
         }
-        catch (const std::exception& e)
-        {
-            std::cerr << "Error: " << e.what() << std::endl;
-            throw;
+        withRgb8(image, [&] { merge(image, *over); });
+    }
+
+private:
+    void merge(Image& base, const Image& over)
+    {
+        blend::Options options;
+        options.mode = blend::Mode(std::clamp(mode, 1, 6));
+        options.opacity = int(std::clamp(opacity, 0.0, 100.0) * 2.55 + 0.5);
+        int dx = offset[0], dy = offset[1];
+        if (mergeType == 2) {
+            int x0 = std::min(0, dx), y0 = std::min(0, dy);
+            int x1 = std::max(base.width, dx + over.width), y1 = std::max(base.height, dy + over.height);
+            blend::compose(base, { -x0, -y0, base.width, base.height }, over,
+                           { dx - x0, dy - y0, over.width, over.height }, x1 - x0, y1 - y0, options);
+        } else {
+            int width = std::max(base.width, over.width), height = std::max(base.height, over.height);
+            blend::compose(base, { 0, 0, width, height }, over, { dx, dy, width, height }, width, height, options);
         }
     }
 };
@@ -627,17 +859,11 @@ public:
     }
 
 };
-class Invert : public Filter {
+class Invert : public PointFilter {
 public:
-    Invert(Image& img) : Filter(img) {};
-    void apply() override {
-        for (int i = 0; i < image.width; i++) {
-            for (int j = 0; j < image.height; j++) {
-                for (int k = 0; k < 3; k++) {
-                    image(i, j, k) = 255 - image(i, j, k);
-                }
-            }
-        }
+    Invert(Image& img) : PointFilter(img) {};
+    PointTransform transform() override {
+        return PointTransform().lut(ChannelLut::fromFunction([](int v, int) { return 255 - v; }));
     }
     string getName() { return "Invert"; };
     static string getId() { return "3"; };
@@ -716,26 +942,21 @@ public:
         if (name == "Rotation Angle (90 / 180 / 270)") angle = (int)value;
     }
 };
-class Brightness : public Filter
+class Brightness : public PointFilter
 {
-    double value;
+    double value = 1.0;
 public:
-    Brightness(Image& img) : Filter(img) {};
+    Brightness(Image& img) : PointFilter(img) {};
     string getName() { return "Brightness"; };
     static string getId() { return "7"; };
 
-    void apply() override {
-        cout << "here is: " << value << '\n';
-        for (int i = 0; i < image.width; i++) {
-            for (int j = 0; j < image.height; j++) {
-                for (int k = 0; k < 3; k++) {
-                    int newValue = image(i, j, k) * value;
-                    if (newValue > 255) newValue = 255;
-                    if (newValue < 0) newValue = 0;
-                    image(i, j, k) = newValue;
-                }
-            }
-        }
+    PointTransform transform() override {
+        return PointTransform().lut(ChannelLut::fromFunction([&](int v, int) {
+            int newValue = v * value;
+            if (newValue > 255) newValue = 255;
+            if (newValue < 0) newValue = 0;
+            return newValue;
+        }));
     }
 
     vector<FilterParam> getNeeds() {
@@ -780,24 +1001,22 @@ public:
     string getName() { return "Crop"; };
     static string getId() { return "8"; };
 
-    void apply() override {
-        Image croppedImage(dimensions[0], dimensions[1]);
-
-        for (int i = corner[0], I = 0; i < (corner[0] + dimensions[0]); i++, I++) {
-            for (int j = corner[1], J = 0; j < (corner[1] + dimensions[1]); j++, J++) {
-                for (int k = 0; k < image.channels; k++) {
-                    croppedImage(I, J, k) = image(i, j, k);
-                }
-            }
-        }
-
+    // The rectangle as a view of the image; nothing is copied.
+    // Throws std::out_of_range if it does not lie inside the image.
+    ImageView view() {
+        return ImageView::of(image).region(corner[0], corner[1], dimensions[0], dimensions[1]);
+    }
 
-        image = croppedImage;
+    // Commits the view: the kept rows move to the front of the same buffer.
+    void apply() override {
+        commitView(image, view());
     }
 };
 class Resize : public Filter {
     int dimensions[2]{ 100 };
     bool keepAspect = true;
+    int mode = 1;
+    int seamsPerPass = 16;
 
 public:
     Resize(Image& img) :Filter(img) {};
@@ -805,18 +1024,26 @@ public:
         return {
             {"Width", "int", "800", 10, double(image.width)},
             {"Height", "int", "600", 10, double(image.height)},
-            {"Keep Aspect Ratio", "bool", "1", 0, 1}
+            {"Keep Aspect Ratio", "bool", "1", 0, 1},
+            {"Mode (1=Stretch, 2=Seam Carving)", "int", "1", 1, 2},
+            {"Seams per Pass (1:64)", "int", "16", 1, 64}
         };
     }
     void setParam(const std::string& name, double value) {
         if (name == "Width") dimensions[0] = (int)value;
         else if (name == "Height") dimensions[1] = (int)value;
         else if (name == "Keep Aspect Ratio") keepAspect = (bool)value;
+        else if (name == "Mode (1=Stretch, 2=Seam Carving)") mode = (int)value;
+        else if (name == "Seams per Pass (1:64)") seamsPerPass = (int)min(max(value, 1.0), 64.0);
     }
     string getName() { return "Resizing"; };
     static string getId() { return "11"; };
 
     void apply() override {
+        if (mode == 2) {
+            withRgb8(image, [&] { seams::retarget(image, dimensions[0], dimensions[1], seamsPerPass); });
+            return;
+        }
         resizeImage(image, dimensions[0], dimensions[1]);
     }
 };
@@ -837,24 +1064,20 @@ public:
 
     string getName() { return "Oil Painting"; };
     static string getId() { return "14"; };
+    int tileHalo() override { return 0; }
 
-    void apply() override {
-        Image output(image.width, image.height);
-        for (int x = 0; x < image.width; x++) {
-            for (int y = 0; y < image.height; y++) {
-
-                for (int k = 0; k < image.channels; k++) {
-                    int intensity = image(x, y, k);
-                    int binIndex = (intensity * intensityLevels) / 255;
-                    if (binIndex >= intensityLevels) binIndex = intensityLevels - 1;
+    // Each channel is quantized independently, so the effect is a per-channel LUT.
+    PointTransform posterize() {
+        return PointTransform().lut(ChannelLut::fromFunction([&](int intensity, int) {
+            int binIndex = (intensity * intensityLevels) / 255;
+            if (binIndex >= intensityLevels) binIndex = intensityLevels - 1;
 
-                    int newIntensity = (binIndex * 255) / (intensityLevels - 1);
+            return (binIndex * 255) / (intensityLevels - 1);
+        }));
+    }
 
-                    output(x, y, k) = newIntensity;
-                }
-            }
-        }
-        image = output;
+    void apply() override {
+        posterize().run(image);
     }
 };
 class ArtisticBrush : public OilPainting {
@@ -874,6 +1097,7 @@ public:
     }
     string getName() { return "Artistic Brush"; };
     static string getId() { return "22"; };
+    int tileHalo() override { return radius; }
 
     void apply() override {
         Image output(image.width, image.height);
@@ -926,104 +1150,141 @@ public:
     }
 
 };
-class Infrared : public Filter {
-    int radius;
+// Kuwahara's edge-preserving smoothing, which gives brush strokes that follow
+// the edges: each pixel takes the mean colour of whichever of the four
+// (r+1)x(r+1) squares cornered on it has the least variance of r + g + b
+// (the first of them on a tie; squares are clipped at the border). Means and
+// variances come from summed-area tables, so the cost per pixel does not
+// depend on the brush size. The tables are built per tile, over the tile and
+// the brush's reach around it, and tiles run on several threads.
+class Kuwahara : public Filter {
+    int radius = 4;
 
 public:
-    Infrared(Image& img) : Filter(img) {};
-    vector<FilterParam> getNeeds() override {return {};};
-    string getName() { return "Infrared"; };
-    static string getId() { return "17"; };
+    Kuwahara(Image& img) : Filter(img) {};
+    string getName() { return "Kuwahara"; };
+    static string getId() { return "30"; };
+    void setParam(const std::string& name, double value) {
+        if (name == "Brush Size (1:100)") radius = int(min(max(value, 0.0), 100.0));
+    }
+
+    vector<FilterParam> getNeeds() {
+        return { {"Brush Size (1:100)", "int", "4", 1.0, 100.0} };
+    }
+    int tileHalo() override { return radius; }
 
     void apply() override {
-        for (int x = 0; x < image.width; x++) {
-            for (int y = 0; y < image.height; y++) {
-                int redChannel = 0;
-                for (int k = 0; k < image.channels; k++) {
-                    redChannel += image(x, y, k);
+        withRgb8(image, [&] {
+            Image output(image.width, image.height);
+            // Tiles at least twice the brush, so building the margins stays a
+            // fraction of the work.
+            const int tile = max(128, 2 * radius);
+            auto runTile = [&](int tx, int ty) {
+                int tx1 = min(image.width, tx + tile), ty1 = min(image.height, ty + tile);
+                SummedAreaTable table(image, tx - radius, ty - radius, tx1 - tx + 2 * radius, ty1 - ty + 2 * radius);
+                for (int y = ty; y < ty1; y++) {
+                    unsigned char* out = output.imageData + (size_t(y) * image.width + tx) * 3;
+                    for (int x = tx; x < tx1; x++, out += 3) {
+                        BoxSums best;
+                        double bestSpread = 0;
+                        for (int q = 0; q < 4; q++) {
+                            int qx = q & 1 ? x : x - radius, qy = q & 2 ? y : y - radius;
+                            BoxSums box = table.box(qx, qy, qx + radius + 1, qy + radius + 1);
+                            // n^2 * variance, exactly, over n^2
+                            uint64_t n = box.count;
+                            double spread = double(n * box.totalSquares - uint64_t(box.total) * box.total) / double(n * n);
+                            if (q == 0 || spread < bestSpread) {
+                                best = box;
+                                bestSpread = spread;
+                            }
+                        }
+                        for (int c = 0; c < 3; c++) out[c] = static_cast<unsigned char>((best.channel[c] + best.count / 2) / best.count);
+                    }
                 }
-                redChannel /= image.channels;
+            };
 
-                image(x, y, 0) = 255;
-                image(x, y, 1) = 255 - redChannel;
-                image(x, y, 2) = 255 - redChannel;
+            vector<pair<int, int>> tiles;
+            for (int ty = 0; ty < image.height; ty += tile) {
+                for (int tx = 0; tx < image.width; tx += tile) tiles.push_back({ tx, ty });
             }
-        }
+            unsigned threads = min<unsigned>(ThreadPool::availableThreads(), unsigned(tiles.size()));
+            if (threads < 2) {
+                for (auto& at : tiles) runTile(at.first, at.second);
+            } else {
+                ThreadPool pool(threads);
+                for (auto& at : tiles) pool.submit([=] { runTile(at.first, at.second); });
+                pool.wait();
+            }
+            image = std::move(output);
+        });
+    }
+};
+class Infrared : public PointFilter {
+    int radius;
+
+public:
+    Infrared(Image& img) : PointFilter(img) {};
+    vector<FilterParam> getNeeds() override {return {};};
+    string getName() { return "Infrared"; };
+    static string getId() { return "17"; };
+
+    static Palette palette() {
+        return Palette::formula([](int intensity) {
+            auto inverse = static_cast<unsigned char>(255 - intensity);
+            return Palette::Color{ 255, inverse, inverse };
+        });
     }
+
+    PointTransform transform() override { return PointTransform().palette(palette()); }
 };
-class Bloody : public Filter {
+class Bloody : public PointFilter {
     int radius;
 
 public:
-    Bloody(Image& img) : Filter(img) {};
+    Bloody(Image& img) : PointFilter(img) {};
     vector<FilterParam> getNeeds() override {return {};};
     string getName() { return "Bloody"; };
     static string getId() { return "19"; };
 
-    void apply() override {
-        for (int x = 0; x < image.width; x++) {
-            for (int y = 0; y < image.height; y++) {
-                int redChannel = 0;
-                for (int k = 0; k < image.channels; k++) {
-                    redChannel += image(x, y, k);
-                }
-                redChannel /= image.channels;
-
-                image(x, y, 0) = redChannel;
-                image(x, y, 1) = 0;
-                image(x, y, 2) = 0;
-            }
-        }
+    static Palette palette() {
+        return Palette::formula([](int intensity) {
+            return Palette::Color{ static_cast<unsigned char>(intensity), 0, 0 };
+        });
     }
 
+    PointTransform transform() override { return PointTransform().palette(palette()); }
+
 };
-class Sky : public Filter {
+class Sky : public PointFilter {
 public:
-    Sky(Image& img) : Filter(img) {};
+    Sky(Image& img) : PointFilter(img) {};
     vector<FilterParam> getNeeds() override {return {};};
     string getName() { return "Sky"; };
     static string getId() { return "21"; };
 
-    void apply() override {
-        for (int x = 0; x < image.width; x++) {
-            for (int y = 0; y < image.height; y++) {
-                int blueChannel = 0;
-                for (int k = 0; k < image.channels; k++) {
-                    blueChannel += image(x, y, k);
-                }
-                blueChannel /= image.channels;
-
-                image(x, y, 0) = 0;
-                image(x, y, 1) = blueChannel / 2;
-                image(x, y, 2) = blueChannel;
-            }
-        }
+    static Palette palette() {
+        return Palette::formula([](int intensity) {
+            return Palette::Color{ 0, static_cast<unsigned char>(intensity / 2), static_cast<unsigned char>(intensity) };
+        });
     }
 
+    PointTransform transform() override { return PointTransform().palette(palette()); }
+
 };
-class Grass: public Filter {
+class Grass: public PointFilter {
 
 public:
-    Grass(Image& img) : Filter(img) {};
+    Grass(Image& img) : PointFilter(img) {};
     string getName() { return "Grass"; };
     static string getId() { return "20"; };
 
-    void apply() override {
-        for (int x = 0; x < image.width; x++) {
-            for (int y = 0; y < image.height; y++) {
-                int intensity = 0;
-                for (int k = 0; k < image.channels; k++) {
-                    intensity += image(x, y, k);
-                }
-                intensity /= image.channels;
-
-                image(x, y, 0) = 0;
-                image(x, y, 1) = intensity;
-                image(x, y, 2) = 0;
-            }
-        }
-
+    static Palette palette() {
+        return Palette::formula([](int intensity) {
+            return Palette::Color{ 0, static_cast<unsigned char>(intensity), 0 };
+        });
     }
+
+    PointTransform transform() override { return PointTransform().palette(palette()); }
     vector<FilterParam> getNeeds() override {return {};};
 
 };
@@ -1195,62 +1456,61 @@ public:
         };
     }
     vector<FilterParam> getNeeds() override {return {};};
+    // Grey, blur and Sobel only ever need one channel, so the whole chain runs
+    // on a single plane. The one-pixel border of the result, which has no
+    // full 3x3 neighbourhood, is white (no edge).
     void apply() override {
-        GreyScale grey(image);
-        grey.apply();
-        Blur blur(image, 2);
-        blur.apply();
-
-        Image output(image.width, image.height);
-        map<string,vector<vector<int>>> kernels = sobelKernels();
-        computeThreshold();
-        for (int x = 1; x < image.width-1; x++) {
-            for (int y = 1; y < image.height-1; y++) {
-                int sumX = 0;
-                int sumY = 0;
-                for (int i = -1; i <= 1; i++ ) {
-                    for (int j = -1; j <= 1; j++ ) {
-                        int intensity = image(x+i,y+j,0);
-                        sumX += intensity * kernels["Gx"][i+1][j+1];
-                        sumY += intensity * kernels["Gy"][i+1][j+1];
-                    }
+        withRgb8(image, [&] {
+            int width = image.width, height = image.height;
+            PlanarImage grey(width, height, 1), blurred(width, height, 1);
+            for (int y = 0; y < height; y++) {
+                const unsigned char* in = image.imageData + size_t(y) * width * 3;
+                unsigned char* out = grey.row(0, y);
+                for (int x = 0; x < width; x++, in += 3) out[x] = (in[0] + in[1] + in[2]) / 3;
+            }
+            planar::boxBlur(grey.plane(0), grey.stride, blurred.plane(0), blurred.stride, width, height, 2);
+
+            unsigned long long sum = 0, sumSquares = 0;
+            for (int y = 0; y < height; y++) {
+                const unsigned char* row = blurred.row(0, y);
+                for (int x = 0; x < width; x++) {
+                    sum += row[x];
+                    sumSquares += unsigned(row[x]) * row[x];
                 }
-                int magnitude = sqrt((sumX*sumX)+(sumY*sumY));
-                if (magnitude > threshold) magnitude = 0;
-                else magnitude = 255;
-                output(x,y,0) = output(x,y,1) = output(x,y,2) = magnitude;
             }
-        }
-
-        image = output;
+            threshold = thresholdFromMoments(double(sum), double(sumSquares), double(width) * height);
+
+            Image output(width, height);
+            memset(output.imageData, 255, output.byteSize());
+            for (int y = 1; y < height - 1; y++) {
+                const unsigned char* above = blurred.row(0, y - 1);
+                const unsigned char* row = blurred.row(0, y);
+                const unsigned char* below = blurred.row(0, y + 1);
+                unsigned char* out = output.imageData + size_t(y) * width * 3;
+                for (int x = 1; x < width - 1; x++) {
+                    planar::Gradient g = planar::sobel(above, row, below, x - 1, x, x + 1);
+                    int magnitude = sqrt((g.x * g.x) + (g.y * g.y));
+                    out[x * 3] = out[x * 3 + 1] = out[x * 3 + 2] = magnitude > threshold ? 0 : 255;
+                }
+            }
+            image = output;
+        });
     }
 };
 
 
-class Gama : public Filter
+class Gama : public PointFilter
 {
     double gama;
 public:
-    Gama(Image& img) : Filter(img) {};
+    Gama(Image& img) : PointFilter(img) {};
     string getName() { return "Gama"; };
     static string getId(){ return "25"; };
-    void apply() override {
-        for (int i = 0; i < image.width; i++)
-        {
-            for (int j = 0; j < image.height;j++)
-            {
-                float Val = pow(image(i, j, 0) / 255.0f, gama);
-                int Nr = min(int(255 * Val), 255);
-                image(i, j, 0) = Nr;
-                Val = pow(image(i, j, 1) / 255.0f, gama);
-                int Ng = min(int(255 * Val), 255);
-                image(i, j, 1) = Ng;
-
-                Val = pow(image(i, j, 2) / 255.0f, gama);
-                int Nb = min(int(255 * Val), 255);
-                image(i, j, 2) = Nb;
-            }
-        }
+    PointTransform transform() override {
+        return PointTransform().lut(ChannelLut::fromFunction([&](int v, int) {
+            float Val = pow(v / 255.0f, gama);
+            return min(int(255 * Val), 255);
+        }));
     };
 
     vector<FilterParam> getNeeds() {
@@ -1264,64 +1524,100 @@ public:
 };
 
 
-class HeatMap : public Filter
+class HeatMap : public PointFilter
 {
     double p;
 public:
-    HeatMap(Image& img) : Filter(img) {};
+    HeatMap(Image& img) : PointFilter(img) {};
     string getName() { return "Heat Map"; };
     static string getId(){ return "26"; };
-    void apply() override {
-        for (int i = 0; i < image.width; i++){
-            for (int j = 0;j < image.height;j++)
-            {
-                float R = static_cast<float>(image(i, j, 0));
-                float G = static_cast<float>(image(i, j, 1));
-                float B = static_cast<float>(image(i, j, 2));
-                float mean_ntensity = (R + G + B) / 3.0f;
+    // Four bands of the mean intensity: blue, green, yellow, red.
+    static Palette palette() {
+        return Palette::fromFunction([](int intensity) {
+            if (intensity < 64) return Palette::Color{ 0, 0, 255 };
+            if (intensity < 128) return Palette::Color{ 0, 255, 0 };
+            if (intensity < 192) return Palette::Color{ 255, 255, 0 };
+            return Palette::Color{ 255, 0, 0 };
+        });
+    }
 
-                if (mean_ntensity < 64)
-                {
-                    image(i , j , 0 ) = 0 ;
-                    image(i, j, 1) = 0;
-                    image(i, j, 2) = 255;
-                }
-                else if (mean_ntensity < 128)
-                {
-                    image(i, j, 0) = 0;
-                    image(i, j, 1) = 255;
-                    image(i, j, 2) =0;
-                }
-                else if (mean_ntensity < 192)
-                {
-                    image(i, j, 0) = 255;
-                    image(i, j, 1) = 255;
-                    image(i, j, 2) = 0;
-                }
-                else
-                {
-                    image(i, j, 0) = 255;
-                    image(i, j, 1) = 0;
-                    image(i, j, 2) = 0;
-                }
+    PointTransform transform() override { return PointTransform().palette(palette()); }
 
-            }
+    vector<FilterParam> getNeeds() {
+        return {
+        };
+    }
+};
+
+
+
+// Recolours by intensity through a named or custom palette; Heat Map, Sky and
+// the other intensity filters are fixed palettes of the same kind.
+class Colormap : public PointFilter
+{
+    int kind = 1;
+    Palette::Color start{ 0, 0, 0 }, end{ 255, 255, 255 };
+
+    // "#rrggbb"; anything else leaves color as it was.
+    static void parseColor(const string& text, Palette::Color& color) {
+        if (text.size() != 7 || text[0] != '#') return;
+        for (size_t i = 1; i < 7; i++) {
+            if (!isxdigit(static_cast<unsigned char>(text[i]))) return;
         }
-    };
+        for (int c = 0; c < 3; c++) {
+            color[c] = static_cast<unsigned char>(stoi(text.substr(1 + 2 * c, 2), nullptr, 16));
+        }
+    }
+
+public:
+    Colormap(Image& img) : PointFilter(img) {};
+    string getName() { return "Colormap"; };
+    static string getId(){ return "28"; };
 
     vector<FilterParam> getNeeds() {
         return {
+            {"Palette (1=Viridis, 2=Inferno, 3=Gradient)", "int", "1", 1, 3},
+            {"Gradient Start", "color", "", 0, 0},
+            {"Gradient End", "color", "", 0, 0}
         };
     }
+
+    void setParam(const std::string& name, double value) {
+        if (name.rfind("Palette", 0) == 0) kind = int(value);
+    }
+
+    void setParam(const std::string& name, const std::string& color) {
+        if (name == "Gradient Start") parseColor(color, start);
+        if (name == "Gradient End") parseColor(color, end);
+    }
+
+    // matplotlib's perceptually uniform maps, sampled at ten evenly spaced stops.
+    static Palette viridis() {
+        return Palette::gradient({ {68, 1, 84}, {72, 40, 120}, {62, 73, 137}, {49, 104, 142}, {38, 130, 142},
+                                   {31, 158, 137}, {53, 183, 121}, {110, 206, 88}, {181, 222, 43}, {253, 231, 37} });
+    }
+
+    static Palette inferno() {
+        return Palette::gradient({ {0, 0, 4}, {27, 12, 66}, {75, 12, 107}, {120, 28, 109}, {165, 44, 96},
+                                   {207, 68, 70}, {237, 105, 37}, {251, 154, 6}, {247, 208, 60}, {252, 255, 164} });
+    }
+
+    Palette palette() const {
+        if (kind == 2) return inferno();
+        if (kind == 3) return Palette::gradient({ start, end });
+        return viridis();
+    }
+
+    PointTransform transform() override { return PointTransform().palette(palette()); }
 };
 
 
 
-class Saturation : public Filter
+class Saturation : public PointFilter
 {
     double p;
 public:
-    Saturation(Image& img) : Filter(img) {};
+    Saturation(Image& img) : PointFilter(img) {};
     string getName() { return "Saturation"; };
     static string getId(){ return "23"; };
     HSV rgbToHsv(const RGB& rgb) {
@@ -1383,22 +1679,23 @@ public:
     }
 
 
-    void apply() override {
-        for (int i = 0; i < image.width; i++) {
-            for (int j = 0; j < image.height; j++) {
-                RGB color = { image(i, j, 0), image(i, j, 1), image(i, j, 2) };
+    PointTransform transform() override {
+        double percent = p;
+        return PointTransform().span([this, percent](unsigned char* rgb, size_t count) {
+            for (size_t i = 0; i < count; i++, rgb += 3) {
+                RGB color = { rgb[0], rgb[1], rgb[2] };
                 HSV hsv = rgbToHsv(color);
 
-                hsv.s *= (p / 100.0f);
+                hsv.s *= (percent / 100.0f);
                 hsv.s = min(max(hsv.s, 0.0f), 1.0f);
 
                 RGB newColor = hsvToRgb(hsv);
 
-                image(i, j, 0) = static_cast<unsigned char>(newColor.R);
-                image(i, j, 1) = static_cast<unsigned char>(newColor.G);
-                image(i, j, 2) = static_cast<unsigned char>(newColor.B);
+                rgb[0] = static_cast<unsigned char>(newColor.R);
+                rgb[1] = static_cast<unsigned char>(newColor.G);
+                rgb[2] = static_cast<unsigned char>(newColor.B);
             }
-        }
+        });
     };
 
     vector<FilterParam> getNeeds() {
@@ -1413,31 +1710,21 @@ public:
 
 
 
-class OldPhoto : public Filter
+class OldPhoto : public PointFilter
 {
     double p;
 public:
-    OldPhoto (Image& img) : Filter(img) {};
+    OldPhoto (Image& img) : PointFilter(img) {};
     string getName() { return "Old Photo"; };
     static string getId(){ return "24"; };
 
-    void apply() override {
-        for (int i = 0; i < image.width; i++)
-        {
-            for (int j = 0; j < image.height; j++)
-            {
-
-                int Nr = 0.4 * image(i, j, 0 ) + 0.75 * image(i, j, 1) + 0.2 * image(i, j, 2);
-                Nr = min(255, Nr);
-                int Ng = 0.35* image(i, j, 0)  + 0.7 * image(i, j, 1) + 0.15*image(i, j, 2);
-                Ng = min(255, Ng);
-                int Nb = 0.2 * image(i, j, 0) +  0.55*image(i, j, 1)  + 0.13* image(i, j, 2);
-                Nb = min(255, Nb);
-                image(i, j, 0) = Nr;
-                image(i, j, 1) = Ng;
-                image(i, j, 2) = Nb;
-            }
-        }
+    PointTransform transform() override {
+        ColorMatrix sepia = {{
+            { 0.4,  0.75, 0.2  },
+            { 0.35, 0.7,  0.15 },
+            { 0.2,  0.55, 0.13 }
+        }};
+        return PointTransform().matrix(sepia);
     }
 
     vector<FilterParam> getNeeds() {
@@ -1451,37 +1738,122 @@ public:
 #include <ctime>
 #include <algorithm>
 
+// Sprinkles bright grey flakes over about 3.3% of the pixels, the density of
+// the old rand()-based version (width * height / 30 flakes dropped at random,
+// 1 - e^(-1/30) of the pixels once overlaps are counted).
+//
+// Row y of the full picture draws from its own Philox substream: the gaps
+// between flakes are geometric, -30 ln(u) pixels, and each flake's grey is
+// 200..255. A row's flakes depend only on the seed and y, so the output for a
+// seed is the same whatever the thread count or tiling, and only the ~3% of
+// pixels that get a flake cost a draw.
 class Snow : public Filter
 {
-    double p;
+    uint64_t seed = 1;
+
+    static constexpr uint32_t stream = 0x536e6f77; // "Snow"
+
 public:
-    Snow(Image& img) : Filter(img) {
-        srand(time(0));
-    };
+    Snow(Image& img) : Filter(img) {};
     string getName() { return "Snow"; };
     static string getId(){ return "27"; };
 
-    void apply() override {
-        int numSnow = (image.width * image.height) / 30;
-        for (int i = 0; i < numSnow; i++) {
-            int x = rand() % image.width;
-            int y = rand() % image.height;
-
-            int snowValue = 200 + rand() % 56;
-
-            image(x, y, 0) = snowValue;
-            image(x, y, 1) = snowValue;
-            image(x, y, 2) = snowValue;
-
-        }
+    void setParam(const std::string& name, double value) {
+        if (name == "Seed") seed = uint64_t(max(0.0, value));
     }
 
     vector<FilterParam> getNeeds() {
-        return {
-        };
+        return { {"Seed", "int", "1", 0.0, 1000000.0} };
     }
-};
+    int tileHalo() override { return 0; }
 
+    void apply() override {
+        withRgb8(image, [&] {
+            auto snowRows = [&](int y0, int y1) {
+                for (int y = y0; y < y1; y++) {
+                    rng::Philox flakes(seed, stream, uint32_t(originY + y));
+                    unsigned char* row = image.imageData + size_t(y) * image.width * 3;
+                    // Replays the row from its left end, so a tile sees the
+                    // flakes the whole picture would have there.
+                    const int64_t end = int64_t(originX) + image.width;
+                    for (int64_t x = -1;;) {
+                        x += 1 + int64_t(-30 * log(flakes.uniformPositive()));
+                        if (x >= end) break;
+                        auto value = static_cast<unsigned char>(200 + flakes.below(56));
+                        if (x < originX) continue;
+                        unsigned char* at = row + (x - originX) * 3;
+                        at[0] = at[1] = at[2] = value;
+                    }
+                }
+            };
+
+            // Bands of rows on a few threads once the image is big enough to pay
+            // for them; every row's flakes are fixed, so the split is invisible.
+            const int bandRows = 256;
+            unsigned threads = min<unsigned>(ThreadPool::availableThreads(), unsigned(image.height / bandRows));
+            if (threads < 2 || size_t(image.width) * image.height < (size_t(1) << 22)) {
+                snowRows(0, image.height);
+                return;
+            }
+            ThreadPool pool(threads);
+            for (int y = 0; y < image.height; y += bandRows) {
+                pool.submit([=] { snowRows(y, min(image.height, y + bandRows)); });
+            }
+            pool.wait();
+        });
+    }
+};
 
 
+// Every filter the app offers, in menu order. Both the GUI and the command-line
+// tool build their filters from here.
+struct FilterEntry {
+    string id;
+    function<shared_ptr<Filter>(Image&)> create;
+};
 
+template <typename T>
+FilterEntry makeFilterEntry() {
+    return { T::getId(), [](Image& img) -> shared_ptr<Filter> { return make_shared<T>(img); } };
+}
+
+inline const vector<FilterEntry>& filterRegistry() {
+    static const vector<FilterEntry> entries = {
+        makeFilterEntry<GreyScale>(),
+        makeFilterEntry<WhiteAndBlack>(),
+        makeFilterEntry<Invert>(),
+        makeFilterEntry<Merge>(),
+        makeFilterEntry<Flip>(),
+        makeFilterEntry<Rotate>(),
+        makeFilterEntry<Brightness>(),
+        makeFilterEntry<Crop>(),
+        makeFilterEntry<Frame>(),
+        makeFilterEntry<EdgeDetection>(),
+        makeFilterEntry<Resize>(),
+        makeFilterEntry<Blur>(),
+        makeFilterEntry<Sunlight>(),
+        makeFilterEntry<OilPainting>(),
+        makeFilterEntry<OldTV>(),
+        makeFilterEntry<Night>(),
+        makeFilterEntry<Infrared>(),
+        makeFilterEntry<Skewing>(),
+        makeFilterEntry<Bloody>(),
+        makeFilterEntry<Grass>(),
+        makeFilterEntry<Sky>(),
+        makeFilterEntry<ArtisticBrush>(),
+        makeFilterEntry<OldPhoto>(),
+        makeFilterEntry<Gama>(),
+        makeFilterEntry<Saturation>(),
+        makeFilterEntry<HeatMap>(),
+        makeFilterEntry<Snow>(),
+        makeFilterEntry<Colormap>(),
+        makeFilterEntry<Median>(),
+        makeFilterEntry<Kuwahara>(),
+        makeFilterEntry<Bilateral>(),
+        makeFilterEntry<UnsharpMask>(),
+        makeFilterEntry<Clarity>(),
+        makeFilterEntry<Equalize>(),
+        makeFilterEntry<CLAHE>(),
+    };
+    return entries;
+}
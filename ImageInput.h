@@ -0,0 +1,306 @@
+/**
+ * @File  : ImageInput.h
+ * @brief : Memory-mapped image input: format detection from magic bytes,
+ *          header-only probing and decoding straight from the mapping.
+ *
+ * The format is taken from the file's first bytes rather than its extension,
+ * so "photo.JPG" or a PNG saved as ".jpg" load fine. probeImage() reads only
+ * the header, which lets callers size buffers and plan work before paying for
+ * a full decode.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <filesystem>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "JpegScaled.h"
+#include "PixelFormat.h"
+#include "Trace.h"
+#include "third_party/Image_Class.h"
+
+
+/**
+ * @class MappedFile
+ * @brief A whole file mapped read-only into memory.
+ */
+class MappedFile {
+    const unsigned char* mapping = nullptr;
+    size_t length = 0;
+#ifdef _WIN32
+    HANDLE file = INVALID_HANDLE_VALUE;
+    HANDLE mapHandle = nullptr;
+#else
+    int fd = -1;
+#endif
+
+public:
+    explicit MappedFile(const std::string& path) {
+#ifdef _WIN32
+        file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                           FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+        if (file == INVALID_HANDLE_VALUE) {
+            throw std::invalid_argument("Invalid filename, File Does not Exist");
+        }
+        LARGE_INTEGER fileSize;
+        GetFileSizeEx(file, &fileSize);
+        length = static_cast<size_t>(fileSize.QuadPart);
+        if (length > 0) {
+            mapHandle = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+            if (mapHandle != nullptr) {
+                mapping = static_cast<const unsigned char*>(MapViewOfFile(mapHandle, FILE_MAP_READ, 0, 0, 0));
+            }
+        }
+#else
+        fd = open(path.c_str(), O_RDONLY);
+        struct stat info;
+        if (fd < 0 || fstat(fd, &info) != 0 || !S_ISREG(info.st_mode)) {
+            close();
+            throw std::invalid_argument("Invalid filename, File Does not Exist");
+        }
+        length = static_cast<size_t>(info.st_size);
+        if (length > 0) {
+            void* mapped = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (mapped != MAP_FAILED) {
+                mapping = static_cast<const unsigned char*>(mapped);
+                madvise(mapped, length, MADV_SEQUENTIAL);
+            }
+        }
+#endif
+        if (length > 0 && mapping == nullptr) {
+            close();
+            throw std::runtime_error("Cannot map " + path);
+        }
+    }
+
+    ~MappedFile() { close(); }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    const unsigned char* data() const { return mapping; }
+    size_t size() const { return length; }
+
+private:
+    void close() {
+#ifdef _WIN32
+        if (mapping) UnmapViewOfFile(mapping);
+        if (mapHandle) CloseHandle(mapHandle);
+        if (file != INVALID_HANDLE_VALUE) CloseHandle(file);
+        mapHandle = nullptr;
+        file = INVALID_HANDLE_VALUE;
+#else
+        if (mapping) munmap(const_cast<unsigned char*>(mapping), length);
+        if (fd >= 0) ::close(fd);
+        fd = -1;
+#endif
+        mapping = nullptr;
+    }
+};
+
+
+/**
+ * @brief Container formats stb_image can decode.
+ */
+enum class ImageFormat { Unknown, Png, Jpeg, Bmp, Gif, Tga, Ppm, Psd, Hdr };
+
+inline const char* formatName(ImageFormat format) {
+    switch (format) {
+        case ImageFormat::Png: return "PNG";
+        case ImageFormat::Jpeg: return "JPEG";
+        case ImageFormat::Bmp: return "BMP";
+        case ImageFormat::Gif: return "GIF";
+        case ImageFormat::Tga: return "TGA";
+        case ImageFormat::Ppm: return "PPM";
+        case ImageFormat::Psd: return "PSD";
+        case ImageFormat::Hdr: return "HDR";
+        default: return "unknown";
+    }
+}
+
+/**
+ * @brief Identifies the format from the leading bytes.
+ *
+ * TGA has no signature, so a file is only taken for a targa when it carries
+ * the TGA 2.0 footer, or when pathHint ends in ".tga" and the header looks sane.
+ */
+inline ImageFormat sniffFormat(const unsigned char* data, size_t size, const std::string& pathHint = "") {
+    auto startsWith = [&](const char* magic, size_t n) { return size >= n && memcmp(data, magic, n) == 0; };
+
+    if (startsWith("\x89PNG\r\n\x1a\n", 8)) return ImageFormat::Png;
+    if (startsWith("\xFF\xD8\xFF", 3)) return ImageFormat::Jpeg;
+    if (startsWith("BM", 2)) return ImageFormat::Bmp;
+    if (startsWith("GIF87a", 6) || startsWith("GIF89a", 6)) return ImageFormat::Gif;
+    if (startsWith("8BPS", 4)) return ImageFormat::Psd;
+    if (startsWith("#?RADIANCE", 10) || startsWith("#?RGBE", 6)) return ImageFormat::Hdr;
+    if (size >= 3 && data[0] == 'P' && (data[1] == '5' || data[1] == '6') && isspace(data[2])) return ImageFormat::Ppm;
+
+    if (size >= 44 && memcmp(data + size - 18, "TRUEVISION-XFILE.", 17) == 0) return ImageFormat::Tga;
+    std::string ext = std::filesystem::path(pathHint).extension().string();
+    for (char& ch : ext) ch = static_cast<char>(tolower(static_cast<unsigned char>(ch)));
+    if (ext == ".tga" && size >= 18) {
+        int colorMapType = data[1];
+        int imageType = data[2];
+        bool knownType = imageType == 1 || imageType == 2 || imageType == 3 ||
+                         imageType == 9 || imageType == 10 || imageType == 11;
+        if (colorMapType <= 1 && knownType) return ImageFormat::Tga;
+    }
+    return ImageFormat::Unknown;
+}
+
+/**
+ * @struct ImageHeader
+ * @brief What probeImage() learns without decoding any pixels.
+ */
+struct ImageHeader {
+    ImageFormat format = ImageFormat::Unknown;
+    int width = 0;
+    int height = 0;
+    int channels = 0; ///< Channels stored in the file (2 and 4 carry alpha).
+    int bitsPerSample = 8;
+};
+
+/**
+ * @brief The format that keeps what the file stores: RGB16 for 16-bit files
+ *        (alpha, if any, is dropped), RGBA8 for files with alpha, else RGB8.
+ */
+inline PixelFormat nativePixelFormat(const ImageHeader& header) {
+    if (header.bitsPerSample > 8) return PixelFormat::RGB16;
+    if (header.channels == 2 || header.channels == 4) return PixelFormat::RGBA8;
+    return PixelFormat::RGB8;
+}
+
+inline ImageHeader probeImage(const MappedFile& file, const std::string& path) {
+    ImageHeader header;
+    header.format = sniffFormat(file.data(), file.size(), path);
+    if (header.format == ImageFormat::Unknown) {
+        throw std::invalid_argument("Unrecognised image format: " + path);
+    }
+    if (!stbi_info_from_memory(file.data(), static_cast<int>(file.size()),
+                               &header.width, &header.height, &header.channels)) {
+        throw std::invalid_argument("Corrupt " + std::string(formatName(header.format)) + " header: " + path);
+    }
+    if (stbi_is_16_bit_from_memory(file.data(), static_cast<int>(file.size()))) header.bitsPerSample = 16;
+    return header;
+}
+
+/**
+ * @brief Reads only the header of path: format, dimensions and channels.
+ */
+inline ImageHeader probeImage(const std::string& path) {
+    MappedFile file(path);
+    return probeImage(file, path);
+}
+
+/**
+ * @brief Decodes path straight from its mapping into an Image of the given format.
+ */
+inline Image decodeImage(const std::string& path, PixelFormat format = PixelFormat::RGB8) {
+    trace::Scope scope("decode", "decode");
+    scope.setDetail(path);
+    MappedFile file(path);
+    probeImage(file, path);
+    Image image;
+    image.loadFromMemory(file.data(), file.size(), format);
+    return image;
+}
+
+/**
+ * @brief Area-averaging resize: each output pixel is the mean of the source
+ *        pixels it covers. Used for downscaling only.
+ */
+inline Image boxResize(const Image& source, int width, int height) {
+    trace::Scope scope("scale", "box resize");
+    Image result(width, height);
+    std::vector<int> columnStart(width + 1);
+    for (int x = 0; x <= width; x++) columnStart[x] = int((long long)x * source.width / width);
+
+    std::vector<unsigned> sums(size_t(width) * 3);
+    for (int y = 0; y < height; y++) {
+        int top = int((long long)y * source.height / height);
+        int bottom = std::max(top + 1, int((long long)(y + 1) * source.height / height));
+        std::fill(sums.begin(), sums.end(), 0u);
+        for (int sy = top; sy < bottom; sy++) {
+            const unsigned char* row = source.imageData + size_t(sy) * source.width * 3;
+            for (int x = 0; x < width; x++) {
+                int right = std::max(columnStart[x] + 1, columnStart[x + 1]);
+                for (int sx = columnStart[x]; sx < right; sx++) {
+                    for (int c = 0; c < 3; c++) sums[x * 3 + c] += row[sx * 3 + c];
+                }
+            }
+        }
+        unsigned char* out = result.imageData + size_t(y) * width * 3;
+        for (int x = 0; x < width; x++) {
+            unsigned count = unsigned(bottom - top) * unsigned(std::max(columnStart[x] + 1, columnStart[x + 1]) - columnStart[x]);
+            for (int c = 0; c < 3; c++) out[x * 3 + c] = static_cast<unsigned char>((sums[x * 3 + c] + count / 2) / count);
+        }
+    }
+    return result;
+}
+
+/**
+ * @brief Largest scale (1, 2, 4 or 8) that keeps a width x height image at
+ *        least maxWidth x maxHeight once scaled to fit, i.e. never upscaled on screen.
+ */
+inline int previewScaleFor(int width, int height, int maxWidth, int maxHeight) {
+    if (maxWidth <= 0 || maxHeight <= 0) return 1;
+    double fit = std::min(double(width) / maxWidth, double(height) / maxHeight);
+    int scale = 1;
+    while (scale < 8 && fit >= scale * 2) scale *= 2;
+    return scale;
+}
+
+/**
+ * @brief Decodes path at 1/scale size (scale 1, 2, 4 or 8).
+ *
+ * JPEGs are reduced in the DCT domain; other formats, and JPEGs the scaled
+ * decoder cannot handle (12-bit or arithmetic-coded, say), are decoded in full
+ * and box-averaged down to the same ceil(width / scale) x ceil(height / scale).
+ */
+inline Image decodeImageScaled(const std::string& path, int scale) {
+    if (scale <= 1) return decodeImage(path);
+    trace::Scope scope("decode", "decode scaled");
+    scope.setDetail(path + " at 1/" + std::to_string(scale));
+    MappedFile file(path);
+    ImageHeader header = probeImage(file, path);
+    Image image;
+    if (header.format == ImageFormat::Jpeg && decodeJpegScaled(file.data(), file.size(), scale, image)) {
+        return image;
+    }
+    image.loadFromMemory(file.data(), file.size());
+    return boxResize(image, (image.width + scale - 1) / scale, (image.height + scale - 1) / scale);
+}
+
+/**
+ * @brief Decodes path as a thumbnail whose longer side is at most maxSide.
+ *
+ * Decodes at the coarsest scale that still covers maxSide, then box-averages
+ * the rest of the way. Images already small enough are returned as decoded.
+ */
+inline Image decodeThumbnail(const std::string& path, int maxSide) {
+    ImageHeader header = probeImage(path);
+    int scale = previewScaleFor(header.width, header.height, maxSide, maxSide);
+    Image image = decodeImageScaled(path, scale);
+    int longest = std::max(image.width, image.height);
+    if (longest <= maxSide) return image;
+    int width = std::max(1, int((long long)image.width * maxSide / longest));
+    int height = std::max(1, int((long long)image.height * maxSide / longest));
+    return boxResize(image, width, height);
+}
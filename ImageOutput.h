@@ -0,0 +1,701 @@
+/**
+ * @File  : ImageOutput.h
+ * @brief : Image encoding with explicit JPEG quality and PNG compression, and a
+ *          PNG writer that filters and deflates on several threads.
+ *
+ * The PNG data is cut into bands of rows that are filtered and deflated
+ * independently, each primed with the 32 KB of filtered data in front of it.
+ * Every band ends on a byte boundary (an empty stored block) and is written as
+ * its own IDAT chunk, so the bands join into one valid zlib stream, the same
+ * way pigz joins its blocks. Band size does not depend on the thread count,
+ * so the file is identical however many threads encode it.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "PixelFormat.h"
+#include "ThreadPool.h"
+#include "Trace.h"
+#include "third_party/Image_Class.h"
+
+
+/**
+ * @struct EncodeOptions
+ * @brief How encodeImage() writes each format.
+ */
+struct EncodeOptions {
+    int jpegQuality = 90;   ///< 1 (smallest) to 100 (best)
+    int pngCompression = 6; ///< 0 (stored, fastest) to 9 (smallest)
+    unsigned threads = ThreadPool::defaultThreadCount(); ///< PNG encoding threads
+};
+
+
+namespace pngwriter {
+
+inline uint32_t crc32(uint32_t crc, const unsigned char* data, size_t size) {
+    static const std::vector<uint32_t> table = [] {
+        std::vector<uint32_t> t(256);
+        for (uint32_t n = 0; n < 256; n++) {
+            uint32_t c = n;
+            for (int k = 0; k < 8; k++) c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            t[n] = c;
+        }
+        return t;
+    }();
+    crc = ~crc;
+    for (size_t i = 0; i < size; i++) crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+    return ~crc;
+}
+
+constexpr uint32_t adlerBase = 65521;
+
+inline uint32_t adler32(const unsigned char* data, size_t size) {
+    uint32_t s1 = 1, s2 = 0;
+    while (size > 0) {
+        size_t block = std::min<size_t>(size, 5552);
+        for (size_t i = 0; i < block; i++) {
+            s1 += data[i];
+            s2 += s1;
+        }
+        s1 %= adlerBase;
+        s2 %= adlerBase;
+        data += block;
+        size -= block;
+    }
+    return (s2 << 16) | s1;
+}
+
+// Adler-32 of A followed by B, from the checksums of each (as zlib's adler32_combine).
+inline uint32_t adler32Combine(uint32_t adlerA, uint32_t adlerB, size_t lengthB) {
+    uint32_t remainder = uint32_t(lengthB % adlerBase);
+    uint32_t sum1 = adlerA & 0xFFFF;
+    uint32_t sum2 = uint32_t((uint64_t(remainder) * sum1) % adlerBase);
+    sum1 += (adlerB & 0xFFFF) + adlerBase - 1;
+    sum2 += (adlerA >> 16) + (adlerB >> 16) + adlerBase - remainder;
+    if (sum1 >= adlerBase) sum1 -= adlerBase;
+    if (sum1 >= adlerBase) sum1 -= adlerBase;
+    if (sum2 >= 2 * adlerBase) sum2 -= 2 * adlerBase;
+    if (sum2 >= adlerBase) sum2 -= adlerBase;
+    return (sum2 << 16) | sum1;
+}
+
+inline int paeth(int a, int b, int c) {
+    int pa = abs(b - c), pb = abs(a - c), pc = abs(a + b - 2 * c);
+    return (pa <= pb && pa <= pc) ? a : (pb <= pc ? b : c);
+}
+
+/**
+ * @brief Writes one filtered row (filter byte + rowBytes) to out, choosing the
+ *        filter with the smallest sum of absolute residuals, as stb does.
+ *        Bpp is the bytes per pixel; for the first row, above points at zeros.
+ */
+template <int Bpp>
+void filterRow(const unsigned char* row, const unsigned char* above, int rowBytes, unsigned char* out) {
+    // The first pixel has no left neighbours, so its bytes predict from 0.
+    const int first = std::min(Bpp, rowBytes);
+    auto residual = [](int value) { return abs(static_cast<signed char>(value)); };
+
+    long cost[5] = {};
+    for (int i = 0; i < first; i++) {
+        int x = row[i], b = above[i];
+        cost[0] += residual(x);
+        cost[1] += residual(x);
+        cost[2] += residual(x - b);
+        cost[3] += residual(x - (b >> 1));
+        cost[4] += residual(x - b);
+    }
+    for (int i = first; i < rowBytes; i++) {
+        int x = row[i], a = row[i - Bpp], b = above[i], c = above[i - Bpp];
+        cost[0] += residual(x);
+        cost[1] += residual(x - a);
+        cost[2] += residual(x - b);
+        cost[3] += residual(x - ((a + b) >> 1));
+        cost[4] += residual(x - paeth(a, b, c));
+    }
+    int type = int(std::min_element(cost, cost + 5) - cost);
+
+    out[0] = static_cast<unsigned char>(type);
+    unsigned char* filtered = out + 1;
+    if (type == 0) {
+        memcpy(filtered, row, rowBytes);
+        return;
+    }
+    for (int i = 0; i < first; i++) {
+        int b = above[i];
+        filtered[i] = static_cast<unsigned char>(row[i] - (type == 1 ? 0 : type == 3 ? b >> 1 : b));
+    }
+    switch (type) {
+        case 1: for (int i = first; i < rowBytes; i++) filtered[i] = static_cast<unsigned char>(row[i] - row[i - Bpp]); break;
+        case 2: for (int i = first; i < rowBytes; i++) filtered[i] = static_cast<unsigned char>(row[i] - above[i]); break;
+        case 3: for (int i = first; i < rowBytes; i++) filtered[i] = static_cast<unsigned char>(row[i] - ((row[i - Bpp] + above[i]) >> 1)); break;
+        default:
+            for (int i = first; i < rowBytes; i++) {
+                filtered[i] = static_cast<unsigned char>(row[i] - paeth(row[i - Bpp], above[i], above[i - Bpp]));
+            }
+            break;
+    }
+}
+
+
+/**
+ * @class BitWriter
+ * @brief LSB-first bit packer for deflate.
+ */
+class BitWriter {
+    std::vector<unsigned char>& out;
+    uint64_t buffer = 0;
+    int count = 0;
+
+public:
+    explicit BitWriter(std::vector<unsigned char>& target) : out(target) {}
+
+    void put(uint32_t value, int bits) {
+        buffer |= uint64_t(value) << count;
+        count += bits;
+        if (count >= 32) {
+            for (int i = 0; i < 4; i++) out.push_back(static_cast<unsigned char>(buffer >> (8 * i)));
+            buffer >>= 32;
+            count -= 32;
+        }
+    }
+
+    // Pads with zero bits to the next byte boundary.
+    void align() {
+        while (count > 0) {
+            out.push_back(static_cast<unsigned char>(buffer));
+            buffer >>= 8;
+            count = std::max(0, count - 8);
+        }
+        buffer = 0;
+    }
+};
+
+/**
+ * @brief Fixed-Huffman codes (already bit-reversed) and the length and
+ *        distance alphabets of RFC 1951.
+ */
+struct FixedCodes {
+    uint16_t literalCode[288];
+    uint8_t literalBits[288];
+    uint8_t distanceCode[30];
+    uint16_t lengthSymbol[259]; ///< Indexed by match length 3..258.
+    uint16_t lengthBase[29];
+    uint8_t lengthExtra[29];
+    uint16_t distanceBase[30];
+    uint8_t distanceExtra[30];
+    uint8_t distanceLookup[512]; ///< Distance code for d - 1 < 256, then by (d - 1) >> 7.
+
+    static uint32_t reverse(uint32_t code, int bits) {
+        uint32_t result = 0;
+        for (int i = 0; i < bits; i++, code >>= 1) result = (result << 1) | (code & 1);
+        return result;
+    }
+
+    FixedCodes() {
+        for (int n = 0; n < 288; n++) {
+            int bits = n <= 143 ? 8 : n <= 255 ? 9 : n <= 279 ? 7 : 8;
+            uint32_t code = n <= 143 ? 0x30 + n : n <= 255 ? 0x190 + n - 144 : n <= 279 ? n - 256 : 0xC0 + n - 280;
+            literalCode[n] = static_cast<uint16_t>(reverse(code, bits));
+            literalBits[n] = static_cast<uint8_t>(bits);
+        }
+        for (int n = 0; n < 30; n++) distanceCode[n] = static_cast<uint8_t>(reverse(n, 5));
+
+        static const uint16_t lengths[29] = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+                                              35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+        static const uint16_t distances[30] = { 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257,
+                                                385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+        for (int i = 0; i < 29; i++) {
+            lengthBase[i] = lengths[i];
+            lengthExtra[i] = static_cast<uint8_t>(i < 8 || i == 28 ? 0 : (i - 4) / 4);
+            int end = i == 28 ? 259 : lengths[i + 1];
+            for (int length = lengths[i]; length < end; length++) lengthSymbol[length] = static_cast<uint16_t>(i);
+        }
+        for (int i = 0; i < 30; i++) {
+            distanceBase[i] = distances[i];
+            distanceExtra[i] = static_cast<uint8_t>(i < 4 ? 0 : (i - 2) / 2);
+            int end = i == 29 ? 32769 : distances[i + 1];
+            for (int d = distances[i]; d < end; d++) {
+                distanceLookup[d - 1 < 256 ? d - 1 : 256 + ((d - 1) >> 7)] = static_cast<uint8_t>(i);
+            }
+        }
+    }
+
+    int distanceIndex(int distance) const {
+        return distanceLookup[distance - 1 < 256 ? distance - 1 : 256 + ((distance - 1) >> 7)];
+    }
+};
+
+inline const FixedCodes& fixedCodes() {
+    static const FixedCodes codes;
+    return codes;
+}
+
+/**
+ * @brief Deflates data[begin, end) with fixed Huffman codes, allowing matches
+ *        back into data[0, begin) (up to the 32 KB window).
+ *
+ * Ends with the final-block bit set when last, otherwise with an empty stored
+ * block, so the next band can be appended at a byte boundary.
+ */
+inline void deflateBand(const unsigned char* data, size_t begin, size_t end, int level, bool last,
+                        std::vector<unsigned char>& out) {
+    constexpr int window = 32768;
+    constexpr int hashBits = 15;
+    // zlib's per-level search limits: stop early once a match is this good,
+    // only try a lazy match below this length, stop at this length, chain depth.
+    struct Tuning { int good, lazy, nice, chain; };
+    static const Tuning tunings[10] = { { 0, 0, 0, 0 },         { 4, 4, 8, 4 },       { 4, 5, 16, 8 },
+                                        { 4, 6, 32, 32 },       { 4, 4, 16, 16 },     { 8, 16, 32, 32 },
+                                        { 8, 16, 128, 128 },    { 8, 32, 128, 256 },  { 32, 128, 258, 1024 },
+                                        { 32, 258, 258, 4096 } };
+    const FixedCodes& codes = fixedCodes();
+    BitWriter bits(out);
+
+    if (level <= 0) {
+        size_t pos = begin;
+        do {
+            size_t length = std::min<size_t>(end - pos, 65535);
+            bool final = last && pos + length == end;
+            out.push_back(final ? 1 : 0);
+            out.push_back(static_cast<unsigned char>(length));
+            out.push_back(static_cast<unsigned char>(length >> 8));
+            out.push_back(static_cast<unsigned char>(~length));
+            out.push_back(static_cast<unsigned char>(~length >> 8));
+            out.insert(out.end(), data + pos, data + pos + length);
+            pos += length;
+        } while (pos < end);
+        return;
+    }
+
+    const Tuning tuning = tunings[std::min(level, 9)];
+    const bool lazy = level >= 4;
+
+    std::vector<int> head(size_t(1) << hashBits, -1);
+    std::vector<int> previous(window, -1);
+    auto hashAt = [&](size_t pos) {
+        uint32_t v = data[pos] | (data[pos + 1] << 8) | (data[pos + 2] << 16);
+        return (v * 2654435761u) >> (32 - hashBits);
+    };
+    auto insert = [&](size_t pos) {
+        if (pos + 3 > end) return;
+        uint32_t h = hashAt(pos);
+        previous[pos & (window - 1)] = head[h];
+        head[h] = int(pos);
+    };
+    auto matchLength = [&](size_t a, size_t b, size_t limit) {
+        size_t n = 0;
+        while (n + 8 <= limit) {
+            uint64_t x, y;
+            memcpy(&x, data + a + n, 8);
+            memcpy(&y, data + b + n, 8);
+            if (x != y) break;
+            n += 8;
+        }
+        while (n < limit && data[a + n] == data[b + n]) n++;
+        return n;
+    };
+    // Longest match at pos that beats atLeast, or 0.
+    auto longestMatch = [&](size_t pos, int atLeast, int& distance) {
+        size_t limit = std::min<size_t>(258, end - pos);
+        if (limit < 3 || size_t(atLeast) >= limit) return 0;
+        int best = std::max(2, atLeast);
+        int candidate = head[hashAt(pos)];
+        int chain = atLeast >= tuning.good ? tuning.chain / 4 : tuning.chain;
+        for (; candidate >= 0 && chain > 0; chain--) {
+            size_t gap = pos - size_t(candidate);
+            if (gap > size_t(window)) break;
+            if (data[candidate + best] == data[pos + best]) {
+                int length = int(matchLength(size_t(candidate), pos, limit));
+                if (length > best) {
+                    best = length;
+                    distance = int(gap);
+                    if (length >= tuning.nice || size_t(length) == limit) break;
+                }
+            }
+            int next = previous[candidate & (window - 1)];
+            if (next >= candidate) break;
+            candidate = next;
+        }
+        return best > std::max(2, atLeast) ? best : 0;
+    };
+    auto literal = [&](unsigned char value) { bits.put(codes.literalCode[value], codes.literalBits[value]); };
+    auto match = [&](int length, int distance) {
+        int lengthIndex = codes.lengthSymbol[length];
+        bits.put(codes.literalCode[257 + lengthIndex], codes.literalBits[257 + lengthIndex]);
+        if (codes.lengthExtra[lengthIndex]) bits.put(length - codes.lengthBase[lengthIndex], codes.lengthExtra[lengthIndex]);
+        int distanceIndex = codes.distanceIndex(distance);
+        bits.put(codes.distanceCode[distanceIndex], 5);
+        if (codes.distanceExtra[distanceIndex]) bits.put(distance - codes.distanceBase[distanceIndex], codes.distanceExtra[distanceIndex]);
+    };
+
+    for (size_t pos = begin > size_t(window) ? begin - window : 0; pos < begin; pos++) insert(pos);
+
+    bits.put(last ? 1 : 0, 1);
+    bits.put(1, 2); // fixed Huffman
+
+    // Lazy matching as zlib does it: a short match is held back one byte in
+    // case the next position starts a longer one.
+    int heldLength = 0, heldDistance = 0;
+    bool holding = false;
+    size_t pos = begin;
+    while (pos < end) {
+        int distance = 0;
+        int length = longestMatch(pos, holding ? heldLength : 0, distance);
+        insert(pos);
+        if (holding) {
+            if (heldLength >= 3 && heldLength >= length) {
+                match(heldLength, heldDistance);
+                size_t matchEnd = pos - 1 + heldLength;
+                for (size_t p = pos + 1; p < matchEnd; p++) insert(p);
+                pos = matchEnd;
+                holding = false;
+                continue;
+            }
+            literal(data[pos - 1]);
+            holding = false;
+        }
+        if (lazy && length < tuning.lazy) {
+            heldLength = length;
+            heldDistance = distance;
+            holding = true;
+            pos++;
+        } else if (length >= 3) {
+            match(length, distance);
+            // Like zlib's fast levels, long greedy matches are not indexed inside.
+            if (lazy || length <= tuning.lazy) {
+                for (size_t p = pos + 1; p < pos + length; p++) insert(p);
+            }
+            pos += length;
+        } else {
+            literal(data[pos]);
+            pos++;
+        }
+    }
+    if (holding) {
+        if (heldLength >= 3) match(heldLength, heldDistance);
+        else literal(data[end - 1]);
+    }
+
+    bits.put(codes.literalCode[256], codes.literalBits[256]);
+    if (!last) bits.put(0, 3); // empty stored block: realigns the stream for the next band
+    bits.align();
+    if (!last) {
+        out.push_back(0x00);
+        out.push_back(0x00);
+        out.push_back(0xFF);
+        out.push_back(0xFF);
+    }
+}
+
+inline void putBigEndian(std::vector<unsigned char>& out, uint32_t value) {
+    for (int shift = 24; shift >= 0; shift -= 8) out.push_back(static_cast<unsigned char>(value >> shift));
+}
+
+// Appends a PNG chunk: length, type, data and the CRC over type and data.
+inline void putChunk(std::vector<unsigned char>& out, const char* type, const unsigned char* data, size_t size) {
+    putBigEndian(out, uint32_t(size));
+    size_t typeAt = out.size();
+    out.insert(out.end(), type, type + 4);
+    if (size) out.insert(out.end(), data, data + size);
+    putBigEndian(out, crc32(0, out.data() + typeAt, size + 4));
+}
+
+// Appends the PNG signature and IHDR chunk.
+inline void putHeader(std::vector<unsigned char>& out, int width, int height, int bitDepth, int colourType) {
+    const unsigned char signature[] = { 137, 80, 78, 71, 13, 10, 26, 10 };
+    out.insert(out.end(), signature, signature + sizeof(signature));
+    unsigned char header[13] = {};
+    for (int i = 0; i < 4; i++) {
+        header[i] = static_cast<unsigned char>(uint32_t(width) >> (24 - 8 * i));
+        header[4 + i] = static_cast<unsigned char>(uint32_t(height) >> (24 - 8 * i));
+    }
+    header[8] = static_cast<unsigned char>(bitDepth);
+    header[9] = static_cast<unsigned char>(colourType);
+    putChunk(out, "IHDR", header, sizeof(header));
+}
+
+/**
+ * @struct BandLayout
+ * @brief How the filtered rows of an image are cut into deflate bands: about
+ *        1 MB each, primed with the rows covering the 32 KB window before them.
+ */
+struct BandLayout {
+    size_t filteredRow; ///< Filter byte + row bytes
+    int rowsPerBand;
+    int primeRows;
+    int bandCount;
+
+    BandLayout(int rowBytes, int height)
+        : filteredRow(size_t(rowBytes) + 1),
+          rowsPerBand(int(std::max<size_t>(1, (size_t(1) << 20) / filteredRow))),
+          primeRows(int((32768 + filteredRow - 1) / filteredRow)),
+          bandCount(std::max(1, (height + rowsPerBand - 1) / rowsPerBand)) {}
+};
+
+/**
+ * @brief Encodes image as PNG at compression level 0-9 using up to threads
+ *        threads. RGBA8 is written with alpha and RGB16 as a 16-bit PNG.
+ */
+inline std::vector<unsigned char> encodePng(const Image& image, int level, unsigned threads) {
+    const int bytesPerPixel = image.channels * image.bytesPerSample();
+    const bool wideSamples = image.bytesPerSample() == 2;
+    const int rowBytes = image.width * bytesPerPixel;
+    const BandLayout layout(rowBytes, image.height);
+    const size_t filteredRow = layout.filteredRow;
+    const int rowsPerBand = layout.rowsPerBand;
+    const int primeRows = layout.primeRows;
+    const int bandCount = layout.bandCount;
+
+    struct Band {
+        std::vector<unsigned char> chunk; ///< Complete IDAT chunk for this band
+        uint32_t adler = 1;
+        size_t length = 0;
+    };
+    std::vector<Band> bands(bandCount);
+
+    auto encodeBand = [&](int index) {
+        int first = index * rowsPerBand;
+        int last = std::min(image.height, first + rowsPerBand);
+        int primed = std::max(0, first - primeRows);
+        std::vector<unsigned char> filtered(size_t(last - primed) * filteredRow);
+        std::vector<unsigned char> zeroRow(rowBytes, 0), bigEndian[3];
+
+        // PNG stores 16-bit samples big-endian, so wide rows go through a copy.
+        auto rowAt = [&](int y, std::vector<unsigned char>& buffer) -> const unsigned char* {
+            const unsigned char* row = image.imageData + size_t(y) * rowBytes;
+            if (!wideSamples) return row;
+            buffer.resize(rowBytes);
+            for (int i = 0; i < rowBytes; i += 2) {
+                uint16_t sample;
+                memcpy(&sample, row + i, 2);
+                buffer[i] = static_cast<unsigned char>(sample >> 8);
+                buffer[i + 1] = static_cast<unsigned char>(sample);
+            }
+            return buffer.data();
+        };
+        const unsigned char* above = primed > 0 ? rowAt(primed - 1, bigEndian[2]) : zeroRow.data();
+        for (int y = primed; y < last; y++) {
+            const unsigned char* row = rowAt(y, bigEndian[(y - primed) & 1]);
+            unsigned char* out = filtered.data() + size_t(y - primed) * filteredRow;
+            switch (bytesPerPixel) {
+                case 4: filterRow<4>(row, above, rowBytes, out); break;
+                case 6: filterRow<6>(row, above, rowBytes, out); break;
+                default: filterRow<3>(row, above, rowBytes, out); break;
+            }
+            above = row;
+        }
+
+        size_t begin = size_t(first - primed) * filteredRow;
+        Band& band = bands[index];
+        band.length = filtered.size() - begin;
+        band.adler = adler32(filtered.data() + begin, band.length);
+
+        std::vector<unsigned char> deflated;
+        if (index == 0) {
+            deflated.push_back(0x78); // deflate, 32 KB window
+            deflated.push_back(0x01);
+        }
+        deflateBand(filtered.data(), begin, filtered.size(), level, index == bandCount - 1, deflated);
+        putChunk(band.chunk, "IDAT", deflated.data(), deflated.size());
+    };
+
+    if (threads <= 1 || bandCount == 1) {
+        for (int i = 0; i < bandCount; i++) encodeBand(i);
+    } else {
+        ThreadPool pool(std::min<unsigned>(threads, unsigned(bandCount)));
+        for (int i = 0; i < bandCount; i++) pool.submit([&, i] { encodeBand(i); });
+        pool.wait();
+    }
+
+    std::vector<unsigned char> png;
+    putHeader(png, image.width, image.height, 8 * image.bytesPerSample(),
+              image.format == PixelFormat::RGBA8 ? 6 : 2); // RGBA or RGB
+
+    uint32_t adler = bands[0].adler;
+    for (int i = 1; i < bandCount; i++) adler = adler32Combine(adler, bands[i].adler, bands[i].length);
+    for (Band& band : bands) {
+        png.insert(png.end(), band.chunk.begin(), band.chunk.end());
+        std::vector<unsigned char>().swap(band.chunk);
+    }
+    unsigned char trailer[4] = { static_cast<unsigned char>(adler >> 24), static_cast<unsigned char>(adler >> 16),
+                                 static_cast<unsigned char>(adler >> 8), static_cast<unsigned char>(adler) };
+    putChunk(png, "IDAT", trailer, sizeof(trailer));
+    putChunk(png, "IEND", nullptr, 0);
+    return png;
+}
+
+/**
+ * @class RowEncoder
+ * @brief Writes an 8-bit RGB PNG to a file as its rows arrive.
+ *
+ * Rows are filtered as they come in and deflated in the same bands as
+ * encodePng(), up to threads bands at a time, so the file is identical to
+ * encodePng()'s and only those bands (plus the 32 KB in front of them) are
+ * held in memory.
+ */
+class RowEncoder {
+    FILE* file;
+    const int width;
+    const int height;
+    const int level;
+    const unsigned threads;
+    const BandLayout layout;
+    std::vector<unsigned char> filtered; ///< Filtered rows [bufferStart, received)
+    std::vector<unsigned char> above;    ///< The last row received, unfiltered
+    std::unique_ptr<ThreadPool> pool;
+    int bufferStart = 0;
+    int received = 0;
+    int nextBand = 0;
+    uint32_t adler = 1;
+    bool failed = false;
+
+    void write(const std::vector<unsigned char>& bytes) {
+        failed |= fwrite(bytes.data(), 1, bytes.size(), file) != bytes.size();
+    }
+
+    // Deflates and writes the bands that every received row completes.
+    void flushBands() {
+        int bandsReady = (received == height ? layout.bandCount : received / layout.rowsPerBand) - nextBand;
+        struct Band {
+            std::vector<unsigned char> chunk;
+            uint32_t adler = 1;
+            size_t length = 0;
+        };
+        std::vector<Band> bands(bandsReady);
+        auto encodeBand = [&](int i) {
+            int index = nextBand + i;
+            int first = index * layout.rowsPerBand;
+            int last = std::min(height, first + layout.rowsPerBand);
+            int primed = std::max(0, first - layout.primeRows);
+            const unsigned char* data = filtered.data() + size_t(primed - bufferStart) * layout.filteredRow;
+            size_t begin = size_t(first - primed) * layout.filteredRow, end = size_t(last - primed) * layout.filteredRow;
+            bands[i].length = end - begin;
+            bands[i].adler = adler32(data + begin, end - begin);
+            std::vector<unsigned char> deflated;
+            if (index == 0) {
+                deflated.push_back(0x78);
+                deflated.push_back(0x01);
+            }
+            deflateBand(data, begin, end, level, index == layout.bandCount - 1, deflated);
+            putChunk(bands[i].chunk, "IDAT", deflated.data(), deflated.size());
+        };
+        if (threads <= 1 || bandsReady == 1) {
+            for (int i = 0; i < bandsReady; i++) encodeBand(i);
+        } else {
+            if (!pool) pool = std::make_unique<ThreadPool>(threads);
+            for (int i = 0; i < bandsReady; i++) pool->submit([&, i] { encodeBand(i); });
+            pool->wait();
+        }
+        for (Band& band : bands) {
+            adler = nextBand == 0 ? band.adler : adler32Combine(adler, band.adler, band.length);
+            nextBand++;
+            write(band.chunk);
+        }
+
+        int keepFrom = std::max(0, received - layout.primeRows);
+        filtered.erase(filtered.begin(), filtered.begin() + size_t(keepFrom - bufferStart) * layout.filteredRow);
+        bufferStart = keepFrom;
+    }
+
+public:
+    RowEncoder(FILE* out, int w, int h, int compression, unsigned threadCount)
+        : file(out), width(w), height(h), level(std::clamp(compression, 0, 9)),
+          threads(std::max(1u, threadCount)), layout(w * 3, h), above(size_t(w) * 3, 0) {
+        std::vector<unsigned char> header;
+        putHeader(header, w, h, 8, 2);
+        write(header);
+        filtered.reserve(size_t(layout.primeRows + layout.rowsPerBand * int(threads)) * layout.filteredRow);
+    }
+
+    void writeRow(const unsigned char* rgb) {
+        if (received >= height) throw std::out_of_range("Wrote past the last row");
+        filtered.resize(filtered.size() + layout.filteredRow);
+        filterRow<3>(rgb, above.data(), width * 3, filtered.data() + filtered.size() - layout.filteredRow);
+        memcpy(above.data(), rgb, above.size());
+        received++;
+        if (received == height || received % (layout.rowsPerBand * int(threads)) == 0) flushBands();
+    }
+
+    /**
+     * @brief Writes the checksum and the end chunk.
+     * @return False if a row is missing or any write failed.
+     */
+    bool finish() {
+        if (received != height) return false;
+        std::vector<unsigned char> trailer;
+        unsigned char checksum[4] = { static_cast<unsigned char>(adler >> 24), static_cast<unsigned char>(adler >> 16),
+                                      static_cast<unsigned char>(adler >> 8), static_cast<unsigned char>(adler) };
+        putChunk(trailer, "IDAT", checksum, sizeof(checksum));
+        putChunk(trailer, "IEND", nullptr, 0);
+        write(trailer);
+        return !failed;
+    }
+};
+
+} // namespace pngwriter
+
+
+/**
+ * @brief Encodes image to path, picking the format from the extension
+ *        (.png, .jpg/.jpeg, .bmp or .tga, any case).
+ *
+ * PNG keeps the pixel format as is. JPEG is always written as 8-bit RGB, and
+ * BMP and TGA keep alpha but not 16-bit samples.
+ *
+ * @throws std::invalid_argument If the extension is missing or unsupported,
+ *         or the image is too large for a TGA.
+ * @throws std::runtime_error If the file cannot be written.
+ */
+inline void encodeImage(const Image& image, const std::string& path, const EncodeOptions& options = EncodeOptions()) {
+    std::string ext = std::filesystem::path(path).extension().string();
+    for (char& ch : ext) ch = static_cast<char>(tolower(static_cast<unsigned char>(ch)));
+    if (ext.empty()) throw std::invalid_argument("The file extension does not exist");
+
+    trace::Scope scope("encode", "encode " + ext.substr(1));
+    scope.setDetail(path);
+
+    Image narrowed;
+    const Image* source = &image;
+    auto narrowTo = [&](PixelFormat format) {
+        if (image.format == format) return;
+        narrowed = convertImage(image, format);
+        source = &narrowed;
+    };
+
+    bool written = false;
+    if (ext == ".png") {
+        std::vector<unsigned char> png =
+            pngwriter::encodePng(image, std::clamp(options.pngCompression, 0, 9), options.threads);
+        FILE* file = fopen(path.c_str(), "wb");
+        if (file) {
+            written = fwrite(png.data(), 1, png.size(), file) == png.size();
+            written = fclose(file) == 0 && written;
+        }
+    } else if (ext == ".jpg" || ext == ".jpeg") {
+        narrowTo(PixelFormat::RGB8);
+        written = stbi_write_jpg(path.c_str(), source->width, source->height, STBI_rgb, source->imageData,
+                                 std::clamp(options.jpegQuality, 1, 100)) != 0;
+    } else if (ext == ".bmp" || ext == ".tga") {
+        if (ext == ".tga" && (image.width > 0xFFFF || image.height > 0xFFFF)) {
+            throw std::invalid_argument("TGA images are at most 65535 pixels wide and high: " + path);
+        }
+        if (image.format == PixelFormat::RGB16) narrowTo(PixelFormat::RGB8);
+        auto write = ext == ".bmp" ? stbi_write_bmp : stbi_write_tga;
+        written = write(path.c_str(), source->width, source->height, source->channels, source->imageData) != 0;
+    } else {
+        throw std::invalid_argument("File Extension is not supported, Only .JPG, JPEG, .BMP, .PNG, .TGA are supported");
+    }
+    if (!written) throw std::runtime_error("Cannot write " + path);
+}
@@ -0,0 +1,119 @@
+/**
+ * @File  : ImageView.h
+ * @brief : Non-owning, strided views of a rectangle of an Image.
+ *
+ * A view is a pointer to its top-left pixel, a size and the parent's row
+ * stride, so taking one copies nothing: Crop is a view of the image until it
+ * is committed, and filters can run on a selection in place (PointTransform
+ * walks a view row by row; applyToView in Filters.h gives other filters the
+ * pixels they need around it). A view stays valid while the parent's buffer
+ * does, so do not keep one across anything that reallocates the parent.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+#include "third_party/Image_Class.h"
+
+
+struct ImageView {
+    unsigned char* data = nullptr;        ///< First byte of the top-left pixel
+    int width = 0, height = 0;
+    size_t stride = 0;                    ///< Bytes from one row to the next
+    PixelFormat format = PixelFormat::RGB8;
+    int x = 0, y = 0;                     ///< Top-left corner in the parent image
+
+    /**
+     * @brief The whole of image.
+     */
+    static ImageView of(Image& image) {
+        ImageView view;
+        view.data = image.imageData;
+        view.width = image.width;
+        view.height = image.height;
+        view.format = image.format;
+        view.stride = size_t(image.width) * view.pixelBytes();
+        return view;
+    }
+
+    size_t pixelBytes() const {
+        switch (format) {
+            case PixelFormat::RGBA8: return 4;
+            case PixelFormat::RGB16: return 6;
+            default: return 3;
+        }
+    }
+
+    size_t rowBytes() const { return size_t(width) * pixelBytes(); }
+    bool empty() const { return width <= 0 || height <= 0; }
+
+    /// True when the rows follow each other with no gap, as in a whole image.
+    bool contiguous() const { return stride == rowBytes() || height <= 1; }
+
+    unsigned char* row(int r) const { return data + size_t(r) * stride; }
+
+    /**
+     * @brief The w x h rectangle at (rx, ry) of this view.
+     * @throws std::out_of_range If the rectangle is empty or not inside the view.
+     */
+    ImageView region(int rx, int ry, int w, int h) const {
+        if (w <= 0 || h <= 0 || rx < 0 || ry < 0 || rx > width - w || ry > height - h) {
+            throw std::out_of_range("Region " + std::to_string(w) + "x" + std::to_string(h) + " at (" +
+                                    std::to_string(rx) + ", " + std::to_string(ry) + ") is not inside the " +
+                                    std::to_string(width) + "x" + std::to_string(height) + " image");
+        }
+        ImageView sub = *this;
+        sub.data = row(ry) + size_t(rx) * pixelBytes();
+        sub.width = w;
+        sub.height = h;
+        sub.x = x + rx;
+        sub.y = y + ry;
+        return sub;
+    }
+
+    /**
+     * @brief Copies the view into a new image of its own.
+     */
+    Image toImage() const {
+        Image image(width, height, format);
+        copyTo(image.imageData, rowBytes());
+        return image;
+    }
+
+    /**
+     * @brief Copies the view's rows out to dst, rows dstStride bytes apart.
+     */
+    void copyTo(unsigned char* dst, size_t dstStride) const {
+        for (int r = 0; r < height; r++) memcpy(dst + size_t(r) * dstStride, row(r), rowBytes());
+    }
+
+    /**
+     * @brief Overwrites the view with rows of src, srcStride bytes apart.
+     */
+    void copyFrom(const unsigned char* src, size_t srcStride) const {
+        for (int r = 0; r < height; r++) memcpy(row(r), src + size_t(r) * srcStride, rowBytes());
+    }
+};
+
+/**
+ * @brief Makes image hold only view, a view of image, without a new buffer:
+ *        the rows are moved to the front and the allocation is shrunk.
+ */
+inline void commitView(Image& image, const ImageView& view) {
+    if (view.empty() || view.format != image.format || view.data < image.imageData ||
+        view.data + (view.height - 1) * view.stride + view.rowBytes() > image.imageData + image.byteSize()) {
+        throw std::invalid_argument("commitView: the view is not of this image");
+    }
+    // Row r only ever moves towards the front, past rows already placed.
+    size_t rowBytes = view.rowBytes();
+    for (int r = 0; r < view.height; r++) memmove(image.imageData + size_t(r) * rowBytes, view.row(r), rowBytes);
+    image.width = view.width;
+    image.height = view.height;
+    if (void* shrunk = realloc(image.imageData, image.byteSize())) image.imageData = static_cast<unsigned char*>(shrunk);
+    image.charge.reset(image.byteSize());
+}
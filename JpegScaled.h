@@ -0,0 +1,734 @@
+/**
+ * @File  : JpegScaled.h
+ * @brief : JPEG decoder that decodes at 1/2, 1/4 or 1/8 scale in the DCT domain.
+ *
+ * Each 8x8 block is entropy-decoded as usual, but only its top-left NxN
+ * coefficients go through an N-point inverse DCT (N = 8 / scale). A 1/8 decode
+ * is one DC term per block, so it never runs an IDCT, never upsamples
+ * full-size chroma and never converts full-size colour. For progressive files
+ * the scans that only carry frequencies above N are skipped without being
+ * decoded, which for 1/8 means every AC scan.
+ *
+ * Handles Huffman-coded baseline, extended and progressive 8-bit files with
+ * any sampling factors, restart markers and grey or YCbCr/RGB components.
+ * Anything else (arithmetic coding, 12-bit, CMYK) makes decodeJpegScaled()
+ * return false so the caller can fall back to a full decode.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include "third_party/Image_Class.h"
+
+
+namespace jpegscaled {
+
+// Zigzag position -> natural (row-major) coefficient index.
+static const unsigned char zigzag[64] = {
+     0,  1,  8, 16,  9,  2,  3, 10, 17, 24, 32, 25, 18, 11,  4,  5,
+    12, 19, 26, 33, 40, 48, 41, 34, 27, 20, 13,  6,  7, 14, 21, 28,
+    35, 42, 49, 56, 57, 50, 43, 36, 29, 22, 15, 23, 30, 37, 44, 51,
+    58, 59, 52, 45, 38, 31, 39, 46, 53, 60, 61, 54, 47, 55, 62, 63,
+};
+
+struct Huffman {
+    static const int lookupBits = 9;
+    uint16_t lookup[1 << lookupBits] = {}; ///< (length << 8) | symbol, 0 when the code is longer.
+    int maxCode[17] = {};                 ///< Largest code of each length, -1 when none.
+    int valueOffset[17] = {};
+    unsigned char symbols[256] = {};
+    /// AC codes whose run/size symbol and magnitude both fit in lookupBits:
+    /// (value << 8) | (run << 4) | bits consumed, 0 otherwise.
+    int16_t fastAc[1 << lookupBits] = {};
+    bool defined = false;
+
+    bool build(const unsigned char* counts, const unsigned char* values, int total) {
+        if (total > 256) return false;
+        memcpy(symbols, values, total);
+        memset(lookup, 0, sizeof(lookup));
+        int code = 0, index = 0;
+        for (int length = 1; length <= 16; length++) {
+            valueOffset[length] = index - code;
+            // An oversubscribed length (more codes than it has room for) would
+            // fill lookup past its end.
+            if (code + counts[length - 1] > (1 << length)) return false;
+            for (int i = 0; i < counts[length - 1]; i++, index++, code++) {
+                if (length <= lookupBits) {
+                    int shift = lookupBits - length;
+                    for (int fill = 0; fill < (1 << shift); fill++) {
+                        lookup[(code << shift) | fill] = static_cast<uint16_t>((length << 8) | symbols[index]);
+                    }
+                }
+            }
+            maxCode[length] = counts[length - 1] ? code - 1 : -1;
+            code <<= 1;
+        }
+
+        for (int i = 0; i < (1 << lookupBits); i++) {
+            fastAc[i] = 0;
+            int length = lookup[i] >> 8, symbol = lookup[i] & 0xFF;
+            int run = symbol >> 4, magnitudeBits = symbol & 15;
+            if (length == 0 || magnitudeBits == 0 || length + magnitudeBits > lookupBits) continue;
+            int raw = (i >> (lookupBits - length - magnitudeBits)) & ((1 << magnitudeBits) - 1);
+            int value = raw < (1 << (magnitudeBits - 1)) ? raw - (1 << magnitudeBits) + 1 : raw;
+            if (value >= -128 && value <= 127) fastAc[i] = static_cast<int16_t>(value * 256 + run * 16 + length + magnitudeBits);
+        }
+        defined = true;
+        return true;
+    }
+};
+
+class BitReader {
+    const unsigned char* pos;
+    const unsigned char* end;
+    uint64_t buffer = 0; ///< Bits are consumed from the top.
+    int count = 0;
+    bool atMarker = false;
+
+public:
+    BitReader(const unsigned char* begin, const unsigned char* stop) : pos(begin), end(stop) {}
+
+    const unsigned char* position() const { return pos; }
+
+    void fill() {
+        // Fast path: four plain bytes in one go.
+        if (count <= 32 && !atMarker && end - pos >= 4 &&
+            pos[0] != 0xFF && pos[1] != 0xFF && pos[2] != 0xFF && pos[3] != 0xFF) {
+            uint64_t word = (uint64_t(pos[0]) << 24) | (uint64_t(pos[1]) << 16) | (uint64_t(pos[2]) << 8) | pos[3];
+            buffer |= word << (32 - count);
+            count += 32;
+            pos += 4;
+            return;
+        }
+        while (count <= 56) {
+            uint64_t byte = 0;
+            if (!atMarker && pos < end) {
+                byte = *pos++;
+                if (byte == 0xFF) {
+                    if (pos < end && *pos == 0x00) {
+                        pos++;
+                    } else {
+                        // A marker ends the entropy data; feed zeros from here on.
+                        atMarker = true;
+                        pos--;
+                        byte = 0;
+                    }
+                }
+            }
+            buffer |= byte << (56 - count);
+            count += 8;
+        }
+    }
+
+    int bits(int n) {
+        if (n == 0) return 0;
+        if (count < n) fill();
+        int value = static_cast<int>(buffer >> (64 - n));
+        buffer <<= n;
+        count -= n;
+        return value;
+    }
+
+    // Reads an n-bit magnitude and sign-extends it (JPEG's "EXTEND").
+    int receiveExtend(int n) {
+        int value = bits(n);
+        return value < (1 << (n - 1)) ? value - (1 << n) + 1 : value;
+    }
+
+    int decode(const Huffman& table) {
+        if (count < 16) fill();
+        int entry = table.lookup[buffer >> (64 - Huffman::lookupBits)];
+        if (entry) {
+            int length = entry >> 8;
+            buffer <<= length;
+            count -= length;
+            return entry & 0xFF;
+        }
+        int length = Huffman::lookupBits + 1;
+        int code = static_cast<int>(buffer >> (64 - length));
+        while (code > table.maxCode[length]) {
+            if (++length > 16) return -1;
+            code = static_cast<int>(buffer >> (64 - length));
+        }
+        buffer <<= length;
+        count -= length;
+        return table.symbols[code + table.valueOffset[length]];
+    }
+
+    // Decodes an AC run/size symbol together with its magnitude. Returns 1
+    // when value holds a coefficient preceded by run zeros, 0 for EOB/ZRL
+    // (told apart by run) and -1 for a bad code.
+    int decodeAc(const Huffman& table, int& run, int& value) {
+        if (count < 16) fill();
+        int fast = table.fastAc[buffer >> (64 - Huffman::lookupBits)];
+        if (fast) {
+            int length = fast & 15;
+            buffer <<= length;
+            count -= length;
+            run = (fast >> 4) & 15;
+            value = fast >> 8;
+            return 1;
+        }
+        int symbol = decode(table);
+        if (symbol < 0) return -1;
+        run = symbol >> 4;
+        if ((symbol & 15) == 0) return 0;
+        value = receiveExtend(symbol & 15);
+        return 1;
+    }
+
+    // Skips past the next RSTn marker and clears the bit buffer. Fails at any
+    // other marker rather than walking over it into the following segments.
+    bool restart() {
+        buffer = 0;
+        count = 0;
+        atMarker = false;
+        for (; pos + 1 < end; pos++) {
+            if (pos[0] != 0xFF || pos[1] == 0x00 || pos[1] == 0xFF) continue;
+            if (pos[1] < 0xD0 || pos[1] > 0xD7) return false;
+            pos += 2;
+            return true;
+        }
+        return false;
+    }
+};
+
+struct Component {
+    int id = 0;
+    int h = 1, v = 1;
+    int quant = 0;
+    int dcTable = 0, acTable = 0;
+    int dcPred = 0;
+    int blocksPerLine = 0;   ///< Blocks covering the component's own width.
+    int blocksPerColumn = 0;
+    int blocksWide = 0;      ///< Blocks per row including MCU padding.
+    int blocksHigh = 0;
+    std::vector<int16_t> coefficients; ///< Progressive only: quantized, zigzag order, `stride` per block.
+    int planeWidth = 0;      ///< blocksWide * N reduced samples.
+    std::vector<unsigned char> plane;
+};
+
+// Rounds and clamps to a sample; cheaper than lround() in the per-pixel loops.
+inline unsigned char toSample(float value) {
+    value += 0.5f;
+    return static_cast<unsigned char>(value <= 0.0f ? 0 : value >= 255.0f ? 255 : static_cast<int>(value));
+}
+
+class Decoder {
+    const unsigned char* data;
+    size_t size;
+    int scale;
+    int outSize;     ///< Samples per block edge after scaling: 8 / scale.
+    int lastNeeded;  ///< Highest zigzag index that lands inside the NxN corner.
+    int stride;      ///< Coefficients stored per block.
+
+    uint16_t quant[4][64] = {};
+    Huffman dc[4], ac[4];
+    std::vector<Component> components;
+    int width = 0, height = 0;
+    int hMax = 1, vMax = 1;
+    int mcusX = 0, mcusY = 0;
+    int restartInterval = 0;
+    int adobeTransform = -1;
+    bool progressive = false;
+    bool frameSeen = false;
+    int eobRun = 0;
+    /// A progressive scan's header: its component (-1 when interleaved), band
+    /// and successive-approximation high bit.
+    struct Band {
+        int component, start, stop, high;
+        bool operator==(const Band& other) const {
+            return component == other.component && start == other.start && stop == other.stop && high == other.high;
+        }
+    };
+    std::vector<Band> bands;      ///< Per scan, in file order; see planScans().
+    std::vector<bool> scanNeeded;
+    size_t scanIndex = 0;
+    float idctTable[4][4] = {}; ///< 0.5 * C(u) * cos((2x + 1) u pi / 2N) for x, u < N.
+
+    static int readU16(const unsigned char* p) { return (p[0] << 8) | p[1]; }
+
+    bool readQuant(const unsigned char* p, int length) {
+        while (length > 0) {
+            int precision = p[0] >> 4, id = p[0] & 15;
+            int bytes = 1 + 64 * (precision ? 2 : 1);
+            if (id > 3 || length < bytes) return false;
+            for (int k = 0; k < 64; k++) quant[id][k] = precision ? readU16(p + 1 + 2 * k) : p[1 + k];
+            p += bytes;
+            length -= bytes;
+        }
+        return true;
+    }
+
+    bool readHuffman(const unsigned char* p, int length) {
+        while (length > 17) {
+            int tableClass = p[0] >> 4, id = p[0] & 15;
+            if (id > 3 || tableClass > 1) return false;
+            int total = 0;
+            for (int i = 0; i < 16; i++) total += p[1 + i];
+            if (length < 17 + total) return false;
+            Huffman& table = tableClass ? ac[id] : dc[id];
+            if (!table.build(p + 1, p + 17, total)) return false;
+            p += 17 + total;
+            length -= 17 + total;
+        }
+        return length == 0;
+    }
+
+    bool readFrame(const unsigned char* p, int length) {
+        if (length < 6 || p[0] != 8) return false;
+        height = readU16(p + 1);
+        width = readU16(p + 3);
+        int count = p[5];
+        if (width == 0 || height == 0 || (count != 1 && count != 3) || length < 6 + 3 * count) return false;
+        for (int i = 0; i < count; i++) {
+            Component component;
+            component.id = p[6 + 3 * i];
+            component.h = p[7 + 3 * i] >> 4;
+            component.v = p[7 + 3 * i] & 15;
+            component.quant = p[8 + 3 * i];
+            if (component.h < 1 || component.h > 4 || component.v < 1 || component.v > 4 || component.quant > 3) return false;
+            hMax = std::max(hMax, component.h);
+            vMax = std::max(vMax, component.v);
+            components.push_back(component);
+        }
+        mcusX = (width + 8 * hMax - 1) / (8 * hMax);
+        mcusY = (height + 8 * vMax - 1) / (8 * vMax);
+        for (Component& component : components) {
+            int componentWidth = (width * component.h + hMax - 1) / hMax;
+            int componentHeight = (height * component.v + vMax - 1) / vMax;
+            component.blocksPerLine = (componentWidth + 7) / 8;
+            component.blocksPerColumn = (componentHeight + 7) / 8;
+            component.blocksWide = mcusX * component.h;
+            component.blocksHigh = mcusY * component.v;
+            component.planeWidth = component.blocksWide * outSize;
+            component.plane.assign(size_t(component.planeWidth) * component.blocksHigh * outSize, 0);
+            if (progressive) component.coefficients.assign(size_t(component.blocksWide) * component.blocksHigh * stride, 0);
+        }
+        frameSeen = true;
+        return true;
+    }
+
+    // Sequential mode: the whole block in one go.
+    bool decodeBaseline(BitReader& reader, Component& component, int16_t* block) {
+        int magnitude = reader.decode(dc[component.dcTable]);
+        if (magnitude < 0 || magnitude > 11) return false;
+        component.dcPred += magnitude ? reader.receiveExtend(magnitude) : 0;
+        block[0] = static_cast<int16_t>(component.dcPred);
+
+        const Huffman& table = ac[component.acTable];
+        for (int k = 1; k < 64;) {
+            int run, value;
+            int coded = reader.decodeAc(table, run, value);
+            if (coded < 0) return false;
+            if (coded == 0) {
+                if (run != 15) break;
+                k += 16;
+                continue;
+            }
+            k += run;
+            if (k > 63) return false;
+            if (k <= lastNeeded) block[k] = static_cast<int16_t>(value);
+            k++;
+        }
+        return true;
+    }
+
+    bool decodeDcFirst(BitReader& reader, Component& component, int16_t* block, int shift) {
+        int magnitude = reader.decode(dc[component.dcTable]);
+        if (magnitude < 0 || magnitude > 11) return false;
+        component.dcPred += magnitude ? reader.receiveExtend(magnitude) : 0;
+        block[0] = static_cast<int16_t>(component.dcPred * (1 << shift));
+        return true;
+    }
+
+    void decodeDcRefine(BitReader& reader, int16_t* block, int shift) {
+        if (reader.bits(1)) block[0] = static_cast<int16_t>(block[0] | (1 << shift));
+    }
+
+    bool decodeAcFirst(BitReader& reader, Component& component, int16_t* block, int start, int stop, int shift) {
+        if (eobRun > 0) {
+            eobRun--;
+            return true;
+        }
+        const Huffman& table = ac[component.acTable];
+        for (int k = start; k <= stop;) {
+            int run, value;
+            int coded = reader.decodeAc(table, run, value);
+            if (coded < 0) return false;
+            if (coded == 0) {
+                if (run < 15) {
+                    eobRun = (1 << run) - 1 + reader.bits(run);
+                    break;
+                }
+                k += 16;
+                continue;
+            }
+            k += run;
+            if (k > 63) return false;
+            block[k] = static_cast<int16_t>(value * (1 << shift));
+            k++;
+        }
+        return true;
+    }
+
+    // Successive approximation: one more bit for every coefficient already
+    // non-zero in [start, stop], and newly non-zero ones placed between them.
+    bool decodeAcRefine(BitReader& reader, Component& component, int16_t* block, int start, int stop, int shift) {
+        int bit = 1 << shift;
+        auto refine = [&](int16_t& coefficient) {
+            if (reader.bits(1) && (coefficient & bit) == 0) {
+                coefficient = static_cast<int16_t>(coefficient > 0 ? coefficient + bit : coefficient - bit);
+            }
+        };
+
+        int k = start;
+        if (eobRun == 0) {
+            const Huffman& table = ac[component.acTable];
+            while (k <= stop) {
+                int symbol = reader.decode(table);
+                if (symbol < 0) return false;
+                int run = symbol >> 4, magnitudeBits = symbol & 15;
+                int value = 0;
+                if (magnitudeBits == 0) {
+                    if (run < 15) {
+                        eobRun = (1 << run) + reader.bits(run);
+                        break;
+                    }
+                } else {
+                    value = reader.bits(1) ? bit : -bit;
+                }
+                while (k <= stop) {
+                    int16_t& coefficient = block[k++];
+                    if (coefficient != 0) {
+                        refine(coefficient);
+                    } else if (run == 0) {
+                        if (value) coefficient = static_cast<int16_t>(value);
+                        break;
+                    } else {
+                        run--;
+                    }
+                }
+            }
+        }
+        if (eobRun > 0) {
+            for (; k <= stop; k++) {
+                if (block[k] != 0) refine(block[k]);
+            }
+            eobRun--;
+        }
+        return true;
+    }
+
+    // Moves past entropy-coded data to the next real marker.
+    static const unsigned char* skipEntropy(const unsigned char* p, const unsigned char* end) {
+        while (p + 1 < end && !(p[0] == 0xFF && p[1] != 0x00 && !(p[1] >= 0xD0 && p[1] <= 0xD7))) p++;
+        return p;
+    }
+
+    // Decodes one scan; returns the position just after its entropy data.
+    const unsigned char* readScan(const unsigned char* p, int length, const unsigned char* end) {
+        int count = p[0];
+        if (count < 1 || count > 4 || length < 4 + 2 * count) return nullptr;
+        int start = p[1 + 2 * count], stop = p[2 + 2 * count];
+        int high = p[3 + 2 * count] >> 4, low = p[3 + 2 * count] & 15;
+        const unsigned char* entropy = p + length;
+        if (!progressive) {
+            start = 0;
+            stop = 63;
+            high = low = 0;
+        } else if (start > stop || stop > 63 || (start == 0 && stop != 0) || (start > 0 && count != 1)) {
+            return nullptr;
+        }
+        // A scan reaching into the NxN corner is always decoded. One beyond it
+        // only when planScans() found a refinement that needs it and this is
+        // the very scan it planned for, and never with one coefficient per
+        // block (stride < 64), where the AC decoders would write past it.
+        size_t index = scanIndex++;
+        if (progressive && start > lastNeeded) {
+            Band band{ count == 1 ? p[1] : -1, start, stop, high };
+            bool planned = index < bands.size() && scanNeeded[index] && bands[index] == band;
+            if (stride < 64 || !planned) return skipEntropy(entropy, end);
+        }
+
+        std::vector<Component*> scan;
+        for (int i = 0; i < count; i++) {
+            int id = p[1 + 2 * i];
+            Component* found = nullptr;
+            for (Component& component : components) {
+                if (component.id == id) found = &component;
+            }
+            if (!found) return nullptr;
+            found->dcTable = p[2 + 2 * i] >> 4;
+            found->acTable = p[2 + 2 * i] & 15;
+            if (found->dcTable > 3 || found->acTable > 3) return nullptr;
+            bool needsDc = start == 0 && high == 0;
+            bool needsAc = stop > 0;
+            if ((needsDc && !dc[found->dcTable].defined) || (needsAc && !ac[found->acTable].defined)) return nullptr;
+            found->dcPred = 0;
+            scan.push_back(found);
+        }
+
+        auto decodeOne = [&](BitReader& reader, Component& component, int blockX, int blockY) {
+            if (!progressive) {
+                // Sequential blocks are final once decoded: reduce them right away.
+                int16_t block[64];
+                std::fill(block, block + lastNeeded + 1, int16_t(0));
+                if (!decodeBaseline(reader, component, block)) return false;
+                reduceBlock(component, block, blockX, blockY);
+                return true;
+            }
+            int16_t* block = component.coefficients.data() + (size_t(blockY) * component.blocksWide + blockX) * stride;
+            if (start == 0) {
+                if (high == 0) return decodeDcFirst(reader, component, block, low);
+                decodeDcRefine(reader, block, low);
+                return true;
+            }
+            if (high == 0) return decodeAcFirst(reader, component, block, start, stop, low);
+            return decodeAcRefine(reader, component, block, start, stop, low);
+        };
+
+        BitReader reader(entropy, end);
+        eobRun = 0;
+        // A single-component scan walks that component's own blocks, not MCUs.
+        bool interleaved = scan.size() > 1;
+        int unitsX = interleaved ? mcusX : scan[0]->blocksPerLine;
+        int unitsY = interleaved ? mcusY : scan[0]->blocksPerColumn;
+        int restartsLeft = restartInterval;
+
+        for (int unitY = 0; unitY < unitsY; unitY++) {
+            for (int unitX = 0; unitX < unitsX; unitX++) {
+                if (restartInterval && restartsLeft == 0) {
+                    if (!reader.restart()) return nullptr;
+                    for (Component* component : scan) component->dcPred = 0;
+                    eobRun = 0;
+                    restartsLeft = restartInterval;
+                }
+                if (interleaved) {
+                    for (Component* component : scan) {
+                        for (int by = 0; by < component->v; by++) {
+                            for (int bx = 0; bx < component->h; bx++) {
+                                if (!decodeOne(reader, *component, unitX * component->h + bx, unitY * component->v + by)) return nullptr;
+                            }
+                        }
+                    }
+                } else if (!decodeOne(reader, *scan[0], unitX, unitY)) {
+                    return nullptr;
+                }
+                restartsLeft--;
+            }
+        }
+        return skipEntropy(reader.position(), end);
+    }
+
+    // Reduced IDCT of one block (zigzag coefficients 0..lastNeeded) into the plane.
+    void reduceBlock(Component& component, const int16_t* block, int blockX, int blockY) {
+        const uint16_t* q = quant[component.quant];
+        unsigned char* out = component.plane.data() + size_t(blockY) * outSize * component.planeWidth + size_t(blockX) * outSize;
+        if (outSize == 1) {
+            out[0] = toSample(block[0] * q[0] / 8.0f + 128.0f);
+            return;
+        }
+
+        float corner[4][4] = {};
+        for (int k = 0; k <= lastNeeded; k++) {
+            int row = zigzag[k] >> 3, column = zigzag[k] & 7;
+            if (row < outSize && column < outSize) corner[row][column] = float(block[k] * q[k]);
+        }
+        float rows[4][4];
+        for (int v = 0; v < outSize; v++) {
+            for (int x = 0; x < outSize; x++) {
+                float sum = 0;
+                for (int u = 0; u < outSize; u++) sum += idctTable[x][u] * corner[v][u];
+                rows[v][x] = sum;
+            }
+        }
+        for (int y = 0; y < outSize; y++) {
+            for (int x = 0; x < outSize; x++) {
+                float sum = 128.0f;
+                for (int v = 0; v < outSize; v++) sum += idctTable[y][v] * rows[v][x];
+                out[size_t(y) * component.planeWidth + x] = toSample(sum);
+            }
+        }
+    }
+
+    // Upsamples chroma by replication at the reduced size and converts to RGB.
+    Image assemble() {
+        int outWidth = (width + scale - 1) / scale;
+        int outHeight = (height + scale - 1) / scale;
+        Image image(outWidth, outHeight);
+
+        std::vector<std::vector<int>> columns(components.size());
+        for (size_t c = 0; c < components.size(); c++) {
+            Component& component = components[c];
+            if (progressive) {
+                for (int blockY = 0; blockY < component.blocksHigh; blockY++) {
+                    for (int blockX = 0; blockX < component.blocksWide; blockX++) {
+                        reduceBlock(component, component.coefficients.data() + (size_t(blockY) * component.blocksWide + blockX) * stride, blockX, blockY);
+                    }
+                }
+                component.coefficients = std::vector<int16_t>();
+            }
+            columns[c].resize(outWidth);
+            for (int x = 0; x < outWidth; x++) columns[c][x] = x * components[c].h / hMax;
+        }
+
+        bool namedRgb = components.size() == 3 && components[0].id == 'R' && components[1].id == 'G' && components[2].id == 'B';
+        bool ycc = components.size() == 3 && adobeTransform != 0 && !(adobeTransform < 0 && namedRgb);
+        for (int y = 0; y < outHeight; y++) {
+            const unsigned char* rows[3];
+            for (size_t c = 0; c < components.size(); c++) {
+                rows[c] = components[c].plane.data() + size_t(y * components[c].v / vMax) * components[c].planeWidth;
+            }
+            unsigned char* out = image.imageData + size_t(y) * outWidth * 3;
+            for (int x = 0; x < outWidth; x++, out += 3) {
+                if (components.size() == 1) {
+                    out[0] = out[1] = out[2] = rows[0][x];
+                    continue;
+                }
+                float luma = rows[0][columns[0][x]];
+                float cb = rows[1][columns[1][x]];
+                float cr = rows[2][columns[2][x]];
+                if (!ycc) {
+                    out[0] = static_cast<unsigned char>(luma);
+                    out[1] = static_cast<unsigned char>(cb);
+                    out[2] = static_cast<unsigned char>(cr);
+                    continue;
+                }
+                cb -= 128;
+                cr -= 128;
+                out[0] = toSample(luma + 1.402f * cr);
+                out[1] = toSample(luma - 0.344136f * cb - 0.714136f * cr);
+                out[2] = toSample(luma + 1.772f * cb);
+            }
+        }
+        return image;
+    }
+
+    // Decides which progressive scans can be skipped. A scan is needed when
+    // its band reaches into the NxN corner, or when a needed refinement scan
+    // of the same component overlaps it: refinement bits are only decodable
+    // knowing which coefficients earlier scans made non-zero.
+    void planScans() {
+        bands.clear();
+        const unsigned char* p = data + 2;
+        const unsigned char* end = data + size;
+        while (p + 4 <= end) {
+            if (p[0] != 0xFF || p[1] == 0xFF || p[1] == 0x00 || (p[1] >= 0xD0 && p[1] <= 0xD7)) {
+                p++;
+                continue;
+            }
+            if (p[1] == 0xD9) break;
+            int length = readU16(p + 2);
+            if (length < 2 || p + 2 + length > end) break;
+            if (p[1] == 0xDA && length >= 6) {
+                const unsigned char* body = p + 4;
+                int count = body[0];
+                if (length < 6 + 2 * count) break;
+                bands.push_back({ count == 1 ? body[1] : -1, body[1 + 2 * count], body[2 + 2 * count], body[3 + 2 * count] >> 4 });
+                p = skipEntropy(p + 2 + length, end);
+                continue;
+            }
+            p += 2 + length;
+        }
+
+        scanNeeded.assign(bands.size(), false);
+        for (size_t i = 0; i < bands.size(); i++) scanNeeded[i] = bands[i].start <= lastNeeded;
+        for (size_t i = bands.size(); i-- > 0;) {
+            if (!scanNeeded[i] || bands[i].high == 0 || bands[i].start == 0) continue;
+            for (size_t j = 0; j < i; j++) {
+                bool overlaps = bands[j].start <= bands[i].stop && bands[i].start <= bands[j].stop;
+                if (bands[j].component == bands[i].component && overlaps) scanNeeded[j] = true;
+            }
+        }
+    }
+
+public:
+    Decoder(const unsigned char* bytes, size_t length, int factor)
+        : data(bytes), size(length), scale(factor), outSize(8 / factor), lastNeeded(0) {
+        for (int k = 0; k < 64; k++) {
+            if ((zigzag[k] >> 3) < outSize && (zigzag[k] & 7) < outSize) lastNeeded = k;
+        }
+        // Progressive refinement scans need every coefficient of the band they
+        // cover, so anything beyond DC keeps whole blocks until the end.
+        stride = outSize == 1 ? 1 : 64;
+
+        const double pi = 3.14159265358979323846;
+        for (int x = 0; x < outSize; x++) {
+            for (int u = 0; u < outSize; u++) {
+                double c = u == 0 ? std::sqrt(0.5) : 1.0;
+                idctTable[x][u] = float(0.5 * c * std::cos((2 * x + 1) * u * pi / (2 * outSize)));
+            }
+        }
+    }
+
+    bool decode(Image& out) {
+        const unsigned char* p = data;
+        const unsigned char* end = data + size;
+        if (size < 4 || p[0] != 0xFF || p[1] != 0xD8) return false;
+        p += 2;
+
+        bool scanned = false;
+        while (p + 4 <= end) {
+            if (p[0] != 0xFF || p[1] == 0xFF || p[1] == 0x00 || (p[1] >= 0xD0 && p[1] <= 0xD7)) {
+                p++;
+                continue;
+            }
+            int marker = p[1];
+            if (marker == 0xD9) break;
+            int length = readU16(p + 2);
+            const unsigned char* body = p + 4;
+            if (length < 2 || body + length - 2 > end) return false;
+            int bodyLength = length - 2;
+
+            if (marker == 0xC0 || marker == 0xC1 || marker == 0xC2) {
+                progressive = marker == 0xC2;
+                if (frameSeen || !readFrame(body, bodyLength)) return false;
+                if (progressive) planScans();
+            } else if (marker >= 0xC3 && marker <= 0xCF && marker != 0xC4 && marker != 0xC8 && marker != 0xCC) {
+                return false; // lossless, hierarchical or arithmetic coded
+            } else if (marker == 0xC4) {
+                if (!readHuffman(body, bodyLength)) return false;
+            } else if (marker == 0xDB) {
+                if (!readQuant(body, bodyLength)) return false;
+            } else if (marker == 0xDD) {
+                if (bodyLength < 2) return false;
+                restartInterval = readU16(body);
+            } else if (marker == 0xEE) {
+                if (bodyLength >= 12 && memcmp(body, "Adobe", 5) == 0) adobeTransform = body[11];
+            } else if (marker == 0xDA) {
+                if (!frameSeen) return false;
+                p = readScan(body, bodyLength, end);
+                if (!p) return false;
+                scanned = true;
+                continue;
+            }
+            p = body + bodyLength;
+        }
+
+        if (!scanned) return false;
+        out = assemble();
+        return true;
+    }
+};
+
+} // namespace jpegscaled
+
+
+/**
+ * @brief Decodes a JPEG at 1/scale of its size (scale 2, 4 or 8).
+ *
+ * The result is ceil(width / scale) x ceil(height / scale) RGB. Returns false,
+ * leaving out untouched, when the file uses a coding mode this decoder does not
+ * handle or is corrupt.
+ */
+inline bool decodeJpegScaled(const unsigned char* data, size_t size, int scale, Image& out) {
+    if (scale != 2 && scale != 4 && scale != 8) return false;
+    jpegscaled::Decoder decoder(data, size, scale);
+    return decoder.decode(out);
+}
@@ -0,0 +1,207 @@
+/**
+ * @File  : MemoryAccounting.h
+ * @brief : Live and peak bytes of pixel buffers, grouped by who holds them.
+ *
+ * Every Image (and PlanarImage) carries a memory::Charge for its buffer, so
+ * the totals cover all of them without scanning anything. A buffer counts
+ * toward its holder's Owner: the editor tags the image being edited, the
+ * Before/After original, the undo and redo snapshots and the on-screen pixmap;
+ * everything untagged (filter work buffers, overlays, decodes in flight) is a
+ * Temporary.
+ *
+ * A ceiling can be set with setLimit() or the WAKEUP_MEMORY_LIMIT environment
+ * variable ("1.5G", "800M", plain bytes). Nothing is refused when it is
+ * crossed; holders of optional buffers (the editor's history) check
+ * exceedsLimit() and drop what they can.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cctype>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <stdexcept>
+#include <string>
+
+
+namespace memory {
+
+enum class Owner { Current, Original, Undo, Redo, Temporary, Display };
+
+constexpr int ownerCount = 6;
+
+inline const char* ownerName(Owner owner) {
+    switch (owner) {
+        case Owner::Current:   return "current";
+        case Owner::Original:  return "original";
+        case Owner::Undo:      return "undo";
+        case Owner::Redo:      return "redo";
+        case Owner::Temporary: return "temporaries";
+        case Owner::Display:   return "display";
+    }
+    return "?";
+}
+
+/**
+ * @brief Parses a byte count such as "2G", "512M", "1.5GB" or "1048576"
+ *        (binary units). "0" or "" means no limit.
+ * @throws std::invalid_argument If text is not a size.
+ */
+inline int64_t parseBytes(const std::string& text) {
+    if (text.empty()) return 0;
+    char* end = nullptr;
+    double value = strtod(text.c_str(), &end);
+    std::string unit;
+    for (; *end; end++) unit += static_cast<char>(toupper(static_cast<unsigned char>(*end)));
+    if (!unit.empty() && unit.back() == 'B') unit.pop_back();
+    double scale = unit.empty() ? 1 : unit == "K" ? 1024.0 : unit == "M" ? 1024.0 * 1024
+                 : unit == "G" ? 1024.0 * 1024 * 1024 : unit == "T" ? 1024.0 * 1024 * 1024 * 1024 : -1;
+    if (end == text.c_str() || scale < 0 || value < 0) throw std::invalid_argument("Not a size: \"" + text + "\"");
+    return static_cast<int64_t>(value * scale);
+}
+
+/**
+ * @brief "512 KB", "1.5 GB", ...
+ */
+inline std::string formatBytes(int64_t bytes) {
+    const char* units[] = { "B", "KB", "MB", "GB", "TB" };
+    double value = double(bytes);
+    int unit = 0;
+    while (unit < 4 && (value >= 1024 || value <= -1024)) {
+        value /= 1024;
+        unit++;
+    }
+    char text[32];
+    snprintf(text, sizeof(text), unit == 0 || value >= 100 ? "%.0f %s" : "%.1f %s", value, units[unit]);
+    return text;
+}
+
+class Accounting {
+    std::atomic<int64_t> liveBytes[ownerCount] = {};
+    std::atomic<int64_t> peakBytes[ownerCount] = {};
+    std::atomic<int64_t> liveTotal{ 0 };
+    std::atomic<int64_t> peakTotal{ 0 };
+    std::atomic<int64_t> ceiling{ 0 };
+
+    static void raise(std::atomic<int64_t>& peak, int64_t value) {
+        int64_t seen = peak.load(std::memory_order_relaxed);
+        while (value > seen && !peak.compare_exchange_weak(seen, value, std::memory_order_relaxed)) {}
+    }
+
+    Accounting() {
+        if (const char* limit = getenv("WAKEUP_MEMORY_LIMIT")) {
+            try {
+                ceiling = parseBytes(limit);
+            } catch (const std::invalid_argument& e) {
+                fprintf(stderr, "WAKEUP_MEMORY_LIMIT ignored: %s\n", e.what());
+            }
+        }
+    }
+
+public:
+    static Accounting& instance() {
+        static Accounting accounting;
+        return accounting;
+    }
+
+    void add(Owner owner, int64_t bytes) {
+        if (bytes == 0) return;
+        int i = static_cast<int>(owner);
+        raise(peakBytes[i], liveBytes[i].fetch_add(bytes, std::memory_order_relaxed) + bytes);
+        raise(peakTotal, liveTotal.fetch_add(bytes, std::memory_order_relaxed) + bytes);
+    }
+
+    int64_t live(Owner owner) const { return liveBytes[static_cast<int>(owner)].load(std::memory_order_relaxed); }
+    int64_t peak(Owner owner) const { return peakBytes[static_cast<int>(owner)].load(std::memory_order_relaxed); }
+    int64_t live() const { return liveTotal.load(std::memory_order_relaxed); }
+    int64_t peak() const { return peakTotal.load(std::memory_order_relaxed); }
+
+    /**
+     * @brief Restarts the peaks from the current live sizes.
+     */
+    void resetPeaks() {
+        for (int i = 0; i < ownerCount; i++) peakBytes[i] = liveBytes[i].load();
+        peakTotal = liveTotal.load();
+    }
+
+    /// Ceiling in bytes, 0 if none.
+    int64_t limit() const { return ceiling.load(std::memory_order_relaxed); }
+    void setLimit(int64_t bytes) { ceiling = bytes > 0 ? bytes : 0; }
+
+    /**
+     * @brief Whether holding extra more bytes would cross the ceiling.
+     */
+    bool exceedsLimit(int64_t extra = 0) const {
+        int64_t cap = limit();
+        return cap > 0 && live() + extra > cap;
+    }
+
+    /**
+     * @brief e.g. "live 1.2 GB (current 280 MB, undo 840 MB, ...), peak 1.6 GB, limit 2.0 GB".
+     */
+    std::string summary() const {
+        std::string text = "live " + formatBytes(live());
+        std::string parts;
+        for (int i = 0; i < ownerCount; i++) {
+            if (live(Owner(i)) == 0) continue;
+            parts += (parts.empty() ? "" : ", ") + std::string(ownerName(Owner(i))) + " " + formatBytes(live(Owner(i)));
+        }
+        if (!parts.empty()) text += " (" + parts + ")";
+        text += ", peak " + formatBytes(peak());
+        if (limit() > 0) text += ", limit " + formatBytes(limit());
+        return text;
+    }
+};
+
+inline Accounting& accounting() { return Accounting::instance(); }
+
+/**
+ * @class Charge
+ * @brief The bytes one buffer holds, counted toward an Owner for as long as
+ *        the Charge lives.
+ *
+ * Copies charge the same bytes again (the buffer was copied too); moves hand
+ * them over. Assignment keeps the target's owner: moving an image into the
+ * editor's current image makes its bytes "current".
+ */
+class Charge {
+    Owner holder;
+    int64_t size = 0;
+
+public:
+    explicit Charge(Owner owner = Owner::Temporary, size_t bytes = 0) : holder(owner) { reset(bytes); }
+    Charge(const Charge& other) : Charge(other.holder, size_t(other.size)) {}
+    Charge(Charge&& other) noexcept : holder(other.holder), size(other.size) { other.size = 0; }
+    Charge& operator=(const Charge& other) {
+        reset(size_t(other.size));
+        return *this;
+    }
+    Charge& operator=(Charge&& other) noexcept {
+        if (this == &other) return *this;
+        accounting().add(holder, other.size - size);
+        accounting().add(other.holder, -other.size);
+        size = other.size;
+        other.size = 0;
+        return *this;
+    }
+    ~Charge() { accounting().add(holder, -size); }
+
+    void reset(size_t bytes) {
+        accounting().add(holder, int64_t(bytes) - size);
+        size = int64_t(bytes);
+    }
+
+    void setOwner(Owner owner) {
+        if (owner == holder) return;
+        accounting().add(holder, -size);
+        holder = owner;
+        accounting().add(holder, size);
+    }
+
+    Owner owner() const { return holder; }
+    size_t bytes() const { return size_t(size); }
+};
+
+} // namespace memory
@@ -0,0 +1,160 @@
+/**
+ * @File  : PixelFormat.h
+ * @brief : Compile-time descriptions of the pixel formats an Image can hold,
+ *          and conversions between them.
+ *
+ * Kernels are written once as templates over a format (Rgb8, Rgba8, Rgb16)
+ * and instantiated per format, so the sample type, channel stride and value
+ * range are constants inside the loops. visitPixelFormat() picks the
+ * instantiation once per image rather than once per pixel.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "third_party/Image_Class.h"
+
+
+struct Rgb8 {
+    using Sample = unsigned char;
+    static constexpr PixelFormat format = PixelFormat::RGB8;
+    static constexpr int channels = 3;
+    static constexpr int maxValue = 255;
+    static constexpr bool hasAlpha = false;
+};
+
+struct Rgba8 {
+    using Sample = unsigned char;
+    static constexpr PixelFormat format = PixelFormat::RGBA8;
+    static constexpr int channels = 4;
+    static constexpr int maxValue = 255;
+    static constexpr bool hasAlpha = true;
+};
+
+struct Rgb16 {
+    using Sample = uint16_t;
+    static constexpr PixelFormat format = PixelFormat::RGB16;
+    static constexpr int channels = 3;
+    static constexpr int maxValue = 65535;
+    static constexpr bool hasAlpha = false;
+};
+
+
+/**
+ * @brief Calls fn with a value of the traits type matching format.
+ */
+template <typename Fn>
+decltype(auto) visitPixelFormat(PixelFormat format, Fn&& fn) {
+    switch (format) {
+        case PixelFormat::RGBA8: return fn(Rgba8{});
+        case PixelFormat::RGB16: return fn(Rgb16{});
+        default: return fn(Rgb8{});
+    }
+}
+
+inline const char* pixelFormatName(PixelFormat format) {
+    switch (format) {
+        case PixelFormat::RGBA8: return "rgba8";
+        case PixelFormat::RGB16: return "rgb16";
+        default: return "rgb8";
+    }
+}
+
+/**
+ * @brief Parses "rgb8", "rgba8" or "rgb16".
+ * @throws std::invalid_argument For any other name.
+ */
+inline PixelFormat parsePixelFormat(const std::string& name) {
+    for (PixelFormat format : { PixelFormat::RGB8, PixelFormat::RGBA8, PixelFormat::RGB16 }) {
+        if (name == pixelFormatName(format)) return format;
+    }
+    throw std::invalid_argument("Unknown pixel format \"" + name + "\" (rgb8, rgba8 or rgb16)");
+}
+
+template <typename Px>
+typename Px::Sample* samplesOf(Image& image) {
+    return reinterpret_cast<typename Px::Sample*>(image.imageData);
+}
+
+template <typename Px>
+const typename Px::Sample* samplesOf(const Image& image) {
+    return reinterpret_cast<const typename Px::Sample*>(image.imageData);
+}
+
+/**
+ * @brief Rescales a sample from From's range to To's, rounding to nearest.
+ */
+template <typename From, typename To>
+typename To::Sample rescaleSample(typename From::Sample value) {
+    if constexpr (From::maxValue == To::maxValue) {
+        return value;
+    } else if constexpr (From::maxValue < To::maxValue) {
+        return static_cast<typename To::Sample>(value * (To::maxValue / From::maxValue));
+    } else {
+        return static_cast<typename To::Sample>((uint32_t(value) * To::maxValue + From::maxValue / 2) / From::maxValue);
+    }
+}
+
+template <typename From, typename To>
+void convertPixels(const typename From::Sample* in, typename To::Sample* out, size_t pixels) {
+    for (size_t i = 0; i < pixels; i++, in += From::channels, out += To::channels) {
+        for (int c = 0; c < 3; c++) out[c] = rescaleSample<From, To>(in[c]);
+        if constexpr (To::hasAlpha) {
+            if constexpr (From::hasAlpha) out[3] = rescaleSample<From, To>(in[3]);
+            else out[3] = static_cast<typename To::Sample>(To::maxValue);
+        }
+    }
+}
+
+/**
+ * @brief Returns image converted to target: samples are rescaled, alpha is
+ *        dropped or added as opaque.
+ */
+inline Image convertImage(const Image& image, PixelFormat target) {
+    if (image.format == target) return image;
+    Image result(image.width, image.height, target);
+    size_t pixels = size_t(image.width) * image.height;
+    visitPixelFormat(image.format, [&](auto from) {
+        visitPixelFormat(target, [&](auto to) {
+            using From = decltype(from);
+            using To = decltype(to);
+            convertPixels<From, To>(samplesOf<From>(image), samplesOf<To>(result), pixels);
+        });
+    });
+    return result;
+}
+
+/**
+ * @brief Runs fn, a step written for 8-bit RGB, on image whatever its format.
+ *
+ * Other formats are narrowed to RGB8 for the call and widened back afterwards;
+ * alpha is put back when fn kept the image size, otherwise it becomes opaque.
+ * Precision beyond 8 bits does not survive the step.
+ */
+template <typename Fn>
+void withRgb8(Image& image, Fn&& fn) {
+    if (image.format == PixelFormat::RGB8) {
+        fn();
+        return;
+    }
+    PixelFormat original = image.format;
+    int width = image.width, height = image.height;
+    std::vector<unsigned char> alpha;
+    if (original == PixelFormat::RGBA8) {
+        alpha.resize(size_t(width) * height);
+        for (size_t i = 0; i < alpha.size(); i++) alpha[i] = image.imageData[i * 4 + 3];
+    }
+
+    image = convertImage(image, PixelFormat::RGB8);
+    fn();
+    image = convertImage(image, original);
+
+    if (!alpha.empty() && image.width == width && image.height == height) {
+        for (size_t i = 0; i < alpha.size(); i++) image.imageData[i * 4 + 3] = alpha[i];
+    }
+}
@@ -0,0 +1,379 @@
+/**
+ * @File  : PlanarImage.h
+ * @brief : Planar (one plane per channel) working copy of an 8-bit RGB image
+ *          for kernels that treat the channels independently.
+ *
+ * Image stays interleaved: stb, the encoders and the Qt view all want RGBRGB.
+ * Channel-wise kernels deinterleave into a PlanarImage on entry, run on
+ * contiguous single-channel rows, and interleave back on exit. Rows are padded
+ * to a multiple of 64 bytes and every plane starts on a 64-byte boundary, so
+ * row loops vectorize without peeling.
+ *
+ * With SSSE3 (-mssse3, or /arch:AVX on MSVC) the conversions shuffle 16 pixels
+ * at a time; otherwise a scalar loop is used.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <vector>
+
+#if defined(__SSSE3__) || defined(__AVX__)
+#include <tmmintrin.h>
+#define WAKEUP_PLANAR_SSSE3 1
+#endif
+
+#include "MemoryAccounting.h"
+#include "third_party/Image_Class.h"
+
+
+namespace planar {
+
+#ifdef WAKEUP_PLANAR_SSSE3
+/// pshufb control that gathers channel c of 16 pixels from the k-th 16-byte block of RGB data.
+constexpr std::array<int8_t, 16> gatherMask(int c, int k) {
+    std::array<int8_t, 16> mask{};
+    for (int i = 0; i < 16; i++) {
+        int at = 3 * i + c;
+        mask[i] = at / 16 == k ? static_cast<int8_t>(at % 16) : int8_t(-128);
+    }
+    return mask;
+}
+
+/// pshufb control that scatters 16 samples of channel c into the k-th 16-byte block of RGB data.
+constexpr std::array<int8_t, 16> scatterMask(int c, int k) {
+    std::array<int8_t, 16> mask{};
+    for (int j = 0; j < 16; j++) {
+        int at = 16 * k + j;
+        mask[j] = at % 3 == c ? static_cast<int8_t>(at / 3) : int8_t(-128);
+    }
+    return mask;
+}
+
+inline __m128i loadMask(const std::array<int8_t, 16>& mask) {
+    return _mm_loadu_si128(reinterpret_cast<const __m128i*>(mask.data()));
+}
+#endif
+
+/**
+ * @brief Splits n interleaved RGB pixels into three planes.
+ */
+inline void deinterleave(const unsigned char* rgb, unsigned char* r, unsigned char* g, unsigned char* b, size_t n) {
+    size_t i = 0;
+#ifdef WAKEUP_PLANAR_SSSE3
+    static constexpr std::array<std::array<int8_t, 16>, 9> masks = {
+        gatherMask(0, 0), gatherMask(0, 1), gatherMask(0, 2),
+        gatherMask(1, 0), gatherMask(1, 1), gatherMask(1, 2),
+        gatherMask(2, 0), gatherMask(2, 1), gatherMask(2, 2),
+    };
+    __m128i m[9];
+    for (int k = 0; k < 9; k++) m[k] = loadMask(masks[k]);
+    unsigned char* out[3] = { r, g, b };
+    for (; i + 16 <= n; i += 16) {
+        const __m128i* in = reinterpret_cast<const __m128i*>(rgb + i * 3);
+        __m128i v0 = _mm_loadu_si128(in);
+        __m128i v1 = _mm_loadu_si128(in + 1);
+        __m128i v2 = _mm_loadu_si128(in + 2);
+        for (int c = 0; c < 3; c++) {
+            __m128i plane = _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(v0, m[c * 3]),
+                                                      _mm_shuffle_epi8(v1, m[c * 3 + 1])),
+                                         _mm_shuffle_epi8(v2, m[c * 3 + 2]));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(out[c] + i), plane);
+        }
+    }
+#endif
+    for (; i < n; i++) {
+        r[i] = rgb[i * 3];
+        g[i] = rgb[i * 3 + 1];
+        b[i] = rgb[i * 3 + 2];
+    }
+}
+
+/**
+ * @brief Merges three planes of n samples into interleaved RGB.
+ */
+inline void interleave(const unsigned char* r, const unsigned char* g, const unsigned char* b, unsigned char* rgb, size_t n) {
+    size_t i = 0;
+#ifdef WAKEUP_PLANAR_SSSE3
+    static constexpr std::array<std::array<int8_t, 16>, 9> masks = {
+        scatterMask(0, 0), scatterMask(1, 0), scatterMask(2, 0),
+        scatterMask(0, 1), scatterMask(1, 1), scatterMask(2, 1),
+        scatterMask(0, 2), scatterMask(1, 2), scatterMask(2, 2),
+    };
+    __m128i m[9];
+    for (int k = 0; k < 9; k++) m[k] = loadMask(masks[k]);
+    for (; i + 16 <= n; i += 16) {
+        __m128i pr = _mm_loadu_si128(reinterpret_cast<const __m128i*>(r + i));
+        __m128i pg = _mm_loadu_si128(reinterpret_cast<const __m128i*>(g + i));
+        __m128i pb = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + i));
+        __m128i* out = reinterpret_cast<__m128i*>(rgb + i * 3);
+        for (int k = 0; k < 3; k++) {
+            __m128i block = _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(pr, m[k * 3]),
+                                                      _mm_shuffle_epi8(pg, m[k * 3 + 1])),
+                                         _mm_shuffle_epi8(pb, m[k * 3 + 2]));
+            _mm_storeu_si128(out + k, block);
+        }
+    }
+#endif
+    for (; i < n; i++) {
+        rgb[i * 3] = r[i];
+        rgb[i * 3 + 1] = g[i];
+        rgb[i * 3 + 2] = b[i];
+    }
+}
+
+/**
+ * @brief Box blur of one plane: dst = (sum of the window clipped to the
+ *        plane) / (2r+1)^2, truncated.
+ *
+ * That is exactly what Blur computed from its 2-D prefix sums (edges darken
+ * because the divisor is not reduced). Here it is a vertical running sum per
+ * column followed by a horizontal running sum, O(1) per sample for any radius,
+ * and the division is a multiply by a 40-bit reciprocal, exact while
+ * 255 * A^2 < 2^40 (radius <= 127).
+ */
+inline void boxBlur(const unsigned char* src, size_t srcStride, unsigned char* dst, size_t dstStride,
+                    int width, int height, int radius) {
+    if (width <= 0 || height <= 0) return;
+    radius = std::max(0, radius);
+    const uint64_t area = (2ULL * radius + 1) * (2ULL * radius + 1);
+    const bool reciprocal = radius <= 127;
+    const uint64_t scale = (1ULL << 40) / area + 1;
+
+    std::vector<uint32_t> columns(width, 0);
+    auto addRow = [&](int y, int sign) {
+        const unsigned char* row = src + size_t(y) * srcStride;
+        uint32_t* col = columns.data();
+        if (sign > 0) for (int x = 0; x < width; x++) col[x] += row[x];
+        else for (int x = 0; x < width; x++) col[x] -= row[x];
+    };
+
+    for (int y = 0; y <= std::min(height - 1, radius); y++) addRow(y, +1);
+    for (int y = 0; y < height; y++) {
+        unsigned char* out = dst + size_t(y) * dstStride;
+        const uint32_t* col = columns.data();
+        auto divide = [&](uint64_t sum) {
+            return static_cast<unsigned char>(reciprocal ? (sum * scale) >> 40 : sum / area);
+        };
+        uint64_t sum = 0;
+        for (int x = 0; x <= std::min(width - 1, radius); x++) sum += col[x];
+        // The window slides in three stretches so the middle one, where it is
+        // fully inside the row, has no bounds checks.
+        int x = 0;
+        for (; x < std::min(radius, width); x++) {
+            out[x] = divide(sum);
+            if (x + radius + 1 < width) sum += col[x + radius + 1];
+        }
+        for (; x + radius + 1 < width; x++) {
+            out[x] = divide(sum);
+            sum += col[x + radius + 1] - uint64_t(col[x - radius]);
+        }
+        for (; x < width; x++) {
+            out[x] = divide(sum);
+            sum -= col[x - radius];
+        }
+        if (y + radius + 1 < height) addRow(y + radius + 1, +1);
+        if (y - radius >= 0) addRow(y - radius, -1);
+    }
+}
+
+/// Horizontal and vertical Sobel responses at one sample.
+struct Gradient {
+    int x, y;
+};
+
+/**
+ * @brief Sobel gradient at column x of row, with above and below the rows
+ *        either side; left and right are the columns read either side of x,
+ *        which lets callers repeat the edge sample instead of skipping it.
+ */
+inline Gradient sobel(const unsigned char* above, const unsigned char* row, const unsigned char* below,
+                      int left, int x, int right) {
+    return { (above[right] - above[left]) + 2 * (row[right] - row[left]) + (below[right] - below[left]),
+             (below[left] - above[left]) + 2 * (below[x] - above[x]) + (below[right] - above[right]) };
+}
+
+/**
+ * @brief Median filter of output columns x0..x1 of one plane: dst is the
+ *        median of the (2r+1)^2 window around each sample, with the plane's
+ *        edge samples repeated beyond it.
+ *
+ * Perreault and Hébert's constant-time median. Every column keeps a histogram
+ * of its 2r+1 samples, which takes one sample in and one out per row, and the
+ * window's histogram slides along the row by adding one column histogram and
+ * removing another. Histograms have two levels, 16 coarse bins of 16 fine
+ * ones: the window's coarse counts are kept current at every step, and the
+ * fine counts of a coarse bin are brought up to date only when the median
+ * falls in it, which from one sample to the next it mostly does. The cost per
+ * sample does not grow with r. Counts are 16-bit, so r is capped at 127.
+ *
+ * A strip reads the r columns either side of it and nothing else, so strips
+ * can run on separate threads into the same dst.
+ */
+inline void median(const unsigned char* src, size_t srcStride, unsigned char* dst, size_t dstStride,
+                   int width, int height, int radius, int x0, int x1) {
+    x0 = std::max(0, x0);
+    x1 = std::min(width, x1);
+    if (height <= 0 || x0 >= x1) return;
+    radius = std::min(std::max(0, radius), 127);
+    if (radius == 0) {
+        for (int y = 0; y < height; y++) {
+            std::copy(src + size_t(y) * srcStride + x0, src + size_t(y) * srcStride + x1, dst + size_t(y) * dstStride + x0);
+        }
+        return;
+    }
+    const int window = 2 * radius + 1;
+    const int half = window * window / 2;  // samples below the median
+
+    // Histograms of the columns the strip's windows reach, c0..c1.
+    const int c0 = std::max(0, x0 - radius), c1 = std::min(width, x1 + radius);
+    std::vector<uint16_t> coarse(size_t(c1 - c0) * 16, 0), fine(size_t(c1 - c0) * 256, 0);
+    auto addRow = [&](int y, int sign) {
+        const unsigned char* row = src + size_t(std::min(std::max(y, 0), height - 1)) * srcStride;
+        for (int x = c0; x < c1; x++) {
+            unsigned v = row[x];
+            coarse[size_t(x - c0) * 16 + (v >> 4)] += sign;
+            fine[size_t(x - c0) * 256 + v] += sign;
+        }
+    };
+    for (int y = -radius; y <= radius; y++) addRow(y, +1);
+    auto column = [&](int x) { return size_t(std::min(std::max(x, 0), width - 1) - c0); };
+
+    uint16_t windowCoarse[16], windowFine[256];
+    int fineAt[16];  ///< the x windowFine's bin k was last brought up to date for
+    for (int y = 0; y < height; y++) {
+        if (y > 0) {
+            addRow(y - radius - 1, -1);
+            addRow(y + radius, +1);
+        }
+        std::fill(windowCoarse, windowCoarse + 16, uint16_t(0));
+        for (int x = x0 - radius; x <= x0 + radius; x++) {
+            const uint16_t* h = &coarse[column(x) * 16];
+            for (int k = 0; k < 16; k++) windowCoarse[k] += h[k];
+        }
+        std::fill(fineAt, fineAt + 16, x0 - window);
+
+        unsigned char* out = dst + size_t(y) * dstStride;
+        for (int x = x0; x < x1; x++) {
+            if (x > x0) {
+                const uint16_t* in = &coarse[column(x + radius) * 16];
+                const uint16_t* gone = &coarse[column(x - radius - 1) * 16];
+                for (int k = 0; k < 16; k++) windowCoarse[k] += in[k] - gone[k];
+            }
+            int below = 0, k = 0;
+            for (; k < 15 && below + windowCoarse[k] <= half; k++) below += windowCoarse[k];
+
+            // Catch bin k's fine counts up with the window, or recount them
+            // when that is less work.
+            uint16_t* bin = windowFine + k * 16;
+            if (x - fineAt[k] > radius) {
+                std::fill(bin, bin + 16, uint16_t(0));
+                for (int c = x - radius; c <= x + radius; c++) {
+                    const uint16_t* h = &fine[column(c) * 256 + k * 16];
+                    for (int i = 0; i < 16; i++) bin[i] += h[i];
+                }
+            } else {
+                for (int c = fineAt[k] + 1; c <= x; c++) {
+                    const uint16_t* in = &fine[column(c + radius) * 256 + k * 16];
+                    const uint16_t* gone = &fine[column(c - radius - 1) * 256 + k * 16];
+                    for (int i = 0; i < 16; i++) bin[i] += in[i] - gone[i];
+                }
+            }
+            fineAt[k] = x;
+
+            int v = 0;
+            for (; v < 15 && below + bin[v] <= half; v++) below += bin[v];
+            out[x] = static_cast<unsigned char>(k * 16 + v);
+        }
+    }
+}
+
+} // namespace planar
+
+
+/**
+ * @class PlanarImage
+ * @brief Separate, padded planes of 8-bit samples.
+ */
+class PlanarImage {
+    std::vector<unsigned char> storage;
+    unsigned char* base = nullptr;
+    memory::Charge charge;  ///< storage's bytes, as a Temporary
+
+public:
+    static constexpr size_t alignment = 64;
+
+    int width = 0, height = 0;
+    int planes = 0;
+    size_t stride = 0;  ///< bytes between rows of a plane, a multiple of alignment
+
+    PlanarImage() = default;
+
+    PlanarImage(int w, int h, int planeCount = 3) : width(w), height(h), planes(planeCount) {
+        if (w < 0 || h < 0 || planeCount <= 0) throw std::invalid_argument("PlanarImage: bad size");
+        stride = (size_t(w) + alignment - 1) / alignment * alignment;
+        storage.resize(planeBytes() * planes + alignment);
+        charge.reset(storage.size());
+        size_t misalignment = reinterpret_cast<uintptr_t>(storage.data()) % alignment;
+        base = storage.data() + (misalignment ? alignment - misalignment : 0);
+    }
+
+    // The planes point into storage, so a copy has to re-derive them.
+    PlanarImage(const PlanarImage& other) : PlanarImage(other.width, other.height, other.planes) {
+        std::copy(other.base, other.base + planeBytes() * planes, base);
+    }
+    PlanarImage& operator=(const PlanarImage& other) {
+        if (this != &other) *this = PlanarImage(other);
+        return *this;
+    }
+    PlanarImage(PlanarImage&&) noexcept = default;
+    PlanarImage& operator=(PlanarImage&&) noexcept = default;
+
+    size_t planeBytes() const { return stride * height; }
+
+    unsigned char* plane(int p) { return base + planeBytes() * p; }
+    const unsigned char* plane(int p) const { return base + planeBytes() * p; }
+    unsigned char* row(int p, int y) { return plane(p) + stride * y; }
+    const unsigned char* row(int p, int y) const { return plane(p) + stride * y; }
+
+    /**
+     * @brief Deinterleaves an 8-bit RGB image into three planes.
+     * @throws std::invalid_argument If image is not RGB8.
+     */
+    static PlanarImage fromImage(const Image& image) {
+        if (image.format != PixelFormat::RGB8) {
+            throw std::invalid_argument("PlanarImage: image must be 8-bit RGB");
+        }
+        PlanarImage result(image.width, image.height, 3);
+        for (int y = 0; y < image.height; y++) {
+            planar::deinterleave(image.imageData + size_t(y) * image.width * 3,
+                                 result.row(0, y), result.row(1, y), result.row(2, y), size_t(image.width));
+        }
+        return result;
+    }
+
+    /**
+     * @brief Interleaves the three planes into image, which is reallocated as
+     *        RGB8 if its size or format differ.
+     */
+    void toImage(Image& image) const {
+        if (planes != 3) throw std::logic_error("PlanarImage: toImage needs three planes");
+        if (image.width != width || image.height != height || image.format != PixelFormat::RGB8) {
+            image = Image(width, height);
+        }
+        for (int y = 0; y < height; y++) {
+            planar::interleave(row(0, y), row(1, y), row(2, y),
+                               image.imageData + size_t(y) * width * 3, size_t(width));
+        }
+    }
+
+    Image toImage() const {
+        Image image(width, height);
+        toImage(image);
+        return image;
+    }
+};
@@ -0,0 +1,455 @@
+/**
+ * @File  : PointTransform.h
+ * @brief : Composable per-pixel transforms (LUTs, colour matrices, palettes
+ *          and span callbacks) that let consecutive point filters run as one pass.
+ *
+ * Every stage is a template over the pixel format (see PixelFormat.h); run()
+ * picks the instantiation for the image once. LUTs and matrices are defined on
+ * the 0-255 scale: on RGB16 a LUT is interpolated between its entries and a
+ * matrix is evaluated at full precision. Alpha is never touched.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <type_traits>
+#include <vector>
+#include "ImageView.h"
+#include "PixelFormat.h"
+#include "third_party/Image_Class.h"
+
+
+/**
+ * @struct ChannelLut
+ * @brief One 256-entry lookup table per RGB channel: out[c] = table[c][in[c]].
+ */
+struct ChannelLut {
+    std::array<std::array<unsigned char, 256>, 3> table;
+
+    static ChannelLut identity() {
+        ChannelLut lut;
+        for (int c = 0; c < 3; c++) {
+            for (int v = 0; v < 256; v++) {
+                lut.table[c][v] = static_cast<unsigned char>(v);
+            }
+        }
+        return lut;
+    }
+
+    /**
+     * @brief Builds a LUT by evaluating fn(value, channel) for every input value.
+     */
+    template <typename Fn>
+    static ChannelLut fromFunction(Fn fn) {
+        ChannelLut lut;
+        for (int c = 0; c < 3; c++) {
+            for (int v = 0; v < 256; v++) {
+                lut.table[c][v] = static_cast<unsigned char>(fn(v, c));
+            }
+        }
+        return lut;
+    }
+
+    /**
+     * @brief Returns the LUT equivalent to applying *this and then next.
+     */
+    ChannelLut then(const ChannelLut& next) const {
+        ChannelLut lut;
+        for (int c = 0; c < 3; c++) {
+            for (int v = 0; v < 256; v++) {
+                lut.table[c][v] = next.table[c][table[c][v]];
+            }
+        }
+        return lut;
+    }
+
+    template <typename Px>
+    void applyTo(typename Px::Sample* px, size_t pixels) const {
+        const unsigned char* t0 = table[0].data();
+        const unsigned char* t1 = table[1].data();
+        const unsigned char* t2 = table[2].data();
+        if constexpr (Px::maxValue == 255) {
+            for (size_t i = 0; i < pixels; i++, px += Px::channels) {
+                px[0] = t0[px[0]];
+                px[1] = t1[px[1]];
+                px[2] = t2[px[2]];
+            }
+        } else {
+            // Linear interpolation between the two entries around value / 257.
+            const unsigned char* tables[3] = { t0, t1, t2 };
+            for (size_t i = 0; i < pixels; i++, px += Px::channels) {
+                for (int c = 0; c < 3; c++) {
+                    uint32_t position = uint32_t(px[c]) * 255;
+                    uint32_t index = position / Px::maxValue;
+                    int64_t fraction = position - index * Px::maxValue;
+                    int64_t low = tables[c][index];
+                    int64_t high = tables[c][index < 255 ? index + 1 : 255];
+                    int64_t scaled = (low * Px::maxValue + (high - low) * fraction) * 257;
+                    px[c] = static_cast<typename Px::Sample>((scaled + Px::maxValue / 2) / Px::maxValue);
+                }
+            }
+        }
+    }
+
+    void applyTo(unsigned char* rgb, size_t pixels) const { applyTo<Rgb8>(rgb, pixels); }
+};
+
+
+/**
+ * @struct ColorMatrix
+ * @brief out[c] = clamp(int(m[c][0]*r + m[c][1]*g + m[c][2]*b + offset[c]), 0, 255).
+ *
+ * The sum is evaluated in double and truncated toward zero, which is what the
+ * hand-written filter loops did, so results stay byte-identical. offset is on
+ * the 0-255 scale and is rescaled for wider samples.
+ */
+struct ColorMatrix {
+    double m[3][3];
+    double offset[3] = { 0, 0, 0 };
+
+    template <typename Px>
+    void applyTo(typename Px::Sample* px, size_t pixels) const {
+        constexpr double offsetScale = Px::maxValue / 255.0;
+        for (size_t i = 0; i < pixels; i++, px += Px::channels) {
+            int out[3];
+            for (int c = 0; c < 3; c++) {
+                double sum = m[c][0] * px[0] + m[c][1] * px[1] + m[c][2] * px[2];
+                if (offset[c] != 0) sum += offset[c] * offsetScale;
+                int v = static_cast<int>(sum);
+                out[c] = v < 0 ? 0 : (v > Px::maxValue ? Px::maxValue : v);
+            }
+            px[0] = static_cast<typename Px::Sample>(out[0]);
+            px[1] = static_cast<typename Px::Sample>(out[1]);
+            px[2] = static_cast<typename Px::Sample>(out[2]);
+        }
+    }
+
+    void applyTo(unsigned char* rgb, size_t pixels) const { applyTo<Rgb8>(rgb, pixels); }
+};
+
+
+/**
+ * @class Palette
+ * @brief Colormap from intensity to colour: out = colors[(r + g + b) / 3].
+ *
+ * The filters that recolour by brightness (Heat Map, Infrared, Sky, ...) are
+ * each just a Palette. 8-bit pixels are recoloured from a copy of the table
+ * indexed by the channel sum (0-765): one add, one load and three stores, no
+ * division and no branches, whatever the colours are.
+ *
+ * A palette that is a cheap formula of the intensity (a ramp such as
+ * 255 - v) can be built with formula() instead; it then also keeps a loop that
+ * evaluates the formula inline on 8-bit RGB, which the compiler vectorizes and
+ * which runs at memory speed, about twice as fast as the lookup.
+ */
+class Palette {
+public:
+    using Color = std::array<unsigned char, 3>;
+
+private:
+    std::array<Color, 256> colors{};
+    std::array<uint32_t, 766> bySum{};  ///< colors[s / 3] packed as r | g << 8 | b << 16
+    std::function<void(unsigned char* rgb, size_t pixels)> inlined; ///< formula() palettes only
+
+    void index() {
+        for (int sum = 0; sum < 766; sum++) {
+            const Color& c = colors[sum / 3];
+            bySum[sum] = uint32_t(c[0]) | uint32_t(c[1]) << 8 | uint32_t(c[2]) << 16;
+        }
+    }
+
+public:
+    /**
+     * @brief Builds a palette by evaluating fn(intensity) -> Color for 0-255.
+     */
+    template <typename Fn>
+    static Palette fromFunction(Fn fn) {
+        Palette palette;
+        for (int v = 0; v < 256; v++) palette.colors[v] = fn(v);
+        palette.index();
+        return palette;
+    }
+
+    /**
+     * @brief As fromFunction(), for a branch-free fn that is cheaper to
+     *        evaluate per pixel than to look up.
+     */
+    template <typename Fn>
+    static Palette formula(Fn fn) {
+        Palette palette = fromFunction(fn);
+        palette.inlined = [fn](unsigned char* rgb, size_t pixels) {
+            for (size_t i = 0; i < pixels; i++) {
+                Color c = fn((rgb[i * 3] + rgb[i * 3 + 1] + rgb[i * 3 + 2]) / 3);
+                rgb[i * 3] = c[0];
+                rgb[i * 3 + 1] = c[1];
+                rgb[i * 3 + 2] = c[2];
+            }
+        };
+        return palette;
+    }
+
+    /**
+     * @brief Evenly spaced stops from intensity 0 to 255, linearly
+     *        interpolated and rounded to nearest.
+     */
+    static Palette gradient(const std::vector<Color>& stops) {
+        if (stops.empty()) {
+            return formula([](int v) {
+                auto grey = static_cast<unsigned char>(v);
+                return Color{ grey, grey, grey };
+            });
+        }
+        return fromFunction([&](int v) {
+            if (stops.size() == 1) return stops[0];
+            // Position in units of 1/255 of a segment, kept integral so the
+            // stops land exactly on their entries.
+            int segments = int(stops.size()) - 1;
+            int position = v * segments;
+            int at = std::min(position / 255, segments - 1);
+            int fraction = position - at * 255;
+            Color out;
+            for (int c = 0; c < 3; c++) {
+                int low = stops[at][c], high = stops[at + 1][c];
+                out[c] = static_cast<unsigned char>((low * 255 + (high - low) * fraction + 127) / 255);
+            }
+            return out;
+        });
+    }
+
+    const Color& color(int intensity) const { return colors[intensity]; }
+
+    /**
+     * @brief The palette equivalent to recolouring with *this and then next.
+     */
+    Palette then(const Palette& next) const {
+        return fromFunction([&](int v) { return next.colors[(colors[v][0] + colors[v][1] + colors[v][2]) / 3]; });
+    }
+
+    template <typename Px>
+    void applyTo(typename Px::Sample* px, size_t pixels) const {
+        if constexpr (Px::maxValue == 255) {
+            // The inlined loop steps over packed RGB; RGBA8 takes the table,
+            // which skips alpha.
+            if (std::is_same_v<Px, Rgb8> && inlined) {
+                inlined(px, pixels);
+                return;
+            }
+            const uint32_t* table = bySum.data();
+            for (size_t i = 0; i < pixels; i++, px += Px::channels) {
+                uint32_t packed = table[px[0] + px[1] + px[2]];
+                px[0] = static_cast<unsigned char>(packed);
+                px[1] = static_cast<unsigned char>(packed >> 8);
+                px[2] = static_cast<unsigned char>(packed >> 16);
+            }
+        } else {
+            // As for span stages: the intensity is taken from the 8-bit values,
+            // and a sample whose 8-bit value the palette leaves unchanged keeps
+            // its full precision.
+            for (size_t i = 0; i < pixels; i++, px += Px::channels) {
+                unsigned char narrow[3];
+                for (int c = 0; c < 3; c++) narrow[c] = rescaleSample<Px, Rgb8>(px[c]);
+                const Color& out = colors[(narrow[0] + narrow[1] + narrow[2]) / 3];
+                for (int c = 0; c < 3; c++) {
+                    if (out[c] != narrow[c]) px[c] = rescaleSample<Rgb8, Px>(out[c]);
+                }
+            }
+        }
+    }
+
+    void applyTo(unsigned char* rgb, size_t pixels) const { applyTo<Rgb8>(rgb, pixels); }
+};
+
+
+/**
+ * @struct PointOp
+ * @brief A single stage of a PointTransform.
+ *
+ * A Matrix stage may carry a LUT applied to its inputs and one applied to its
+ * outputs; that is how neighbouring LUTs are folded into it.
+ */
+struct PointOp {
+    enum Kind { Lut, Matrix, Palette, Span };
+
+    Kind kind = Lut;
+    ChannelLut lut;                 ///< Lut stages
+    ColorMatrix matrix{};           ///< Matrix stages
+    bool hasPre = false;            ///< Matrix stages: apply pre before the matrix
+    bool hasPost = false;           ///< Matrix stages: apply post after the matrix
+    ChannelLut pre, post;
+    ::Palette palette;              ///< Palette stages
+    std::function<void(unsigned char* rgb, size_t pixels)> span; ///< Span stages, always 8-bit RGB
+
+    template <typename Px>
+    void applyTo(typename Px::Sample* px, size_t pixels) const {
+        switch (kind) {
+        case Lut:
+            lut.applyTo<Px>(px, pixels);
+            break;
+        case Matrix:
+            if (hasPre) pre.applyTo<Px>(px, pixels);
+            matrix.applyTo<Px>(px, pixels);
+            if (hasPost) post.applyTo<Px>(px, pixels);
+            break;
+        case Palette:
+            palette.applyTo<Px>(px, pixels);
+            break;
+        case Span:
+            applySpan<Px>(px, pixels);
+            break;
+        }
+    }
+
+private:
+    // Span callbacks see 8-bit RGB. Other formats go through a narrowed copy;
+    // a 16-bit sample the callback left alone keeps its full precision.
+    template <typename Px>
+    void applySpan(typename Px::Sample* px, size_t pixels) const {
+        if constexpr (std::is_same_v<Px, Rgb8>) {
+            span(px, pixels);
+        } else {
+            thread_local std::vector<unsigned char> narrowed, before;
+            narrowed.resize(pixels * 3);
+            convertPixels<Px, Rgb8>(px, narrowed.data(), pixels);
+            if constexpr (Px::maxValue != 255) before = narrowed;
+            span(narrowed.data(), pixels);
+            for (size_t i = 0; i < pixels; i++) {
+                for (int c = 0; c < 3; c++) {
+                    size_t at = i * 3 + c;
+                    if constexpr (Px::maxValue != 255) {
+                        if (narrowed[at] == before[at]) continue;
+                    }
+                    px[i * Px::channels + c] = rescaleSample<Rgb8, Px>(narrowed[at]);
+                }
+            }
+        }
+    }
+};
+
+
+/**
+ * @class PointTransform
+ * @brief An ordered list of per-pixel stages over interleaved RGB data.
+ *
+ * Appending a stage fuses it with the previous one when that is exact:
+ * LUT after LUT becomes one LUT, a LUT next to a matrix becomes that
+ * matrix's input/output table, and palette after palette becomes one palette. run() then walks the image once, pushing
+ * cache-sized chunks through every stage, so a chain of N point filters
+ * costs one read and one write of the image instead of N.
+ */
+class PointTransform {
+    std::vector<PointOp> ops;
+
+    void append(const PointOp& op) {
+        if (!ops.empty()) {
+            PointOp& last = ops.back();
+            if (op.kind == PointOp::Lut && last.kind == PointOp::Lut) {
+                last.lut = last.lut.then(op.lut);
+                return;
+            }
+            if (op.kind == PointOp::Lut && last.kind == PointOp::Matrix) {
+                last.post = last.hasPost ? last.post.then(op.lut) : op.lut;
+                last.hasPost = true;
+                return;
+            }
+            if (last.kind == PointOp::Palette && op.kind == PointOp::Palette) {
+                last.palette = last.palette.then(op.palette);
+                return;
+            }
+            if (op.kind == PointOp::Matrix && last.kind == PointOp::Lut) {
+                PointOp fused = op;
+                fused.pre = op.hasPre ? last.lut.then(op.pre) : last.lut;
+                fused.hasPre = true;
+                ops.back() = fused;
+                return;
+            }
+        }
+        ops.push_back(op);
+    }
+
+public:
+    // Number of pixels pushed through all stages at a time (fits in L1/L2).
+    static constexpr size_t chunkPixels = 4096;
+
+    PointTransform& lut(const ChannelLut& table) {
+        PointOp op;
+        op.kind = PointOp::Lut;
+        op.lut = table;
+        append(op);
+        return *this;
+    }
+
+    PointTransform& matrix(const ColorMatrix& m) {
+        PointOp op;
+        op.kind = PointOp::Matrix;
+        op.matrix = m;
+        append(op);
+        return *this;
+    }
+
+    PointTransform& palette(const Palette& colors) {
+        PointOp op;
+        op.kind = PointOp::Palette;
+        op.palette = colors;
+        append(op);
+        return *this;
+    }
+
+    PointTransform& span(std::function<void(unsigned char*, size_t)> fn) {
+        PointOp op;
+        op.kind = PointOp::Span;
+        op.span = std::move(fn);
+        append(op);
+        return *this;
+    }
+
+    /**
+     * @brief Appends every stage of next, fusing across the boundary.
+     */
+    PointTransform& then(const PointTransform& next) {
+        for (const PointOp& op : next.ops) append(op);
+        return *this;
+    }
+
+    bool empty() const { return ops.empty(); }
+    size_t stageCount() const { return ops.size(); }
+
+    template <typename Px>
+    void run(typename Px::Sample* px, size_t pixels) const {
+        for (size_t start = 0; start < pixels; start += chunkPixels) {
+            size_t count = std::min(chunkPixels, pixels - start);
+            typename Px::Sample* chunk = px + start * Px::channels;
+            for (const PointOp& op : ops) op.applyTo<Px>(chunk, count);
+        }
+    }
+
+    void run(unsigned char* rgb, size_t pixels) const { run<Rgb8>(rgb, pixels); }
+
+    void run(Image& image) const {
+        size_t pixels = static_cast<size_t>(image.width) * image.height;
+        visitPixelFormat(image.format, [&](auto px) {
+            using Px = decltype(px);
+            run<Px>(samplesOf<Px>(image), pixels);
+        });
+    }
+
+    /**
+     * @brief Runs in place on a view, a row at a time (one pass when the rows
+     *        are contiguous).
+     */
+    void run(const ImageView& view) const {
+        if (view.empty()) return;
+        visitPixelFormat(view.format, [&](auto px) {
+            using Px = decltype(px);
+            using Sample = typename Px::Sample;
+            if (view.contiguous()) {
+                run<Px>(reinterpret_cast<Sample*>(view.data), size_t(view.width) * view.height);
+                return;
+            }
+            for (int row = 0; row < view.height; row++) run<Px>(reinterpret_cast<Sample*>(view.row(row)), view.width);
+        });
+    }
+};
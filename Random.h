@@ -0,0 +1,185 @@
+/**
+ * @File  : Random.h
+ * @brief : Counter-based random numbers (Philox4x32-10) for noise filters.
+ *
+ * A counter-based generator turns (counter, key) into random bits with no
+ * state in between, so the bits for pixel (x, y) can be computed directly, on
+ * any thread, in any order. Noise filters key it with their seed and use the
+ * pixel's position in the full image as the counter: the result is the same
+ * however the image is split into tiles, bands or threads.
+ *
+ * Philox4x32-10 is the generator of Salmon et al., "Parallel Random Numbers:
+ * As Easy as 1, 2, 3" (SC'11); it passes BigCrush and its output matches the
+ * Random123 reference. fillRow() runs eight counters side by side in plain
+ * loops the compiler vectorizes.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+
+
+namespace rng {
+
+/// Philox key, derived from a filter's seed.
+struct Key {
+    uint32_t k0 = 0, k1 = 0;
+};
+
+inline Key keyFor(uint64_t seed) {
+    return { static_cast<uint32_t>(seed), static_cast<uint32_t>(seed >> 32) };
+}
+
+constexpr uint32_t philoxM0 = 0xD2511F53, philoxM1 = 0xCD9E8D57;
+constexpr uint32_t philoxW0 = 0x9E3779B9, philoxW1 = 0xBB67AE85;
+
+/**
+ * @brief Philox4x32-10: four random words for one counter.
+ */
+inline std::array<uint32_t, 4> philox(std::array<uint32_t, 4> c, Key key) {
+    uint32_t k0 = key.k0, k1 = key.k1;
+    for (int round = 0; round < 10; round++) {
+        uint64_t p0 = uint64_t(philoxM0) * c[0];
+        uint64_t p1 = uint64_t(philoxM1) * c[2];
+        c = { uint32_t(p1 >> 32) ^ c[1] ^ k0, uint32_t(p1), uint32_t(p0 >> 32) ^ c[3] ^ k1, uint32_t(p0) };
+        k0 += philoxW0;
+        k1 += philoxW1;
+    }
+    return c;
+}
+
+/**
+ * @brief The random word for sample x of row y in the given stream.
+ *
+ * Streams keep unrelated uses of one seed (Snow, grain, ...) independent.
+ * Four neighbouring samples share a Philox call; fillRow() returns the same
+ * words for whole rows.
+ */
+inline uint32_t at(Key key, uint32_t x, uint32_t y, uint32_t stream) {
+    return philox({ x >> 2, y, stream, 0 }, key)[x & 3];
+}
+
+/**
+ * @brief out[i] = at(key, x0 + i, y, stream) for i < n.
+ */
+inline void fillRow(Key key, uint32_t y, uint32_t stream, uint32_t x0, uint32_t* out, size_t n) {
+    constexpr int lanes = 8;
+    uint32_t block = x0 >> 2;
+    size_t skip = x0 & 3;  // words of the first block that lie before x0
+    while (n > 0) {
+        // Structure-of-arrays over eight counters, so each step of a round is
+        // one loop over independent lanes.
+        uint32_t c0[lanes], c1[lanes], c2[lanes], c3[lanes];
+        for (int i = 0; i < lanes; i++) {
+            c0[i] = (block + i) & 0x3FFFFFFF; // x wraps at 2^32 in at(), so its block does at 2^30
+            c1[i] = y;
+            c2[i] = stream;
+            c3[i] = 0;
+        }
+        uint32_t k0 = key.k0, k1 = key.k1;
+        for (int round = 0; round < 10; round++) {
+            for (int i = 0; i < lanes; i++) {
+                uint64_t p0 = uint64_t(philoxM0) * c0[i];
+                uint64_t p1 = uint64_t(philoxM1) * c2[i];
+                uint32_t n0 = uint32_t(p1 >> 32) ^ c1[i] ^ k0;
+                uint32_t n2 = uint32_t(p0 >> 32) ^ c3[i] ^ k1;
+                c1[i] = uint32_t(p1);
+                c3[i] = uint32_t(p0);
+                c0[i] = n0;
+                c2[i] = n2;
+            }
+            k0 += philoxW0;
+            k1 += philoxW1;
+        }
+        uint32_t words[lanes * 4];
+        for (int i = 0; i < lanes; i++) {
+            words[i * 4] = c0[i];
+            words[i * 4 + 1] = c1[i];
+            words[i * 4 + 2] = c2[i];
+            words[i * 4 + 3] = c3[i];
+        }
+        size_t take = std::min(n, lanes * 4 - skip);
+        std::copy(words + skip, words + skip + take, out);
+        out += take;
+        n -= take;
+        skip = 0;
+        block += lanes;
+    }
+}
+
+/**
+ * @brief Unbiased integer in [0, bound) from one random word (Lemire's
+ *        multiply-shift; the rare rejected words are replaced by next()).
+ */
+template <typename NextWord>
+uint32_t below(uint32_t bound, uint32_t word, NextWord next) {
+    uint64_t m = uint64_t(word) * bound;
+    uint32_t low = uint32_t(m);
+    if (low < bound) {
+        uint32_t threshold = uint32_t(-bound) % bound;
+        while (low < threshold) {
+            m = uint64_t(next()) * bound;
+            low = uint32_t(m);
+        }
+    }
+    return uint32_t(m >> 32);
+}
+
+/**
+ * @class Philox
+ * @brief Sequential words for one (seed, stream, substream), e.g. one
+ *        substream per image row.
+ *
+ * Meets UniformRandomBitGenerator, so it works with <random> distributions and
+ * std::shuffle. discard() jumps ahead in O(1): thread i of n can start at
+ * i * (count / n) and draw exactly what a single thread would have. A
+ * substream holds 2^34 words before it repeats.
+ */
+class Philox {
+    Key key;
+    uint32_t stream, substream;
+    uint64_t position = 0;  ///< index of the next word
+    std::array<uint32_t, 4> words{};
+
+    void refill() {
+        words = philox({ uint32_t(position >> 2), substream, stream, 0x5eed }, key);
+    }
+
+public:
+    using result_type = uint32_t;
+
+    explicit Philox(uint64_t seed, uint32_t streamId = 0, uint32_t substreamId = 0)
+        : key(keyFor(seed)), stream(streamId), substream(substreamId) { refill(); }
+
+    static constexpr result_type min() { return 0; }
+    static constexpr result_type max() { return std::numeric_limits<uint32_t>::max(); }
+
+    result_type operator()() {
+        uint32_t word = words[position & 3];
+        position++;
+        if ((position & 3) == 0) refill();
+        return word;
+    }
+
+    void discard(uint64_t count) {
+        position += count;
+        refill();
+    }
+
+    /// Unbiased integer in [0, bound).
+    uint32_t below(uint32_t bound) {
+        return rng::below(bound, (*this)(), [this] { return (*this)(); });
+    }
+
+    /// Uniform double in [0, 1) with 32 random bits.
+    double uniform() { return (*this)() * (1.0 / 4294967296.0); }
+
+    /// Uniform double in (0, 1], safe to take the log of.
+    double uniformPositive() { return ((*this)() + 1.0) * (1.0 / 4294967296.0); }
+};
+
+} // namespace rng
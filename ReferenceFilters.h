@@ -0,0 +1,2161 @@
+/**
+ * @File  : ReferenceFilters.h
+ * @brief : The original, straightforward implementation of every filter,
+ *          kept as the correctness reference for optimized kernels.
+ *
+ * These are the filters as they were before any fusing, planar or SIMD work:
+ * plain per-pixel loops through Image::operator(). filters_verify runs each
+ * registered filter next to its reference on adversarial inputs and reports
+ * any difference. Nothing else should include this file.
+ *
+ * When a filter's output is changed on purpose, change its reference here in
+ * the same commit; a new filter adds its reference and a referenceRegistry()
+ * entry.
+ */
+
+#pragma once
+
+#include <cstdlib>
+#include "Filters.h"
+
+
+namespace reference {
+
+class Filter
+{
+protected:
+    Image& image;
+    double threshold = 127;
+    unordered_map<string, FilterParam> params;
+    // static string id;
+    // string outputFolderPath = "../../output/";
+public:
+    Filter(Image& img) : image(img) {};
+    virtual void apply() = 0;
+    virtual vector<FilterParam> getNeeds() { return {}; };
+
+    virtual void setParam(const std::string &name, double val) {
+        params[name].value = val;
+    }
+
+    virtual void setParam(const std::string &name, int val) {
+        params[name].value = val;
+    }
+
+    virtual void setParam(const std::string &name, bool val) {
+        params[name].value = val;
+    }
+    virtual void setParam(const std::string& name, const Image& img){
+        // params[name].value = img;
+    }
+
+    virtual void setParam(const std::string &name, const std::string &val) {
+        params[name].value = val;
+    }
+
+    template<typename T>
+    T getParam(const string &name, const T &defaultVal = T()) const {
+        auto it = params.find(name);
+        if (it != params.end()) {
+            if (auto val = get_if<T>(&it->second))
+                return *val;
+        }
+        return defaultVal;
+    }
+
+    virtual string getName() = 0;
+
+    double computeThreshold() {
+        vector<int> intensities(image.width * image.height);
+
+        for (int x = 0; x < image.width; x++) {
+            for (int y = 0; y < image.height; y++) {
+                int r = image(x, y, 0);
+                int g = image(x, y, 1);
+                int b = image(x, y, 2);
+                intensities.push_back(((r + g + b) / 3));
+            }
+        }
+
+        double sum = 0;
+        for (int& val : intensities) sum += val;
+
+        double mean = sum / intensities.size();
+
+        double variance = 0;
+        for (int& val : intensities) variance += pow(val - mean, 2);
+
+        variance /= intensities.size();
+
+        double standardDeviation = sqrt(variance);
+
+        threshold = mean + 0.6 * standardDeviation;
+
+        return threshold;
+    }
+
+    double getThreshold() {
+        return threshold;
+    }
+
+    bool isInBound(int x = 0, int y = 0) {
+        bool output = true;
+        if (x < 0 || x >= image.width) output = false;
+        if (y < 0 || y >= image.height) output = false;
+
+        return output;
+    }
+    static void resizeImage(Image& img, int newW, int newH) {
+        Image resizedImage(newW, newH);
+
+        double xRatio = static_cast<double>(img.width) / newW;
+        double yRatio = static_cast<double>(img.height) / newH;
+
+        for (int x = 0; x < newW; x++) {
+            for (int y = 0; y < newH; y++) {
+                int nearestX = static_cast<int>(x * xRatio);
+                int nearestY = static_cast<int>(y * yRatio);
+
+                nearestX = min(nearestX, img.width - 1);
+                nearestY = min(nearestY, img.height - 1);
+
+                for (int k = 0; k < img.channels; k++) {
+                    resizedImage(x, y, k) = img(nearestX, nearestY, k);
+                }
+            }
+        }
+
+        img = resizedImage;
+    }
+    // static string getId() {};
+};
+
+class Sunlight : public Filter
+{
+public:
+    Sunlight(Image& img) : Filter(img) {};
+    string getName() { return "Sunlight"; };
+    static string getId() { return "13"; };
+    void apply()
+    {
+        for (int i = 0; i < image.width; i++)
+        {
+            for (int j = 0; j < image.height; j++)
+            {
+                double r = 1.1 * image(i, j, 0);
+                if (r > 255)
+                {
+                    r = 255;
+                }
+                image(i, j, 0) = r;
+                double g = 1.2 * image(i, j, 1);
+                if (g > 255)
+                {
+                    g = 255;
+                }
+                image(i, j, 1) = g;
+                double b = 0.7 * image(i, j, 2);
+                if (b < 0)
+                {
+                    b = 0;
+                }
+                image(i, j, 2) = b;
+            }
+        }
+    }
+    vector<FilterParam> getNeeds() override {return {};};
+};
+class Night : public Filter
+{
+public:
+    Night(Image& img) : Filter(img) {};
+    string getName() { return "Night"; };
+    static string getId() { return "16"; };
+    void apply()
+    {
+        for (int i = 0; i < image.width; i++)
+        {
+            for (int j = 0; j < image.height; j++)
+            {
+                double r = 1.4 * image(i, j, 0);
+                if (r > 255)
+                {
+                    r = 255;
+                }
+                image(i, j, 0) = r;
+                double g = 0.7 * image(i, j, 1);
+                if (g < 0)
+                {
+                    g = 0;
+                }
+                image(i, j, 1) = g;
+                double b = 1.6 * image(i, j, 2);
+                if (b > 255)
+                {
+                    b = 255;
+                }
+                image(i, j, 2) = b;
+            }
+        }
+
+    }
+    vector<FilterParam> getNeeds() override {return {};};
+};
+class Blur : public Filter {
+    int radius;
+
+public:
+    Blur(Image& img, int r = 10) : Filter(img), radius(r) {};
+    string getName() { return "Blur"; };
+    static string getId() { return "12"; };
+    void setParam(const std::string& name, double value) {
+        if (name == "Blur Strength (0:100)") radius = value;
+    }
+
+    vector<FilterParam> getNeeds() {
+        return { {"Blur Strength (0:100)", "float", "5", 0.0, 100.0} };
+    }
+
+    void Prefix_sum(Image& image, vector<vector<ll>>& prefixR, vector<vector<ll>>& prefixG, vector<vector<ll>>& prefixB)
+    {
+        for (int i = 1; i <= image.width; i++)
+        {
+            for (int j = 1; j <= image.height; j++)
+            {
+                ll r = image(i - 1, j - 1, 0);
+                ll g = image(i - 1, j - 1, 1);
+                ll b = image(i - 1, j - 1, 2);
+                prefixR[i][j] = r + prefixR[i - 1][j] + prefixR[i][j - 1] - prefixR[i - 1][j - 1];
+                prefixG[i][j] = g + prefixG[i - 1][j] + prefixG[i][j - 1] - prefixG[i - 1][j - 1];
+                prefixB[i][j] = b + prefixB[i - 1][j] + prefixB[i][j - 1] - prefixB[i - 1][j - 1];
+            }
+        }
+    }
+    void apply() override
+    {
+        try
+        {
+            Image Blured_image(image.width, image.height);
+            vector<vector<ll>> PrefixR(image.width + 1, vector<ll>(image.height + 1, 0));
+            vector<vector<ll>> PrefixG(image.width + 1, vector<ll>(image.height + 1, 0));
+            vector<vector<ll>> PrefixB(image.width + 1, vector<ll>(image.height + 1, 0));
+            Prefix_sum(image, PrefixR, PrefixG, PrefixB);
+            for (int i = 0; i < image.width; i++)
+            {
+                for (int j = 0; j < image.height; j++)
+                {
+                    int x1, x2, y1, y2;
+
+                    x1 = max(0, i - radius);
+                    x2 = min(image.width - 1, i + radius);
+                    y1 = max(0, j - radius);
+                    y2 = min(image.height - 1, j + radius);
+
+                    x1++, x2++, y1++, y2++;
+
+
+                    ll SUM_R, SUM_G, SUM_B;
+                    SUM_R = PrefixR[x2][y2] + PrefixR[x1 - 1][y1 - 1] - PrefixR[x2][y1 - 1] - PrefixR[x1 - 1][y2];
+                    SUM_G = PrefixG[x2][y2] + PrefixG[x1 - 1][y1 - 1] - PrefixG[x2][y1 - 1] - PrefixG[x1 - 1][y2];
+                    SUM_B = PrefixB[x2][y2] + PrefixB[x1 - 1][y1 - 1] - PrefixB[x2][y1 - 1] - PrefixB[x1 - 1][y2];
+
+
+                    ll A = (2 * radius + 1) * (2 * radius + 1);
+
+
+                    Blured_image(i, j, 0) = static_cast<unsigned char>(SUM_R / A);
+                    Blured_image(i, j, 1) = static_cast<unsigned char>(SUM_G / A);
+                    Blured_image(i, j, 2) = static_cast<unsigned char>(SUM_B / A);
+                }
+            }
+            image = Blured_image;
+        }
+        catch (const std::exception& e)
+        {
+            std::cerr << "Error: " << e.what() << std::endl;
+        }
+    }
+};
+class Skewing : public Filter
+{
+    int angle;
+public:
+    Skewing(Image& img) : Filter(img) {};
+    string getName() { return "Horizontal Skew"; };
+    static string getId() { return "18"; };
+    void apply()
+    {
+        try
+        {
+            double tan_angle = tan(angle * M_PI / 180);
+            double slope = -tan_angle;
+            int new_width = image.width + abs(image.height * slope);
+            int checker = 0;
+            if (slope < 0)
+            {
+                checker = abs(image.height * slope);
+            }
+
+            Image Skewed_image(new_width, image.height);
+            for (int x = 0; x < image.width; x++)
+            {
+                for (int y = 0; y < image.height; y++)
+                {
+                    double X = x + (slope * y) + checker;
+                    /*if (X < 0)  X += abs(image.height * slope); */
+                    for (int k = 0; k < 3; k++)
+                    {
+                        if (X >= 0 && X < new_width)
+                        {
+                            Skewed_image(X, y, k) = image(x, y, k);
+                        }
+                    }
+                }
+            }
+            image = Skewed_image;
+        }
+        catch (const std::exception& e) {
+            std::cerr << "Error: " << e.what() << std::endl;
+            throw;
+        }
+    }
+
+    vector<FilterParam> getNeeds() {
+        return {
+            {"Skew Angle (-100:100)", "float", "10",-45, 45}
+        };
+    }
+    void setParam(const std::string& name, double value) {
+        if (name == "Skew Angle (-100:100)") angle = value;
+    }
+};
+class OldTV : public Filter
+{
+public:
+    OldTV(Image& img) : Filter(img) {};
+    string getName() { return "Old TV"; };
+    static string getId() { return "15"; };
+    void apply() override
+    {
+        try {
+            for (int i = 0; i < image.height - 1; i += 2)
+            {
+                for (int j = 0; j < image.width; j++)
+                {
+                    for (int k = 0; k < 3;k++)
+                    {
+                        image(j, i, k) = 0.5 * image(j, i, k);
+                    }
+                }
+            }
+        }
+
+        catch (const std::exception& e) {
+            std::cerr << "Error: " << e.what() << std::endl;
+            throw;
+        }
+    }
+    vector<FilterParam> getNeeds() override {return {};};
+};
+class GreyScale : public Filter
+{
+public:
+    GreyScale(Image& img) : Filter(img) {};
+    string getName() { return "Grey Scale"; };
+    static string getId() { return "1"; };
+    void apply() override
+    {
+        try
+        {
+            for (int i = 0; i < image.width; i++)
+            {
+                for (int j = 0; j < image.height; j++)
+                {
+
+                    unsigned int avg = 0;
+
+                    for (int k = 0; k < 3; k++)
+                    {
+                        avg += image(i, j, k);
+                    }
+
+                    avg /= image.channels; // average
+                    for (int k = 0; k < image.channels; k++)
+                    {
+                        image(i, j, k) = avg;
+                    }
+                }
+            }
+        }
+        catch (const exception& e)
+        {
+            cerr << "Error: " << e.what() << endl;
+            throw;
+        }
+    }
+    vector<FilterParam> getNeeds() override {return {};};
+};
+// Tile t of n along an axis of size pixels starts at t * size / n.
+inline int tileStart(int t, int n, int size) { return int((long long)t * size / n); }
+
+// The last tile whose centre is at or before pixel p, and the next tile's
+// weight out of 256 (0 before the first centre or past the last).
+inline pair<int, int> tileWeight(int p, int n, int size) {
+    auto twiceCentre = [&](int t) { return tileStart(t, n, size) + tileStart(t + 1, n, size) - 1; };
+    int t = 0;
+    for (int k = 1; k < n; k++) {
+        if (twiceCentre(k) <= 2 * p) t = k;
+    }
+    if (t + 1 == n || 2 * p <= twiceCentre(t)) return { t, 0 };
+    int from = twiceCentre(t), to = twiceCentre(t + 1);
+    return { t, ((2 * p - from) * 256 + (to - from) / 2) / (to - from) };
+}
+
+// Brightness histograms of a tiles x tiles grid (fewer if the image is
+// smaller), row by row.
+inline vector<vector<long long>> tileHistograms(Image& image, int& columns, int& rows, int tiles) {
+    columns = max(1, min(tiles, image.width));
+    rows = max(1, min(tiles, image.height));
+    vector<vector<long long>> histograms(columns * rows, vector<long long>(256, 0));
+    for (int i = 0; i < image.width; i++) {
+        for (int j = 0; j < image.height; j++) {
+            int tx = 0, ty = 0;
+            while (tileStart(tx + 1, columns, image.width) <= i) tx++;
+            while (tileStart(ty + 1, rows, image.height) <= j) ty++;
+            histograms[ty * columns + tx][(image(i, j, 0) + image(i, j, 1) + image(i, j, 2)) / 3]++;
+        }
+    }
+    return histograms;
+}
+
+// The bilinear blend, in 1/256ths, of value(tile, level) over the four tiles
+// around pixel (i, j), rounded.
+inline int blendTiles(Image& image, int columns, int rows, int i, int j, int level,
+                      const function<int(int, int)>& value) {
+    pair<int, int> across = tileWeight(i, columns, image.width), down = tileWeight(j, rows, image.height);
+    int tx = across.first, wx = across.second, ty = down.first, wy = down.second;
+    int right = min(tx + 1, columns - 1), below = min(ty + 1, rows - 1);
+    int top = value(ty * columns + tx, level) * (256 - wx) + value(ty * columns + right, level) * wx;
+    int bottom = value(below * columns + tx, level) * (256 - wx) + value(below * columns + right, level) * wx;
+    return (top * (256 - wy) + bottom * wy + 32768) >> 16;
+}
+
+// Histogram equalization table, bins first clipped to clipLimit (0 for none)
+// with the excess spread evenly, the remainder one each from level 0 up.
+inline vector<int> equalizationTable(vector<long long> hist, long long clipLimit) {
+    if (clipLimit > 0) {
+        long long excess = 0;
+        for (int v = 0; v < 256; v++) {
+            if (hist[v] > clipLimit) {
+                excess += hist[v] - clipLimit;
+                hist[v] = clipLimit;
+            }
+        }
+        for (int v = 0; v < 256; v++) hist[v] += excess / 256 + (v < excess % 256 ? 1 : 0);
+    }
+    long long total = 0, darkest = 0;
+    for (int v = 0; v < 256; v++) total += hist[v];
+    for (int v = 0; v < 256 && darkest == 0; v++) darkest = hist[v];
+    vector<int> table(256);
+    long long cdf = 0;
+    for (int v = 0; v < 256; v++) {
+        cdf += hist[v];
+        if (total == darkest) table[v] = v;
+        else if (cdf < darkest) table[v] = 0;
+        else table[v] = int(((cdf - darkest) * 255 + (total - darkest) / 2) / (total - darkest));
+    }
+    return table;
+}
+
+// Moves every channel of pixel (i, j) by level - from, clamped.
+inline void shiftPixel(Image& image, int i, int j, int from, int level) {
+    for (int c = 0; c < 3; c++) image(i, j, c) = min(255, max(0, image(i, j, c) + level - from));
+}
+
+class WhiteAndBlack : public Filter
+{
+    int mode = 1, tiles = 8, offset = 10;
+public:
+    WhiteAndBlack(Image& img) : Filter(img) {};
+    string getName() { return "White and Black"; };
+    static string getId() { return "2"; };
+    void setParam(const std::string& name, double value) {
+        if (name == "Mode (1=Global, 2=Adaptive)") mode = int(value);
+        else if (name == "Tiles (2:16)") tiles = int(min(max(value, 1.0), 64.0));
+        else if (name == "Offset (0:50)") offset = int(min(max(value, -255.0), 255.0));
+    }
+
+    // Each tile's mean brightness less offset, blended between tile centres.
+    void applyAdaptive()
+    {
+        int columns, rows;
+        vector<vector<long long>> histograms = tileHistograms(image, columns, rows, tiles);
+        vector<int> thresholds;
+        for (auto& hist : histograms) {
+            long long sum = 0, count = 0;
+            for (int v = 0; v < 256; v++) {
+                sum += v * hist[v];
+                count += hist[v];
+            }
+            thresholds.push_back(min(255, max(0, int((sum + count / 2) / count) - offset)));
+        }
+        for (int i = 0; i < image.width; i++) {
+            for (int j = 0; j < image.height; j++) {
+                int level = (image(i, j, 0) + image(i, j, 1) + image(i, j, 2)) / 3;
+                int threshold = blendTiles(image, columns, rows, i, j, level, [&](int t, int) { return thresholds[t]; });
+                for (int c = 0; c < 3; c++) image(i, j, c) = level >= threshold ? 255 : 0;
+            }
+        }
+    }
+
+    void apply() override
+    {
+        if (mode == 2) {
+            applyAdaptive();
+            return;
+        }
+        computeThreshold();
+        for (int i = 0; i < image.width; i++)
+        {
+            for (int j = 0; j < image.height; j++)
+            {
+                unsigned short avg = 0;
+                for (int k = 0; k < image.channels; k++)
+                {
+                    avg += image(i, j, k);
+                }
+
+                avg /= image.channels;
+
+                for (int k = 0; k < image.channels; k++)
+                {
+                    image(i, j, k) = (avg >= (threshold) ? 255 : 0);
+                }
+            }
+        }
+    };
+    vector<FilterParam> getNeeds() override {
+        return { {"Mode (1=Global, 2=Adaptive)", "int", "1", 1.0, 2.0},
+                 {"Tiles (2:16)", "int", "8", 2.0, 16.0},
+                 {"Offset (0:50)", "int", "10", 0.0, 50.0} };
+    };
+};
+class Merge : public Filter
+{
+    Image overlay;
+    int mergeType = 1;
+    int mode = 1;
+    double opacity = 100;
+    int offset[2]{ 0, 0 };
+
+    // round(x / 255)
+    static int divide255(int x) { return int(floor(x / 255.0 + 0.5)); }
+
+    int blendSample(int a, int b) const {
+        switch (mode) {
+        case 2: return b;
+        case 3: return divide255(a * b);
+        case 4: return 255 - divide255((255 - a) * (255 - b));
+        case 5: return a < 128 ? divide255(2 * a * b) : 255 - divide255(2 * (255 - a) * (255 - b));
+        case 6: return abs(a - b);
+        default: return (a + b) / 2;
+        }
+    }
+
+public:
+    Merge(Image& img) : Filter(img) {};
+    string getName() { return "Merge"; };
+    static string getId() { return "4"; };
+
+    vector<FilterParam> getNeeds() {
+        return {
+            {"Enter Merge type (1: Stretch to fit, 2: Common):", "int", "1",1, 2},
+            {"Blend Mode (1=Average, 2=Alpha, 3=Multiply, 4=Screen, 5=Overlay, 6=Difference)", "int", "1", 1, 6},
+            {"Opacity (0:100)", "float", "100", 0, 100},
+            {"Overlay X Offset", "int", "0", -double(image.width), double(image.width)},
+            {"Overlay Y Offset", "int", "0", -double(image.height), double(image.height)},
+            {"Overlay Image", "image", ""}
+
+        };
+    }
+    void setParam(const std::string& name, double value) {
+        if (name == "Enter Merge type (1: Stretch to fit, 2: Common):") mergeType = (int)value;
+        else if (name.rfind("Blend Mode", 0) == 0) mode = std::clamp((int)value, 1, 6);
+        else if (name == "Opacity (0:100)") opacity = value;
+        else if (name == "Overlay X Offset") offset[0] = (int)value;
+        else if (name == "Overlay Y Offset") offset[1] = (int)value;
+    }
+    void setParam(const string& name, const Image& img) {
+        if (name == "Overlay Image") overlay = img;
+    }
+
+    // Pixel by pixel over the canvas: where each image lands, stretched by
+    // nearest neighbour; blended where both cover a pixel.
+    void apply() override
+    {
+        Image& base = image;
+        if (overlay.width == 0) throw invalid_argument("Merge needs an overlay image");
+        int weight = int(std::clamp(opacity, 0.0, 100.0) * 2.55 + 0.5);
+
+        int canvasW, canvasH, baseX = 0, baseY = 0, baseW, baseH, overX = offset[0], overY = offset[1], overW, overH;
+        if (mergeType == 2) {
+            int left = std::min(0, offset[0]), top = std::min(0, offset[1]);
+            canvasW = std::max(base.width, offset[0] + overlay.width) - left;
+            canvasH = std::max(base.height, offset[1] + overlay.height) - top;
+            baseX = -left;
+            baseY = -top;
+            overX -= left;
+            overY -= top;
+            baseW = base.width;
+            baseH = base.height;
+            overW = overlay.width;
+            overH = overlay.height;
+        } else {
+            canvasW = baseW = overW = std::max(base.width, overlay.width);
+            canvasH = baseH = overH = std::max(base.height, overlay.height);
+        }
+
+        Image result(canvasW, canvasH);
+        for (int i = 0; i < canvasW; i++) {
+            for (int j = 0; j < canvasH; j++) {
+                bool inBase = i >= baseX && i < baseX + baseW && j >= baseY && j < baseY + baseH;
+                bool inOver = i >= overX && i < overX + overW && j >= overY && j < overY + overH;
+                int bi = 0, bj = 0, oi = 0, oj = 0, w = weight;
+                if (inBase) {
+                    bi = std::min(int((i - baseX) * (double(base.width) / baseW)), base.width - 1);
+                    bj = std::min(int((j - baseY) * (double(base.height) / baseH)), base.height - 1);
+                }
+                if (inOver) {
+                    oi = std::min(int((i - overX) * (double(overlay.width) / overW)), overlay.width - 1);
+                    oj = std::min(int((j - overY) * (double(overlay.height) / overH)), overlay.height - 1);
+                    if (overlay.channels == 4) {
+                        w = divide255(overlay.imageData[(size_t(oj) * overlay.width + oi) * 4 + 3] * weight);
+                    }
+                }
+                for (int k = 0; k < 3; k++) {
+                    int a = inBase ? base(bi, bj, k) : 0;
+                    int value = a;
+                    if (inOver) {
+                        int b = overlay(oi, oj, k);
+                        value = inBase ? divide255(a * (255 - w) + blendSample(a, b) * w) : divide255(b * w);
+                    }
+                    result(i, j, k) = value;
+                }
+            }
+        }
+        base = result;
+    }
+};
+class Flip : public Filter
+{
+    char dir = 'h';
+public:
+    Flip(Image& img) : Filter(img) {};
+    string getName() { return "Flip"; };
+    static string getId() { return "5"; };
+
+    vector<FilterParam> getNeeds() {
+        return {
+            {"Direction (0=Vertical, 1=Horizontal)", "int", "0",0, 1} // 0=Vertical, 1=Horizontal
+        };
+    }
+
+   void setParam(const std::string& name, double value) {
+        if (name == "Direction (0=Vertical, 1=Horizontal)")
+            dir = (value == 0) ? 'v' : 'h';
+    }
+    void apply() override
+    {
+        if (dir == 'h')
+        {
+            for (int i = 0; i < image.height; i++)
+            {
+                for (int j = 0; j < image.width / 2; j++)
+                {
+                    int tempChannels[3] = { 0 };
+                    for (int k = 0; k < image.channels; k++)
+                    {
+                        tempChannels[k] = image(j, i, k);
+                    }
+
+                    for (int k = 0; k < image.channels; k++)
+                    {
+                        image(j, i, k) = image(image.width - j - 1, i, k);
+                    }
+
+                    for (int k = 0; k < image.channels; k++)
+                    {
+                        image(image.width - j - 1, i, k) = tempChannels[k];
+                    }
+                }
+            }
+        }
+        else
+        {
+            for (int j = 0; j < image.width; j++)
+            {
+                for (int i = 0; i < image.height / 2; i++)
+                {
+                    int tempChannels[3] = { 0 };
+                    for (int k = 0; k < image.channels; k++)
+                    {
+                        tempChannels[k] = image(j, i, k);
+                    }
+
+                    for (int k = 0; k < image.channels; k++)
+                    {
+                        image(j, i, k) = image(j, image.height - i - 1, k);
+                    }
+
+                    for (int k = 0; k < image.channels; k++)
+                    {
+                        image(j, image.height - i - 1, k) = tempChannels[k];
+                    }
+                }
+            }
+        }
+    }
+
+};
+class Invert : public Filter {
+public:
+    Invert(Image& img) : Filter(img) {};
+    void apply() override {
+        for (int i = 0; i < image.width; i++) {
+            for (int j = 0; j < image.height; j++) {
+                for (int k = 0; k < 3; k++) {
+                    image(i, j, k) = 255 - image(i, j, k);
+                }
+            }
+        }
+    }
+    string getName() { return "Invert"; };
+    static string getId() { return "3"; };
+
+    vector<FilterParam> getNeeds() override {return {};};
+
+};
+class Rotate : public Filter
+{
+    int angle;
+public:
+    Rotate(Image& img) : Filter(img) {};
+    string getName() { return "Rotate"; };
+    static string getId() { return "6"; };
+
+    void apply() override
+    {
+        try
+        {
+            Image rotated_image;
+            /*angle = 360 - angle; */
+            switch (angle)
+            {
+            case 90:
+            case 270:
+                rotated_image = Image(image.height, image.width);
+                break;
+
+            case 180:
+                rotated_image = Image(image.width, image.height);
+                break;
+            }
+
+            double radian = angle * M_PI / 180.0;
+            double cos_Angle = cos(radian);
+            double sin_Angle = sin(radian);
+
+            int cx = image.width / 2;
+            int cy = image.height / 2;
+
+            int ncx = rotated_image.width / 2;
+            int ncy = rotated_image.height / 2;
+
+            for (int x = 0; x < rotated_image.width; x++)
+            {
+                for (int y = 0; y < rotated_image.height; y++)
+                {
+                    int X = cx + (x - ncx) * cos_Angle + (y - ncy) * sin_Angle;
+                    int Y = cy - (x - ncx) * sin_Angle + (y - ncy) * cos_Angle;
+
+                    if (X >= 0 && X < image.width && Y >= 0 && Y < image.height)
+                    {
+                        for (int k = 0; k < 3; k++)
+                        {
+                            rotated_image(x, y, k) = image(X, Y, k);
+                        }
+                    }
+                }
+            }
+
+            image = rotated_image;
+        }
+        catch (const std::exception& e)
+        {
+            std::cerr << "Error: " << e.what() << std::endl;
+            throw;
+        }
+    }
+
+    vector<FilterParam> getNeeds() {
+        return {
+            {"Rotation Angle (90 / 180 / 270)", "int", "90",90, 270}
+        };
+    }
+    void setParam(const std::string& name, double value) {
+        if (name == "Rotation Angle (90 / 180 / 270)") angle = (int)value;
+    }
+};
+class Brightness : public Filter
+{
+    double value;
+public:
+    Brightness(Image& img) : Filter(img) {};
+    string getName() { return "Brightness"; };
+    static string getId() { return "7"; };
+
+    void apply() override {
+        for (int i = 0; i < image.width; i++) {
+            for (int j = 0; j < image.height; j++) {
+                for (int k = 0; k < 3; k++) {
+                    int newValue = image(i, j, k) * value;
+                    if (newValue > 255) newValue = 255;
+                    if (newValue < 0) newValue = 0;
+                    image(i, j, k) = newValue;
+                }
+            }
+        }
+    }
+
+    vector<FilterParam> getNeeds() {
+        return {
+            {"Brightness (0:5)", "float", "1.0",0.0, 3.0}
+        };
+    }
+    void setParam(const std::string& name, double value) {
+        if (name == "Brightness (0:5)") this->value = value;
+    }
+};
+class Crop : public Filter {
+    int corner[2]{ 0 };
+    int dimensions[2]{ 100 };
+
+public:
+
+    vector<FilterParam> getNeeds() override {
+        return {
+            {"X Corner", "int", "0", 0, double(image.width-1)},
+            {"Y Corner", "int", "0", 0, double(image.height-1)},
+            {"Width", "int", "100", 1, double(image.width)},
+            {"Height", "int", "100", 1, double(image.height)}
+        };
+    }
+
+    // 🛠️ setter مشابه لـ Resize
+    void setParam(const std::string& name, double value) override {
+        if (name == "X Corner") corner[0] = (int)value;
+        else if (name == "Y Corner") corner[1] = (int)value;
+        else if (name == "Width") dimensions[0] = (int)value;
+        else if (name == "Height") dimensions[1] = (int)value;
+    }
+
+    // 🧩 لو محتاج تعيين مباشر (من الكروب بالماوس)
+    void setCropParams(int x, int y, int w, int h) {
+        corner[0] = x; corner[1] = y;
+        dimensions[0] = w; dimensions[1] = h;
+    }
+
+    Crop(Image& img) :Filter(img) {};
+    string getName() { return "Crop"; };
+    static string getId() { return "8"; };
+
+    void apply() override {
+        Image croppedImage(dimensions[0], dimensions[1]);
+
+        for (int i = corner[0], I = 0; i < (corner[0] + dimensions[0]); i++, I++) {
+            for (int j = corner[1], J = 0; j < (corner[1] + dimensions[1]); j++, J++) {
+                for (int k = 0; k < image.channels; k++) {
+                    croppedImage(I, J, k) = image(i, j, k);
+                }
+            }
+        }
+
+
+        image = croppedImage;
+    }
+};
+// Seam carving, with the whole energy map and cost table computed afresh
+// every pass.
+inline vector<int> seamEnergy(Image& image) {
+    int w = image.width, h = image.height;
+    vector<int> grey(size_t(w) * h), energy(size_t(w) * h);
+    const unsigned char* px = image.imageData;
+    for (size_t i = 0; i < grey.size(); i++) grey[i] = (px[i * 3] + px[i * 3 + 1] + px[i * 3 + 2]) / 3;
+    const int* g = grey.data();
+    for (int y = 0; y < h; y++) {
+        const int* above = g + size_t(max(y - 1, 0)) * w;
+        const int* row = g + size_t(y) * w;
+        const int* below = g + size_t(min(y + 1, h - 1)) * w;
+        for (int x = 0; x < w; x++) {
+            int left = x > 0 ? x - 1 : 0, right = x + 1 < w ? x + 1 : w - 1;
+            int gx = (above[right] - above[left]) + 2 * (row[right] - row[left]) + (below[right] - below[left]);
+            int gy = (below[left] - above[left]) + 2 * (below[x] - above[x]) + (below[right] - above[right]);
+            energy[size_t(y) * w + x] = abs(gx) + abs(gy);
+        }
+    }
+    return energy;
+}
+
+// Removes count seams, perPass at a time; removed[y] collects the original
+// columns taken out of row y.
+inline Image carveSeams(Image image, int count, int perPass, vector<vector<int>>& removed) {
+    int h = image.height;
+    vector<int> columns(size_t(image.width) * h);
+    for (size_t i = 0; i < columns.size(); i++) columns[i] = int(i % image.width);
+    removed.assign(h, {});
+    count = min(count, image.width);
+    while (count > 0) {
+        int w = image.width;
+        vector<int> energy = seamEnergy(image);
+        vector<long long> cost(size_t(w) * h);
+        for (int y = 0; y < h; y++) {
+            long long* row = &cost[size_t(y) * w];
+            const long long* above = row - w;
+            for (int x = 0; x < w; x++) {
+                long long best = -1;
+                for (int dx = -1; y > 0 && dx <= 1; dx++) {
+                    if (x + dx < 0 || x + dx >= w) continue;
+                    if (best < 0 || above[x + dx] < best) best = above[x + dx];
+                }
+                row[x] = energy[size_t(y) * w + x] + (best < 0 ? 0 : best);
+            }
+        }
+
+        int seams = min(count, perPass);
+        const long long* bottom = &cost[size_t(h - 1) * w];
+        vector<int> ends(w);
+        for (int x = 0; x < w; x++) ends[x] = x;
+        stable_sort(ends.begin(), ends.end(), [&](int a, int b) { return bottom[a] < bottom[b]; });
+        vector<char> taken(size_t(w) * h, 0);
+        for (int i = 0; i < seams; i++) {
+            int x = ends[i];
+            taken[size_t(h - 1) * w + x] = 1;
+            for (int y = h - 2; y >= 0; y--) {
+                const long long* c = &cost[size_t(y) * w];
+                char* t = &taken[size_t(y) * w];
+                int best = -1;
+                for (int next : { x, x - 1, x + 1 }) {
+                    if (next < 0 || next >= w || t[next]) continue;
+                    if (best < 0 || c[next] < c[best]) best = next;
+                }
+                for (int d = 2; best < 0; d++) {
+                    for (int next : { x - d, x + d }) {
+                        if (next < 0 || next >= w || t[next]) continue;
+                        if (best < 0 || c[next] < c[best]) best = next;
+                    }
+                }
+                x = best;
+                t[x] = 1;
+            }
+        }
+
+        Image carved(w - seams, h);
+        vector<int> kept;
+        kept.reserve(size_t(w - seams) * h);
+        unsigned char* out = carved.imageData;
+        for (size_t i = 0; i < taken.size(); i++) {
+            if (taken[i]) {
+                removed[i / w].push_back(columns[i]);
+                continue;
+            }
+            for (int k = 0; k < 3; k++) *out++ = image.imageData[i * 3 + k];
+            kept.push_back(columns[i]);
+        }
+        image = carved;
+        columns = kept;
+        count -= seams;
+    }
+    return image;
+}
+
+// Inserts after each of the n seams carving would remove the mean of its
+// pixel and the pixel to the right.
+inline Image insertSeams(Image& image, int n, int perPass) {
+    vector<vector<int>> removed;
+    carveSeams(image, n, perPass, removed);
+    Image result(image.width + n, image.height);
+    for (int y = 0; y < image.height; y++) {
+        vector<bool> copied(image.width, false);
+        for (int x : removed[y]) copied[x] = true;
+        int out = 0;
+        for (int x = 0; x < image.width; x++) {
+            for (int k = 0; k < 3; k++) result(out, y, k) = image(x, y, k);
+            out++;
+            if (!copied[x]) continue;
+            int right = min(x + 1, image.width - 1);
+            for (int k = 0; k < 3; k++) result(out, y, k) = (image(x, y, k) + image(right, y, k) + 1) / 2;
+            out++;
+        }
+    }
+    return result;
+}
+
+inline Image seamCarveWidth(Image image, int width, int perPass) {
+    vector<vector<int>> removed;
+    if (image.width > width) image = carveSeams(image, image.width - width, perPass, removed);
+    while (image.width < width) image = insertSeams(image, min(width - image.width, max(1, image.width / 2)), perPass);
+    return image;
+}
+
+inline Image transposeImage(Image& image) {
+    Image result(image.height, image.width);
+    for (int y = 0; y < image.height; y++)
+        for (int x = 0; x < image.width; x++)
+            for (int k = 0; k < 3; k++) result(y, x, k) = image(x, y, k);
+    return result;
+}
+
+class Resize : public Filter {
+    int dimensions[2]{ 100 };
+    bool keepAspect = true;
+    int mode = 1;
+    int seamsPerPass = 16;
+
+public:
+    Resize(Image& img) :Filter(img) {};
+    vector<FilterParam> getNeeds() {
+        return {
+            {"Width", "int", "800", 10, double(image.width)},
+            {"Height", "int", "600", 10, double(image.height)},
+            {"Keep Aspect Ratio", "bool", "1", 0, 1},
+            {"Mode (1=Stretch, 2=Seam Carving)", "int", "1", 1, 2},
+            {"Seams per Pass (1:64)", "int", "16", 1, 64}
+        };
+    }
+    void setParam(const std::string& name, double value) {
+        if (name == "Width") dimensions[0] = (int)value;
+        else if (name == "Height") dimensions[1] = (int)value;
+        else if (name == "Keep Aspect Ratio") keepAspect = (bool)value;
+        else if (name == "Mode (1=Stretch, 2=Seam Carving)") mode = (int)value;
+        else if (name == "Seams per Pass (1:64)") seamsPerPass = (int)min(max(value, 1.0), 64.0);
+    }
+    string getName() { return "Resizing"; };
+    static string getId() { return "11"; };
+
+    void apply() override {
+        if (mode == 2) {
+            int width = max(1, dimensions[0]), height = max(1, dimensions[1]);
+            image = seamCarveWidth(image, width, seamsPerPass);
+            if (image.height != height) {
+                Image across = transposeImage(image);
+                across = seamCarveWidth(across, height, seamsPerPass);
+                image = transposeImage(across);
+            }
+            return;
+        }
+        resizeImage(image, dimensions[0], dimensions[1]);
+    }
+};
+class OilPainting : public Filter {
+protected:
+    int intensityLevels;
+
+public:
+    OilPainting(Image& img) :Filter(img) {};
+    vector<FilterParam> getNeeds() {
+        return {
+            {"Detail Level (10:70)", "int", "20",10, 30}
+        };
+    }
+    void setParam(const std::string& name, double value) {
+        if (name == "Detail Level (10:70)") intensityLevels = (int)value;
+    }
+
+    string getName() { return "Oil Painting"; };
+    static string getId() { return "14"; };
+
+    void apply() override {
+        Image output(image.width, image.height);
+        for (int x = 0; x < image.width; x++) {
+            for (int y = 0; y < image.height; y++) {
+
+                for (int k = 0; k < image.channels; k++) {
+                    int intensity = image(x, y, k);
+                    int binIndex = (intensity * intensityLevels) / 255;
+                    if (binIndex >= intensityLevels) binIndex = intensityLevels - 1;
+
+                    int newIntensity = (binIndex * 255) / (intensityLevels - 1);
+
+                    output(x, y, k) = newIntensity;
+                }
+            }
+        }
+        image = output;
+    }
+};
+class ArtisticBrush : public OilPainting {
+    int radius;
+
+public:
+    ArtisticBrush(Image& img) : OilPainting(img) {};
+    vector<FilterParam> getNeeds() {
+        return {
+            {"Brush Width (2:7)", "int", "3", 2, 7},
+            {"Detail Level (10:70)", "int", "20",10, 30}
+        };
+    }
+    void setParam(const std::string& name, double value) {
+        if (name == "Brush Width (2:7)") radius = (int)value;
+        else if (name == "Detail Level (10:70)") intensityLevels = (int)value;
+    }
+    string getName() { return "Artistic Brush"; };
+    static string getId() { return "22"; };
+
+    void apply() override {
+        Image output(image.width, image.height);
+
+        for (int x = 0; x < image.width; x++) {
+            for (int y = 0; y < image.height; y++) {
+                vector<int> intensityCount(intensityLevels, 0);
+                vector<int> avgR(intensityLevels, 0);
+                vector<int> avgG(intensityLevels, 0);
+                vector<int> avgB(intensityLevels, 0);
+
+                int count = 0;
+                for (int ny = y - radius; ny <= (y + radius); ny++) {
+                    for (int nx = x - radius; nx <= (x + radius); nx++) {
+                        if (isInBound(nx, ny)) {
+                            count++;
+                            int r = image(nx, ny, 0);
+                            int g = image(nx, ny, 1);
+                            int b = image(nx, ny, 2);
+
+                            int intensity = (r + g + b) / 3;
+
+                            int binIndex = (intensity * (intensityLevels - 1)) / 255;
+
+                            intensityCount[binIndex]++;
+                            avgR[binIndex] += r;
+                            avgG[binIndex] += g;
+                            avgB[binIndex] += b;
+                        }
+                    }
+                }
+
+                int maxBin = 0;
+                int maxCount = 0;
+                for (int i = 0; i < intensityLevels; i++) {
+                    if (maxCount < intensityCount[i]) {
+                        maxBin = i;
+                        maxCount = intensityCount[i];
+                    }
+                }
+
+                if (maxCount) { // I mean maxCount > 0; but logically if maxCount was not zero then it is a true value;
+                    output(x, y, 0) = avgR[maxBin] / maxCount;
+                    output(x, y, 1) = avgG[maxBin] / maxCount;
+                    output(x, y, 2) = avgB[maxBin] / maxCount;
+                }
+            }
+        }
+        image = output;
+    }
+
+};
+class Infrared : public Filter {
+    int radius;
+
+public:
+    Infrared(Image& img) : Filter(img) {};
+    vector<FilterParam> getNeeds() override {return {};};
+    string getName() { return "Infrared"; };
+    static string getId() { return "17"; };
+
+    void apply() override {
+        for (int x = 0; x < image.width; x++) {
+            for (int y = 0; y < image.height; y++) {
+                int redChannel = 0;
+                for (int k = 0; k < image.channels; k++) {
+                    redChannel += image(x, y, k);
+                }
+                redChannel /= image.channels;
+
+                image(x, y, 0) = 255;
+                image(x, y, 1) = 255 - redChannel;
+                image(x, y, 2) = 255 - redChannel;
+            }
+        }
+    }
+};
+class Bloody : public Filter {
+    int radius;
+
+public:
+    Bloody(Image& img) : Filter(img) {};
+    vector<FilterParam> getNeeds() override {return {};};
+    string getName() { return "Bloody"; };
+    static string getId() { return "19"; };
+
+    void apply() override {
+        for (int x = 0; x < image.width; x++) {
+            for (int y = 0; y < image.height; y++) {
+                int redChannel = 0;
+                for (int k = 0; k < image.channels; k++) {
+                    redChannel += image(x, y, k);
+                }
+                redChannel /= image.channels;
+
+                image(x, y, 0) = redChannel;
+                image(x, y, 1) = 0;
+                image(x, y, 2) = 0;
+            }
+        }
+    }
+
+};
+class Sky : public Filter {
+public:
+    Sky(Image& img) : Filter(img) {};
+    vector<FilterParam> getNeeds() override {return {};};
+    string getName() { return "Sky"; };
+    static string getId() { return "21"; };
+
+    void apply() override {
+        for (int x = 0; x < image.width; x++) {
+            for (int y = 0; y < image.height; y++) {
+                int blueChannel = 0;
+                for (int k = 0; k < image.channels; k++) {
+                    blueChannel += image(x, y, k);
+                }
+                blueChannel /= image.channels;
+
+                image(x, y, 0) = 0;
+                image(x, y, 1) = blueChannel / 2;
+                image(x, y, 2) = blueChannel;
+            }
+        }
+    }
+
+};
+class Grass: public Filter {
+
+public:
+    Grass(Image& img) : Filter(img) {};
+    string getName() { return "Grass"; };
+    static string getId() { return "20"; };
+
+    void apply() override {
+        for (int x = 0; x < image.width; x++) {
+            for (int y = 0; y < image.height; y++) {
+                int intensity = 0;
+                for (int k = 0; k < image.channels; k++) {
+                    intensity += image(x, y, k);
+                }
+                intensity /= image.channels;
+
+                image(x, y, 0) = 0;
+                image(x, y, 1) = intensity;
+                image(x, y, 2) = 0;
+            }
+        }
+
+    }
+    vector<FilterParam> getNeeds() override {return {};};
+
+};
+class Frame : public Filter {
+    int Thickness;
+    int R, G, B;
+    bool isDecorative;
+
+public:
+    Frame(Image& img) : Filter(img), R(0), G(0), B(0), Thickness(1), isDecorative(false) {}
+
+    string getName() { return "Frame"; }
+    static string getId() { return "9"; }
+
+    vector<FilterParam> getNeeds() {
+        return {
+            {"Frame Type (1=Normal, 2=Decorative)", "int","1", 1, 2},
+            {"Frame Color", "color","", 0, 0},
+            {"Thickness", "int","10", 1, 50}
+        };
+    }
+
+    void setParam(const std::string& name, double value) {
+        if (name.find("Frame Type") != string::npos) isDecorative = (value == 2);
+        if (name == "Thickness") Thickness = value;
+    }
+
+    void setParam(const std::string& name, const std::string& color) {
+        if (color.size() == 7 && color[0] == '#') {
+            R = std::stoi(color.substr(1, 2), nullptr, 16);
+            G = std::stoi(color.substr(3, 2), nullptr, 16);
+            B = std::stoi(color.substr(5, 2), nullptr, 16);
+        } else {
+            R = G = B = 0; // fallback لو الصيغة غلط
+        }
+    }
+
+    void apply() override
+    {
+        int width = image.width;
+        int height = image.height;
+
+        if (!isDecorative) {
+            for (int i = 0; i < width; i++) {
+                for (int t = 0; t < Thickness; t++) {
+                    image(i, t, 0) = R;
+                    image(i, t, 1) = G;
+                    image(i, t, 2) = B;
+                }
+            }
+            for (int i = 0; i < width; i++) {
+                for (int t = 0; t < Thickness; t++) {
+                    image(i, height - 1 - t, 0) = R;
+                    image(i, height - 1 - t, 1) = G;
+                    image(i, height - 1 - t, 2) = B;
+                }
+            }
+            for (int i = 0; i < height; i++) {
+                for (int t = 0; t < Thickness; t++) {
+                    image(t, i, 0) = R;
+                    image(t, i, 1) = G;
+                    image(t, i, 2) = B;
+                }
+            }
+            for (int i = 0; i < height; i++) {
+                for (int t = 0; t < Thickness; t++) {
+                    image(width - 1 - t, i, 0) = R;
+                    image(width - 1 - t, i, 1) = G;
+                    image(width - 1 - t, i, 2) = B;
+                }
+            }
+        }
+
+        else
+        {
+            RGB inner = { 255, 255, 255 };
+            int outerThickness = Thickness;
+            int innerThickness = Thickness / 2;
+            for (int i = 0; i < width; i++) {
+                for (int t = 0; t < outerThickness; t++) {
+                    image(i, t, 0) = R;
+                    image(i, t, 1) = G;
+                    image(i, t, 2) = B;
+                }
+            }
+            for (int i = 0; i < width; i++)
+            {
+                for (int t = 0; t < outerThickness; t++)
+                {
+                    image(i, height - 1 - t, 0) = R;
+                    image(i, height - 1 - t, 1) = G;
+                    image(i, height - 1 - t, 2) = B;
+                }
+            }
+            for (int i = 0; i < height; i++)
+            {
+                for (int t = 0; t < outerThickness; t++) {
+                    image(t, i, 0) = R;
+                    image(t, i, 1) = G;
+                    image(t, i, 2) = B;
+                }
+            }
+            for (int i = 0; i < height; i++)
+            {
+                for (int t = 0; t < outerThickness; t++) {
+                    image(width - 1 - t, i, 0) = R;
+                    image(width - 1 - t, i, 1) = G;
+                    image(width - 1 - t, i, 2) = B;
+                }
+            }
+            for (int i = outerThickness; i < width - outerThickness; i++)
+            {
+                for (int t = 0; t < innerThickness; t++) {
+                    image(i, outerThickness + t, 0) = inner.R;
+                    image(i, outerThickness + t, 1) = inner.G;
+                    image(i, outerThickness + t, 2) = inner.B;
+                }
+            }
+            for (int i = outerThickness; i < width - outerThickness; i++)
+            {
+                for (int t = 0; t < innerThickness; t++) {
+                    image(i, height - outerThickness - 1 - t, 0) = inner.R;
+                    image(i, height - outerThickness - 1 - t, 1) = inner.G;
+                    image(i, height - outerThickness - 1 - t, 2) = inner.B;
+                }
+            }
+            for (int i = outerThickness; i < height - outerThickness; i++)
+            {
+                for (int t = 0; t < innerThickness; t++)
+                {
+                    image(outerThickness + t, i, 0) = inner.R;
+                    image(outerThickness + t, i, 1) = inner.G;
+                    image(outerThickness + t, i, 2) = inner.B;
+                }
+            }
+            for (int i = outerThickness; i < height - outerThickness; i++)
+            {
+                for (int t = 0; t < innerThickness; t++)
+                {
+                    image(width - outerThickness - 1 - t, i, 0) = inner.R;
+                    image(width - outerThickness - 1 - t, i, 1) = inner.G;
+                    image(width - outerThickness - 1 - t, i, 2) = inner.B;
+                }
+            }
+        }
+
+
+    }
+};
+class EdgeDetection : public Filter {
+
+public:
+    EdgeDetection(Image& img) : Filter(img){}
+
+    string getName() { return "Edge Detection"; }
+    static string getId() { return "10"; }
+    static map<string,vector<vector<int>>> sobelKernels () {
+        return {
+            {"Gx",{
+                       {-1,0,1},
+                       {-2,0,2},
+                       {-1,0,1}
+                   }},
+            {"Gy", {
+                       {-1,-2,-1},
+                       {0,0,0},
+                       {1,2,1}
+                   }}
+        };
+    }
+    vector<FilterParam> getNeeds() override {return {};};
+    void apply() override {
+        GreyScale grey(image);
+        grey.apply();
+        Blur blur(image, 2);
+        blur.apply();
+
+        Image output(image.width, image.height);
+        memset(output.imageData, 255, output.byteSize()); // the border: no edge
+        map<string,vector<vector<int>>> kernels = sobelKernels();
+        computeThreshold();
+        for (int x = 1; x < image.width-1; x++) {
+            for (int y = 1; y < image.height-1; y++) {
+                int sumX = 0;
+                int sumY = 0;
+                for (int i = -1; i <= 1; i++ ) {
+                    for (int j = -1; j <= 1; j++ ) {
+                        int intensity = image(x+i,y+j,0);
+                        sumX += intensity * kernels["Gx"][i+1][j+1];
+                        sumY += intensity * kernels["Gy"][i+1][j+1];
+                    }
+                }
+                int magnitude = sqrt((sumX*sumX)+(sumY*sumY));
+                if (magnitude > threshold) magnitude = 0;
+                else magnitude = 255;
+                output(x,y,0) = output(x,y,1) = output(x,y,2) = magnitude;
+            }
+        }
+
+        image = output;
+    }
+};
+
+
+class Gama : public Filter
+{
+    double gama;
+public:
+    Gama(Image& img) : Filter(img) {};
+    string getName() { return "Gama"; };
+    static string getId(){ return "25"; };
+    void apply() override {
+        for (int i = 0; i < image.width; i++)
+        {
+            for (int j = 0; j < image.height;j++)
+            {
+                float Val = pow(image(i, j, 0) / 255.0f, gama);
+                int Nr = min(int(255 * Val), 255);
+                image(i, j, 0) = Nr;
+                Val = pow(image(i, j, 1) / 255.0f, gama);
+                int Ng = min(int(255 * Val), 255);
+                image(i, j, 1) = Ng;
+
+                Val = pow(image(i, j, 2) / 255.0f, gama);
+                int Nb = min(int(255 * Val), 255);
+                image(i, j, 2) = Nb;
+            }
+        }
+    };
+
+    vector<FilterParam> getNeeds() {
+        return {
+            {"Enter Value between [0 , 10]", "float", "1.0",0.0, 10}
+        };
+    }
+    void setParam(const std::string& name, double value) {
+        if (name == "Enter Value between [0 , 10]") this->gama = value;
+    }
+};
+
+
+class HeatMap : public Filter
+{
+    double p;
+public:
+    HeatMap(Image& img) : Filter(img) {};
+    string getName() { return "Heat Map"; };
+    static string getId(){ return "26"; };
+    void apply() override {
+        for (int i = 0; i < image.width; i++){
+            for (int j = 0;j < image.height;j++)
+            {
+                float R = static_cast<float>(image(i, j, 0));
+                float G = static_cast<float>(image(i, j, 1));
+                float B = static_cast<float>(image(i, j, 2));
+                float mean_ntensity = (R + G + B) / 3.0f;
+
+                if (mean_ntensity < 64)
+                {
+                    image(i , j , 0 ) = 0 ;
+                    image(i, j, 1) = 0;
+                    image(i, j, 2) = 255;
+                }
+                else if (mean_ntensity < 128)
+                {
+                    image(i, j, 0) = 0;
+                    image(i, j, 1) = 255;
+                    image(i, j, 2) =0;
+                }
+                else if (mean_ntensity < 192)
+                {
+                    image(i, j, 0) = 255;
+                    image(i, j, 1) = 255;
+                    image(i, j, 2) = 0;
+                }
+                else
+                {
+                    image(i, j, 0) = 255;
+                    image(i, j, 1) = 0;
+                    image(i, j, 2) = 0;
+                }
+
+            }
+        }
+    };
+
+    vector<FilterParam> getNeeds() {
+        return {
+        };
+    }
+};
+
+
+
+class Saturation : public Filter
+{
+    double p;
+public:
+    Saturation(Image& img) : Filter(img) {};
+    string getName() { return "Saturation"; };
+    static string getId(){ return "23"; };
+    HSV rgbToHsv(const RGB& rgb) {
+        float r = rgb.R / 255.0f;
+        float g = rgb.G / 255.0f;
+        float b = rgb.B / 255.0f;
+
+        float maxVal = max({ r, g, b });
+        float minVal = min({ r, g, b });
+        float diff = maxVal - minVal;
+
+        HSV hsv;
+        hsv.v = maxVal;
+
+        if (maxVal == 0)
+            hsv.s = 0;
+        else
+            hsv.s = diff / maxVal;
+
+        if (diff == 0)
+            hsv.h = 0;
+        else if (maxVal == r)
+            hsv.h = 60 * fmod(((g - b) / diff), 6.0);
+        else if (maxVal == g)
+            hsv.h = 60 * (((b - r) / diff) + 2);
+        else
+            hsv.h = 60 * (((r - g) / diff) + 4);
+
+        if (hsv.h < 0) hsv.h += 360;
+
+        return hsv;
+    }
+    RGB hsvToRgb(const HSV& hsv) {
+        double C = hsv.v * hsv.s;
+        double X = C * (1 - fabs(fmod(hsv.h / 60.0, 2) - 1));
+        double m = hsv.v - C;
+
+        double rPrime, gPrime, bPrime;
+
+        if (hsv.h >= 0 && hsv.h < 60)
+            rPrime = C, gPrime = X, bPrime = 0;
+        else if (hsv.h >= 60 && hsv.h < 120)
+            rPrime = X, gPrime = C, bPrime = 0;
+        else if (hsv.h >= 120 && hsv.h < 180)
+            rPrime = 0, gPrime = C, bPrime = X;
+        else if (hsv.h >= 180 && hsv.h < 240)
+            rPrime = 0, gPrime = X, bPrime = C;
+        else if (hsv.h >= 240 && hsv.h < 300)
+            rPrime = X, gPrime = 0, bPrime = C;
+        else
+            rPrime = C, gPrime = 0, bPrime = X;
+
+        RGB out;
+        out.R = (rPrime + m) * 255;
+        out.G = (gPrime + m) * 255;
+        out.B = (bPrime + m) * 255;
+
+        return out;
+    }
+
+
+    void apply() override {
+        for (int i = 0; i < image.width; i++) {
+            for (int j = 0; j < image.height; j++) {
+                RGB color = { image(i, j, 0), image(i, j, 1), image(i, j, 2) };
+                HSV hsv = rgbToHsv(color);
+
+                hsv.s *= (p / 100.0f);
+                hsv.s = min(max(hsv.s, 0.0f), 1.0f);
+
+                RGB newColor = hsvToRgb(hsv);
+
+                image(i, j, 0) = static_cast<unsigned char>(newColor.R);
+                image(i, j, 1) = static_cast<unsigned char>(newColor.G);
+                image(i, j, 2) = static_cast<unsigned char>(newColor.B);
+            }
+        }
+    };
+
+    vector<FilterParam> getNeeds() {
+        return {
+            {"Enter saturation percentage (100 = normal, >100 = more color, <100 = less color):", "float", "1.0",0.0, 10}
+        };
+    }
+    void setParam(const std::string& name, double value) {
+        if (name == "Enter saturation percentage (100 = normal, >100 = more color, <100 = less color):") this->p = value;
+    }
+};
+
+
+
+class OldPhoto : public Filter
+{
+    double p;
+public:
+    OldPhoto (Image& img) : Filter(img) {};
+    string getName() { return "Old Photo"; };
+    static string getId(){ return "24"; };
+
+    void apply() override {
+        for (int i = 0; i < image.width; i++)
+        {
+            for (int j = 0; j < image.height; j++)
+            {
+
+                int Nr = 0.4 * image(i, j, 0 ) + 0.75 * image(i, j, 1) + 0.2 * image(i, j, 2);
+                Nr = min(255, Nr);
+                int Ng = 0.35* image(i, j, 0)  + 0.7 * image(i, j, 1) + 0.15*image(i, j, 2);
+                Ng = min(255, Ng);
+                int Nb = 0.2 * image(i, j, 0) +  0.55*image(i, j, 1)  + 0.13* image(i, j, 2);
+                Nb = min(255, Nb);
+                image(i, j, 0) = Nr;
+                image(i, j, 1) = Ng;
+                image(i, j, 2) = Nb;
+            }
+        }
+    }
+
+    vector<FilterParam> getNeeds() {
+        return {
+        };
+    }
+};
+
+
+
+class Snow : public Filter
+{
+    uint64_t seed = 1;
+public:
+    Snow(Image& img) : Filter(img) {};
+    string getName() { return "Snow"; };
+    static string getId(){ return "27"; };
+
+    void setParam(const std::string& name, double value) {
+        if (name == "Seed") seed = uint64_t(max(0.0, value));
+    }
+
+    // Row y draws from Philox substream y: a geometric gap of -30 ln(u)
+    // pixels to the next flake, then the flake's grey, 200..255.
+    void apply() override {
+        for (int y = 0; y < image.height; y++) {
+            rng::Philox flakes(seed, 0x536e6f77, y);
+            int x = -1;
+            while (true) {
+                x += 1 + int(-30 * log(flakes.uniformPositive()));
+                if (x >= image.width) break;
+
+                int snowValue = 200 + flakes.below(56);
+
+                image(x, y, 0) = snowValue;
+                image(x, y, 1) = snowValue;
+                image(x, y, 2) = snowValue;
+            }
+        }
+    }
+
+    vector<FilterParam> getNeeds() {
+        return { {"Seed", "int", "1", 0.0, 1000000.0} };
+    }
+};
+
+class Colormap : public Filter
+{
+    int kind = 1;
+    int startColor[3] = { 0, 0, 0 }, endColor[3] = { 255, 255, 255 };
+public:
+    Colormap(Image& img) : Filter(img) {};
+    string getName() { return "Colormap"; };
+    static string getId(){ return "28"; };
+
+    void setParam(const std::string& name, double value) {
+        if (name.rfind("Palette", 0) == 0) kind = int(value);
+    }
+
+    void setParam(const std::string& name, const std::string& color) {
+        int* target = name == "Gradient Start" ? startColor : name == "Gradient End" ? endColor : nullptr;
+        if (!target || color.size() != 7 || color[0] != '#') return;
+        for (size_t i = 1; i < 7; i++) {
+            if (!isxdigit(static_cast<unsigned char>(color[i]))) return;
+        }
+        for (int c = 0; c < 3; c++) target[c] = std::stoi(color.substr(1 + 2 * c, 2), nullptr, 16);
+    }
+
+    // Evenly spaced stops, linear between them, rounded to nearest.
+    void apply() override {
+        vector<array<int, 3>> stops;
+        if (kind == 2) {
+            stops = { {0, 0, 4}, {27, 12, 66}, {75, 12, 107}, {120, 28, 109}, {165, 44, 96},
+                      {207, 68, 70}, {237, 105, 37}, {251, 154, 6}, {247, 208, 60}, {252, 255, 164} };
+        } else if (kind == 3) {
+            stops = { {startColor[0], startColor[1], startColor[2]}, {endColor[0], endColor[1], endColor[2]} };
+        } else {
+            stops = { {68, 1, 84}, {72, 40, 120}, {62, 73, 137}, {49, 104, 142}, {38, 130, 142},
+                      {31, 158, 137}, {53, 183, 121}, {110, 206, 88}, {181, 222, 43}, {253, 231, 37} };
+        }
+        for (int i = 0; i < image.width; i++) {
+            for (int j = 0; j < image.height; j++) {
+                int intensity = (image(i, j, 0) + image(i, j, 1) + image(i, j, 2)) / 3;
+                double position = intensity / 255.0 * (stops.size() - 1);
+                int at = min(int(position), int(stops.size()) - 2);
+                for (int c = 0; c < 3; c++) {
+                    double value = stops[at][c] + (stops[at + 1][c] - stops[at][c]) * (position - at);
+                    image(i, j, c) = int(floor(value + 0.5));
+                }
+            }
+        }
+    }
+
+    vector<FilterParam> getNeeds() {
+        return {
+            {"Palette (1=Viridis, 2=Inferno, 3=Gradient)", "int", "1", 1, 3},
+            {"Gradient Start", "color", "", 0, 0},
+            {"Gradient End", "color", "", 0, 0}
+        };
+    }
+};
+
+class Median : public Filter
+{
+    int radius = 2;
+public:
+    Median(Image& img) : Filter(img) {};
+    string getName() { return "Median"; };
+    static string getId(){ return "29"; };
+
+    void setParam(const std::string& name, double value) {
+        if (name == "Radius (1:100)") radius = int(min(max(value, 0.0), 127.0));
+    }
+
+    // Counts the (2r+1)^2 window with coordinates clamped to the image: a
+    // pixel is counted once per window position that clamps onto it.
+    void apply() override {
+        Image result(image.width, image.height);
+        for (int i = 0; i < image.width; i++) {
+            for (int j = 0; j < image.height; j++) {
+                long long counts[3][256] = {};
+                for (int x = max(0, i - radius); x <= min(image.width - 1, i + radius); x++) {
+                    int across = 1;
+                    if (x == 0) across += radius - i;
+                    if (x == image.width - 1) across += i + radius - (image.width - 1);
+                    for (int y = max(0, j - radius); y <= min(image.height - 1, j + radius); y++) {
+                        int down = 1;
+                        if (y == 0) down += radius - j;
+                        if (y == image.height - 1) down += j + radius - (image.height - 1);
+                        for (int c = 0; c < 3; c++) counts[c][image(x, y, c)] += across * down;
+                    }
+                }
+                long long half = (2LL * radius + 1) * (2 * radius + 1) / 2;
+                for (int c = 0; c < 3; c++) {
+                    long long below = 0;
+                    int v = 0;
+                    while (below + counts[c][v] <= half) below += counts[c][v++];
+                    result(i, j, c) = v;
+                }
+            }
+        }
+        image = result;
+    }
+
+    vector<FilterParam> getNeeds() {
+        return { {"Radius (1:100)", "int", "2", 1.0, 100.0} };
+    }
+};
+
+class Kuwahara : public Filter
+{
+    int radius = 4;
+public:
+    Kuwahara(Image& img) : Filter(img) {};
+    string getName() { return "Kuwahara"; };
+    static string getId(){ return "30"; };
+
+    void setParam(const std::string& name, double value) {
+        if (name == "Brush Size (1:100)") radius = int(min(max(value, 0.0), 100.0));
+    }
+
+    // Sums each clipped quadrant pixel by pixel.
+    void apply() override {
+        Image result(image.width, image.height);
+        for (int i = 0; i < image.width; i++) {
+            for (int j = 0; j < image.height; j++) {
+                double bestSpread = 0;
+                long long best[3] = {}, bestCount = 1;
+                for (int q = 0; q < 4; q++) {
+                    int x0 = q & 1 ? i : i - radius, y0 = q & 2 ? j : j - radius;
+                    long long sum[3] = {}, total = 0, squares = 0, count = 0;
+                    for (int x = max(0, x0); x <= min(image.width - 1, x0 + radius); x++) {
+                        for (int y = max(0, y0); y <= min(image.height - 1, y0 + radius); y++) {
+                            long long s = 0;
+                            for (int c = 0; c < 3; c++) {
+                                sum[c] += image(x, y, c);
+                                s += image(x, y, c);
+                            }
+                            total += s;
+                            squares += s * s;
+                            count++;
+                        }
+                    }
+                    double spread = double(count * squares - total * total) / double(count * count);
+                    if (q == 0 || spread < bestSpread) {
+                        bestSpread = spread;
+                        bestCount = count;
+                        for (int c = 0; c < 3; c++) best[c] = sum[c];
+                    }
+                }
+                for (int c = 0; c < 3; c++) result(i, j, c) = int((best[c] + bestCount / 2) / bestCount);
+            }
+        }
+        image = result;
+    }
+
+    vector<FilterParam> getNeeds() {
+        return { {"Brush Size (1:100)", "int", "4", 1.0, 100.0} };
+    }
+};
+
+class Bilateral : public Filter
+{
+    int sigmaSpace = 16, sigmaRange = 20;
+public:
+    Bilateral(Image& img) : Filter(img) {};
+    string getName() { return "Bilateral"; };
+    static string getId(){ return "31"; };
+
+    void setParam(const std::string& name, double value) {
+        if (name == "Spatial Sigma (4:100)") sigmaSpace = int(min(max(value, 1.0), 1000.0));
+        else if (name == "Range Sigma (4:100)") sigmaRange = int(min(max(value, 1.0), 255.0));
+    }
+
+    // The grid as nested vectors of doubles, one padding cell each side:
+    // splat to the nearest cell, 1 4 6 4 1 along each axis, trilinear slice.
+    void apply() override {
+        double space = sigmaSpace, range = sigmaRange;
+        int nx = int((image.width - 1) / space + 0.5) + 3, ny = int((image.height - 1) / space + 0.5) + 3;
+        int nz = int(255 / range + 0.5) + 2;
+        vector<vector<vector<array<double, 4>>>> grid(nx, vector<vector<array<double, 4>>>(ny, vector<array<double, 4>>(nz, array<double, 4>{})));
+        for (int i = 0; i < image.width; i++) {
+            for (int j = 0; j < image.height; j++) {
+                int grey = (image(i, j, 0) + image(i, j, 1) + image(i, j, 2)) / 3;
+                auto& cell = grid[int(i / space + 0.5) + 1][int(j / space + 0.5) + 1][int(grey / range + 0.5)];
+                for (int c = 0; c < 3; c++) cell[c] += image(i, j, c);
+                cell[3] += 1;
+            }
+        }
+        const double kernel[5] = { 1, 4, 6, 4, 1 };
+        auto blurred = grid;
+        for (int axis = 0; axis < 3; axis++) {
+            for (int x = 0; x < nx; x++) {
+                for (int y = 0; y < ny; y++) {
+                    for (int z = 0; z < nz; z++) {
+                        array<double, 4> sum{};
+                        for (int t = -2; t <= 2; t++) {
+                            int at[3] = { x, y, z };
+                            at[axis] += t;
+                            if (at[axis] < 0 || at[axis] >= (axis == 0 ? nx : axis == 1 ? ny : nz)) continue;
+                            for (int k = 0; k < 4; k++) sum[k] += kernel[t + 2] * grid[at[0]][at[1]][at[2]][k];
+                        }
+                        blurred[x][y][z] = sum;
+                    }
+                }
+            }
+            grid = blurred;
+        }
+        for (int i = 0; i < image.width; i++) {
+            for (int j = 0; j < image.height; j++) {
+                int grey = (image(i, j, 0) + image(i, j, 1) + image(i, j, 2)) / 3;
+                double px = i / space, py = j / space, pz = grey / range;
+                int ix = int(px), iy = int(py), iz = int(pz);
+                double sum[4] = {};
+                for (int dx = 0; dx <= 1; dx++) {
+                    for (int dy = 0; dy <= 1; dy++) {
+                        for (int dz = 0; dz <= 1; dz++) {
+                            double w = (dx ? px - ix : 1 - (px - ix)) * (dy ? py - iy : 1 - (py - iy)) *
+                                       (dz ? pz - iz : 1 - (pz - iz));
+                            for (int k = 0; k < 4; k++) sum[k] += w * grid[ix + dx + 1][iy + dy + 1][iz + dz][k];
+                        }
+                    }
+                }
+                if (sum[3] <= 0) continue;
+                for (int c = 0; c < 3; c++) image(i, j, c) = int(min(255.0, sum[c] / sum[3] + 0.5));
+            }
+        }
+    }
+
+    vector<FilterParam> getNeeds() {
+        return { {"Spatial Sigma (4:100)", "int", "16", 4.0, 100.0},
+                 {"Range Sigma (4:100)", "int", "20", 4.0, 100.0} };
+    }
+};
+
+// The mean of each sample's (2r+1)^2 box clipped to the image, rounded, from
+// 2-D prefix sums; shared by the UnsharpMask and Clarity references.
+inline Image boxMean(Image& image, int radius) {
+    Image mean(image.width, image.height);
+    for (int c = 0; c < 3; c++) {
+        vector<vector<ll>> prefix(image.width + 1, vector<ll>(image.height + 1, 0));
+        for (int i = 1; i <= image.width; i++) {
+            for (int j = 1; j <= image.height; j++) {
+                prefix[i][j] = image(i - 1, j - 1, c) + prefix[i - 1][j] + prefix[i][j - 1] - prefix[i - 1][j - 1];
+            }
+        }
+        for (int i = 0; i < image.width; i++) {
+            for (int j = 0; j < image.height; j++) {
+                int x1 = max(0, i - radius), x2 = min(image.width - 1, i + radius) + 1;
+                int y1 = max(0, j - radius), y2 = min(image.height - 1, j + radius) + 1;
+                ll sum = prefix[x2][y2] - prefix[x1][y2] - prefix[x2][y1] + prefix[x1][y1];
+                ll count = (ll)(x2 - x1) * (y2 - y1);
+                mean(i, j, c) = int((sum + count / 2) / count);
+            }
+        }
+    }
+    return mean;
+}
+
+// value * numerator / denominator, rounded half away from zero.
+inline int roundedShare(int value, int numerator, int denominator) {
+    double share = double(value) * numerator / denominator;
+    return int(share < 0 ? ceil(share - 0.5) : floor(share + 0.5));
+}
+
+class UnsharpMask : public Filter
+{
+    int radius = 2, amount = 100, limit = 0;
+public:
+    UnsharpMask(Image& img) : Filter(img) {};
+    string getName() { return "Unsharp Mask"; };
+    static string getId(){ return "32"; };
+
+    void setParam(const std::string& name, double value) {
+        if (name == "Radius (1:100)") radius = int(min(max(value, 0.0), 127.0));
+        else if (name == "Amount (0:500)") amount = int(min(max(value, 0.0), 1000.0));
+        else if (name == "Threshold (0:255)") limit = int(min(max(value, 0.0), 255.0));
+    }
+
+    void apply() override {
+        Image mean = boxMean(image, radius);
+        for (int i = 0; i < image.width; i++) {
+            for (int j = 0; j < image.height; j++) {
+                for (int c = 0; c < 3; c++) {
+                    int detail = image(i, j, c) - mean(i, j, c);
+                    if (abs(detail) < limit) continue;
+                    image(i, j, c) = min(255, max(0, image(i, j, c) + roundedShare(detail, amount, 100)));
+                }
+            }
+        }
+    }
+
+    vector<FilterParam> getNeeds() {
+        return { {"Radius (1:100)", "int", "2", 1.0, 100.0},
+                 {"Amount (0:500)", "int", "100", 0.0, 500.0},
+                 {"Threshold (0:255)", "int", "0", 0.0, 255.0} };
+    }
+};
+
+class Clarity : public Filter
+{
+    int radius = 30, amount = 40;
+public:
+    Clarity(Image& img) : Filter(img) {};
+    string getName() { return "Clarity"; };
+    static string getId(){ return "33"; };
+
+    void setParam(const std::string& name, double value) {
+        if (name == "Radius (1:100)") radius = int(min(max(value, 0.0), 127.0));
+        else if (name == "Amount (-100:100)") amount = int(min(max(value, -500.0), 500.0));
+    }
+
+    void apply() override {
+        Image mean = boxMean(image, radius);
+        for (int i = 0; i < image.width; i++) {
+            for (int j = 0; j < image.height; j++) {
+                int brightness = (image(i, j, 0) + image(i, j, 1) + image(i, j, 2)) / 3;
+                int local = (mean(i, j, 0) + mean(i, j, 1) + mean(i, j, 2)) / 3;
+                int midtones = 255 - abs(2 * brightness - 255);
+                int shift = roundedShare((brightness - local) * midtones, amount, 100 * 255);
+                for (int c = 0; c < 3; c++) image(i, j, c) = min(255, max(0, image(i, j, c) + shift));
+            }
+        }
+    }
+
+    vector<FilterParam> getNeeds() {
+        return { {"Radius (1:100)", "int", "30", 1.0, 100.0},
+                 {"Amount (-100:100)", "int", "40", -100.0, 100.0} };
+    }
+};
+
+class Equalize : public Filter
+{
+public:
+    Equalize(Image& img) : Filter(img) {};
+    string getName() { return "Equalize"; };
+    static string getId(){ return "34"; };
+
+    void apply() override {
+        vector<long long> hist(256, 0);
+        for (int i = 0; i < image.width; i++) {
+            for (int j = 0; j < image.height; j++) hist[(image(i, j, 0) + image(i, j, 1) + image(i, j, 2)) / 3]++;
+        }
+        vector<int> table = equalizationTable(hist, 0);
+        for (int i = 0; i < image.width; i++) {
+            for (int j = 0; j < image.height; j++) {
+                int level = (image(i, j, 0) + image(i, j, 1) + image(i, j, 2)) / 3;
+                shiftPixel(image, i, j, level, table[level]);
+            }
+        }
+    }
+};
+
+class CLAHE : public Filter
+{
+    int tiles = 8;
+    double clipLimit = 2;
+public:
+    CLAHE(Image& img) : Filter(img) {};
+    string getName() { return "CLAHE"; };
+    static string getId(){ return "35"; };
+
+    void setParam(const std::string& name, double value) {
+        if (name == "Tiles (2:16)") tiles = int(min(max(value, 1.0), 64.0));
+        else if (name == "Clip Limit (1:10)") clipLimit = max(value, 0.0);
+    }
+
+    void apply() override {
+        int columns, rows;
+        vector<vector<long long>> histograms = tileHistograms(image, columns, rows, tiles);
+        vector<vector<int>> tables;
+        for (int t = 0; t < columns * rows; t++) {
+            int tx = t % columns, ty = t / columns;
+            double pixels = double(tileStart(tx + 1, columns, image.width) - tileStart(tx, columns, image.width)) *
+                            (tileStart(ty + 1, rows, image.height) - tileStart(ty, rows, image.height));
+            tables.push_back(equalizationTable(histograms[t], (long long)max(1.0, clipLimit * (pixels / 256))));
+        }
+        for (int i = 0; i < image.width; i++) {
+            for (int j = 0; j < image.height; j++) {
+                int level = (image(i, j, 0) + image(i, j, 1) + image(i, j, 2)) / 3;
+                int value = blendTiles(image, columns, rows, i, j, level, [&](int t, int v) { return tables[t][v]; });
+                shiftPixel(image, i, j, level, value);
+            }
+        }
+    }
+
+    vector<FilterParam> getNeeds() {
+        return { {"Tiles (2:16)", "int", "8", 2.0, 16.0},
+                 {"Clip Limit (1:10)", "float", "2", 1.0, 10.0} };
+    }
+};
+
+struct ReferenceEntry {
+    string id;
+    function<shared_ptr<Filter>(Image&)> create;
+};
+
+template <typename T>
+ReferenceEntry makeReferenceEntry() {
+    return { T::getId(), [](Image& img) -> shared_ptr<Filter> { return make_shared<T>(img); } };
+}
+
+inline const vector<ReferenceEntry>& referenceRegistry() {
+    static const vector<ReferenceEntry> entries = {
+        makeReferenceEntry<Sunlight>(),
+        makeReferenceEntry<Night>(),
+        makeReferenceEntry<Blur>(),
+        makeReferenceEntry<Skewing>(),
+        makeReferenceEntry<OldTV>(),
+        makeReferenceEntry<GreyScale>(),
+        makeReferenceEntry<WhiteAndBlack>(),
+        makeReferenceEntry<Merge>(),
+        makeReferenceEntry<Flip>(),
+        makeReferenceEntry<Invert>(),
+        makeReferenceEntry<Rotate>(),
+        makeReferenceEntry<Brightness>(),
+        makeReferenceEntry<Crop>(),
+        makeReferenceEntry<Resize>(),
+        makeReferenceEntry<OilPainting>(),
+        makeReferenceEntry<ArtisticBrush>(),
+        makeReferenceEntry<Infrared>(),
+        makeReferenceEntry<Bloody>(),
+        makeReferenceEntry<Sky>(),
+        makeReferenceEntry<Grass>(),
+        makeReferenceEntry<Frame>(),
+        makeReferenceEntry<EdgeDetection>(),
+        makeReferenceEntry<Gama>(),
+        makeReferenceEntry<HeatMap>(),
+        makeReferenceEntry<Saturation>(),
+        makeReferenceEntry<OldPhoto>(),
+        makeReferenceEntry<Snow>(),
+        makeReferenceEntry<Colormap>(),
+        makeReferenceEntry<Median>(),
+        makeReferenceEntry<Kuwahara>(),
+        makeReferenceEntry<Bilateral>(),
+        makeReferenceEntry<UnsharpMask>(),
+        makeReferenceEntry<Clarity>(),
+        makeReferenceEntry<Equalize>(),
+        makeReferenceEntry<CLAHE>(),
+    };
+    return entries;
+}
+
+} // namespace reference
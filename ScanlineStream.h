@@ -0,0 +1,738 @@
+/**
+ * @File  : ScanlineStream.h
+ * @brief : Row-at-a-time decode -> filter -> encode for headless runs.
+ *
+ * Rows flow from a ScanlineReader through a chain of RowStages into a
+ * ScanlineWriter, so point filters and bounded-window filters (Blur, Edge
+ * Detection, Oil Painting) run in O(width x window) memory instead of holding
+ * whole frames.
+ *
+ * Uncompressed BMP, TGA and binary PPM are read and written a row at a time,
+ * and PNG is written a band of rows at a time. stb_image can only decode
+ * PNG/JPEG as a whole frame, so those inputs are decoded once up front and then
+ * fed row by row, and JPEG output is encoded from a whole frame on close; the
+ * filter chain itself still stays bounded.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <typeinfo>
+#include <vector>
+
+#include "Filters.h"
+#include "ImageInput.h"
+#include "ImageOutput.h"
+#include "TiledImage.h"
+
+
+inline std::string lowerExtension(const std::string& path) {
+    std::string ext = std::filesystem::path(path).extension().string();
+    for (char& ch : ext) ch = static_cast<char>(tolower(static_cast<unsigned char>(ch)));
+    return ext;
+}
+
+inline bool seekFile(FILE* file, uint64_t offset) {
+#ifdef _WIN32
+    return _fseeki64(file, static_cast<long long>(offset), SEEK_SET) == 0;
+#else
+    return fseeko(file, static_cast<off_t>(offset), SEEK_SET) == 0;
+#endif
+}
+
+inline uint32_t readLE(const unsigned char* p, int bytes) {
+    uint32_t value = 0;
+    for (int i = bytes - 1; i >= 0; i--) value = (value << 8) | p[i];
+    return value;
+}
+
+inline void writeLE(FILE* file, uint32_t value, int bytes) {
+    for (int i = 0; i < bytes; i++) fputc((value >> (8 * i)) & 0xFF, file);
+}
+
+
+// ----------------------------------------------------------------------------
+// Readers
+// ----------------------------------------------------------------------------
+
+/**
+ * @class ScanlineReader
+ * @brief Produces an image's RGB rows top to bottom.
+ */
+class ScanlineReader {
+public:
+    int width = 0;
+    int height = 0;
+
+    virtual ~ScanlineReader() = default;
+    virtual void readRow(unsigned char* rgb) = 0;
+    // Starts again from the top row (used by filters that need two passes).
+    virtual void rewind() = 0;
+};
+
+/**
+ * @brief Reads rows stored uncompressed as BGR, bottom-up or top-down.
+ */
+class RawScanlineReader : public ScanlineReader {
+    FILE* file = nullptr;
+    uint64_t dataOffset = 0;
+    size_t rowStride = 0;
+    bool bottomUp = false;
+    bool bgr = true;
+    int nextRow = 0;
+    std::vector<unsigned char> rowBuffer;
+
+public:
+    RawScanlineReader(const std::string& path, int w, int h, uint64_t offset, size_t stride, bool isBottomUp, bool isBgr)
+        : dataOffset(offset), rowStride(stride), bottomUp(isBottomUp), bgr(isBgr), rowBuffer(stride) {
+        width = w;
+        height = h;
+        file = fopen(path.c_str(), "rb");
+        if (!file) throw std::invalid_argument("Invalid filename, File Does not Exist");
+        rewind();
+    }
+
+    ~RawScanlineReader() override {
+        if (file) fclose(file);
+    }
+
+    void rewind() override {
+        nextRow = 0;
+        seekFile(file, dataOffset);
+    }
+
+    void readRow(unsigned char* rgb) override {
+        if (nextRow >= height) throw std::out_of_range("Read past the last row");
+        if (bottomUp) seekFile(file, dataOffset + uint64_t(height - 1 - nextRow) * rowStride);
+        if (fread(rowBuffer.data(), 1, rowStride, file) != rowStride) {
+            throw std::runtime_error("Unexpected end of image data");
+        }
+        for (int x = 0; x < width; x++) {
+            const unsigned char* src = &rowBuffer[size_t(x) * 3];
+            rgb[x * 3 + 0] = bgr ? src[2] : src[0];
+            rgb[x * 3 + 1] = src[1];
+            rgb[x * 3 + 2] = bgr ? src[0] : src[2];
+        }
+        nextRow++;
+    }
+};
+
+/**
+ * @brief Feeds rows of an image decoded in one go by stb_image (PNG, JPEG, ...).
+ */
+class DecodedScanlineReader : public ScanlineReader {
+    Image image;
+    int nextRow = 0;
+
+public:
+    explicit DecodedScanlineReader(const std::string& path) : image(decodeImage(path)) {
+        width = image.width;
+        height = image.height;
+    }
+
+    void rewind() override { nextRow = 0; }
+
+    void readRow(unsigned char* rgb) override {
+        memcpy(rgb, image.imageData + size_t(nextRow) * width * 3, size_t(width) * 3);
+        nextRow++;
+    }
+};
+
+// 24-bit BI_RGB bitmaps; other BMP flavours return nullptr.
+inline std::unique_ptr<ScanlineReader> openBmpReader(const std::string& path, FILE* file) {
+    unsigned char header[54];
+    if (fread(header, 1, sizeof(header), file) != sizeof(header) || header[0] != 'B' || header[1] != 'M') {
+        return nullptr;
+    }
+    uint32_t offset = readLE(header + 10, 4);
+    int32_t w = static_cast<int32_t>(readLE(header + 18, 4));
+    int32_t h = static_cast<int32_t>(readLE(header + 22, 4));
+    uint32_t bitsPerPixel = readLE(header + 28, 2);
+    uint32_t compression = readLE(header + 30, 4);
+    if (bitsPerPixel != 24 || compression != 0 || w <= 0 || h == 0) return nullptr;
+
+    size_t stride = (size_t(w) * 3 + 3) & ~size_t(3);
+    return std::make_unique<RawScanlineReader>(path, w, h < 0 ? -h : h, offset, stride, h > 0, true);
+}
+
+// Uncompressed true-colour (type 2) 24-bit targas; anything else returns nullptr.
+inline std::unique_ptr<ScanlineReader> openTgaReader(const std::string& path, FILE* file) {
+    unsigned char header[18];
+    if (fread(header, 1, sizeof(header), file) != sizeof(header)) return nullptr;
+    int idLength = header[0];
+    int colorMapType = header[1];
+    int imageType = header[2];
+    int w = readLE(header + 12, 2);
+    int h = readLE(header + 14, 2);
+    int bitsPerPixel = header[16];
+    int descriptor = header[17];
+    if (colorMapType != 0 || imageType != 2 || bitsPerPixel != 24 || (descriptor & 0x10) || w == 0 || h == 0) {
+        return nullptr;
+    }
+    bool topDown = (descriptor & 0x20) != 0;
+    return std::make_unique<RawScanlineReader>(path, w, h, 18 + idLength, size_t(w) * 3, !topDown, true);
+}
+
+// Binary PPM (P6) with 8-bit samples.
+inline std::unique_ptr<ScanlineReader> openPpmReader(const std::string& path, FILE* file) {
+    auto readNumber = [&]() {
+        int ch = fgetc(file);
+        while (ch == '#' || isspace(ch)) {
+            if (ch == '#') while (ch != '\n' && ch != EOF) ch = fgetc(file);
+            ch = fgetc(file);
+        }
+        long value = 0;
+        while (ch != EOF && isdigit(ch)) {
+            value = value * 10 + (ch - '0');
+            ch = fgetc(file);
+        }
+        return value; // the single whitespace after the number has been consumed
+    };
+    if (fgetc(file) != 'P' || fgetc(file) != '6') return nullptr;
+    long w = readNumber(), h = readNumber(), maxValue = readNumber();
+    if (w <= 0 || h <= 0 || maxValue != 255) return nullptr;
+    uint64_t offset = static_cast<uint64_t>(ftell(file));
+    return std::make_unique<RawScanlineReader>(path, int(w), int(h), offset, size_t(w) * 3, false, false);
+}
+
+/**
+ * @brief Opens path for row-by-row reading, streaming it when the format allows.
+ */
+inline std::unique_ptr<ScanlineReader> openScanlineReader(const std::string& path) {
+    ImageFormat format = probeImage(path).format;
+    FILE* file = fopen(path.c_str(), "rb");
+    if (!file) throw std::invalid_argument("Invalid filename, File Does not Exist");
+
+    std::unique_ptr<ScanlineReader> reader;
+    if (format == ImageFormat::Bmp) reader = openBmpReader(path, file);
+    else if (format == ImageFormat::Tga) reader = openTgaReader(path, file);
+    else if (format == ImageFormat::Ppm) reader = openPpmReader(path, file);
+    fclose(file);
+
+    if (!reader) reader = std::make_unique<DecodedScanlineReader>(path);
+    return reader;
+}
+
+
+// ----------------------------------------------------------------------------
+// Writers
+// ----------------------------------------------------------------------------
+
+/**
+ * @class ScanlineWriter
+ * @brief Consumes an image's RGB rows top to bottom.
+ */
+class ScanlineWriter {
+public:
+    virtual ~ScanlineWriter() = default;
+    virtual void writeRow(const unsigned char* rgb) = 0;
+    virtual void close() = 0;
+};
+
+/**
+ * @brief Writes top-down uncompressed rows (BMP with negative height, TGA with
+ *        top-left origin, or PPM) straight to disk.
+ */
+class RawScanlineWriter : public ScanlineWriter {
+    std::string path;
+    FILE* file = nullptr;
+    bool failed = false;
+    int width;
+    bool bgr;
+    size_t rowStride;
+    std::vector<unsigned char> rowBuffer;
+
+public:
+    RawScanlineWriter(const std::string& outputPath, const std::string& ext, int w, int h)
+        : path(outputPath), width(w), bgr(ext != ".ppm") {
+        if (ext == ".tga" && (w > 0xFFFF || h > 0xFFFF)) {
+            throw std::invalid_argument("TGA images are at most 65535 pixels wide and high: " + path);
+        }
+        file = fopen(path.c_str(), "wb");
+        if (!file) throw std::invalid_argument("Cannot open " + path + " for writing");
+
+        rowStride = ext == ".bmp" ? ((size_t(w) * 3 + 3) & ~size_t(3)) : size_t(w) * 3;
+        rowBuffer.assign(rowStride, 0);
+        if (ext == ".bmp") {
+            uint64_t dataSize = uint64_t(rowStride) * h;
+            fputc('B', file);
+            fputc('M', file);
+            writeLE(file, static_cast<uint32_t>(std::min<uint64_t>(54 + dataSize, 0xFFFFFFFFu)), 4);
+            writeLE(file, 0, 4);
+            writeLE(file, 54, 4);
+            writeLE(file, 40, 4);
+            writeLE(file, static_cast<uint32_t>(w), 4);
+            writeLE(file, static_cast<uint32_t>(-h), 4); // negative height: rows stored top-down
+            writeLE(file, 1, 2);
+            writeLE(file, 24, 2);
+            writeLE(file, 0, 4);
+            writeLE(file, static_cast<uint32_t>(std::min<uint64_t>(dataSize, 0xFFFFFFFFu)), 4);
+            writeLE(file, 2835, 4);
+            writeLE(file, 2835, 4);
+            writeLE(file, 0, 4);
+            writeLE(file, 0, 4);
+        } else if (ext == ".tga") {
+            unsigned char header[18] = { 0 };
+            header[2] = 2;
+            header[12] = w & 0xFF;
+            header[13] = (w >> 8) & 0xFF;
+            header[14] = h & 0xFF;
+            header[15] = (h >> 8) & 0xFF;
+            header[16] = 24;
+            header[17] = 0x20; // top-left origin
+            fwrite(header, 1, sizeof(header), file);
+        } else {
+            fprintf(file, "P6\n%d %d\n255\n", w, h);
+        }
+    }
+
+    ~RawScanlineWriter() override {
+        try { close(); } catch (const std::exception& e) { std::cerr << "Error: " << e.what() << std::endl; }
+    }
+
+    void writeRow(const unsigned char* rgb) override {
+        for (int x = 0; x < width; x++) {
+            rowBuffer[x * 3 + 0] = bgr ? rgb[x * 3 + 2] : rgb[x * 3 + 0];
+            rowBuffer[x * 3 + 1] = rgb[x * 3 + 1];
+            rowBuffer[x * 3 + 2] = bgr ? rgb[x * 3 + 0] : rgb[x * 3 + 2];
+        }
+        failed |= fwrite(rowBuffer.data(), 1, rowStride, file) != rowStride;
+    }
+
+    // Throws if any write failed, the header's included.
+    void close() override {
+        if (!file) return;
+        bool written = !failed && !ferror(file);
+        written = fclose(file) == 0 && written;
+        file = nullptr;
+        if (!written) throw std::runtime_error("Cannot write " + path);
+    }
+};
+
+/**
+ * @brief Filters and deflates PNG rows as they arrive (see pngwriter::RowEncoder).
+ */
+class PngScanlineWriter : public ScanlineWriter {
+    std::string path;
+    FILE* file = nullptr;
+    std::unique_ptr<pngwriter::RowEncoder> encoder;
+
+public:
+    PngScanlineWriter(const std::string& outputPath, int w, int h, const EncodeOptions& encode) : path(outputPath) {
+        file = fopen(path.c_str(), "wb");
+        if (!file) throw std::invalid_argument("Cannot open " + path + " for writing");
+        encoder = std::make_unique<pngwriter::RowEncoder>(file, w, h, encode.pngCompression, encode.threads);
+    }
+
+    ~PngScanlineWriter() override {
+        try { close(); } catch (const std::exception& e) { std::cerr << "Error: " << e.what() << std::endl; }
+    }
+
+    void writeRow(const unsigned char* rgb) override { encoder->writeRow(rgb); }
+
+    void close() override {
+        if (!file) return;
+        bool written = encoder->finish();
+        written = fclose(file) == 0 && written;
+        file = nullptr;
+        if (!written) throw std::runtime_error("Cannot write " + path);
+    }
+};
+
+/**
+ * @brief Collects rows into an Image and encodes it on close (JPEG).
+ */
+class EncodedScanlineWriter : public ScanlineWriter {
+    std::string path;
+    EncodeOptions options;
+    Image image;
+    int nextRow = 0;
+    bool closed = false;
+
+public:
+    EncodedScanlineWriter(const std::string& outputPath, int w, int h, const EncodeOptions& encode)
+        : path(outputPath), options(encode), image(w, h) {}
+
+    ~EncodedScanlineWriter() override {
+        try { close(); } catch (const std::exception& e) { std::cerr << "Error: " << e.what() << std::endl; }
+    }
+
+    void writeRow(const unsigned char* rgb) override {
+        memcpy(image.imageData + size_t(nextRow) * image.width * 3, rgb, size_t(image.width) * 3);
+        nextRow++;
+    }
+
+    void close() override {
+        if (closed) return;
+        closed = true;
+        encodeImage(image, path, options);
+    }
+};
+
+inline std::unique_ptr<ScanlineWriter> openScanlineWriter(const std::string& path, int width, int height,
+                                                          const EncodeOptions& encode = EncodeOptions()) {
+    std::string ext = lowerExtension(path);
+    if (ext == ".bmp" || ext == ".tga" || ext == ".ppm") {
+        return std::make_unique<RawScanlineWriter>(path, ext, width, height);
+    }
+    if (ext == ".png") return std::make_unique<PngScanlineWriter>(path, width, height, encode);
+    return std::make_unique<EncodedScanlineWriter>(path, width, height, encode);
+}
+
+
+// ----------------------------------------------------------------------------
+// Row stages
+// ----------------------------------------------------------------------------
+
+/**
+ * @class RowStage
+ * @brief One filter in a streaming chain; rows are pushed in top to bottom.
+ *
+ * A stage may hold back rows until it has seen enough context below them, and
+ * releases the remainder in finish(). All stages keep the image size.
+ */
+class RowStage {
+public:
+    using Emit = std::function<void(const unsigned char* rgb)>;
+
+    virtual ~RowStage() = default;
+    virtual void begin(int width, int height) = 0;
+    virtual void push(const unsigned char* row, const Emit& emit) = 0;
+    virtual void finish(const Emit& emit) {}
+
+    // Stages that need whole-image statistics first see every input row via
+    // observe() in an extra pass before begin().
+    virtual bool needsPrepass() const { return false; }
+    virtual void observe(const unsigned char* row) {}
+    virtual void beginPrepass(int width, int height) {}
+};
+
+class PointRowStage : public RowStage {
+    PointTransform transform;
+    std::vector<unsigned char> row;
+    int width = 0;
+
+public:
+    explicit PointRowStage(PointTransform t) : transform(std::move(t)) {}
+
+    PointTransform& getTransform() { return transform; }
+
+    void begin(int w, int h) override {
+        width = w;
+        row.resize(size_t(w) * 3);
+    }
+
+    void push(const unsigned char* in, const Emit& emit) override {
+        memcpy(row.data(), in, row.size());
+        transform.run(row.data(), width);
+        emit(row.data());
+    }
+};
+
+/**
+ * @brief Streaming form of Blur: same clipped box sum, divided by (2r+1)^2.
+ *
+ * Keeps the last 2r+1 input rows in a ring and a running per-column sum, so
+ * memory is (2r+1) rows instead of the full prefix-sum tables.
+ */
+class BlurRowStage : public RowStage {
+    int radius;
+    int width = 0, height = 0;
+    int received = 0;
+    std::vector<unsigned char> ring;         ///< (2r+1) rows
+    std::vector<uint32_t> columnSums;        ///< width * 3
+    std::vector<unsigned long long> prefix;  ///< (width + 1) * 3
+    std::vector<unsigned char> out;
+
+    unsigned char* ringRow(int y) { return ring.data() + size_t(y % (2 * radius + 1)) * width * 3; }
+
+    void addRow(const unsigned char* row, int sign) {
+        for (size_t i = 0; i < size_t(width) * 3; i++) columnSums[i] += sign * row[i];
+    }
+
+    void emitRow(const Emit& emit) {
+        for (int x = 0; x < width; x++) {
+            for (int k = 0; k < 3; k++) {
+                prefix[(x + 1) * 3 + k] = prefix[x * 3 + k] + columnSums[x * 3 + k];
+            }
+        }
+        unsigned long long area = (2ULL * radius + 1) * (2ULL * radius + 1);
+        for (int x = 0; x < width; x++) {
+            int x1 = std::max(0, x - radius);
+            int x2 = std::min(width - 1, x + radius) + 1;
+            for (int k = 0; k < 3; k++) {
+                out[x * 3 + k] = static_cast<unsigned char>((prefix[x2 * 3 + k] - prefix[x1 * 3 + k]) / area);
+            }
+        }
+        emit(out.data());
+    }
+
+public:
+    explicit BlurRowStage(int r) : radius(std::max(0, r)) {}
+
+    void begin(int w, int h) override {
+        width = w;
+        height = h;
+        received = 0;
+        ring.assign(size_t(2 * radius + 1) * w * 3, 0);
+        columnSums.assign(size_t(w) * 3, 0);
+        prefix.assign(size_t(w + 1) * 3, 0);
+        out.resize(size_t(w) * 3);
+    }
+
+    void push(const unsigned char* row, const Emit& emit) override {
+        int y = received++;
+        unsigned char* slot = ringRow(y);
+        if (y >= 2 * radius + 1) addRow(slot, -1); // drops row y - 2r - 1
+        memcpy(slot, row, size_t(width) * 3);
+        addRow(slot, +1);
+        if (y >= radius) emitRow(emit);
+    }
+
+    void finish(const Emit& emit) override {
+        for (int y = std::max(0, height - radius); y < height; y++) {
+            if (y - radius - 1 >= 0) addRow(ringRow(y - radius - 1), -1);
+            emitRow(emit);
+        }
+    }
+};
+
+/**
+ * @brief The Sobel step of Edge Detection on an already grey, blurred stream.
+ *
+ * The threshold comes from the prepass; the one-pixel border is white (no
+ * edge), as in the in-memory filter.
+ */
+class SobelRowStage : public RowStage {
+    int width = 0, height = 0;
+    int received = 0;
+    double threshold = 127;
+    unsigned long long sum = 0, sumSquares = 0;
+    std::vector<unsigned char> ring; ///< 3 rows
+    std::vector<unsigned char> out;
+
+    const unsigned char* ringRow(int y) const { return ring.data() + size_t(y % 3) * width * 3; }
+
+    void emitBorder(const Emit& emit) {
+        std::fill(out.begin(), out.end(), 255);
+        emit(out.data());
+    }
+
+    void emitInterior(int y, const Emit& emit) {
+        static const int gx[3][3] = { { -1, 0, 1 }, { -2, 0, 2 }, { -1, 0, 1 } };
+        static const int gy[3][3] = { { -1, -2, -1 }, { 0, 0, 0 }, { 1, 2, 1 } };
+        std::fill(out.begin(), out.end(), 255);
+        for (int x = 1; x < width - 1; x++) {
+            int sumX = 0, sumY = 0;
+            for (int i = -1; i <= 1; i++) {
+                for (int j = -1; j <= 1; j++) {
+                    int intensity = ringRow(y + j)[(x + i) * 3];
+                    sumX += intensity * gx[i + 1][j + 1];
+                    sumY += intensity * gy[i + 1][j + 1];
+                }
+            }
+            int magnitude = sqrt((sumX * sumX) + (sumY * sumY));
+            unsigned char value = magnitude > threshold ? 0 : 255;
+            out[x * 3] = out[x * 3 + 1] = out[x * 3 + 2] = value;
+        }
+        emit(out.data());
+    }
+
+public:
+    bool needsPrepass() const override { return true; }
+
+    void beginPrepass(int w, int h) override {
+        width = w;
+        height = h;
+        sum = sumSquares = 0;
+    }
+
+    void observe(const unsigned char* row) override {
+        for (int x = 0; x < width; x++) {
+            unsigned long long intensity = (row[x * 3] + row[x * 3 + 1] + row[x * 3 + 2]) / 3;
+            sum += intensity;
+            sumSquares += intensity * intensity;
+        }
+    }
+
+    void begin(int w, int h) override {
+        threshold = Filter::thresholdFromMoments(double(sum), double(sumSquares), double(w) * h);
+        width = w;
+        height = h;
+        received = 0;
+        ring.assign(size_t(3) * w * 3, 0);
+        out.resize(size_t(w) * 3);
+    }
+
+    void push(const unsigned char* row, const Emit& emit) override {
+        int y = received++;
+        memcpy(ring.data() + size_t(y % 3) * width * 3, row, size_t(width) * 3);
+        if (y == 0) emitBorder(emit);
+        else if (y >= 2) emitInterior(y - 1, emit);
+    }
+
+    void finish(const Emit& emit) override {
+        if (height >= 2) emitBorder(emit);
+    }
+};
+
+
+/**
+ * @class StreamPipeline
+ * @brief Turns a filter chain into row stages and runs it reader -> writer.
+ */
+class StreamPipeline {
+    std::vector<std::unique_ptr<RowStage>> stages;
+
+    void addPoint(const PointTransform& transform) {
+        if (!stages.empty()) {
+            if (auto* last = dynamic_cast<PointRowStage*>(stages.back().get())) {
+                last->getTransform().then(transform);
+                return;
+            }
+        }
+        stages.push_back(std::make_unique<PointRowStage>(transform));
+    }
+
+    // Pushes every input row through stages [0, count) into sink.
+    void runPass(ScanlineReader& reader, size_t count, const RowStage::Emit& sink) {
+        std::vector<RowStage::Emit> emits(count + 1);
+        emits[count] = sink;
+        for (size_t i = count; i-- > 0;) {
+            RowStage* next = i + 1 < count ? stages[i + 1].get() : nullptr;
+            const RowStage::Emit& after = emits[i + 1];
+            emits[i] = next ? RowStage::Emit([next, &after](const unsigned char* row) { next->push(row, after); })
+                            : after;
+        }
+        for (size_t i = 0; i < count; i++) stages[i]->begin(reader.width, reader.height);
+
+        std::vector<unsigned char> row(size_t(reader.width) * 3);
+        reader.rewind();
+        for (int y = 0; y < reader.height; y++) {
+            reader.readRow(row.data());
+            if (count > 0) stages[0]->push(row.data(), emits[0]);
+            else sink(row.data());
+        }
+        for (size_t i = 0; i < count; i++) stages[i]->finish(emits[i]);
+    }
+
+public:
+    /**
+     * @brief Whether filter has a streaming form (see add()).
+     */
+    static bool canStream(Filter& filter) {
+        return dynamic_cast<PointFilter*>(&filter) || dynamic_cast<Blur*>(&filter) ||
+               dynamic_cast<EdgeDetection*>(&filter) || typeid(filter) == typeid(OilPainting);
+    }
+
+    /**
+     * @brief Appends filter's streaming form, using its current parameters.
+     * @throws std::invalid_argument If the filter needs the whole frame.
+     */
+    void add(Filter& filter) {
+        if (auto* point = dynamic_cast<PointFilter*>(&filter)) {
+            addPoint(point->transform());
+        } else if (typeid(filter) == typeid(OilPainting)) {
+            addPoint(static_cast<OilPainting&>(filter).posterize());
+        } else if (auto* blur = dynamic_cast<Blur*>(&filter)) {
+            stages.push_back(std::make_unique<BlurRowStage>(blur->getRadius()));
+        } else if (dynamic_cast<EdgeDetection*>(&filter)) {
+            Image unused;
+            GreyScale grey(unused);
+            addPoint(grey.transform());
+            stages.push_back(std::make_unique<BlurRowStage>(2));
+            stages.push_back(std::make_unique<SobelRowStage>());
+        } else {
+            throw std::invalid_argument(filter.getName() + " needs the whole image and cannot be streamed");
+        }
+    }
+
+    void run(ScanlineReader& reader, ScanlineWriter& writer) {
+        for (size_t i = 0; i < stages.size(); i++) {
+            if (!stages[i]->needsPrepass()) continue;
+            stages[i]->beginPrepass(reader.width, reader.height);
+            RowStage* stage = stages[i].get();
+            runPass(reader, i, [stage](const unsigned char* row) { stage->observe(row); });
+        }
+        runPass(reader, stages.size(), [&writer](const unsigned char* row) { writer.writeRow(row); });
+        writer.close();
+    }
+};
+
+/**
+ * @brief Streams inputPath through filters into outputPath.
+ *
+ * The filters are only read for their parameters; the image they are bound
+ * to is not touched.
+ */
+inline void streamFile(const std::string& inputPath, const std::string& outputPath,
+                       const std::vector<std::shared_ptr<Filter>>& filters,
+                       const EncodeOptions& encode = EncodeOptions()) {
+    StreamPipeline pipeline;
+    for (auto& filter : filters) pipeline.add(*filter);
+    auto reader = openScanlineReader(inputPath);
+    auto writer = openScanlineWriter(outputPath, reader->width, reader->height, encode);
+    pipeline.run(*reader, *writer);
+}
+
+
+/**
+ * @brief Reads an image into tiled storage one band of tile rows at a time.
+ */
+inline std::unique_ptr<TiledImage> readTiled(ScanlineReader& reader, size_t cacheBytes = TiledImage::defaultCacheBytes) {
+    auto tiled = std::make_unique<TiledImage>(reader.width, reader.height, cacheBytes);
+    std::vector<unsigned char> band(size_t(tiled->tileSize) * reader.width * 3);
+    reader.rewind();
+    for (int y = 0; y < reader.height; y += tiled->tileSize) {
+        int rows = std::min(tiled->tileSize, reader.height - y);
+        for (int r = 0; r < rows; r++) reader.readRow(band.data() + size_t(r) * reader.width * 3);
+        tiled->writeRegion(0, y, reader.width, rows, band.data(), size_t(reader.width) * 3);
+    }
+    return tiled;
+}
+
+inline void writeTiled(TiledImage& tiled, ScanlineWriter& writer) {
+    std::vector<unsigned char> band(size_t(tiled.tileSize) * tiled.width * 3);
+    for (int y = 0; y < tiled.height; y += tiled.tileSize) {
+        int rows = std::min(tiled.tileSize, tiled.height - y);
+        tiled.readRegion(0, y, tiled.width, rows, band.data(), size_t(tiled.width) * 3);
+        for (int r = 0; r < rows; r++) writer.writeRow(band.data() + size_t(r) * tiled.width * 3);
+    }
+    writer.close();
+}
+
+/**
+ * @brief Runs filters over inputPath tile by tile (see applyTiled) into outputPath.
+ *
+ * At most cacheBytes of each tiled image stay in memory; the rest is paged to
+ * a scratch file. The reader is closed before the first filter runs, so a
+ * PNG or JPEG decoded whole by DecodedScanlineReader is freed by then.
+ *
+ * @throws std::invalid_argument If a filter needs the whole image at once.
+ */
+inline void tileFile(const std::string& inputPath, const std::string& outputPath,
+                     const std::vector<std::shared_ptr<Filter>>& filters, size_t cacheBytes,
+                     const EncodeOptions& encode = EncodeOptions()) {
+    for (auto& filter : filters) {
+        if (filter->tileHalo() < 0) {
+            throw std::invalid_argument(filter->getName() + " needs the whole image and cannot run on tiles");
+        }
+    }
+    std::unique_ptr<TiledImage> tiled;
+    {
+        auto reader = openScanlineReader(inputPath);
+        tiled = readTiled(*reader, cacheBytes);
+    }
+    for (auto& filter : filters) applyTiled(*tiled, *filter);
+    for (auto& filter : filters) filter->getImage() = Image(); // the last tile's buffer
+    auto writer = openScanlineWriter(outputPath, tiled->width, tiled->height, encode);
+    writeTiled(*tiled, *writer);
+}
@@ -0,0 +1,312 @@
+/**
+ * @File  : SeamCarving.h
+ * @brief : Content-aware resizing of an 8-bit RGB image by seam carving
+ *          (Avidan and Shamir): narrowing removes the connected top-to-bottom
+ *          paths of least energy, widening duplicates them.
+ *
+ * A pixel's energy is |Gx| + |Gy|, the Sobel gradient (as in EdgeDetection) of
+ * the brightness (r + g + b) / 3, with the edge samples repeated beyond the
+ * border. A pass runs the usual dynamic programme over the rows, the cost of a
+ * pixel being its energy plus the least cost of the three above it, then
+ * traces perPass seams up from the cheapest ends of the bottom row. Later
+ * seams step around the pixels earlier ones took; where all three pixels above
+ * are taken, a seam jumps to the nearest free one in that row, so a batch
+ * stays one pixel per row and only loses connectivity where seams crowd.
+ *
+ * After a pass only the energies whose 3 x 3 neighbourhood changed are
+ * computed again: those within a pixel of where a seam left any of the three
+ * rows they read, and the two border columns. Every other pixel still sees the
+ * same neighbours, so the map stays exactly what a full recomputation would
+ * give at a few pixels per seam per row. Rows are compacted and refreshed in
+ * parallel bands; the programme itself runs row after row, as each row needs
+ * the one above it, and its rows are short, branch-free loops.
+ *
+ * Heights are carved as widths of the transposed image. Widening by n
+ * duplicates the n seams that narrowing by n would remove, each next to its
+ * original as the mean of it and its right neighbour, in rounds of at most half
+ * the width so the same seams are not stretched over and over.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <numeric>
+#include <vector>
+
+#include "MemoryAccounting.h"
+#include "PlanarImage.h"
+#include "ThreadPool.h"
+#include "third_party/Image_Class.h"
+
+
+namespace seams {
+
+/**
+ * @class Carver
+ * @brief An RGB8 image being narrowed seam by seam, with its brightness and
+ *        energy maps kept up to date.
+ *
+ * Rows keep their original stride and are compacted in place, so removing a
+ * seam moves at most one row's bytes per row.
+ */
+class Carver {
+    int width = 0, height = 0;
+    size_t stride = 0;                      ///< samples per row, the original width
+    std::vector<unsigned char> rgb, grey;
+    std::vector<uint16_t> energy;
+    std::vector<uint32_t> cost;             ///< least cost of a seam ending at each pixel
+    std::vector<unsigned char> taken;       ///< pixels on this pass's seams
+    std::vector<int> steps;                 ///< per row, the new column of each removed pixel
+    std::vector<int> column;                ///< original column of each pixel, when tracking
+    std::vector<std::vector<int>> removed;  ///< original columns removed from each row, when tracking
+    memory::Charge charge;
+
+    void measure(int x, int y) {
+        const unsigned char* row = &grey[size_t(y) * stride];
+        const unsigned char* above = &grey[size_t(std::max(y - 1, 0)) * stride];
+        const unsigned char* below = &grey[size_t(std::min(y + 1, height - 1)) * stride];
+        planar::Gradient g = planar::sobel(above, row, below, std::max(x - 1, 0), x, std::min(x + 1, width - 1));
+        energy[size_t(y) * stride + x] = static_cast<uint16_t>(std::abs(g.x) + std::abs(g.y));
+    }
+
+    void accumulate() {
+        const int last = width - 1;
+        for (int x = 0; x < width; x++) cost[x] = energy[x];
+        for (int y = 1; y < height; y++) {
+            const uint32_t* above = &cost[size_t(y - 1) * stride];
+            const uint16_t* e = &energy[size_t(y) * stride];
+            uint32_t* c = &cost[size_t(y) * stride];
+            if (last == 0) {
+                c[0] = e[0] + above[0];
+                continue;
+            }
+            c[0] = e[0] + std::min(above[0], above[1]);
+            for (int x = 1; x < last; x++) c[x] = e[x] + std::min(std::min(above[x - 1], above[x]), above[x + 1]);
+            c[last] = e[last] + std::min(above[last - 1], above[last]);
+        }
+    }
+
+    /// Traces seams up from the wanted (<= width) cheapest bottom pixels,
+    /// marking them in taken.
+    void trace(int wanted) {
+        const uint32_t* bottom = &cost[size_t(height - 1) * stride];
+        std::vector<int> ends(width);
+        std::iota(ends.begin(), ends.end(), 0);
+        std::partial_sort(ends.begin(), ends.begin() + wanted, ends.end(), [&](int a, int b) {
+            return bottom[a] != bottom[b] ? bottom[a] < bottom[b] : a < b;
+        });
+        for (int i = 0; i < wanted; i++) {
+            int x = ends[i];
+            taken[size_t(height - 1) * stride + x] = 1;
+            for (int y = height - 2; y >= 0; y--) {
+                const uint32_t* c = &cost[size_t(y) * stride];
+                unsigned char* t = &taken[size_t(y) * stride];
+                int best = -1;
+                for (int next : { x, x - 1, x + 1 }) {
+                    if (next < 0 || next >= width || t[next]) continue;
+                    if (best < 0 || c[next] < c[best]) best = next;
+                }
+                // Boxed in by earlier seams: the nearest free pixel, the cheaper
+                // of the two at the same distance. Fewer than wanted are taken.
+                for (int d = 2; best < 0; d++) {
+                    for (int next : { x - d, x + d }) {
+                        if (next < 0 || next >= width || t[next]) continue;
+                        if (best < 0 || c[next] < c[best]) best = next;
+                    }
+                }
+                x = best;
+                t[x] = 1;
+            }
+        }
+    }
+
+    /// Closes the gaps the kept seams leave in row y and records where they were.
+    void compact(int y, int kept) {
+        unsigned char* t = &taken[size_t(y) * stride];
+        int* step = &steps[size_t(y) * kept];
+        size_t base = size_t(y) * stride;
+        int out = 0, from = 0, found = 0;
+        auto move = [&](int to) {  // shifts samples from..to-1 down to out
+            int n = to - from;
+            if (n > 0 && out != from) {
+                memmove(&rgb[(base + out) * 3], &rgb[(base + from) * 3], size_t(n) * 3);
+                memmove(&grey[base + out], &grey[base + from], size_t(n));
+                memmove(&energy[base + out], &energy[base + from], size_t(n) * sizeof(uint16_t));
+                if (!column.empty()) memmove(&column[base + out], &column[base + from], size_t(n) * sizeof(int));
+            }
+            out += std::max(n, 0);
+        };
+        for (int x = 0; x < width && found < kept; x++) {
+            if (!t[x]) continue;
+            t[x] = 0;
+            move(x);
+            if (!column.empty()) removed[y].push_back(column[base + x]);
+            step[found++] = out;
+            from = x + 1;
+        }
+        move(width);
+    }
+
+    /// Measures again the pixels of row y whose neighbourhood the last pass
+    /// changed, with width already the new width.
+    void refresh(int y, int kept) {
+        const int* rows[3] = { &steps[size_t(std::max(y - 1, 0)) * kept], &steps[size_t(y) * kept],
+                               &steps[size_t(std::min(y + 1, height - 1)) * kept] };
+        for (int j = 0; j < kept; j++) {
+            int lo = std::min({ rows[0][j], rows[1][j], rows[2][j] }) - 1;
+            int hi = std::max({ rows[0][j], rows[1][j], rows[2][j] });
+            for (int x = std::max(lo, 0); x <= std::min(hi, width - 1); x++) measure(x, y);
+        }
+        measure(0, y);
+        measure(width - 1, y);
+    }
+
+public:
+    /**
+     * @brief Starts carving image (RGB8); with trackColumns, remembers which
+     *        original columns each row loses (see removedFrom()).
+     */
+    Carver(const Image& image, bool trackColumns)
+        : width(image.width), height(image.height), stride(size_t(image.width)) {
+        const size_t pixels = stride * height;
+        rgb.assign(image.imageData, image.imageData + pixels * 3);
+        grey.resize(pixels);
+        energy.resize(pixels);
+        cost.resize(pixels);
+        taken.assign(pixels, 0);
+        if (trackColumns) {
+            column.resize(pixels);
+            removed.resize(height);
+        }
+        charge.reset(pixels * (3 + 1 + sizeof(uint16_t) + sizeof(uint32_t) + 1) + column.size() * sizeof(int));
+        if (pixels == 0) return;
+
+        forEachBand(height, stride * 16, [&](int y0, int y1) {
+            for (int y = y0; y < y1; y++) {
+                const unsigned char* px = &rgb[size_t(y) * stride * 3];
+                unsigned char* g = &grey[size_t(y) * stride];
+                for (int x = 0; x < width; x++, px += 3) g[x] = static_cast<unsigned char>((px[0] + px[1] + px[2]) / 3);
+                if (!column.empty()) std::iota(&column[size_t(y) * stride], &column[size_t(y) * stride] + width, 0);
+            }
+        });
+        forEachBand(height, stride * 16, [&](int y0, int y1) {
+            for (int y = y0; y < y1; y++) {
+                for (int x = 0; x < width; x++) measure(x, y);
+            }
+        });
+    }
+
+    int currentWidth() const { return width; }
+
+    /// Removes count seams (no more than the width), up to perPass per pass.
+    void remove(int count, int perPass) {
+        count = std::min(count, width);
+        perPass = std::max(1, perPass);
+        while (count > 0 && height > 0) {
+            accumulate();
+            int kept = std::min(count, perPass);
+            trace(kept);
+            steps.resize(size_t(height) * kept);
+            forEachBand(height, stride * 4, [&](int y0, int y1) {
+                for (int y = y0; y < y1; y++) compact(y, kept);
+            });
+            width -= kept;
+            count -= kept;
+            if (width == 0) break;
+            forEachBand(height, size_t(kept) * 64, [&](int y0, int y1) {
+                for (int y = y0; y < y1; y++) refresh(y, kept);
+            });
+        }
+    }
+
+    /// The original columns removed from row y so far, by pass and then left
+    /// to right; empty unless tracking.
+    const std::vector<int>& removedFrom(int y) const { return removed[y]; }
+
+    /// The carved image.
+    Image picture() const {
+        Image result(width, height);
+        for (int y = 0; y < height; y++) {
+            memcpy(result.imageData + size_t(y) * width * 3, &rgb[size_t(y) * stride * 3], size_t(width) * 3);
+        }
+        return result;
+    }
+};
+
+/// image (RGB8) with rows and columns swapped.
+inline Image transposed(const Image& image) {
+    Image result(image.height, image.width);
+    forEachBand(result.height, size_t(result.width) * 3, [&](int y0, int y1) {
+        for (int y = y0; y < y1; y++) {
+            unsigned char* out = result.imageData + size_t(y) * result.width * 3;
+            for (int x = 0; x < result.width; x++, out += 3) {
+                memcpy(out, image.imageData + (size_t(x) * image.width + y) * 3, 3);
+            }
+        }
+    });
+    return result;
+}
+
+/**
+ * @brief image (RGB8) widened by n <= image.width columns: the n seams
+ *        narrowing would remove each get a copy, the mean of the seam pixel
+ *        and its right neighbour, inserted after it.
+ */
+inline Image widened(const Image& image, int n, int perPass) {
+    const int width = image.width;
+    Carver carver(image, true);
+    carver.remove(n, perPass);
+    Image result(width + n, image.height);
+    forEachBand(image.height, size_t(width) * 4, [&](int y0, int y1) {
+        std::vector<unsigned char> copied(width);
+        for (int y = y0; y < y1; y++) {
+            std::fill(copied.begin(), copied.end(), 0);
+            for (int x : carver.removedFrom(y)) copied[x] = 1;
+            const unsigned char* in = image.imageData + size_t(y) * width * 3;
+            unsigned char* out = result.imageData + size_t(y) * result.width * 3;
+            for (int x = 0; x < width; x++) {
+                memcpy(out, in + x * 3, 3);
+                out += 3;
+                if (!copied[x]) continue;
+                const unsigned char* right = in + std::min(x + 1, width - 1) * 3;
+                for (int c = 0; c < 3; c++) out[c] = static_cast<unsigned char>((in[x * 3 + c] + right[c] + 1) / 2);
+                out += 3;
+            }
+        }
+    });
+    return result;
+}
+
+/// Carves or widens image (RGB8) to width columns.
+inline void retargetWidth(Image& image, int width, int perPass) {
+    if (image.width > width) {
+        Carver carver(image, false);
+        carver.remove(image.width - width, perPass);
+        image = carver.picture();
+    }
+    while (image.width < width) {
+        image = widened(image, std::min(width - image.width, std::max(1, image.width / 2)), perPass);
+    }
+}
+
+/**
+ * @brief Resizes image (RGB8) to width x height by seam carving, the width
+ *        first, removing or inserting up to perPass seams per pass.
+ */
+inline void retarget(Image& image, int width, int height, int perPass) {
+    width = std::max(1, width);
+    height = std::max(1, height);
+    if (image.width <= 0 || image.height <= 0) return;
+    retargetWidth(image, width, perPass);
+    if (image.height != height) {
+        Image across = transposed(image);
+        retargetWidth(across, height, perPass);
+        image = transposed(across);
+    }
+}
+
+} // namespace seams
@@ -0,0 +1,113 @@
+/**
+ * @File  : Sharpen.h
+ * @brief : A box low-pass streamed a row at a time, for filters that combine
+ *          each pixel with its local mean (unsharp mask, clarity) in one pass.
+ *
+ * boxMeanRows() slides a (2r+1)^2 box down an 8-bit RGB image with running
+ * column sums, as planar::boxBlur does, but works on the interleaved pixels
+ * and hands each blurred row to a callback as soon as it is complete instead
+ * of writing a blurred image. The callback may overwrite that row of the
+ * source: the kernel keeps the original of the last r+1 rows in a rolling
+ * buffer for the sums, so sharpening in place needs neither a blurred copy nor
+ * a copy of the source.
+ *
+ * Unlike Blur, the mean divides by the pixels actually inside the image, so
+ * the low-pass does not darken towards the border (which would brighten a
+ * sharpened border).
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <cstdlib>
+#include <vector>
+
+#include "MemoryAccounting.h"
+
+
+namespace sharpen {
+
+/// round(value * numerator / denominator), halves away from zero.
+inline int roundedShare(int value, int numerator, int denominator) {
+    long long product = (long long)value * numerator;
+    return int((product + (product >= 0 ? denominator / 2 : -(denominator / 2))) / denominator);
+}
+
+/**
+ * @brief Calls emit(y, mean) for every row y of the width x height RGB8 image
+ *        at data, in order; mean holds the rounded mean of each sample's
+ *        (2r+1)^2 box clipped to the image. emit may overwrite row y of data.
+ *
+ * Radius is capped at 127, which keeps the reciprocal division exact.
+ */
+template <typename Emit>
+void boxMeanRows(unsigned char* data, int width, int height, int radius, Emit&& emit) {
+    if (width <= 0 || height <= 0) return;
+    radius = std::min(std::max(0, radius), 127);
+    const size_t rowBytes = size_t(width) * 3;
+    std::vector<uint32_t> columns(rowBytes, 0);
+    std::vector<unsigned char> original(rowBytes * (radius + 1)), mean(rowBytes);
+    std::vector<uint32_t> pixels(width);  ///< pixels in the box at x, on this row
+    std::vector<uint64_t> scale(width);   ///< 2^40 / pixels + 1
+    memory::Charge charge(memory::Owner::Temporary,
+                          columns.size() * 4 + original.size() + mean.size() + pixels.size() * 12);
+
+    auto addRow = [&](const unsigned char* row, int sign) {
+        uint32_t* col = columns.data();
+        if (sign > 0) for (size_t i = 0; i < rowBytes; i++) col[i] += row[i];
+        else for (size_t i = 0; i < rowBytes; i++) col[i] -= row[i];
+    };
+    for (int y = 0; y <= std::min(height - 1, radius); y++) addRow(data + size_t(y) * rowBytes, +1);
+
+    int boxRows = -1;
+    for (int y = 0; y < height; y++) {
+        unsigned char* row = data + size_t(y) * rowBytes;
+        memcpy(&original[size_t(y % (radius + 1)) * rowBytes], row, rowBytes);
+
+        // The divisor only changes along x, and along y within r of the top or bottom.
+        int rows = std::min(height - 1, y + radius) - std::max(0, y - radius) + 1;
+        if (rows != boxRows) {
+            boxRows = rows;
+            for (int x = 0; x < width; x++) {
+                pixels[x] = uint32_t(rows) * (std::min(width - 1, x + radius) - std::max(0, x - radius) + 1);
+                scale[x] = (uint64_t(1) << 40) / pixels[x] + 1;
+            }
+        }
+
+        // Exact while (sum + pixels / 2) * pixels < 2^40, which r <= 127 ensures.
+        const uint32_t* col = columns.data();
+        unsigned char* out = mean.data();
+        uint64_t sum[3] = { 0, 0, 0 };
+        for (int x = 0; x <= std::min(width - 1, radius); x++) {
+            for (int c = 0; c < 3; c++) sum[c] += col[x * 3 + c];
+        }
+        auto divide = [&](int x) {
+            for (int c = 0; c < 3; c++) {
+                out[x * 3 + c] = static_cast<unsigned char>(((sum[c] + pixels[x] / 2) * scale[x]) >> 40);
+            }
+        };
+        // As in planar::boxBlur, the middle stretch has no bounds checks.
+        int x = 0;
+        for (; x < std::min(radius, width); x++) {
+            divide(x);
+            if (x + radius + 1 < width) for (int c = 0; c < 3; c++) sum[c] += col[(x + radius + 1) * 3 + c];
+        }
+        for (; x + radius + 1 < width; x++) {
+            divide(x);
+            for (int c = 0; c < 3; c++) sum[c] += col[(x + radius + 1) * 3 + c] - uint64_t(col[(x - radius) * 3 + c]);
+        }
+        for (; x < width; x++) {
+            divide(x);
+            for (int c = 0; c < 3; c++) sum[c] -= col[(x - radius) * 3 + c];
+        }
+        emit(y, mean.data());
+
+        if (y + radius + 1 < height) addRow(data + size_t(y + radius + 1) * rowBytes, +1);
+        if (y - radius >= 0) addRow(&original[size_t((y - radius) % (radius + 1)) * rowBytes], -1);
+    }
+}
+
+} // namespace sharpen
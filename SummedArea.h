@@ -0,0 +1,113 @@
+/**
+ * @File  : SummedArea.h
+ * @brief : Summed-area tables over a window of an 8-bit RGB image, giving the
+ *          sums (and so the mean and variance) of any rectangle in four lookups.
+ *
+ * For every corner (x, y) of the window a table holds the sums, over the pixels
+ * above and left of it, of each channel, of the pixel's total s = r + g + b and
+ * of s^2. Tables cover a window, normally a tile plus the margin its filter
+ * reads, rather than the whole image: that bounds their memory, lets tiles be
+ * built and used on separate threads, and keeps the sums within 32 bits.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <vector>
+
+#include "MemoryAccounting.h"
+#include "third_party/Image_Class.h"
+
+
+/// Sums over the pixels of a rectangle.
+struct BoxSums {
+    uint32_t channel[3] = { 0, 0, 0 };
+    uint32_t total = 0;         ///< sum of r + g + b
+    uint64_t totalSquares = 0;  ///< sum of (r + g + b)^2
+    uint32_t count = 0;         ///< pixels in the rectangle
+};
+
+/**
+ * @class SummedAreaTable
+ * @brief Sums of a window of an RGB8 image, queried by rectangle.
+ */
+class SummedAreaTable {
+    std::vector<uint32_t> sums;     ///< r, g, b and s for each corner
+    std::vector<uint64_t> squares;  ///< s^2 for each corner
+    memory::Charge charge;          ///< both tables' bytes, as a Temporary
+    int left = 0, top = 0, width = 0, height = 0;
+    size_t stride = 0;              ///< corners per row, width + 1
+
+public:
+    /// The most pixels a window may have for its sums to fit 32 bits.
+    static constexpr size_t maxPixels = 0xFFFFFFFFu / 765;
+
+    SummedAreaTable() = default;
+
+    /**
+     * @brief Tables for the w x h window at (x, y) of image, clipped to the image.
+     * @throws std::invalid_argument If image is not RGB8 or the window has more
+     *         than maxPixels pixels.
+     */
+    SummedAreaTable(const Image& image, int x, int y, int w, int h) {
+        if (image.format != PixelFormat::RGB8) {
+            throw std::invalid_argument("SummedAreaTable: image must be 8-bit RGB");
+        }
+        left = std::max(0, x);
+        top = std::max(0, y);
+        width = std::max(0, std::min(image.width, x + w) - left);
+        height = std::max(0, std::min(image.height, y + h) - top);
+        if (size_t(width) * height > maxPixels) {
+            throw std::invalid_argument("SummedAreaTable: window too large for 32-bit sums");
+        }
+        stride = size_t(width) + 1;
+        sums.assign(stride * (height + 1) * 4, 0);
+        squares.assign(stride * (height + 1), 0);
+        charge.reset(sums.size() * sizeof(uint32_t) + squares.size() * sizeof(uint64_t));
+
+        for (int r = 0; r < height; r++) {
+            const unsigned char* px = image.imageData + (size_t(top + r) * image.width + left) * 3;
+            const uint32_t* above = &sums[size_t(r) * stride * 4];
+            uint32_t* row = &sums[size_t(r + 1) * stride * 4];
+            const uint64_t* aboveSquares = &squares[size_t(r) * stride];
+            uint64_t* rowSquares = &squares[size_t(r + 1) * stride];
+            uint32_t run[4] = { 0, 0, 0, 0 };
+            uint64_t runSquares = 0;
+            for (int c = 0; c < width; c++, px += 3) {
+                uint32_t s = uint32_t(px[0]) + px[1] + px[2];
+                run[0] += px[0];
+                run[1] += px[1];
+                run[2] += px[2];
+                run[3] += s;
+                runSquares += s * s;
+                for (int k = 0; k < 4; k++) row[(c + 1) * 4 + k] = above[(c + 1) * 4 + k] + run[k];
+                rowSquares[c + 1] = aboveSquares[c + 1] + runSquares;
+            }
+        }
+    }
+
+    /**
+     * @brief Sums over the pixels x0 <= x < x1, y0 <= y < y1, in image
+     *        coordinates, clipped to the window.
+     */
+    BoxSums box(int x0, int y0, int x1, int y1) const {
+        BoxSums result;
+        x0 = std::max(x0, left) - left;
+        y0 = std::max(y0, top) - top;
+        x1 = std::min(x1, left + width) - left;
+        y1 = std::min(y1, top + height) - top;
+        if (x0 >= x1 || y0 >= y1) return result;
+        size_t a = size_t(y0) * stride + x0, b = size_t(y0) * stride + x1;
+        size_t c = size_t(y1) * stride + x0, d = size_t(y1) * stride + x1;
+        for (int k = 0; k < 3; k++) {
+            result.channel[k] = sums[d * 4 + k] - sums[b * 4 + k] - sums[c * 4 + k] + sums[a * 4 + k];
+        }
+        result.total = sums[d * 4 + 3] - sums[b * 4 + 3] - sums[c * 4 + 3] + sums[a * 4 + 3];
+        result.totalSquares = squares[d] - squares[b] - squares[c] + squares[a];
+        result.count = uint32_t(x1 - x0) * uint32_t(y1 - y0);
+        return result;
+    }
+};
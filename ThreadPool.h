@@ -0,0 +1,159 @@
+/**
+ * @File  : ThreadPool.h
+ * @brief : Fixed-size worker pool with a bounded task queue.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+
+/**
+ * @class ThreadPool
+ * @brief Runs tasks on a fixed number of threads.
+ *
+ * submit() blocks while maxQueued tasks are already waiting, so a producer that
+ * enqueues one task per input file cannot run ahead of the workers. An
+ * exception thrown by a task is kept (the first one only) and rethrown by
+ * wait(); the other tasks still run.
+ *
+ * Pools nest: each thread has a share of the cores (availableThreads()), and
+ * a pool of n threads hands each worker 1/n of its creator's share, so a
+ * filter that sizes its pool from availableThreads() inside another pool's
+ * task runs serially instead of starting cores x cores threads.
+ */
+class ThreadPool {
+    std::vector<std::thread> workers;
+    std::deque<std::function<void()>> tasks;
+    std::mutex mutex;
+    std::condition_variable taskReady;   ///< workers wait for work
+    std::condition_variable slotFree;    ///< submit() waits for queue space
+    std::condition_variable allDone;     ///< wait() waits for an idle pool
+    size_t maxQueued;
+    size_t running = 0;
+    bool stopping = false;
+    std::exception_ptr failure; ///< First exception thrown by a task since the last wait()
+
+    static unsigned& share() {
+        thread_local unsigned threads = 0; // 0: every core
+        return threads;
+    }
+
+    void workerLoop(unsigned workerShare) {
+        share() = workerShare;
+        for (;;) {
+            std::function<void()> task;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                taskReady.wait(lock, [this] { return stopping || !tasks.empty(); });
+                if (tasks.empty()) return;
+                task = std::move(tasks.front());
+                tasks.pop_front();
+                running++;
+            }
+            slotFree.notify_one();
+            std::exception_ptr thrown;
+            try {
+                task();
+            } catch (...) {
+                thrown = std::current_exception();
+            }
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (thrown && !failure) failure = thrown;
+                running--;
+                if (tasks.empty() && running == 0) allDone.notify_all();
+            }
+        }
+    }
+
+public:
+    static unsigned defaultThreadCount() {
+        return std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    // Cores the calling thread may spread its own work over.
+    static unsigned availableThreads() {
+        return share() ? share() : defaultThreadCount();
+    }
+
+    explicit ThreadPool(unsigned threads = defaultThreadCount(), size_t queueLimit = 0)
+        : maxQueued(queueLimit ? queueLimit : 2 * size_t(std::max(1u, threads))) {
+        threads = std::max(1u, threads);
+        unsigned workerShare = std::max(1u, availableThreads() / threads);
+        for (unsigned i = 0; i < threads; i++) workers.emplace_back([this, workerShare] { workerLoop(workerShare); });
+    }
+
+    ~ThreadPool() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        taskReady.notify_all();
+        for (auto& worker : workers) worker.join();
+    }
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    size_t size() const { return workers.size(); }
+
+    /**
+     * @brief Narrows availableThreads() on the calling thread while in scope,
+     *        for threads started outside a pool (e.g. a scheduler stage).
+     */
+    class Share {
+        unsigned saved;
+
+    public:
+        explicit Share(unsigned threads) : saved(share()) { share() = std::max(1u, threads); }
+        ~Share() { share() = saved; }
+        Share(const Share&) = delete;
+        Share& operator=(const Share&) = delete;
+    };
+
+    void submit(std::function<void()> task) {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            slotFree.wait(lock, [this] { return tasks.size() < maxQueued; });
+            tasks.push_back(std::move(task));
+        }
+        taskReady.notify_one();
+    }
+
+    // Blocks until every submitted task has finished, then rethrows the first
+    // exception any of them threw.
+    void wait() {
+        std::unique_lock<std::mutex> lock(mutex);
+        allDone.wait(lock, [this] { return tasks.empty() && running == 0; });
+        if (failure) std::rethrow_exception(std::exchange(failure, nullptr));
+    }
+};
+
+/**
+ * @brief Runs fn(begin, end) over slices of 0..count, on a few threads when
+ *        there is enough work. If fn throws, the first exception is rethrown
+ *        once every slice has finished.
+ */
+inline void forEachBand(int count, size_t workPerItem, const std::function<void(int, int)>& fn) {
+    unsigned threads = std::min<unsigned>(ThreadPool::availableThreads(), unsigned(std::max(count, 0)));
+    if (threads < 2 || size_t(count) * workPerItem < (size_t(1) << 18)) {
+        fn(0, count);
+        return;
+    }
+    int band = (count + int(threads) * 4 - 1) / (int(threads) * 4);
+    ThreadPool pool(threads);
+    for (int begin = 0; begin < count; begin += band) {
+        int end = std::min(count, begin + band);
+        pool.submit([&fn, begin, end] { fn(begin, end); });
+    }
+    pool.wait();
+}
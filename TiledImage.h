@@ -0,0 +1,347 @@
+/**
+ * @File  : TiledImage.h
+ * @brief : Tiled RGB image storage with an LRU tile cache that pages cold
+ *          tiles out to a memory-mapped scratch file, so images larger than
+ *          physical memory can be filtered tile by tile.
+ */
+
+#pragma once
+
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <list>
+#include <memory>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#include "Filters.h"
+
+
+/**
+ * @class ScratchFile
+ * @brief A temporary file mapped into memory, deleted when closed.
+ */
+class ScratchFile {
+    unsigned char* mapping = nullptr;
+    size_t size = 0;
+#ifdef _WIN32
+    HANDLE file = INVALID_HANDLE_VALUE;
+    HANDLE mapHandle = nullptr;
+#else
+    int fd = -1;
+#endif
+
+public:
+    explicit ScratchFile(size_t bytes) : size(bytes) {
+        std::string dir = std::filesystem::temp_directory_path().string();
+#ifdef _WIN32
+        char path[MAX_PATH];
+        if (!GetTempFileNameA(dir.c_str(), "wud", 0, path)) {
+            throw std::runtime_error("Cannot create tile scratch file");
+        }
+        file = CreateFileA(path, GENERIC_READ | GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS,
+                           FILE_ATTRIBUTE_TEMPORARY | FILE_FLAG_DELETE_ON_CLOSE, nullptr);
+        if (file == INVALID_HANDLE_VALUE) {
+            throw std::runtime_error("Cannot open tile scratch file");
+        }
+        LARGE_INTEGER length;
+        length.QuadPart = static_cast<LONGLONG>(bytes);
+        mapHandle = CreateFileMappingA(file, nullptr, PAGE_READWRITE, length.HighPart, length.LowPart, nullptr);
+        if (mapHandle != nullptr) {
+            mapping = static_cast<unsigned char*>(MapViewOfFile(mapHandle, FILE_MAP_ALL_ACCESS, 0, 0, bytes));
+        }
+#else
+        std::string pattern = dir + "/wakeupatdawn-tiles-XXXXXX";
+        std::vector<char> path(pattern.begin(), pattern.end());
+        path.push_back('\0');
+        fd = mkstemp(path.data());
+        if (fd < 0) {
+            throw std::runtime_error("Cannot create tile scratch file in " + dir);
+        }
+        unlink(path.data());
+        if (ftruncate(fd, static_cast<off_t>(bytes)) == 0) {
+            void* mapped = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+            if (mapped != MAP_FAILED) mapping = static_cast<unsigned char*>(mapped);
+        }
+#endif
+        if (mapping == nullptr) {
+            close();
+            throw std::runtime_error("Cannot map tile scratch file");
+        }
+    }
+
+    ~ScratchFile() { close(); }
+
+    ScratchFile(const ScratchFile&) = delete;
+    ScratchFile& operator=(const ScratchFile&) = delete;
+
+    unsigned char* data() { return mapping; }
+
+private:
+    void close() {
+#ifdef _WIN32
+        if (mapping) UnmapViewOfFile(mapping);
+        if (mapHandle) CloseHandle(mapHandle);
+        if (file != INVALID_HANDLE_VALUE) CloseHandle(file);
+        mapHandle = nullptr;
+        file = INVALID_HANDLE_VALUE;
+#else
+        if (mapping) munmap(mapping, size);
+        if (fd >= 0) ::close(fd);
+        fd = -1;
+#endif
+        mapping = nullptr;
+    }
+};
+
+
+/**
+ * @class TiledImage
+ * @brief Interleaved RGB image split into square tiles.
+ *
+ * At most cacheBytes worth of tiles are kept in RAM; the least recently used
+ * tile is written to the scratch file when the budget is exceeded and read
+ * back on the next access. The scratch file is only created once the first
+ * tile has to leave memory, so images that fit in the budget never touch disk.
+ *
+ * Not thread-safe: a pointer returned by tileData() stays valid only until the
+ * next tile access.
+ */
+class TiledImage {
+    struct Slot {
+        std::unique_ptr<unsigned char[]> data;
+        bool dirty = false;
+        bool paged = false; ///< The scratch file holds this tile's contents.
+        std::list<int>::iterator lruPos;
+    };
+
+    std::vector<Slot> slots;
+    std::list<int> lru; ///< Resident tiles, most recently used first.
+    std::unique_ptr<ScratchFile> scratch;
+    size_t cacheBytes;
+    size_t residentTiles = 0;
+
+    size_t tileBytes() const { return static_cast<size_t>(tileSize) * tileSize * 3; }
+
+    void evictOne() {
+        int index = lru.back();
+        lru.pop_back();
+        Slot& slot = slots[index];
+        if (slot.dirty) {
+            if (!scratch) scratch = std::make_unique<ScratchFile>(tileBytes() * slots.size());
+            memcpy(scratch->data() + index * tileBytes(), slot.data.get(), tileBytes());
+            slot.paged = true;
+            slot.dirty = false;
+        }
+        slot.data.reset();
+        residentTiles--;
+    }
+
+public:
+    static constexpr int defaultTileSize = 256;
+    static constexpr size_t defaultCacheBytes = size_t(512) << 20;
+
+    const int width;
+    const int height;
+    const int tileSize;
+    const int tilesX;
+    const int tilesY;
+
+    TiledImage(int w, int h, size_t cache = defaultCacheBytes, int tile = defaultTileSize)
+        : cacheBytes(cache), width(w), height(h), tileSize(tile),
+          tilesX((w + tile - 1) / tile), tilesY((h + tile - 1) / tile) {
+        if (w <= 0 || h <= 0 || tile <= 0) {
+            throw std::invalid_argument("TiledImage needs positive dimensions");
+        }
+        slots.resize(static_cast<size_t>(tilesX) * tilesY);
+    }
+
+    TiledImage(const TiledImage&) = delete;
+    TiledImage& operator=(const TiledImage&) = delete;
+
+    /**
+     * @brief Returns the tile's pixels (row stride tileSize * 3), loading it if needed.
+     *
+     * @param forWrite Marks the tile dirty so it is written out on eviction.
+     */
+    unsigned char* tileData(int tx, int ty, bool forWrite) {
+        int index = ty * tilesX + tx;
+        Slot& slot = slots[index];
+        if (slot.data) {
+            lru.splice(lru.begin(), lru, slot.lruPos);
+        } else {
+            size_t maxTiles = std::max<size_t>(2, cacheBytes / tileBytes());
+            while (residentTiles >= maxTiles) evictOne();
+            slot.data.reset(new unsigned char[tileBytes()]);
+            if (slot.paged) {
+                memcpy(slot.data.get(), scratch->data() + index * tileBytes(), tileBytes());
+            } else {
+                memset(slot.data.get(), 0, tileBytes());
+            }
+            lru.push_front(index);
+            slot.lruPos = lru.begin();
+            residentTiles++;
+        }
+        slot.dirty |= forWrite;
+        return slot.data.get();
+    }
+
+    /**
+     * @brief Copies the w x h rectangle at (x, y) into dst.
+     */
+    void readRegion(int x, int y, int w, int h, unsigned char* dst, size_t dstStride) {
+        for (int ty = y / tileSize; ty <= (y + h - 1) / tileSize; ty++) {
+            for (int tx = x / tileSize; tx <= (x + w - 1) / tileSize; tx++) {
+                const unsigned char* tile = tileData(tx, ty, false);
+                int x0 = std::max(x, tx * tileSize), x1 = std::min(x + w, (tx + 1) * tileSize);
+                int y0 = std::max(y, ty * tileSize), y1 = std::min(y + h, (ty + 1) * tileSize);
+                for (int row = y0; row < y1; row++) {
+                    memcpy(dst + (row - y) * dstStride + (x0 - x) * 3,
+                           tile + ((row - ty * tileSize) * tileSize + (x0 - tx * tileSize)) * 3,
+                           (x1 - x0) * 3);
+                }
+            }
+        }
+    }
+
+    /**
+     * @brief Copies src into the w x h rectangle at (x, y).
+     */
+    void writeRegion(int x, int y, int w, int h, const unsigned char* src, size_t srcStride) {
+        for (int ty = y / tileSize; ty <= (y + h - 1) / tileSize; ty++) {
+            for (int tx = x / tileSize; tx <= (x + w - 1) / tileSize; tx++) {
+                unsigned char* tile = tileData(tx, ty, true);
+                int x0 = std::max(x, tx * tileSize), x1 = std::min(x + w, (tx + 1) * tileSize);
+                int y0 = std::max(y, ty * tileSize), y1 = std::min(y + h, (ty + 1) * tileSize);
+                for (int row = y0; row < y1; row++) {
+                    memcpy(tile + ((row - ty * tileSize) * tileSize + (x0 - tx * tileSize)) * 3,
+                           src + (row - y) * srcStride + (x0 - x) * 3,
+                           (x1 - x0) * 3);
+                }
+            }
+        }
+    }
+
+    static std::unique_ptr<TiledImage> fromImage(const Image& image, size_t cache = defaultCacheBytes,
+                                                 int tile = defaultTileSize) {
+        if (image.format != PixelFormat::RGB8) throw std::invalid_argument("Tiled images hold 8-bit RGB only");
+        auto tiled = std::make_unique<TiledImage>(image.width, image.height, cache, tile);
+        tiled->writeRegion(0, 0, image.width, image.height, image.imageData, size_t(image.width) * 3);
+        return tiled;
+    }
+
+    Image toImage() {
+        Image image(width, height, PixelFormat::RGB8);
+        if (!image.imageData) throw std::bad_alloc();
+        readRegion(0, 0, width, height, image.imageData, size_t(width) * 3);
+        return image;
+    }
+
+    size_t residentBytes() const { return residentTiles * tileBytes(); }
+    size_t cacheBudget() const { return cacheBytes; }
+    bool isPaging() const { return scratch != nullptr; }
+
+    /**
+     * @brief Exchanges pixel storage with another image of the same geometry.
+     */
+    void swapStorage(TiledImage& other) {
+        if (other.width != width || other.height != height || other.tileSize != tileSize) {
+            throw std::invalid_argument("Tiled images have different geometry");
+        }
+        std::swap(slots, other.slots);
+        std::swap(lru, other.lru);
+        std::swap(scratch, other.scratch);
+        std::swap(residentTiles, other.residentTiles);
+    }
+};
+
+
+/**
+ * @brief Makes img a w x h buffer, reusing its allocation when the size matches.
+ */
+inline void reshapeImage(Image& img, int w, int h) {
+    if (img.imageData == nullptr || size_t(img.width) * img.height != size_t(w) * h || img.format != PixelFormat::RGB8) {
+        stbi_image_free(img.imageData);
+        img.imageData = static_cast<unsigned char*>(malloc(size_t(w) * h * 3));
+    }
+    img.width = w;
+    img.height = h;
+    img.channels = 3;
+    img.format = PixelFormat::RGB8;
+    img.charge.reset(img.imageData ? img.byteSize() : 0);
+}
+
+/**
+ * @brief Runs filter over a tiled image one tile at a time.
+ *
+ * Each tile is read together with filter.tileHalo() pixels of context on every
+ * side (clipped at the image border), filtered in the image the filter is bound
+ * to, and only its interior is written back. Filters with a halo write into a
+ * second tiled image (with the same cache budget) so later tiles still read
+ * unfiltered neighbours.
+ *
+ * @throws std::invalid_argument If the filter needs the whole image at once.
+ */
+inline void applyTiled(TiledImage& tiled, Filter& filter) {
+    int halo = filter.tileHalo();
+    if (halo < 0) {
+        throw std::invalid_argument(filter.getName() + " needs the whole image and cannot run on tiles");
+    }
+
+    if (auto* point = dynamic_cast<PointFilter*>(&filter)) {
+        PointTransform transform = point->transform();
+        for (int ty = 0; ty < tiled.tilesY; ty++) {
+            for (int tx = 0; tx < tiled.tilesX; tx++) {
+                unsigned char* tile = tiled.tileData(tx, ty, true);
+                int w = std::min(tiled.tileSize, tiled.width - tx * tiled.tileSize);
+                int h = std::min(tiled.tileSize, tiled.height - ty * tiled.tileSize);
+                for (int row = 0; row < h; row++) {
+                    transform.run(tile + size_t(row) * tiled.tileSize * 3, w);
+                }
+            }
+        }
+        return;
+    }
+
+    std::unique_ptr<TiledImage> output;
+    if (halo > 0) output = std::make_unique<TiledImage>(tiled.width, tiled.height, tiled.cacheBudget(), tiled.tileSize);
+    TiledImage& target = output ? *output : tiled;
+
+    Image& buffer = filter.getImage();
+    for (int ty = 0; ty < tiled.tilesY; ty++) {
+        for (int tx = 0; tx < tiled.tilesX; tx++) {
+            int x0 = tx * tiled.tileSize, y0 = ty * tiled.tileSize;
+            int w = std::min(tiled.tileSize, tiled.width - x0);
+            int h = std::min(tiled.tileSize, tiled.height - y0);
+            int hx0 = std::max(0, x0 - halo), hy0 = std::max(0, y0 - halo);
+            int hx1 = std::min(tiled.width, x0 + w + halo), hy1 = std::min(tiled.height, y0 + h + halo);
+            int bw = hx1 - hx0, bh = hy1 - hy0;
+
+            reshapeImage(buffer, bw, bh);
+            tiled.readRegion(hx0, hy0, bw, bh, buffer.imageData, size_t(bw) * 3);
+            filter.setOrigin(hx0, hy0);
+            filter.apply();
+            if (buffer.width != bw || buffer.height != bh) {
+                throw std::logic_error(filter.getName() + " changed the tile size");
+            }
+            target.writeRegion(x0, y0, w, h,
+                               buffer.imageData + (size_t(y0 - hy0) * bw + (x0 - hx0)) * 3, size_t(bw) * 3);
+        }
+    }
+    filter.setOrigin(0, 0);
+    if (output) tiled.swapStorage(*output);
+}
@@ -0,0 +1,266 @@
+/**
+ * @File  : Trace.h
+ * @brief : Scoped timers around decode, filters, display and encode, with
+ *          rolling per-operation statistics and optional Chrome trace export.
+ *
+ * A trace::Scope times the block it lives in. Tracing is off unless the app
+ * asks for statistics (the GUI does, for its status bar and stats panel) or
+ * the WAKEUP_TRACE environment variable names a file; while it is off a Scope
+ * costs one relaxed atomic load and no clock reads, so the timers stay in
+ * release builds. With WAKEUP_TRACE set every event is also kept and written
+ * to that file as Chrome trace JSON (chrome://tracing, ui.perfetto.dev) at
+ * exit or on flush(), ready to attach to a bug report.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+
+namespace trace {
+
+using Clock = std::chrono::steady_clock;
+
+struct Event {
+    std::string name;     ///< "decode", "Blur", ...
+    const char* category; ///< "decode", "filter", "display", "scale" or "encode"
+    std::string detail;   ///< e.g. the file name; shown in the trace's args
+    int64_t startUs;      ///< since the tracer started
+    int64_t durationUs;
+    uint32_t thread;
+};
+
+/**
+ * @brief Timings of one operation over its most recent calls.
+ */
+struct Stats {
+    std::string name;
+    const char* category = "";
+    uint64_t count = 0;   ///< calls since the last reset
+    double lastMs = 0;
+    double meanMs = 0;    ///< over the window
+    double minMs = 0;
+    double maxMs = 0;
+    size_t window = 0;    ///< calls the mean, min and max cover
+};
+
+/**
+ * @brief Small, stable number for the calling thread (Chrome's "tid").
+ */
+inline uint32_t threadNumber() {
+    static std::atomic<uint32_t> next{ 1 };
+    thread_local uint32_t number = next++;
+    return number;
+}
+
+class Tracer {
+public:
+    static constexpr size_t statsWindow = 64;          ///< calls kept per operation
+    static constexpr size_t maxFileEvents = 1 << 20;   ///< cap on events kept for WAKEUP_TRACE
+
+    static Tracer& instance() {
+        static Tracer tracer;
+        return tracer;
+    }
+
+    bool enabled() const { return on.load(std::memory_order_relaxed); }
+
+    /**
+     * @brief Turns statistics collection on or off; WAKEUP_TRACE keeps tracing
+     *        on regardless.
+     */
+    void enableStats(bool enable) {
+        std::lock_guard<std::mutex> lock(mutex);
+        statsWanted = enable;
+        on.store(statsWanted || !filePath.empty(), std::memory_order_relaxed);
+    }
+
+    bool writingFile() const { return !filePath.empty(); }
+    const std::string& tracePath() const { return filePath; }
+
+    void record(std::string name, const char* category, std::string detail, Clock::time_point start, Clock::time_point end) {
+        Event event{ std::move(name), category, std::move(detail),
+                     std::chrono::duration_cast<std::chrono::microseconds>(start - epoch).count(),
+                     std::chrono::duration_cast<std::chrono::microseconds>(end - start).count(),
+                     threadNumber() };
+        double ms = std::chrono::duration<double, std::milli>(end - start).count();
+
+        std::lock_guard<std::mutex> lock(mutex);
+        Series& series = byName[event.name];
+        series.category = category;
+        series.count++;
+        series.samples.push_back(ms);
+        if (series.samples.size() > statsWindow) series.samples.pop_front();
+        if (!filePath.empty() && events.size() < maxFileEvents) events.push_back(std::move(event));
+    }
+
+    /**
+     * @brief Statistics of every operation seen so far, most total time first.
+     */
+    std::vector<Stats> stats() const {
+        std::vector<Stats> result;
+        std::lock_guard<std::mutex> lock(mutex);
+        for (const auto& [name, series] : byName) {
+            if (series.samples.empty()) continue;
+            Stats s;
+            s.name = name;
+            s.category = series.category;
+            s.count = series.count;
+            s.window = series.samples.size();
+            s.lastMs = series.samples.back();
+            s.minMs = s.maxMs = s.lastMs;
+            double total = 0;
+            for (double ms : series.samples) {
+                total += ms;
+                s.minMs = std::min(s.minMs, ms);
+                s.maxMs = std::max(s.maxMs, ms);
+            }
+            s.meanMs = total / s.window;
+            result.push_back(s);
+        }
+        std::sort(result.begin(), result.end(), [](const Stats& a, const Stats& b) {
+            return a.meanMs * a.window > b.meanMs * b.window;
+        });
+        return result;
+    }
+
+    /**
+     * @brief Duration of the latest call of name, or a negative value if none.
+     */
+    double lastMs(const std::string& name) const {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = byName.find(name);
+        return it == byName.end() || it->second.samples.empty() ? -1 : it->second.samples.back();
+    }
+
+    void resetStats() {
+        std::lock_guard<std::mutex> lock(mutex);
+        byName.clear();
+    }
+
+    /**
+     * @brief Writes the events kept so far to WAKEUP_TRACE.
+     * @return false if there is no file or it cannot be written.
+     */
+    bool flush() {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (filePath.empty()) return false;
+        FILE* file = fopen(filePath.c_str(), "wb");
+        if (!file) return false;
+        fputs("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n", file);
+        for (size_t i = 0; i < events.size(); i++) {
+            const Event& e = events[i];
+            fprintf(file, "%s{\"name\":%s,\"cat\":\"%s\",\"ph\":\"X\",\"ts\":%lld,\"dur\":%lld,\"pid\":1,\"tid\":%u",
+                    i ? ",\n" : "", quoted(e.name).c_str(), e.category, (long long)e.startUs, (long long)e.durationUs,
+                    e.thread);
+            if (!e.detail.empty()) fprintf(file, ",\"args\":{\"detail\":%s}", quoted(e.detail).c_str());
+            fputc('}', file);
+        }
+        fputs("\n]}\n", file);
+        return fclose(file) == 0;
+    }
+
+private:
+    struct Series {
+        const char* category = "";
+        uint64_t count = 0;
+        std::deque<double> samples;
+    };
+
+    std::atomic<bool> on{ false };
+    mutable std::mutex mutex;
+    bool statsWanted = false;
+    std::string filePath;
+    Clock::time_point epoch = Clock::now();
+    std::map<std::string, Series> byName;
+    std::vector<Event> events;
+
+    Tracer() {
+        if (const char* path = getenv("WAKEUP_TRACE")) filePath = path;
+        on.store(!filePath.empty(), std::memory_order_relaxed);
+    }
+
+    ~Tracer() { flush(); }
+
+    static std::string quoted(const std::string& text) {
+        std::string out = "\"";
+        for (char ch : text) {
+            if (ch == '"' || ch == '\\') {
+                out += '\\';
+                out += ch;
+            } else if (static_cast<unsigned char>(ch) < 0x20) {
+                char escaped[8];
+                snprintf(escaped, sizeof(escaped), "\\u%04x", ch);
+                out += escaped;
+            } else {
+                out += ch;
+            }
+        }
+        return out + "\"";
+    }
+};
+
+inline bool enabled() { return Tracer::instance().enabled(); }
+
+/**
+ * @class Scope
+ * @brief Records the time from construction to destruction (or stop()).
+ *
+ * When tracing is off nothing is read or stored. Pass names that are stable
+ * across calls ("decode", a filter's name) so statistics group them; put
+ * per-call information in the detail.
+ */
+class Scope {
+    const char* category;
+    const char* literal = nullptr;
+    std::string name;
+    std::string detail;
+    Clock::time_point start;
+    bool active;
+
+public:
+    Scope(const char* category, const char* name) : category(category), literal(name), active(enabled()) {
+        if (active) start = Clock::now();
+    }
+
+    Scope(const char* category, std::string name) : category(category), active(enabled()) {
+        if (active) {
+            this->name = std::move(name);
+            start = Clock::now();
+        }
+    }
+
+    Scope(const Scope&) = delete;
+    Scope& operator=(const Scope&) = delete;
+
+    ~Scope() { stop(); }
+
+    void setDetail(std::string text) {
+        if (active) detail = std::move(text);
+    }
+
+    /**
+     * @brief Ends the measurement early.
+     * @return Milliseconds measured, or 0 when tracing is off.
+     */
+    double stop() {
+        if (!active) return 0;
+        active = false;
+        Clock::time_point end = Clock::now();
+        Tracer::instance().record(literal ? std::string(literal) : std::move(name), category, std::move(detail), start, end);
+        return std::chrono::duration<double, std::milli>(end - start).count();
+    }
+};
+
+} // namespace trace
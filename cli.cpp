@@ -0,0 +1,494 @@
+// Headless batch processor: runs a chain of filters over many images in parallel.
+//
+//   WakeUpAtDawnCLI -f Blur -p "Blur Strength=8" -f Invert -o out/ photos/*.jpg
+//
+// Filters are picked by id or name (see --list); -p sets a parameter on the
+// filter given just before it, using the same names the GUI asks for.
+
+#include "BatchScheduler.h"
+#include "Filters.h"
+#include "ImageInput.h"
+#include "ImageOutput.h"
+#include "MemoryAccounting.h"
+#include "ScanlineStream.h"
+#include "ThreadPool.h"
+#include "Trace.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace {
+
+struct FilterSpec {
+    string filter;
+    vector<pair<string, string>> params;
+    map<string, shared_ptr<const Image>> images; ///< "image" parameter values by path, decoded once
+};
+
+struct Options {
+    vector<string> inputs;
+    vector<FilterSpec> chain;
+    string outputDir;
+    string format;
+    unsigned jobs = ThreadPool::defaultThreadCount();
+    size_t queueDepth = 0;
+    int64_t memoryLimit = -1;  ///< -1: keep WAKEUP_MEMORY_LIMIT
+    int thumbnail = 0;
+    string pixelFormat = "rgb8"; ///< A pixelFormatName(), or "auto" for each file's own
+    EncodeOptions encode;
+    bool stream = false;
+};
+
+const char* usage =
+    "Usage: WakeUpAtDawnCLI [options] -o <output dir> <inputs...>\n"
+    "\n"
+    "Inputs may be files, directories or wildcard patterns (* and ?).\n"
+    "\n"
+    "Options:\n"
+    "  -f, --filter <id|name>    append a filter to the chain\n"
+    "  -p, --param <name=value>  set a parameter of the last filter; a unique\n"
+    "                            prefix of the parameter name is enough\n"
+    "  -o, --output <dir>        directory for the results (created if needed)\n"
+    "  -t, --format <ext>        output format, e.g. png or jpg (default: input's)\n"
+    "  -j, --jobs <n>            threads per stage (decode, filter, encode;\n"
+    "                            default: core count)\n"
+    "  -q, --queue <n>           decoded images allowed to wait between two\n"
+    "                            stages (default: --jobs); bounds memory use\n"
+    "  -M, --memory-limit <size> hold off decoding while images in flight use\n"
+    "                            more than size, e.g. 2G or 800M (default:\n"
+    "                            $WAKEUP_MEMORY_LIMIT, else none); larger\n"
+    "                            images are filtered in tiles paged to disk\n"
+    "  -T, --thumbnail <px>      shrink each image to fit px x px before the\n"
+    "                            filters; JPEGs are decoded at reduced size\n"
+    "  -F, --pixel-format <fmt>  rgb8, rgba8 (keep alpha), rgb16 (16-bit\n"
+    "                            samples) or auto (per file; default: rgb8)\n"
+    "  -Q, --quality <1-100>     JPEG quality (default: 90)\n"
+    "  -z, --compression <0-9>   PNG compression, 0 = fastest (default: 6)\n"
+    "  -s, --stream              process row by row when every filter allows it\n"
+    "                            (point filters, Blur, Edge Detection, Oil\n"
+    "                            Painting); PNG and JPEG inputs are still\n"
+    "                            decoded whole, and JPEG output encoded whole\n"
+    "  -l, --list                list filters and their parameters\n"
+    "  -h, --help                show this help\n"
+    "\n"
+    "Set WAKEUP_TRACE=<file.json> to record a Chrome trace (chrome://tracing)\n"
+    "of every decode, filter and encode.\n";
+
+string lower(string text) {
+    for (char& ch : text) ch = static_cast<char>(tolower(static_cast<unsigned char>(ch)));
+    return text;
+}
+
+bool wildcardMatch(const char* pattern, const char* text) {
+    if (*pattern == '\0') return *text == '\0';
+    if (*pattern == '*') {
+        for (const char* t = text;; t++) {
+            if (wildcardMatch(pattern + 1, t)) return true;
+            if (*t == '\0') return false;
+        }
+    }
+    if (*text == '\0') return false;
+    if (*pattern == '?' || *pattern == *text) return wildcardMatch(pattern + 1, text + 1);
+    return false;
+}
+
+// Judged by content, so upper-case or missing extensions are still picked up.
+bool isImageFile(const fs::path& path) {
+    try {
+        MappedFile file(path.string());
+        return sniffFormat(file.data(), file.size(), path.string()) != ImageFormat::Unknown;
+    } catch (const exception&) {
+        return false;
+    }
+}
+
+vector<string> expandInputs(const vector<string>& patterns) {
+    vector<string> files;
+    for (const string& pattern : patterns) {
+        fs::path path(pattern);
+        if (fs::is_directory(path)) {
+            vector<string> found;
+            for (auto& entry : fs::directory_iterator(path)) {
+                if (entry.is_regular_file() && isImageFile(entry.path())) found.push_back(entry.path().string());
+            }
+            sort(found.begin(), found.end());
+            files.insert(files.end(), found.begin(), found.end());
+        } else if (pattern.find_first_of("*?") != string::npos) {
+            fs::path dir = path.has_parent_path() ? path.parent_path() : fs::path(".");
+            string name = path.filename().string();
+            vector<string> found;
+            if (fs::is_directory(dir)) {
+                for (auto& entry : fs::directory_iterator(dir)) {
+                    if (entry.is_regular_file() && wildcardMatch(name.c_str(), entry.path().filename().string().c_str())) {
+                        found.push_back(entry.path().string());
+                    }
+                }
+            }
+            if (found.empty()) cerr << "No files match " << pattern << endl;
+            sort(found.begin(), found.end());
+            files.insert(files.end(), found.begin(), found.end());
+        } else {
+            files.push_back(pattern);
+        }
+    }
+    return files;
+}
+
+const FilterEntry* findFilter(const string& key) {
+    Image unused;
+    for (const FilterEntry& entry : filterRegistry()) {
+        if (entry.id == key || lower(entry.create(unused)->getName()) == lower(key)) return &entry;
+    }
+    return nullptr;
+}
+
+void listFilters() {
+    Image unused;
+    for (const FilterEntry& entry : filterRegistry()) {
+        auto filter = entry.create(unused);
+        printf("%3s  %s\n", entry.id.c_str(), filter->getName().c_str());
+        for (const FilterParam& param : filter->getNeeds()) {
+            printf("       - \"%s\" (%s", param.name.c_str(), param.type.c_str());
+            if (!param.defaultValue.empty()) printf(", default %s", param.defaultValue.c_str());
+            printf(")\n");
+        }
+    }
+}
+
+// The parameter key names: the exact name or a unique prefix of one.
+const FilterParam& findParam(Filter& filter, const vector<FilterParam>& needs, const string& key) {
+    const FilterParam* match = nullptr;
+    int prefixMatches = 0;
+    for (const FilterParam& param : needs) {
+        if (param.name == key) {
+            match = &param;
+            prefixMatches = 1;
+            break;
+        }
+        if (lower(param.name).rfind(lower(key), 0) == 0) {
+            match = &param;
+            prefixMatches++;
+        }
+    }
+    if (!match || prefixMatches != 1) {
+        throw invalid_argument("Unknown or ambiguous parameter \"" + key + "\" for " + filter.getName());
+    }
+    return *match;
+}
+
+// Decodes every "image" parameter of the chain once; each chain built from it
+// then shares the same Image.
+void loadImageParams(vector<FilterSpec>& chain) {
+    Image unused;
+    for (FilterSpec& spec : chain) {
+        auto filter = findFilter(spec.filter)->create(unused);
+        vector<FilterParam> needs = filter->getNeeds();
+        for (const auto& [key, value] : spec.params) {
+            if (findParam(*filter, needs, key).type == "image" && !spec.images.count(value)) {
+                spec.images[value] = make_shared<const Image>(decodeImage(value, PixelFormat::RGBA8));
+            }
+        }
+    }
+}
+
+// Sets the GUI's default for every parameter, then the user's values.
+void configure(Filter& filter, const FilterSpec& spec) {
+    vector<FilterParam> needs = filter.getNeeds();
+    for (const FilterParam& param : needs) {
+        if ((param.type == "float" || param.type == "int" || param.type == "bool") && !param.defaultValue.empty()) {
+            filter.setParam(param.name, stod(param.defaultValue));
+        }
+    }
+
+    for (const auto& [key, value] : spec.params) {
+        const FilterParam* match = &findParam(filter, needs, key);
+        if (match->type == "image") {
+            filter.setParam(match->name, spec.images.at(value));
+        } else if (match->type == "color") {
+            filter.setParam(match->name, value);
+        } else {
+            filter.setParam(match->name, stod(value));
+        }
+    }
+
+    for (const FilterParam& param : needs) {
+        bool given = false;
+        for (const auto& [key, value] : spec.params) {
+            given |= lower(param.name).rfind(lower(key), 0) == 0;
+        }
+        if (param.type == "image" && !given) {
+            throw invalid_argument(filter.getName() + " needs \"" + param.name + "\"");
+        }
+    }
+}
+
+vector<shared_ptr<Filter>> buildChain(const vector<FilterSpec>& chain, Image& image) {
+    vector<shared_ptr<Filter>> filters;
+    for (const FilterSpec& spec : chain) {
+        auto filter = findFilter(spec.filter)->create(image);
+        configure(*filter, spec);
+        filters.push_back(filter);
+    }
+    return filters;
+}
+
+double millisecondsSince(chrono::steady_clock::time_point start) {
+    return chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+}
+
+string outputPathFor(const string& input, const Options& options) {
+    fs::path in(input);
+    string ext = options.format.empty() ? in.extension().string() : "." + options.format;
+    if (ext.empty()) ext = ".png"; // input recognised by content alone
+    return (fs::path(options.outputDir) / (in.stem().string() + ext)).string();
+}
+
+bool parseArguments(int argc, char* argv[], Options& options) {
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        auto next = [&]() -> string {
+            if (i + 1 >= argc) throw invalid_argument(arg + " needs a value");
+            return argv[++i];
+        };
+        if (arg == "-h" || arg == "--help") {
+            cout << usage;
+            return false;
+        } else if (arg == "-l" || arg == "--list") {
+            listFilters();
+            return false;
+        } else if (arg == "-f" || arg == "--filter") {
+            string key = next();
+            if (!findFilter(key)) throw invalid_argument("Unknown filter \"" + key + "\" (see --list)");
+            options.chain.push_back({ key, {} });
+        } else if (arg == "-p" || arg == "--param") {
+            string assignment = next();
+            size_t eq = assignment.rfind('=');
+            if (options.chain.empty()) throw invalid_argument("-p must follow a -f");
+            if (eq == string::npos) throw invalid_argument("Expected name=value, got \"" + assignment + "\"");
+            options.chain.back().params.push_back({ assignment.substr(0, eq), assignment.substr(eq + 1) });
+        } else if (arg == "-o" || arg == "--output") {
+            options.outputDir = next();
+        } else if (arg == "-t" || arg == "--format") {
+            options.format = lower(next());
+            if (!options.format.empty() && options.format[0] == '.') options.format.erase(0, 1);
+        } else if (arg == "-j" || arg == "--jobs") {
+            options.jobs = max(1, stoi(next()));
+        } else if (arg == "-q" || arg == "--queue") {
+            options.queueDepth = size_t(max(1, stoi(next())));
+        } else if (arg == "-M" || arg == "--memory-limit") {
+            options.memoryLimit = memory::parseBytes(next());
+        } else if (arg == "-T" || arg == "--thumbnail") {
+            options.thumbnail = max(1, stoi(next()));
+        } else if (arg == "-F" || arg == "--pixel-format") {
+            options.pixelFormat = lower(next());
+            if (options.pixelFormat != "auto") parsePixelFormat(options.pixelFormat);
+        } else if (arg == "-Q" || arg == "--quality") {
+            options.encode.jpegQuality = clamp(stoi(next()), 1, 100);
+        } else if (arg == "-z" || arg == "--compression") {
+            options.encode.pngCompression = clamp(stoi(next()), 0, 9);
+        } else if (arg == "-s" || arg == "--stream") {
+            options.stream = true;
+        } else if (!arg.empty() && arg[0] == '-') {
+            throw invalid_argument("Unknown option " + arg);
+        } else {
+            options.inputs.push_back(arg);
+        }
+    }
+    if (options.inputs.empty() || options.outputDir.empty()) {
+        throw invalid_argument("Need at least one input and an output directory (-o)");
+    }
+    return true;
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    Options options;
+    try {
+        if (!parseArguments(argc, argv, options)) return 0;
+        if (options.memoryLimit >= 0) memory::accounting().setLimit(options.memoryLimit);
+        // Fail on bad parameters before touching any input image.
+        loadImageParams(options.chain);
+        Image probe;
+        buildChain(options.chain, probe);
+    } catch (const exception& e) {
+        cerr << "Error: " << e.what() << "\n\n" << usage;
+        return 2;
+    }
+
+    vector<string> files = expandInputs(options.inputs);
+    if (files.empty()) {
+        cerr << "Error: no input images" << endl;
+        return 2;
+    }
+    fs::create_directories(options.outputDir);
+
+    bool streamable = options.stream;
+    if (streamable && options.thumbnail) {
+        cerr << "Note: --thumbnail decodes whole images, --stream ignored" << endl;
+        streamable = false;
+    }
+    if (streamable && options.pixelFormat != "rgb8") {
+        cerr << "Note: streaming is 8-bit RGB only, --stream ignored" << endl;
+        streamable = false;
+    }
+    if (options.thumbnail && options.pixelFormat != "rgb8") {
+        cerr << "Note: thumbnails are 8-bit RGB, --pixel-format ignored" << endl;
+    }
+    if (streamable) {
+        Image probe;
+        for (auto& filter : buildChain(options.chain, probe)) streamable &= StreamPipeline::canStream(*filter);
+        if (!streamable) cerr << "Note: chain has whole-image filters, --stream ignored" << endl;
+    }
+    // Under --memory-limit, an image whose pixels alone exceed the limit is
+    // filtered tile by tile instead, paging tiles to a scratch file.
+    int64_t memoryLimit = memory::accounting().limit();
+    bool tileable = memoryLimit > 0 && !streamable && !options.thumbnail && options.pixelFormat == "rgb8";
+    if (tileable) {
+        Image probe;
+        for (auto& filter : buildChain(options.chain, probe)) tileable &= filter->tileHalo() >= 0;
+    }
+
+    mutex outputMutex;
+    atomic<int> done{ 0 }, failed{ 0 };
+    int counterWidth = int(to_string(files.size()).size());
+    auto batchStart = chrono::steady_clock::now();
+
+    auto reportLine = [&](const string& file, const char* line) {
+        int index = ++done;
+        lock_guard<mutex> lock(outputMutex);
+        printf("[%*d/%zu] %-32s %s\n", counterWidth, index, files.size(), fs::path(file).filename().string().c_str(), line);
+    };
+    auto reportFailure = [&](const string& file, const string& error) {
+        failed++;
+        lock_guard<mutex> lock(outputMutex);
+        cerr << "Failed " << file << ": " << error << endl;
+    };
+
+    // Headers only: unreadable inputs fail before any decoding starts, and the
+    // largest images are scheduled first so a big one does not straggle at the end.
+    vector<pair<uint64_t, string>> bySize;
+    vector<string> tiledFiles;
+    bool overLimit = false;
+    for (const string& file : files) {
+        try {
+            ImageHeader header = probeImage(file);
+            uint64_t pixels = uint64_t(header.width) * uint64_t(header.height);
+            bool large = memoryLimit > 0 && !options.thumbnail && pixels * 3 > uint64_t(memoryLimit);
+            overLimit |= large;
+            if (large && tileable) tiledFiles.push_back(file);
+            else bySize.push_back({ pixels, file });
+        } catch (const exception& e) {
+            reportFailure(file, e.what());
+        }
+    }
+    stable_sort(bySize.begin(), bySize.end(), [](const auto& a, const auto& b) { return a.first > b.first; });
+    vector<string> scheduled;
+    for (auto& entry : bySize) scheduled.push_back(entry.second);
+    if (overLimit && !tileable && !streamable) {
+        cerr << "Note: chain has whole-image filters, images over --memory-limit are filtered whole" << endl;
+    }
+
+    // One at a time, each with every thread for its filters and encode. The
+    // source tiles and the filtered ones get a quarter of the limit each.
+    for (const string& file : tiledFiles) {
+        try {
+            auto start = chrono::steady_clock::now();
+            EncodeOptions encode = options.encode;
+            encode.threads = options.jobs;
+            Image buffer;
+            tileFile(file, outputPathFor(file, options), buildChain(options.chain, buffer), size_t(memoryLimit) / 4,
+                     encode);
+            char line[128];
+            snprintf(line, sizeof(line), "tiled     total %8.1f ms", millisecondsSince(start));
+            reportLine(file, line);
+        } catch (const exception& e) {
+            reportFailure(file, e.what());
+        }
+    }
+
+    // A PNG is deflated in bands on several threads; with fewer images than
+    // jobs, the spare threads go to each encode.
+    EncodeOptions encode = options.encode;
+    encode.threads = max<unsigned>(1, options.jobs / unsigned(max<size_t>(1, scheduled.size())));
+
+    if (streamable) {
+        // Streaming keeps a few rows per image, so images simply run side by
+        // side; with fewer images than jobs, the spare cores go to each filter.
+        ThreadPool pool(min<unsigned>(options.jobs, unsigned(scheduled.size())));
+        for (const string& file : scheduled) {
+            pool.submit([&, file]() {
+                try {
+                    auto start = chrono::steady_clock::now();
+                    Image unused;
+                    streamFile(file, outputPathFor(file, options), buildChain(options.chain, unused), encode);
+                    char line[128];
+                    snprintf(line, sizeof(line), "streamed  total %8.1f ms", millisecondsSince(start));
+                    reportLine(file, line);
+                } catch (const exception& e) {
+                    reportFailure(file, e.what());
+                }
+            });
+        }
+        pool.wait();
+    } else {
+        BatchScheduler::Config config;
+        config.decodeThreads = config.filterThreads = config.encodeThreads = options.jobs;
+        config.queueDepth = options.queueDepth ? options.queueDepth : options.jobs;
+        config.encode = encode;
+        if (options.thumbnail) {
+            config.decode = [&](const string& path) { return decodeThumbnail(path, options.thumbnail); };
+        } else if (options.pixelFormat != "rgb8") {
+            config.decode = [&](const string& path) {
+                PixelFormat format = options.pixelFormat == "auto" ? nativePixelFormat(probeImage(path))
+                                                                   : parsePixelFormat(options.pixelFormat);
+                return decodeImage(path, format);
+            };
+        }
+
+        vector<pair<string, string>> jobs;
+        for (const string& file : scheduled) jobs.push_back({ file, outputPathFor(file, options) });
+
+        BatchScheduler(config).run(
+            jobs,
+            [&](Image& image) {
+                FilterPipeline pipeline(image);
+                for (auto& filter : buildChain(options.chain, image)) pipeline.add(filter);
+                pipeline.run();
+            },
+            [&](const BatchResult& result) {
+                if (!result.error.empty()) {
+                    reportFailure(result.input, result.error);
+                    return;
+                }
+                char line[256];
+                snprintf(line, sizeof(line), "%5dx%-5d decode %8.1f ms  filters %8.1f ms  encode %8.1f ms",
+                         result.width, result.height, result.decodeMs, result.filterMs, result.encodeMs);
+                reportLine(result.input, line);
+            });
+    }
+
+    double seconds = millisecondsSince(batchStart) / 1000.0;
+    printf("%d image(s) in %.2f s (%.2f images/s, %u threads per stage), %d failed\n",
+           done.load(), seconds, seconds > 0 ? done / seconds : 0.0, options.jobs, failed.load());
+    const memory::Accounting& accounting = memory::accounting();
+    printf("Peak image memory %s (images %s, filter temporaries %s)",
+           memory::formatBytes(accounting.peak()).c_str(),
+           memory::formatBytes(accounting.peak(memory::Owner::Current)).c_str(),
+           memory::formatBytes(accounting.peak(memory::Owner::Temporary)).c_str());
+    if (accounting.limit() > 0) printf(", limit %s", memory::formatBytes(accounting.limit()).c_str());
+    printf("\n");
+    if (trace::Tracer::instance().writingFile()) {
+        const string& path = trace::Tracer::instance().tracePath();
+        if (trace::Tracer::instance().flush()) printf("Trace written to %s\n", path.c_str());
+        else fprintf(stderr, "Cannot write trace %s\n", path.c_str());
+    }
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,543 @@
+// Performance suite for every filter in the registry.
+//
+//   filters_bench                          all filters, all sizes, the sample images
+//   filters_bench --filter Blur --sizes 2,12 --json blur.json
+//   filters_bench --baseline before.json   adds a speed-up column against an earlier run
+//
+// Each benchmark times construction, default parameters and apply() on a fresh
+// copy of its input, repeated until --min-time has passed. It reports time per
+// call, pixels per second, heap allocations per call and the peak resident set.
+// JSON output is meant to be kept per release and diffed, e.g. between a build
+// with -DWAKEUP_SSSE3=ON and one with OFF.
+
+#include "Filters.h"
+#include "ImageInput.h"
+
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <new>
+#include <regex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if defined(_WIN32)
+#define NOMINMAX
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+#ifndef WAKEUP_ASSETS_DIR
+#define WAKEUP_ASSETS_DIR "assets"
+#endif
+
+namespace fs = std::filesystem;
+
+// --------------------------------------------------------------------------
+// Allocation counting. With glibc every heap allocation, Image's malloc and
+// operator new alike, goes through malloc, so that is what is counted;
+// elsewhere, and under ASan (which owns malloc), only operator new is.
+// --------------------------------------------------------------------------
+
+#if defined(__SANITIZE_ADDRESS__)
+#define WAKEUP_ASAN 1
+#elif defined(__has_feature)
+#if __has_feature(address_sanitizer)
+#define WAKEUP_ASAN 1
+#endif
+#endif
+
+namespace {
+std::atomic<unsigned long long> allocationCount{ 0 };
+std::atomic<unsigned long long> allocatedBytes{ 0 };
+
+inline void countAllocation(size_t size) {
+    allocationCount.fetch_add(1, std::memory_order_relaxed);
+    allocatedBytes.fetch_add(size, std::memory_order_relaxed);
+}
+} // namespace
+
+#if defined(__GLIBC__) && !defined(WAKEUP_ASAN)
+extern "C" {
+void* __libc_malloc(size_t size);
+void* __libc_calloc(size_t count, size_t size);
+void* __libc_realloc(void* ptr, size_t size);
+
+void* malloc(size_t size) {
+    countAllocation(size);
+    return __libc_malloc(size);
+}
+void* calloc(size_t count, size_t size) {
+    countAllocation(count * size);
+    return __libc_calloc(count, size);
+}
+void* realloc(void* ptr, size_t size) {
+    countAllocation(size);
+    return __libc_realloc(ptr, size);
+}
+}
+static const char* allocationCounter = "malloc";
+#else
+void* operator new(size_t size) {
+    countAllocation(size);
+    if (void* ptr = std::malloc(size ? size : 1)) return ptr;
+    throw std::bad_alloc();
+}
+void* operator new[](size_t size) { return operator new(size); }
+void operator delete(void* ptr) noexcept { std::free(ptr); }
+void operator delete[](void* ptr) noexcept { std::free(ptr); }
+void operator delete(void* ptr, size_t) noexcept { std::free(ptr); }
+void operator delete[](void* ptr, size_t) noexcept { std::free(ptr); }
+static const char* allocationCounter = "operator new";
+#endif
+
+namespace {
+
+// --------------------------------------------------------------------------
+// Peak resident set. Linux can reset the high-water mark, which makes it per
+// benchmark; elsewhere it is the process's peak so far.
+// --------------------------------------------------------------------------
+
+bool resetPeakRss() {
+#if defined(__linux__)
+    if (FILE* file = fopen("/proc/self/clear_refs", "w")) {
+        bool ok = fputs("5", file) >= 0;
+        return fclose(file) == 0 && ok;
+    }
+#endif
+    return false;
+}
+
+unsigned long long peakRssBytes() {
+#if defined(__linux__)
+    if (FILE* file = fopen("/proc/self/status", "r")) {
+        char line[256];
+        unsigned long long kb = 0;
+        while (fgets(line, sizeof(line), file)) {
+            if (sscanf(line, "VmHWM: %llu kB", &kb) == 1) break;
+        }
+        fclose(file);
+        if (kb) return kb * 1024;
+    }
+#endif
+#if defined(_WIN32)
+    PROCESS_MEMORY_COUNTERS counters;
+    if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) return counters.PeakWorkingSetSize;
+    return 0;
+#else
+    rusage usage{};
+    getrusage(RUSAGE_SELF, &usage);
+#if defined(__APPLE__)
+    return static_cast<unsigned long long>(usage.ru_maxrss);
+#else
+    return static_cast<unsigned long long>(usage.ru_maxrss) * 1024;
+#endif
+#endif
+}
+
+// --------------------------------------------------------------------------
+// Inputs
+// --------------------------------------------------------------------------
+
+struct BenchInput {
+    string name;   ///< "2MP" or the file name
+    string source; ///< "synthetic" or the path
+    Image image;
+};
+
+// A smooth gradient with noise on top, so that filters which depend on
+// content (thresholds, edges) do a representative amount of work.
+Image syntheticImage(int width, int height, uint32_t seed) {
+    Image image(width, height);
+    uint32_t state = seed * 2654435761u + 1;
+    unsigned char* px = image.imageData;
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++, px += 3) {
+            state ^= state << 13;
+            state ^= state >> 17;
+            state ^= state << 5;
+            int noise = int(state & 31) - 16;
+            px[0] = static_cast<unsigned char>(clamp(x * 255 / max(1, width - 1) + noise, 0, 255));
+            px[1] = static_cast<unsigned char>(clamp(y * 255 / max(1, height - 1) + noise, 0, 255));
+            px[2] = static_cast<unsigned char>(clamp(((x ^ y) & 255) + noise, 0, 255));
+        }
+    }
+    return image;
+}
+
+// 4:3 frame of roughly megapixels * 10^6 pixels.
+pair<int, int> frameFor(double megapixels) {
+    double pixels = megapixels * 1e6;
+    int width = max(1, int(lround(sqrt(pixels * 4 / 3))));
+    int height = max(1, int(lround(pixels / width)));
+    return { width, height };
+}
+
+string sizeLabel(double megapixels) {
+    ostringstream label;
+    label << megapixels << "MP";
+    return label.str();
+}
+
+// --------------------------------------------------------------------------
+// Running
+// --------------------------------------------------------------------------
+
+struct BenchResult {
+    string name, filter, input, source;
+    int width = 0, height = 0;
+    long iterations = 0;
+    double meanMs = 0, minMs = 0;
+    double pixelsPerSecond = 0;
+    double allocationsPerCall = 0, bytesPerCall = 0;
+    unsigned long long peakRss = 0;
+    string error;
+};
+
+// The GUI's default for every parameter; images get the overlay, colours a
+// fixed one.
+void configure(Filter& filter, const Image& overlay) {
+    for (const FilterParam& param : filter.getNeeds()) {
+        if ((param.type == "float" || param.type == "int" || param.type == "bool") && !param.defaultValue.empty()) {
+            filter.setParam(param.name, stod(param.defaultValue));
+        } else if (param.type == "image") {
+            filter.setParam(param.name, overlay);
+        } else if (param.type == "color") {
+            filter.setParam(param.name, string("#c08040"));
+        }
+    }
+}
+
+BenchResult runBenchmark(const FilterEntry& entry, const BenchInput& input, double minSeconds, long maxIterations) {
+    BenchResult result;
+    Image unused;
+    result.filter = entry.create(unused)->getName();
+    result.input = input.name;
+    result.source = input.source;
+    result.name = result.filter + "/" + input.name;
+    result.width = input.image.width;
+    result.height = input.image.height;
+
+    // Filters that take a second image (Merge) get one of the same size, made
+    // outside the timed region.
+    Image overlay;
+    for (const FilterParam& param : entry.create(unused)->getNeeds()) {
+        if (param.type == "image") overlay = syntheticImage(result.width, result.height, 7);
+    }
+
+    resetPeakRss();
+    double totalMs = 0;
+    unsigned long long allocations = 0, bytes = 0;
+    result.minMs = 1e300;
+    try {
+        while (result.iterations < 1 || (totalMs < minSeconds * 1000 && result.iterations < maxIterations)) {
+            Image work = input.image;
+            unsigned long long allocationsBefore = allocationCount.load();
+            unsigned long long bytesBefore = allocatedBytes.load();
+            auto start = chrono::steady_clock::now();
+            {
+                auto filter = entry.create(work);
+                configure(*filter, overlay);
+                filter->apply();
+            }
+            double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+            allocations += allocationCount.load() - allocationsBefore;
+            bytes += allocatedBytes.load() - bytesBefore;
+            totalMs += ms;
+            result.minMs = min(result.minMs, ms);
+            result.iterations++;
+        }
+    } catch (const exception& e) {
+        result.error = e.what();
+    }
+    if (result.iterations == 0) result.minMs = 0;
+    result.peakRss = peakRssBytes();
+    if (result.iterations > 0) {
+        result.meanMs = totalMs / result.iterations;
+        result.allocationsPerCall = double(allocations) / result.iterations;
+        result.bytesPerCall = double(bytes) / result.iterations;
+        if (result.meanMs > 0) result.pixelsPerSecond = double(result.width) * result.height / (result.meanMs / 1000);
+    }
+    return result;
+}
+
+// --------------------------------------------------------------------------
+// Output
+// --------------------------------------------------------------------------
+
+string jsonString(const string& text) {
+    string out = "\"";
+    for (char ch : text) {
+        if (ch == '"' || ch == '\\') out += '\\';
+        if (static_cast<unsigned char>(ch) < 0x20) {
+            char escaped[8];
+            snprintf(escaped, sizeof(escaped), "\\u%04x", ch);
+            out += escaped;
+        } else {
+            out += ch;
+        }
+    }
+    return out + "\"";
+}
+
+const char* simdName() {
+#ifdef WAKEUP_PLANAR_SSSE3
+    return "ssse3";
+#else
+    return "scalar";
+#endif
+}
+
+void writeJson(ostream& out, const vector<BenchResult>& results, bool perBenchmarkRss) {
+    char date[64];
+    time_t now = time(nullptr);
+    strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%S", localtime(&now));
+
+    out << "{\n  \"context\": {\n"
+        << "    \"date\": " << jsonString(date) << ",\n"
+        << "    \"num_cpus\": " << thread::hardware_concurrency() << ",\n"
+#ifdef NDEBUG
+        << "    \"build_type\": \"release\",\n"
+#else
+        << "    \"build_type\": \"debug\",\n"
+#endif
+        << "    \"simd\": " << jsonString(simdName()) << ",\n"
+        << "    \"allocation_counter\": " << jsonString(allocationCounter) << ",\n"
+        << "    \"peak_rss_scope\": " << jsonString(perBenchmarkRss ? "benchmark" : "process") << "\n"
+        << "  },\n  \"benchmarks\": [";
+    for (size_t i = 0; i < results.size(); i++) {
+        const BenchResult& r = results[i];
+        out << (i ? "," : "") << "\n    {\n"
+            << "      \"name\": " << jsonString(r.name) << ",\n"
+            << "      \"filter\": " << jsonString(r.filter) << ",\n"
+            << "      \"input\": " << jsonString(r.input) << ",\n"
+            << "      \"source\": " << jsonString(r.source) << ",\n"
+            << "      \"width\": " << r.width << ",\n"
+            << "      \"height\": " << r.height << ",\n"
+            << "      \"iterations\": " << r.iterations << ",\n"
+            << "      \"real_time_ms\": " << r.meanMs << ",\n"
+            << "      \"min_time_ms\": " << r.minMs << ",\n"
+            << "      \"pixels_per_second\": " << r.pixelsPerSecond << ",\n"
+            << "      \"allocations_per_call\": " << r.allocationsPerCall << ",\n"
+            << "      \"allocated_bytes_per_call\": " << r.bytesPerCall << ",\n"
+            << "      \"peak_rss_bytes\": " << r.peakRss;
+        if (!r.error.empty()) out << ",\n      \"error\": " << jsonString(r.error);
+        out << "\n    }";
+    }
+    out << "\n  ]\n}\n";
+}
+
+// Reads name -> pixels_per_second from a file this tool wrote.
+map<string, double> readBaseline(const string& path) {
+    ifstream in(path);
+    if (!in) throw runtime_error("Cannot read baseline " + path);
+    stringstream text;
+    text << in.rdbuf();
+    string json = text.str();
+    static const regex entry("\"name\": \"((?:[^\"\\\\]|\\\\.)*)\"[^}]*?\"pixels_per_second\": ([-+0-9.eE]+)");
+    map<string, double> rates;
+    for (sregex_iterator it(json.begin(), json.end(), entry), end; it != end; ++it) {
+        rates[(*it)[1]] = stod((*it)[2]);
+    }
+    return rates;
+}
+
+string humanBytes(double bytes) {
+    const char* units[] = { "B", "KB", "MB", "GB" };
+    int unit = 0;
+    while (bytes >= 1024 && unit < 3) {
+        bytes /= 1024;
+        unit++;
+    }
+    char text[32];
+    snprintf(text, sizeof(text), "%.1f %s", bytes, units[unit]);
+    return text;
+}
+
+void printRow(FILE* out, const BenchResult& r, const map<string, double>& baseline) {
+    if (!r.error.empty()) {
+        fprintf(out, "%-34s ERROR: %s\n", r.name.c_str(), r.error.c_str());
+        return;
+    }
+    fprintf(out, "%-34s %11.2f ms %6ld %10.1f %11.1f %11s", r.name.c_str(), r.meanMs, r.iterations,
+           r.pixelsPerSecond / 1e6, r.allocationsPerCall, humanBytes(double(r.peakRss)).c_str());
+    auto before = baseline.find(r.name);
+    if (before != baseline.end() && before->second > 0) fprintf(out, " %8.2fx", r.pixelsPerSecond / before->second);
+    fprintf(out, "\n");
+    fflush(out);
+}
+
+// --------------------------------------------------------------------------
+// Command line
+// --------------------------------------------------------------------------
+
+struct Options {
+    vector<string> filters;                     ///< ids or names; empty = all
+    vector<double> sizes = { 0.3, 2, 12, 24, 100 };
+    string assetsDir = WAKEUP_ASSETS_DIR;
+    vector<string> images = { "building.jpg", "toy2.jpg", "arrow.jpg" };
+    double minSeconds = 0.5;
+    long maxIterations = 1000;
+    string jsonPath;
+    string baselinePath;
+};
+
+const char* usage =
+    "Usage: filters_bench [options]\n"
+    "\n"
+    "Options:\n"
+    "  -f, --filter <id|name>    benchmark only this filter (repeatable)\n"
+    "  -s, --sizes <list>        synthetic sizes in megapixels, comma separated\n"
+    "                            (default: 0.3,2,12,24,100; 'none' for no synthetic)\n"
+    "  -a, --assets <dir>        directory of the sample images\n"
+    "  -i, --images <list>       sample images, comma separated (default:\n"
+    "                            building.jpg,toy2.jpg,arrow.jpg; 'none' to skip)\n"
+    "  -m, --min-time <seconds>  minimum time per benchmark (default: 0.5)\n"
+    "  -n, --max-iterations <n>  cap on calls per benchmark (default: 1000)\n"
+    "  -j, --json <file>         write results as JSON ('-' for stdout)\n"
+    "  -b, --baseline <file>     JSON from an earlier run; prints the speed-up\n"
+    "  -h, --help                show this help\n";
+
+vector<string> splitList(const string& text) {
+    vector<string> items;
+    stringstream stream(text);
+    string item;
+    while (getline(stream, item, ',')) {
+        if (!item.empty()) items.push_back(item);
+    }
+    if (items.size() == 1 && items[0] == "none") items.clear();
+    return items;
+}
+
+bool parseArguments(int argc, char* argv[], Options& options) {
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        auto next = [&]() -> string {
+            if (i + 1 >= argc) throw invalid_argument(arg + " needs a value");
+            return argv[++i];
+        };
+        if (arg == "-h" || arg == "--help") {
+            cout << usage;
+            return false;
+        } else if (arg == "-f" || arg == "--filter") {
+            options.filters.push_back(next());
+        } else if (arg == "-s" || arg == "--sizes") {
+            options.sizes.clear();
+            for (const string& size : splitList(next())) options.sizes.push_back(stod(size));
+        } else if (arg == "-a" || arg == "--assets") {
+            options.assetsDir = next();
+        } else if (arg == "-i" || arg == "--images") {
+            options.images = splitList(next());
+        } else if (arg == "-m" || arg == "--min-time") {
+            options.minSeconds = max(0.0, stod(next()));
+        } else if (arg == "-n" || arg == "--max-iterations") {
+            options.maxIterations = max(1L, stol(next()));
+        } else if (arg == "-j" || arg == "--json") {
+            options.jsonPath = next();
+        } else if (arg == "-b" || arg == "--baseline") {
+            options.baselinePath = next();
+        } else {
+            throw invalid_argument("Unknown option " + arg);
+        }
+    }
+    return true;
+}
+
+string lower(string text) {
+    for (char& ch : text) ch = static_cast<char>(tolower(static_cast<unsigned char>(ch)));
+    return text;
+}
+
+vector<const FilterEntry*> selectFilters(const vector<string>& keys) {
+    vector<const FilterEntry*> selected;
+    Image unused;
+    for (const FilterEntry& entry : filterRegistry()) {
+        bool wanted = keys.empty();
+        for (const string& key : keys) {
+            wanted |= entry.id == key || lower(entry.create(unused)->getName()) == lower(key);
+        }
+        if (wanted) selected.push_back(&entry);
+    }
+    if (selected.empty()) throw invalid_argument("No filter matches --filter");
+    return selected;
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    Options options;
+    vector<const FilterEntry*> filters;
+    map<string, double> baseline;
+    try {
+        if (!parseArguments(argc, argv, options)) return 0;
+        filters = selectFilters(options.filters);
+        if (!options.baselinePath.empty()) baseline = readBaseline(options.baselinePath);
+    } catch (const exception& e) {
+        cerr << "Error: " << e.what() << "\n\n" << usage;
+        return 2;
+    }
+
+    // Inputs are built one at a time so only one 100 MP source is alive.
+    vector<function<BenchInput()>> inputs;
+    for (double megapixels : options.sizes) {
+        inputs.push_back([megapixels] {
+            auto [width, height] = frameFor(megapixels);
+            return BenchInput{ sizeLabel(megapixels), "synthetic", syntheticImage(width, height, 1) };
+        });
+    }
+    for (const string& name : options.images) {
+        string path = (fs::path(options.assetsDir) / name).string();
+        inputs.push_back([name, path] { return BenchInput{ name, path, decodeImage(path) }; });
+    }
+
+    bool perBenchmarkRss = resetPeakRss();
+    FILE* console = options.jsonPath == "-" ? stderr : stdout;
+    fprintf(console, "filters_bench: simd %s, allocations counted at %s, peak RSS per %s\n\n", simdName(),
+            allocationCounter, perBenchmarkRss ? "benchmark" : "process");
+    fprintf(console, "%-34s %14s %6s %10s %11s %11s%s\n", "Benchmark", "Time/call", "Calls", "Mpix/s",
+            "Allocs/call", "Peak RSS", baseline.empty() ? "" : "  Speed-up");
+    fflush(console);
+
+    vector<BenchResult> results;
+    int failed = 0;
+    for (auto& makeInput : inputs) {
+        BenchInput input;
+        try {
+            input = makeInput();
+        } catch (const exception& e) {
+            cerr << "Skipping input: " << e.what() << endl;
+            failed++;
+            continue;
+        }
+        for (const FilterEntry* entry : filters) {
+            results.push_back(runBenchmark(*entry, input, options.minSeconds, options.maxIterations));
+            if (!results.back().error.empty()) failed++;
+            printRow(console, results.back(), baseline);
+        }
+    }
+
+    if (!options.jsonPath.empty()) {
+        if (options.jsonPath == "-") {
+            writeJson(cout, results, perBenchmarkRss);
+        } else {
+            ofstream out(options.jsonPath);
+            writeJson(out, results, perBenchmarkRss);
+            if (!out) {
+                cerr << "Error: cannot write " << options.jsonPath << endl;
+                return 1;
+            }
+        }
+    }
+    return failed ? 1 : 0;
+}
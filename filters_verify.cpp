@@ -0,0 +1,974 @@
+// Correctness harness: runs every registered filter next to its reference
+// implementation (ReferenceFilters.h) and compares the outputs.
+//
+//   filters_verify                 all filters, exit status 1 on any mismatch
+//   filters_verify -f Blur -v      one filter, list every failing case
+//
+// Inputs are small adversarial images: 1x1, single rows and columns, odd
+// widths and widths around the 16-pixel SIMD block, filled with noise, flat
+// black or white, stripes and gradients. Each filter runs with its GUI
+// defaults, with every numeric parameter at its minimum and its maximum, and
+// with a few out-of-range extras (a radius of 250, for one). Random chains
+// through FilterPipeline check the fused point-filter path as well, and random
+// selections check applyToView against the reference run on the whole image.
+// Every filter also runs on RGBA8 and RGB16 copies of the inputs, which must
+// match the reference on 8-bit RGB with alpha kept.
+// Tiled runs that page to disk and row-by-row streams must match the filter on
+// the whole image, PNGs written as rows arrive must match encodePng(), the
+// Philox generator must give Random123's known answers, and last, the scaled
+// JPEG decoder gets truncated and corrupted files.
+//
+// Outputs must match byte for byte unless the filter has a tolerance below
+// (maximum absolute difference per sample); mismatches report the PSNR and
+// the first differing sample. Filters that leave pixels unwritten (uncovered
+// Skew and Merge areas) compare equal because
+// fresh heap blocks are filled with a fixed byte: by a malloc wrapper with
+// glibc, or ASan's malloc_fill_byte when built with WAKEUP_SANITIZE.
+
+#include "Filters.h"
+#include "JpegScaled.h"
+#include "Random.h"
+#include "ReferenceFilters.h"
+#include "ScanlineStream.h"
+#include "TiledImage.h"
+
+#include <array>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#ifndef WAKEUP_ASSETS_DIR
+#define WAKEUP_ASSETS_DIR "assets"
+#endif
+
+#if defined(__SANITIZE_ADDRESS__)
+#define WAKEUP_ASAN 1
+#elif defined(__has_feature)
+#if __has_feature(address_sanitizer)
+#define WAKEUP_ASAN 1
+#endif
+#endif
+
+// Fill every fresh heap block with 0x55 so unwritten pixels read the same in
+// both runs. glibc's own M_PERTURB skips its per-thread cache, hence the wrapper.
+#if defined(WAKEUP_ASAN)
+extern "C" const char* __asan_default_options() {
+    return "malloc_fill_byte=85:max_malloc_fill_size=2147483647";
+}
+static const bool filledHeap = true;
+#elif defined(__GLIBC__)
+extern "C" {
+void* __libc_malloc(size_t size);
+
+void* malloc(size_t size) {
+    void* block = __libc_malloc(size);
+    if (block) memset(block, 0x55, size);
+    return block;
+}
+}
+static const bool filledHeap = true;
+#else
+static const bool filledHeap = false;
+#endif
+
+namespace {
+
+// Per-filter tolerance (by id): the largest absolute difference allowed per
+// sample. Filters not listed must match exactly.
+// Bilateral's grid is in float, its reference in double.
+const map<string, int> tolerances = { { Bilateral::getId(), 1 } };
+
+// --------------------------------------------------------------------------
+// Inputs
+// --------------------------------------------------------------------------
+
+struct Input {
+    string label;
+    Image image;
+};
+
+Image patternImage(int width, int height, int pattern, mt19937& rng) {
+    Image image(width, height);
+    unsigned char* px = image.imageData;
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++, px += 3) {
+            for (int c = 0; c < 3; c++) {
+                switch (pattern) {
+                case 0: px[c] = static_cast<unsigned char>(rng()); break;
+                case 1: px[c] = 0; break;
+                case 2: px[c] = 255; break;
+                case 3: px[c] = ((x + y + c) & 1) ? 255 : 0; break;
+                default: px[c] = static_cast<unsigned char>((x * 255 / max(1, width - 1) + y * 7 + c * 85) & 255); break;
+                }
+            }
+        }
+    }
+    return image;
+}
+
+vector<Input> makeInputs(uint32_t seed) {
+    static const int sizes[][2] = {
+        { 1, 1 }, { 1, 2 }, { 2, 1 }, { 2, 2 }, { 3, 3 }, { 1, 17 }, { 17, 1 }, { 5, 7 },
+        { 15, 16 }, { 16, 15 }, { 17, 33 }, { 31, 31 }, { 33, 17 }, { 63, 5 }, { 65, 64 }, { 129, 67 },
+    };
+    static const char* patterns[] = { "noise", "black", "white", "checker", "gradient" };
+    mt19937 rng(seed);
+    vector<Input> inputs;
+    for (auto& size : sizes) {
+        for (int pattern = 0; pattern < 5; pattern++) {
+            string label = to_string(size[0]) + "x" + to_string(size[1]) + " " + patterns[pattern];
+            inputs.push_back({ label, patternImage(size[0], size[1], pattern, rng) });
+        }
+    }
+    return inputs;
+}
+
+// --------------------------------------------------------------------------
+// Parameter cases
+// --------------------------------------------------------------------------
+
+struct ParamValue {
+    string name, type;
+    double number = 0;
+    string text;
+};
+
+struct Case {
+    string label;
+    vector<ParamValue> values;
+};
+
+// Crop's GUI defaults (100x100) do not fit most of these inputs, so it gets
+// rectangles that do, plus one a pixel too wide, which must throw in both.
+vector<Case> cropCases(const Image& image) {
+    int w = image.width, h = image.height;
+    auto rect = [](int x, int y, int cw, int ch) {
+        return Case{ "rect " + to_string(x) + "," + to_string(y) + " " + to_string(cw) + "x" + to_string(ch),
+                     { { "X Corner", "int", double(x) }, { "Y Corner", "int", double(y) },
+                       { "Width", "int", double(cw) }, { "Height", "int", double(ch) } } };
+    };
+    return { rect(0, 0, w, h), rect(w / 2, h / 2, w - w / 2, h - h / 2), rect(w - 1, h - 1, 1, 1), rect(0, 0, 1, h),
+             rect(0, 0, w + 1, h) };
+}
+
+// Values beyond what the GUI offers that a caller can still set.
+vector<Case> extraCases(const string& id) {
+    if (id == Blur::getId()) {
+        return { { "radius 250", { { "Blur Strength (0:100)", "float", 250 } } },
+                 { "radius 1", { { "Blur Strength (0:100)", "float", 1 } } } };
+    }
+    if (id == Median::getId()) {
+        return { { "radius 0", { { "Radius (1:100)", "int", 0 } } },
+                 { "radius 7", { { "Radius (1:100)", "int", 7 } } } };
+    }
+    if (id == Kuwahara::getId()) {
+        return { { "brush 0", { { "Brush Size (1:100)", "int", 0 } } },
+                 { "brush 2", { { "Brush Size (1:100)", "int", 2 } } } };
+    }
+    if (id == Bilateral::getId()) {
+        return { { "fine", { { "Spatial Sigma (4:100)", "int", 2 }, { "Range Sigma (4:100)", "int", 8 } } },
+                 { "range 255", { { "Range Sigma (4:100)", "int", 255 } } } };
+    }
+    if (id == UnsharpMask::getId()) {
+        return { { "threshold 6", { { "Amount (0:500)", "int", 250 }, { "Threshold (0:255)", "int", 6 } } },
+                 { "radius 0", { { "Radius (1:100)", "int", 0 } } } };
+    }
+    if (id == Clarity::getId()) {
+        return { { "small radius", { { "Radius (1:100)", "int", 3 }, { "Amount (-100:100)", "int", 100 } } } };
+    }
+    if (id == WhiteAndBlack::getId()) {
+        const string mode = "Mode (1=Global, 2=Adaptive)";
+        return { { "adaptive, 2 tiles", { { mode, "int", 2 }, { "Tiles (2:16)", "int", 2 } } },
+                 { "adaptive, 16 tiles", { { mode, "int", 2 }, { "Tiles (2:16)", "int", 16 }, { "Offset (0:50)", "int", 0 } } },
+                 { "adaptive, offset 50", { { mode, "int", 2 }, { "Offset (0:50)", "int", 50 } } } };
+    }
+    if (id == CLAHE::getId()) {
+        return { { "3 tiles, no clip", { { "Tiles (2:16)", "int", 3 }, { "Clip Limit (1:10)", "float", 0 } } },
+                 { "5 tiles, clip 1.5", { { "Tiles (2:16)", "int", 5 }, { "Clip Limit (1:10)", "float", 1.5 } } } };
+    }
+    if (id == Resize::getId()) {
+        const string mode = "Mode (1=Stretch, 2=Seam Carving)", perPass = "Seams per Pass (1:64)";
+        return { { "seams, 10x10", { { mode, "int", 2 }, { "Width", "int", 10 }, { "Height", "int", 10 }, { perPass, "int", 4 } } },
+                 { "seams, one per pass", { { mode, "int", 2 }, { "Width", "int", 40 }, { "Height", "int", 20 }, { perPass, "int", 1 } } },
+                 { "seams, 64 per pass", { { mode, "int", 2 }, { "Width", "int", 100 }, { "Height", "int", 50 }, { perPass, "int", 64 } } } };
+    }
+    if (id == Rotate::getId()) return { { "angle 180", { { "Rotation Angle (90 / 180 / 270)", "int", 180 } } } };
+    if (id == Colormap::getId()) {
+        const string palette = "Palette (1=Viridis, 2=Inferno, 3=Gradient)";
+        return { { "inferno", { { palette, "int", 2 } } },
+                 { "gradient", { { palette, "int", 3 }, { "Gradient Start", "color", 0, "#102030" },
+                                 { "Gradient End", "color", 0, "#f0e0d0" } } },
+                 { "falling gradient", { { palette, "int", 3 }, { "Gradient Start", "color", 0, "#ffff00" },
+                                         { "Gradient End", "color", 0, "#0000ff" } } } };
+    }
+    if (id == Merge::getId()) {
+        const string type = "Enter Merge type (1: Stretch to fit, 2: Common):";
+        const string mode = "Blend Mode (1=Average, 2=Alpha, 3=Multiply, 4=Screen, 5=Overlay, 6=Difference)";
+        vector<Case> cases;
+        for (int m = 2; m <= 6; m++) {
+            cases.push_back({ "mode " + to_string(m) + " at 60%, offset",
+                              { { mode, "int", double(m) }, { "Opacity (0:100)", "float", 60 },
+                                { "Overlay X Offset", "int", 2 }, { "Overlay Y Offset", "int", -1 } } });
+        }
+        cases.push_back({ "common, offset up-left",
+                          { { type, "int", 2 }, { mode, "int", 5 }, { "Overlay X Offset", "int", -3 },
+                            { "Overlay Y Offset", "int", -2 } } });
+        cases.push_back({ "common, offset down-right, 30%",
+                          { { type, "int", 2 }, { "Opacity (0:100)", "float", 30 }, { "Overlay X Offset", "int", 4 },
+                            { "Overlay Y Offset", "int", 5 } } });
+        return cases;
+    }
+    if (id == Frame::getId()) {
+        return { { "bad colour", { { "Frame Color", "color", 0, "red" } } },
+                 { "decorative", { { "Frame Type (1=Normal, 2=Decorative)", "int", 2 } } } };
+    }
+    return {};
+}
+
+vector<Case> casesFor(const string& id, Filter& filter, const Image& image) {
+    if (id == Crop::getId()) return cropCases(image);
+    vector<FilterParam> needs = filter.getNeeds();
+    vector<Case> cases = { { "defaults", {} } };
+    for (const FilterParam& param : needs) {
+        if (param.type != "float" && param.type != "int" && param.type != "bool") continue;
+        for (double value : { param.minValue, param.maxValue }) {
+            ostringstream label;
+            label << param.name << "=" << value;
+            cases.push_back({ label.str(), { { param.name, param.type, value } } });
+        }
+    }
+    for (Case& extra : extraCases(id)) cases.push_back(extra);
+    return cases;
+}
+
+// --------------------------------------------------------------------------
+// Running and comparing
+// --------------------------------------------------------------------------
+
+struct Outcome {
+    Image image;
+    string error; ///< what() of the exception, if apply threw
+    bool threw = false;
+};
+
+// GUI defaults first, then the case's values on top.
+template <typename FilterT>
+void configure(FilterT& filter, const Case& testCase, const Image& overlay) {
+    for (const FilterParam& param : filter.getNeeds()) {
+        if ((param.type == "float" || param.type == "int" || param.type == "bool") && !param.defaultValue.empty()) {
+            filter.setParam(param.name, stod(param.defaultValue));
+        } else if (param.type == "image") {
+            filter.setParam(param.name, overlay);
+        } else if (param.type == "color") {
+            filter.setParam(param.name, string("#c08040"));
+        }
+    }
+    for (const ParamValue& value : testCase.values) {
+        if (value.type == "color") filter.setParam(value.name, value.text);
+        else filter.setParam(value.name, value.number);
+    }
+}
+
+template <typename Create>
+Outcome runFilter(Create create, const Image& input, const Case& testCase, const Image& overlay) {
+    Outcome outcome;
+    outcome.image = input;
+    try {
+        auto filter = create(outcome.image);
+        configure(*filter, testCase, overlay);
+        filter->apply();
+    } catch (const exception& e) {
+        outcome.threw = true;
+        outcome.error = e.what();
+    }
+    return outcome;
+}
+
+struct Comparison {
+    bool pass = true;
+    string detail;
+};
+
+Comparison compare(const Outcome& reference, const Outcome& optimized, int tolerance) {
+    Comparison result;
+    char text[256];
+    if (reference.threw || optimized.threw) {
+        if (reference.threw && optimized.threw) return result;
+        result.pass = false;
+        result.detail = reference.threw ? "reference threw \"" + reference.error + "\", optimized did not"
+                                        : "optimized threw \"" + optimized.error + "\"";
+        return result;
+    }
+    const Image& a = reference.image;
+    const Image& b = optimized.image;
+    if (a.width != b.width || a.height != b.height || a.format != b.format) {
+        snprintf(text, sizeof(text), "size %dx%d %s vs %dx%d %s", a.width, a.height, pixelFormatName(a.format),
+                 b.width, b.height, pixelFormatName(b.format));
+        result.pass = false;
+        result.detail = text;
+        return result;
+    }
+    size_t samples = a.byteSize();
+    size_t differing = 0, first = 0;
+    int maxAbs = 0;
+    double squared = 0;
+    for (size_t i = 0; i < samples; i++) {
+        int d = abs(int(a.imageData[i]) - int(b.imageData[i]));
+        if (!d) continue;
+        if (!differing++) first = i;
+        maxAbs = max(maxAbs, d);
+        squared += double(d) * d;
+    }
+    if (maxAbs <= tolerance) return result;
+    double psnr = 10 * log10(255.0 * 255.0 / (squared / double(samples)));
+    size_t at = first / a.channels;
+    snprintf(text, sizeof(text), "%zu samples differ, max |d| %d, PSNR %.1f dB; first at (%zu,%zu) ch %zu: %d vs %d",
+             differing, maxAbs, psnr, at % a.width, at / a.width, first % a.channels,
+             a.imageData[first], b.imageData[first]);
+    result.pass = false;
+    result.detail = text;
+    return result;
+}
+
+// --------------------------------------------------------------------------
+// Command line
+// --------------------------------------------------------------------------
+
+struct Options {
+    vector<string> filters; ///< ids or names; empty = all
+    unsigned seed = 1;
+    int chains = 40;
+    int extraTolerance = 0;
+    bool verbose = false;
+};
+
+const char* usage =
+    "Usage: filters_verify [options]\n"
+    "\n"
+    "Options:\n"
+    "  -f, --filter <id|name>  check only this filter (repeatable)\n"
+    "  -c, --chains <n>        random pipeline chains to check (default: 40)\n"
+    "  -s, --seed <n>          seed for inputs and chains (default: 1)\n"
+    "  -t, --tolerance <n>     allow this much more |difference| everywhere\n"
+    "  -v, --verbose           print every failing case, not just the first\n"
+    "  -h, --help              show this help\n";
+
+string lower(string text) {
+    for (char& ch : text) ch = static_cast<char>(tolower(static_cast<unsigned char>(ch)));
+    return text;
+}
+
+bool parseArguments(int argc, char* argv[], Options& options) {
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        auto next = [&]() -> string {
+            if (i + 1 >= argc) throw invalid_argument(arg + " needs a value");
+            return argv[++i];
+        };
+        if (arg == "-h" || arg == "--help") {
+            cout << usage;
+            return false;
+        } else if (arg == "-f" || arg == "--filter") {
+            options.filters.push_back(next());
+        } else if (arg == "-c" || arg == "--chains") {
+            options.chains = max(0, stoi(next()));
+        } else if (arg == "-s" || arg == "--seed") {
+            options.seed = unsigned(stoul(next()));
+        } else if (arg == "-t" || arg == "--tolerance") {
+            options.extraTolerance = max(0, stoi(next()));
+        } else if (arg == "-v" || arg == "--verbose") {
+            options.verbose = true;
+        } else {
+            throw invalid_argument("Unknown option " + arg);
+        }
+    }
+    return true;
+}
+
+const reference::ReferenceEntry* findReference(const string& id) {
+    for (const auto& entry : reference::referenceRegistry()) {
+        if (entry.id == id) return &entry;
+    }
+    return nullptr;
+}
+
+int toleranceFor(const string& id, const Options& options) {
+    auto it = tolerances.find(id);
+    return (it == tolerances.end() ? 0 : it->second) + options.extraTolerance;
+}
+
+// Checks one filter on every input and case; returns the number of failures.
+int verifyFilter(const FilterEntry& entry, const vector<Input>& inputs, const Options& options) {
+    Image unused;
+    string name = entry.create(unused)->getName();
+    const reference::ReferenceEntry* ref = findReference(entry.id);
+    if (!ref) {
+        printf("%-18s FAIL  no reference implementation in ReferenceFilters.h\n", name.c_str());
+        return 1;
+    }
+
+    bool usesOverlay = false;
+    for (const FilterParam& param : entry.create(unused)->getNeeds()) usesOverlay |= param.type == "image";
+
+    int tolerance = toleranceFor(entry.id, options);
+    int cases = 0, failures = 0;
+    string firstFailure;
+    for (const Input& input : inputs) {
+        Image probe = input.image;
+        vector<Case> list = casesFor(entry.id, *entry.create(probe), input.image);
+        for (const Case& testCase : list) {
+            for (int overlayKind = 0; overlayKind < 2; overlayKind++) {
+                // The second overlay has a different size, which takes Merge's resize paths.
+                mt19937 rng(options.seed + cases);
+                Image overlay = overlayKind == 0
+                    ? patternImage(input.image.width, input.image.height, 0, rng)
+                    : patternImage(input.image.width + 3, max(1, input.image.height / 2), 0, rng);
+                cases++;
+                Outcome expected = runFilter(ref->create, input.image, testCase, overlay);
+                Outcome actual = runFilter(entry.create, input.image, testCase, overlay);
+                Comparison result = compare(expected, actual, tolerance);
+                if (!result.pass) {
+                    string line = input.label + ", " + testCase.label + (overlayKind ? ", other-size overlay" : "") +
+                                  ": " + result.detail;
+                    if (!failures++) firstFailure = line;
+                    if (options.verbose) printf("    %s: %s\n", name.c_str(), line.c_str());
+                }
+                if (!usesOverlay) break;
+            }
+        }
+    }
+    if (failures) {
+        printf("%-18s FAIL  %d of %d cases; first: %s\n", name.c_str(), failures, cases, firstFailure.c_str());
+    } else {
+        printf("%-18s ok    %d cases%s\n", name.c_str(), cases,
+               tolerance ? (" (tolerance " + to_string(tolerance) + ")").c_str() : "");
+    }
+    fflush(stdout);
+    return failures;
+}
+
+// Random chains of filters through FilterPipeline, which fuses neighbouring
+// point filters, against the references applied one after another.
+int verifyChains(const vector<const FilterEntry*>& filters, const vector<Input>& inputs, const Options& options) {
+    vector<const FilterEntry*> usable;
+    for (const FilterEntry* entry : filters) {
+        if (entry->id != Crop::getId() && findReference(entry->id)) usable.push_back(entry);
+    }
+    if (usable.empty() || options.chains == 0) return 0;
+
+    mt19937 rng(options.seed);
+    int failures = 0, checked = 0;
+    for (int chain = 0; chain < options.chains; chain++) {
+        vector<const FilterEntry*> steps(2 + rng() % 3);
+        for (auto& step : steps) step = usable[rng() % usable.size()];
+        const Input& input = inputs[rng() % inputs.size()];
+        Image overlay = patternImage(input.image.width, input.image.height, 0, rng);
+
+        string label;
+        for (auto* step : steps) label += (label.empty() ? "" : " > ") + step->id;
+
+        Outcome expected, actual;
+        expected.image = input.image;
+        actual.image = input.image;
+        try {
+            for (auto* step : steps) {
+                auto filter = findReference(step->id)->create(expected.image);
+                configure(*filter, Case{}, overlay);
+                filter->apply();
+            }
+        } catch (const exception& e) {
+            expected.threw = true;
+            expected.error = e.what();
+        }
+        try {
+            FilterPipeline pipeline(actual.image);
+            for (auto* step : steps) {
+                auto filter = step->create(actual.image);
+                configure(*filter, Case{}, overlay);
+                pipeline.add(filter);
+            }
+            pipeline.run();
+        } catch (const exception& e) {
+            actual.threw = true;
+            actual.error = e.what();
+        }
+
+        checked++;
+
+        int tolerance = 0;
+        for (auto* step : steps) tolerance = max(tolerance, toleranceFor(step->id, options));
+        Comparison result = compare(expected, actual, tolerance);
+        if (!result.pass) {
+            failures++;
+            printf("chain %-30s FAIL  %s: %s\n", label.c_str(), input.label.c_str(), result.detail.c_str());
+        }
+    }
+    printf("%-18s %s %d chains\n", "Pipeline", failures ? "FAIL " : "ok   ", checked);
+    return failures;
+}
+
+// Each filter that can run on a selection, on random rectangles through
+// applyToView: inside the rectangle the result must be the reference's on the
+// whole image, outside it the input.
+int verifyRegions(const vector<const FilterEntry*>& filters, const vector<Input>& inputs, const Options& options) {
+    mt19937 rng(options.seed);
+    int failures = 0, checked = 0;
+    for (const FilterEntry* entry : filters) {
+        const reference::ReferenceEntry* ref = findReference(entry->id);
+        Image unused;
+        if (!ref || entry->create(unused)->tileHalo() < 0) continue;
+        for (int round = 0; round < 6; round++) {
+            const Input& input = inputs[rng() % inputs.size()];
+            int w = 1 + rng() % input.image.width, h = 1 + rng() % input.image.height;
+            int x = rng() % (input.image.width - w + 1), y = rng() % (input.image.height - h + 1);
+            Image overlay = patternImage(input.image.width, input.image.height, 0, rng);
+
+            Outcome whole = runFilter(ref->create, input.image, Case{}, overlay);
+            Outcome expected, actual;
+            expected.image = input.image;
+            actual.image = input.image;
+            if (whole.threw) {
+                expected = whole;
+            } else {
+                ImageView filtered = ImageView::of(whole.image).region(x, y, w, h);
+                ImageView::of(expected.image).region(x, y, w, h).copyFrom(filtered.data, filtered.stride);
+            }
+            try {
+                auto filter = entry->create(actual.image);
+                configure(*filter, Case{}, overlay);
+                applyToView(*filter, ImageView::of(actual.image).region(x, y, w, h));
+            } catch (const exception& e) {
+                actual.threw = true;
+                actual.error = e.what();
+            }
+
+            checked++;
+            Comparison result = compare(expected, actual, toleranceFor(entry->id, options));
+            if (!result.pass) {
+                failures++;
+                printf("region %-29s FAIL  %s, %dx%d at %d,%d: %s\n", entry->id.c_str(), input.label.c_str(), w, h, x, y,
+                       result.detail.c_str());
+            }
+        }
+    }
+    printf("%-18s %s %d selections\n", "Region", failures ? "FAIL " : "ok   ", checked);
+    return failures;
+}
+
+// Every filter on RGBA8 copies of the inputs with random alpha and on RGB16
+// copies, through FilterPipeline as the CLI runs them. The reference is the
+// filter on the RGB8 input: RGBA8 results must be it with the input's alpha
+// (opaque if the size changed), RGB16 results narrowed to 8 bits must be it
+// to within one step, since LUTs and matrices round 16-bit samples at full
+// precision.
+int verifyFormats(const vector<const FilterEntry*>& filters, const vector<Input>& inputs, const Options& options) {
+    mt19937 rng(options.seed);
+    int failures = 0, checked = 0;
+    for (const FilterEntry* entry : filters) {
+        const reference::ReferenceEntry* ref = findReference(entry->id);
+        if (!ref) continue;
+        for (const Input& input : inputs) {
+            Image overlay = patternImage(input.image.width, input.image.height, 0, rng);
+            Outcome reference = runFilter(ref->create, input.image, Case{}, overlay);
+            for (PixelFormat format : { PixelFormat::RGBA8, PixelFormat::RGB16 }) {
+                Image source = convertImage(input.image, format);
+                size_t pixels = size_t(source.width) * source.height;
+                if (format == PixelFormat::RGBA8) {
+                    for (size_t i = 0; i < pixels; i++) source.imageData[i * 4 + 3] = static_cast<unsigned char>(rng());
+                }
+
+                Outcome expected = reference, actual;
+                actual.image = source;
+                try {
+                    FilterPipeline pipeline(actual.image);
+                    auto filter = entry->create(actual.image);
+                    configure(*filter, Case{}, overlay);
+                    pipeline.add(filter);
+                    pipeline.run();
+                } catch (const exception& e) {
+                    actual.threw = true;
+                    actual.error = e.what();
+                }
+                int tolerance = toleranceFor(entry->id, options);
+                if (format == PixelFormat::RGBA8 && !expected.threw) {
+                    Image widened = convertImage(expected.image, PixelFormat::RGBA8);
+                    if (widened.width == source.width && widened.height == source.height) {
+                        for (size_t i = 0; i < pixels; i++) widened.imageData[i * 4 + 3] = source.imageData[i * 4 + 3];
+                    }
+                    expected.image = std::move(widened);
+                } else if (format == PixelFormat::RGB16) {
+                    if (!actual.threw && actual.image.format != PixelFormat::RGB16) {
+                        actual.threw = true;
+                        actual.error = string("came out as ") + pixelFormatName(actual.image.format);
+                    } else if (!actual.threw) {
+                        actual.image = convertImage(actual.image, PixelFormat::RGB8);
+                    }
+                    tolerance++;
+                }
+
+                checked++;
+                Comparison result = compare(expected, actual, tolerance);
+                if (!result.pass) {
+                    failures++;
+                    string label = string(pixelFormatName(format)) + " " + entry->id;
+                    printf("%-36s FAIL  %s: %s\n", label.c_str(), input.label.c_str(), result.detail.c_str());
+                }
+            }
+        }
+    }
+    printf("%-18s %s %d images\n", "Formats", failures ? "FAIL " : "ok   ", checked);
+    return failures;
+}
+
+// Each filter that can run on part of an image, through applyTiled on 16x16
+// tiles with room for only two in memory, so the rest page to the scratch file
+// and back: the result must be the filter's own on the whole image.
+int verifyTiled(const vector<const FilterEntry*>& filters, const vector<Input>& inputs, const Options& options) {
+    const int tile = 16;
+    const size_t cache = size_t(2) * tile * tile * 3;
+    mt19937 rng(options.seed);
+    int failures = 0, checked = 0;
+    for (const FilterEntry* entry : filters) {
+        Image unused;
+        if (entry->create(unused)->tileHalo() < 0) continue;
+        for (const Input& input : inputs) {
+            if (input.image.width <= tile && input.image.height <= tile) continue;
+            Image overlay = patternImage(input.image.width, input.image.height, 0, rng);
+            Outcome expected = runFilter(entry->create, input.image, Case{}, overlay);
+            Outcome actual;
+            bool paged = false;
+            try {
+                Image buffer;
+                auto filter = entry->create(buffer);
+                configure(*filter, Case{}, overlay);
+                auto tiled = TiledImage::fromImage(input.image, cache, tile);
+                applyTiled(*tiled, *filter);
+                paged = tiled->isPaging();
+                actual.image = tiled->toImage();
+            } catch (const exception& e) {
+                actual.threw = true;
+                actual.error = e.what();
+            }
+
+            checked++;
+            Comparison result = compare(expected, actual, toleranceFor(entry->id, options));
+            if (result.pass && !paged && !actual.threw && input.image.width * input.image.height > 2 * tile * tile) {
+                result = { false, "never paged" };
+            }
+            if (!result.pass) {
+                failures++;
+                printf("tiled %-30s FAIL  %s: %s\n", entry->id.c_str(), input.label.c_str(), result.detail.c_str());
+            }
+        }
+    }
+    printf("%-18s %s %d images\n", "Tiled", failures ? "FAIL " : "ok   ", checked);
+    return failures;
+}
+
+// Each filter with a streaming form, through StreamPipeline a row at a time:
+// the result must be the filter's own on the whole image. Then PNGs written
+// by RowEncoder as rows arrive, tall enough for several bands, must be the
+// same file as encodePng() makes.
+int verifyStream(const vector<const FilterEntry*>& filters, const vector<Input>& inputs, const Options& options) {
+    struct ImageReader : ScanlineReader {
+        const Image& image;
+        int nextRow = 0;
+        explicit ImageReader(const Image& source) : image(source) {
+            width = source.width;
+            height = source.height;
+        }
+        void rewind() override { nextRow = 0; }
+        void readRow(unsigned char* rgb) override {
+            memcpy(rgb, image.imageData + size_t(nextRow++) * width * 3, size_t(width) * 3);
+        }
+    };
+    struct ImageWriter : ScanlineWriter {
+        Image& image;
+        int nextRow = 0;
+        explicit ImageWriter(Image& target) : image(target) {}
+        void writeRow(const unsigned char* rgb) override {
+            memcpy(image.imageData + size_t(nextRow++) * image.width * 3, rgb, size_t(image.width) * 3);
+        }
+        void close() override {}
+    };
+
+    mt19937 rng(options.seed);
+    int failures = 0, checked = 0;
+    for (const FilterEntry* entry : filters) {
+        Image unused;
+        if (!StreamPipeline::canStream(*entry->create(unused))) continue;
+        for (const Input& input : inputs) {
+            Image overlay = patternImage(input.image.width, input.image.height, 0, rng);
+            Outcome expected = runFilter(entry->create, input.image, Case{}, overlay);
+            Outcome actual;
+            actual.image = Image(input.image.width, input.image.height);
+            try {
+                Image buffer;
+                auto filter = entry->create(buffer);
+                configure(*filter, Case{}, overlay);
+                StreamPipeline pipeline;
+                pipeline.add(*filter);
+                ImageReader reader(input.image);
+                ImageWriter writer(actual.image);
+                pipeline.run(reader, writer);
+            } catch (const exception& e) {
+                actual.threw = true;
+                actual.error = e.what();
+            }
+
+            checked++;
+            Comparison result = compare(expected, actual, toleranceFor(entry->id, options));
+            if (!result.pass) {
+                failures++;
+                printf("stream %-29s FAIL  %s: %s\n", entry->id.c_str(), input.label.c_str(), result.detail.c_str());
+            }
+        }
+    }
+
+    for (int height : { 1, 499, 500, 1201 }) {
+        Image picture = patternImage(700, height, height % 2 ? 0 : 4, rng);
+        for (int level : { 0, 1 }) {
+            for (unsigned threads : { 1u, 3u }) {
+                vector<unsigned char> whole = pngwriter::encodePng(picture, level, threads);
+                vector<unsigned char> streamed;
+                FILE* file = tmpfile();
+                bool finished = false;
+                if (file) {
+                    pngwriter::RowEncoder encoder(file, picture.width, picture.height, level, threads);
+                    for (int y = 0; y < height; y++) encoder.writeRow(picture.imageData + size_t(y) * picture.width * 3);
+                    finished = encoder.finish();
+                    streamed.resize(size_t(ftell(file)));
+                    rewind(file);
+                    finished &= fread(streamed.data(), 1, streamed.size(), file) == streamed.size();
+                    fclose(file);
+                }
+                checked++;
+                if (!finished || streamed != whole) {
+                    failures++;
+                    printf("stream png %-25s FAIL  level %d, %u threads: %zu bytes vs %zu\n",
+                           ("700x" + to_string(height)).c_str(), level, threads, streamed.size(), whole.size());
+                }
+            }
+        }
+    }
+    printf("%-18s %s %d runs\n", "Stream", failures ? "FAIL " : "ok   ", checked);
+    return failures;
+}
+
+// Philox4x32-10 (Random.h) against the known answers published with Random123,
+// and fillRow() against at() for rows that start and end off a four-word
+// block and span several of fillRow()'s eight-counter batches.
+int verifyRandom() {
+    struct KnownAnswer {
+        array<uint32_t, 4> counter;
+        rng::Key key;
+        array<uint32_t, 4> expected;
+    };
+    static const KnownAnswer answers[] = {
+        { { 0, 0, 0, 0 }, { 0, 0 }, { 0x6627e8d5, 0xe169c58d, 0xbc57ac4c, 0x9b00dbd8 } },
+        { { 0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff }, { 0xffffffff, 0xffffffff },
+          { 0x408f276d, 0x41c83b0e, 0xa20bc7c6, 0x6d5451fd } },
+        { { 0x243f6a88, 0x85a308d3, 0x13198a2e, 0x03707344 }, { 0xa4093822, 0x299f31d0 },
+          { 0xd16cfe09, 0x94fdcceb, 0x5001e420, 0x24126ea1 } },
+    };
+    int failures = 0, checked = 0;
+    for (const KnownAnswer& answer : answers) {
+        array<uint32_t, 4> words = rng::philox(answer.counter, answer.key);
+        checked++;
+        if (words != answer.expected) {
+            failures++;
+            printf("random %-29s FAIL  counter %08x...: got %08x %08x %08x %08x\n", "philox", answer.counter[0],
+                   words[0], words[1], words[2], words[3]);
+        }
+    }
+
+    rng::Key key = rng::keyFor(0x0123456789abcdefULL);
+    for (uint32_t x0 : { 0u, 1u, 2u, 3u, 5u, 31u, 33u, 0xfffffff0u }) {
+        for (size_t n : { size_t(0), size_t(1), size_t(3), size_t(32), size_t(33), size_t(70) }) {
+            vector<uint32_t> row(n + 1, 0xdeadbeef);
+            rng::fillRow(key, 7, 0x536e6f77, x0, row.data(), n);
+            checked++;
+            bool pass = row[n] == 0xdeadbeef;
+            for (size_t i = 0; i < n; i++) pass &= row[i] == rng::at(key, x0 + uint32_t(i), 7, 0x536e6f77);
+            if (!pass) {
+                failures++;
+                printf("random %-29s FAIL  x0 %u, %zu words differ from at()\n", "fillRow", x0, n);
+            }
+        }
+    }
+    printf("%-18s %s %d checks\n", "Random", failures ? "FAIL " : "ok   ", checked);
+    return failures;
+}
+
+// The scaled JPEG decoder (JpegScaled.h) on damaged files: a baseline file
+// made here and the progressive night3.jpg from the assets, truncated at many
+// lengths, with random bytes changed, with an oversubscribed Huffman table and
+// with a restart interval whose markers lead into other segments. Each must
+// either decode to the right size or be refused; built with WAKEUP_SANITIZE,
+// any stray read or write stops the run. An oversubscribed table must be
+// refused outright.
+int verifyJpeg(const Options& options) {
+    mt19937 rng(options.seed);
+    vector<pair<string, vector<unsigned char>>> sources;
+    Image picture = patternImage(129, 67, 0, rng);
+    for (int i = 0; i < 129 * 67 * 3; i += 5) picture.imageData[i] = static_cast<unsigned char>(i / 97);
+    vector<unsigned char> baseline;
+    stbi_write_jpg_to_func([](void* context, void* data, int size) {
+        auto* out = static_cast<vector<unsigned char>*>(context);
+        out->insert(out->end(), static_cast<unsigned char*>(data), static_cast<unsigned char*>(data) + size);
+    }, &baseline, picture.width, picture.height, 3, picture.imageData, 90);
+    sources.push_back({ "baseline", baseline });
+    ifstream file(string(WAKEUP_ASSETS_DIR) + "/night3.jpg", ios::binary);
+    if (file) sources.push_back({ "night3.jpg", vector<unsigned char>(istreambuf_iterator<char>(file), {}) });
+
+    enum Expect { Decodes, SizedIfDecoded, Refused, Anything };
+    int failures = 0, checked = 0;
+    auto check = [&](const string& label, const vector<unsigned char>& bytes, int width, int height, Expect expect) {
+        for (int scale : { 2, 4, 8 }) {
+            Image out;
+            bool decoded = decodeJpegScaled(bytes.data(), bytes.size(), scale, out);
+            bool sized = out.width == (width + scale - 1) / scale && out.height == (height + scale - 1) / scale;
+            checked++;
+            const char* problem = nullptr;
+            if (expect == Decodes && !decoded) problem = "refused";
+            else if (expect == Refused && decoded) problem = "decoded";
+            else if ((expect == Decodes || expect == SizedIfDecoded) && decoded && !sized) problem = "wrong size";
+            if (problem) {
+                failures++;
+                printf("jpeg %-31s FAIL  1/%d: %s\n", label.c_str(), scale, problem);
+            }
+        }
+    };
+    // The offset of the first marker of type code at or after from, or 0.
+    auto findMarker = [](const vector<unsigned char>& bytes, int code, size_t from = 2) {
+        for (size_t i = from; i + 1 < bytes.size(); i++) {
+            if (bytes[i] == 0xFF && bytes[i + 1] == code) return i;
+        }
+        return size_t(0);
+    };
+
+    for (auto& [name, bytes] : sources) {
+        size_t frame = findMarker(bytes, 0xC0) ? findMarker(bytes, 0xC0) : findMarker(bytes, 0xC2);
+        int width = (bytes[frame + 7] << 8) | bytes[frame + 8], height = (bytes[frame + 5] << 8) | bytes[frame + 6];
+        check(name, bytes, width, height, Decodes);
+
+        for (size_t length = 0; length < bytes.size(); length += 1 + bytes.size() / 97) {
+            vector<unsigned char> truncated(bytes.begin(), bytes.begin() + length);
+            check(name + " truncated", truncated, width, height, SizedIfDecoded);
+        }
+        for (int round = 0; round < 60; round++) {
+            vector<unsigned char> damaged = bytes;
+            for (int n = 1 + rng() % 4; n > 0; n--) damaged[2 + rng() % (damaged.size() - 2)] = static_cast<unsigned char>(rng());
+            check(name + " damaged", damaged, width, height, Anything);
+        }
+
+        // Three 1-bit codes, the total kept by taking the extra ones from a
+        // longer length.
+        size_t table = findMarker(bytes, 0xC4);
+        for (int length = 2; table && length <= 16; length++) {
+            const unsigned char* counts = &bytes[table + 5];
+            if (counts[0] >= 3 || counts[length - 1] < 3 - counts[0]) continue;
+            vector<unsigned char> oversubscribed = bytes;
+            oversubscribed[table + 5 + length - 1] = static_cast<unsigned char>(counts[length - 1] - (3 - counts[0]));
+            oversubscribed[table + 5] = 3;
+            check(name + " oversubscribed", oversubscribed, width, height, Refused);
+            break;
+        }
+
+        // A restart interval one unit short of the first scan, and after that
+        // scan a comment holding an RST marker, then two fake AC scans of the
+        // last component, each followed by the RST markers it needs, and a
+        // second DRI turning restarts off. A decoder that hunts for RST
+        // markers across segments takes the comment for scans and falls out
+        // of step with the file's real ones.
+        int count = bytes[frame + 9], hMax = 1, vMax = 1;
+        for (int i = 0; i < count; i++) {
+            hMax = max(hMax, bytes[frame + 11 + 3 * i] >> 4);
+            vMax = max(vMax, bytes[frame + 11 + 3 * i] & 15);
+        }
+        int mcus = ((width + 8 * hMax - 1) / (8 * hMax)) * ((height + 8 * vMax - 1) / (8 * vMax));
+        int last = frame + 10 + 3 * (count - 1), lastH = bytes[last + 1] >> 4, lastV = bytes[last + 1] & 15;
+        int units = ((width * lastH + hMax - 1) / hMax + 7) / 8 * (((height * lastV + vMax - 1) / vMax + 7) / 8);
+        int interval = max(1, mcus - 1);
+        vector<unsigned char> comment = { 0xFF, 0xFE, 0, 0, 0xFF, 0xD0 };
+        for (int fake = 0; fake < 2; fake++) {
+            const unsigned char header[] = { 0xFF, 0xDA, 0x00, 0x08, 0x01, bytes[last], 0x11, 0x01, 0x3F, 0x00 };
+            comment.insert(comment.end(), header, header + sizeof(header));
+            for (int n = 0; n <= units / interval; n++) {
+                comment.push_back(0xFF);
+                comment.push_back(static_cast<unsigned char>(0xD0 + n % 8));
+            }
+        }
+        comment[2] = static_cast<unsigned char>((comment.size() - 2) >> 8);
+        comment[3] = static_cast<unsigned char>(comment.size() - 2);
+        const unsigned char restarts[] = { 0xFF, 0xDD, 0x00, 0x04, static_cast<unsigned char>(interval >> 8),
+                                           static_cast<unsigned char>(interval) };
+        size_t second = findMarker(bytes, 0xDA, findMarker(bytes, 0xDA) + 2);
+        if (!second) second = bytes.size() - 2;
+        vector<unsigned char> misled(bytes.begin(), bytes.begin() + 2);
+        misled.insert(misled.end(), restarts, restarts + sizeof(restarts));
+        misled.insert(misled.end(), bytes.begin() + 2, bytes.begin() + second);
+        misled.insert(misled.end(), comment.begin(), comment.end());
+        misled.insert(misled.end(), restarts, restarts + 4);
+        misled.insert(misled.end(), 2, 0);
+        misled.insert(misled.end(), bytes.begin() + second, bytes.end());
+        check(name + " misleading restarts", misled, width, height, SizedIfDecoded);
+    }
+    printf("%-18s %s %d decodes\n", "JPEG decoder", failures ? "FAIL " : "ok   ", checked);
+    return failures;
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    Options options;
+    try {
+        if (!parseArguments(argc, argv, options)) return 0;
+    } catch (const exception& e) {
+        cerr << "Error: " << e.what() << "\n\n" << usage;
+        return 2;
+    }
+
+    if (!filledHeap) {
+        printf("Note: heap blocks are not pre-filled on this platform; filters that leave\n"
+               "pixels unwritten may report spurious differences.\n\n");
+    }
+    // Image's bounds checks print before throwing; the outcome is compared anyway.
+    cerr.setstate(ios::failbit);
+
+    vector<const FilterEntry*> filters;
+    Image unused;
+    for (const FilterEntry& entry : filterRegistry()) {
+        bool wanted = options.filters.empty();
+        for (const string& key : options.filters) {
+            wanted |= entry.id == key || lower(entry.create(unused)->getName()) == lower(key);
+        }
+        if (wanted) filters.push_back(&entry);
+    }
+    if (filters.empty()) {
+        fprintf(stderr, "Error: no filter matches --filter\n");
+        return 2;
+    }
+
+    vector<Input> inputs = makeInputs(options.seed);
+    int failures = 0;
+    for (const FilterEntry* entry : filters) failures += verifyFilter(*entry, inputs, options);
+    failures += verifyChains(filters, inputs, options);
+    failures += verifyRegions(filters, inputs, options);
+    failures += verifyFormats(filters, inputs, options);
+    failures += verifyTiled(filters, inputs, options);
+    failures += verifyStream(filters, inputs, options);
+    failures += verifyRandom();
+    failures += verifyJpeg(options);
+
+    printf("\n%s\n", failures ? "FAILED" : "All filters match their references.");
+    return failures ? 1 : 0;
+}
@@ -17,12 +17,26 @@
 #include <QInputDialog>
 #include <QColorDialog>
 #include <QMessageBox>
+#include <QMouseEvent>
+#include <QRubberBand>
 #include <QShortcut>
+#include <QDockWidget>
+#include <QTableWidget>
+#include <QHeaderView>
+#include <QTimer>
+#include <QThread>
+#include <QPointer>
 #include <QDebug>
 
-#include <stack>
+#include <deque>
 #include <unordered_map>
 
+// " (123 ms)" for the status bar, or nothing when tracing was off.
+static QString timingSuffix(double ms) {
+    if (ms <= 0) return QString();
+    return " (" + QString::number(ms, 'f', ms < 10 ? 1 : 0) + " ms)";
+}
+
 MainWindow::MainWindow(QWidget *parent)
     : QMainWindow(parent), ui(new Ui::MainWindow)
 {
@@ -48,6 +62,19 @@ MainWindow::MainWindow(QWidget *parent)
     statusLabel = new QLabel("Ready");
     statusBar()->addWidget(statusLabel);
 
+    // Always collect timings: the status bar reports them and a Scope that is
+    // not written to a file costs next to nothing.
+    trace::Tracer::instance().enableStats(true);
+    setupTimingsPanel();
+
+    memoryLabel = new QLabel;
+    statusBar()->addPermanentWidget(memoryLabel);
+    customImage.setOwner(memory::Owner::Current);
+    QTimer *memoryTimer = new QTimer(this);
+    connect(memoryTimer, &QTimer::timeout, this, [=]() { updateMemoryStatus(); });
+    memoryTimer->start(1000);
+    updateMemoryStatus();
+
     // --------------------------------------------
     // 🧩 لوحة الفلاتر
     QFrame *filtersFrame = new QFrame;
@@ -64,36 +91,8 @@ MainWindow::MainWindow(QWidget *parent)
     QWidget *scrollContent = new QWidget;
     QVBoxLayout *scrollLayout = new QVBoxLayout(scrollContent);
 
-    filters = {
-               {GreyScale::getId(), make_shared<GreyScale>(customImage)},
-               {WhiteAndBlack::getId(), make_shared<WhiteAndBlack>(customImage)},
-               {Invert::getId(), make_shared<Invert>(customImage)},
-               {Merge::getId(), make_shared<Merge>(customImage)},
-               {Flip::getId(), make_shared<Flip>(customImage)},
-               {Rotate::getId(), make_shared<Rotate>(customImage)},
-               {Brightness::getId(), make_shared<Brightness>(customImage)},
-               {Crop::getId(), make_shared<Crop>(customImage)},
-               {Frame::getId(), make_shared<Frame>(customImage)},
-               {EdgeDetection::getId(), make_shared<EdgeDetection>(customImage)},
-               {Resize::getId(), make_shared<Resize>(customImage)},
-               {Blur::getId(), make_shared<Blur>(customImage)},
-               {Sunlight::getId(), make_shared<Sunlight>(customImage)},
-               {OilPainting::getId(), make_shared<OilPainting>(customImage)},
-               {OldTV::getId(), make_shared<OldTV>(customImage)},
-               {Night::getId(), make_shared<Night>(customImage)},
-               {Infrared::getId(), make_shared<Infrared>(customImage)},
-               {Skewing::getId(), make_shared<Skewing>(customImage)},
-               {Bloody::getId(), make_shared<Bloody>(customImage)},
-               {Grass::getId(), make_shared<Grass>(customImage)},
-               {Sky::getId(), make_shared<Sky>(customImage)},
-               {ArtisticBrush::getId(), make_shared<ArtisticBrush>(customImage)},
-
-                {OldPhoto::getId(), make_shared<OldPhoto>(customImage)},
-                {Gama::getId(), make_shared<Gama>(customImage)},
-                {Saturation::getId(), make_shared<Saturation>(customImage)},
-                {HeatMap::getId(), make_shared<HeatMap>(customImage)},
-                {Snow::getId(), make_shared<Snow>(customImage)},
-               };
+    for (const FilterEntry &entry : filterRegistry())
+        filters.push_back({entry.id, entry.create(customImage)});
 
     for (auto &pair : filters) {
         QString name = QString::fromStdString(pair.second->getName());
@@ -128,6 +127,7 @@ MainWindow::MainWindow(QWidget *parent)
     imageLabel->setMinimumHeight(380);
     canvasLayout->addWidget(imageLabel);
     imageLabel->installEventFilter(this);
+    selectionBand = new QRubberBand(QRubberBand::Rectangle, imageLabel);
 
     mainLayout->addWidget(filtersFrame);
     mainLayout->addWidget(canvasFrame, 1);
@@ -142,6 +142,8 @@ MainWindow::MainWindow(QWidget *parent)
     addShortcut("Ctrl+Z", [=]() { undoStackTrigger(); });
     addShortcut("Ctrl+Shift+Z", [=]() { redoStackTrigger(); });
     addShortcut("Ctrl+Y", [=]() { redoStackTrigger(); });
+    addShortcut("Ctrl+T", [=]() { timingsDock->setVisible(!timingsDock->isVisible()); });
+    addShortcut("Esc", [=]() { clearSelection(); });
 }
 
 shared_ptr<Filter> MainWindow::getFilter(const std::string &name) {
@@ -163,11 +165,23 @@ void MainWindow::setupToolbar() {
     QAction *saveAct = toolbar->addAction("💾 Save");
     QAction *undoAct = toolbar->addAction("↩ Undo");
     QAction *redoAct = toolbar->addAction("↪ Redo");
+    selectAct = toolbar->addAction("✂ Select");
+    selectAct->setCheckable(true);
+    selectAct->setToolTip("Drag a rectangle on the image: filters apply to it alone, Crop keeps it (Esc clears)");
 
     connect(openAct, &QAction::triggered, this, [=]() { openImage(); });
     connect(saveAct, &QAction::triggered, this, [=]() { saveImage(); });
     connect(undoAct, &QAction::triggered, this, [=]() { undoStackTrigger(); });
     connect(redoAct, &QAction::triggered, this, [=]() { redoStackTrigger(); });
+    connect(selectAct, &QAction::toggled, this, [=](bool on) {
+        croppingMode = on;
+        if (!on) clearSelection();
+        statusLabel->setText(on ? "✂ Drag on the image to select" : "Ready");
+    });
+
+    toolbar->addSeparator();
+    timingsAct = toolbar->addAction("⏱ Timings");
+    timingsAct->setCheckable(true);
 
     QWidget *spacer = new QWidget;
     spacer->setSizePolicy(QSizePolicy::Expanding, QSizePolicy::Preferred);
@@ -178,64 +192,330 @@ void MainWindow::setupToolbar() {
     toolbar->addWidget(appTitle);
 }
 
+// --------------------------------------------
+// Rolling per-operation timings (decode, filters, display, scaling, encode),
+// refreshed while the panel is open. Toggled from the toolbar or with Ctrl+T.
+void MainWindow::setupTimingsPanel() {
+    timingsDock = new QDockWidget("Timings", this);
+    timingsDock->setObjectName("dockTimings");
+    QWidget *content = new QWidget;
+    QVBoxLayout *layout = new QVBoxLayout(content);
+
+    timingsTable = new QTableWidget(0, 6);
+    timingsTable->setHorizontalHeaderLabels({"Operation", "Kind", "Calls", "Last ms", "Mean ms", "Max ms"});
+    timingsTable->horizontalHeader()->setSectionResizeMode(0, QHeaderView::Stretch);
+    timingsTable->verticalHeader()->setVisible(false);
+    timingsTable->setEditTriggers(QAbstractItemView::NoEditTriggers);
+    timingsTable->setSelectionMode(QAbstractItemView::NoSelection);
+    layout->addWidget(timingsTable);
+
+    QString note = "Mean and max cover the last " + QString::number(trace::Tracer::statsWindow) + " calls.";
+    if (trace::Tracer::instance().writingFile())
+        note += "\nTrace: " + QString::fromStdString(trace::Tracer::instance().tracePath());
+    QLabel *noteLabel = new QLabel(note);
+    noteLabel->setWordWrap(true);
+    layout->addWidget(noteLabel);
+
+    QPushButton *resetBtn = new QPushButton("Reset");
+    connect(resetBtn, &QPushButton::clicked, this, [=]() {
+        trace::Tracer::instance().resetStats();
+        refreshTimings();
+    });
+    layout->addWidget(resetBtn);
+
+    timingsDock->setWidget(content);
+    addDockWidget(Qt::RightDockWidgetArea, timingsDock);
+    timingsDock->hide();
+
+    QTimer *timer = new QTimer(this);
+    timer->setInterval(500);
+    connect(timer, &QTimer::timeout, this, [=]() { refreshTimings(); });
+    connect(timingsDock, &QDockWidget::visibilityChanged, this, [=](bool visible) {
+        timingsAct->setChecked(visible);
+        if (visible) {
+            refreshTimings();
+            timer->start();
+        } else {
+            timer->stop();
+        }
+    });
+    connect(timingsAct, &QAction::triggered, this, [=](bool checked) { timingsDock->setVisible(checked); });
+}
+
+void MainWindow::refreshTimings() {
+    std::vector<trace::Stats> stats = trace::Tracer::instance().stats();
+    timingsTable->setRowCount(int(stats.size()));
+    auto number = [](double ms) { return QString::number(ms, 'f', ms < 10 ? 2 : 1); };
+    for (int row = 0; row < int(stats.size()); row++) {
+        const trace::Stats &s = stats[row];
+        QStringList cells = {QString::fromStdString(s.name), QString::fromUtf8(s.category), QString::number(s.count),
+                             number(s.lastMs), number(s.meanMs), number(s.maxMs)};
+        for (int column = 0; column < cells.size(); column++) {
+            QTableWidgetItem *item = timingsTable->item(row, column);
+            if (!item) {
+                item = new QTableWidgetItem;
+                if (column >= 2) item->setTextAlignment(Qt::AlignRight | Qt::AlignVCenter);
+                timingsTable->setItem(row, column, item);
+            }
+            item->setText(cells[column]);
+        }
+    }
+}
+
+// --------------------------------------------
+// Tags every image the editor holds with its role for memory accounting. The
+// first undo snapshot doubles as the original and is counted as that.
+void MainWindow::tagHistory() {
+    customImage.setOwner(memory::Owner::Current);
+    for (auto &img : undoStack) img->setOwner(memory::Owner::Undo);
+    for (auto &img : redoStack) img->setOwner(memory::Owner::Redo);
+    if (originalImage) originalImage->setOwner(memory::Owner::Original);
+}
+
+// Drops history, oldest redo steps first, then the oldest undo steps, then the
+// Before/After original, until incoming more bytes fit under the memory limit
+// (WAKEUP_MEMORY_LIMIT). The current image is never dropped. Returns the
+// number of steps dropped.
+int MainWindow::trimHistory(int64_t incoming) {
+    const memory::Accounting &accounting = memory::accounting();
+    int dropped = 0;
+    while (accounting.exceedsLimit(incoming)) {
+        if (!redoStack.empty()) {
+            redoStack.pop_front();
+        } else if (!undoStack.empty()) {
+            undoStack.pop_front();
+        } else if (originalImage) {
+            originalImage.reset();
+        } else {
+            break;
+        }
+        dropped++;
+    }
+    if (dropped > 0) qDebug() << "Memory limit: dropped" << dropped << "history step(s);"
+                              << QString::fromStdString(accounting.summary());
+    return dropped;
+}
+
+void MainWindow::updateMemoryStatus() {
+    const memory::Accounting &accounting = memory::accounting();
+    QString text = "🧠 " + QString::fromStdString(memory::formatBytes(accounting.live()))
+                 + " (peak " + QString::fromStdString(memory::formatBytes(accounting.peak()));
+    if (accounting.limit() > 0) text += " of " + QString::fromStdString(memory::formatBytes(accounting.limit()));
+    memoryLabel->setText(text + ")");
+    memoryLabel->setToolTip(QString::fromStdString(accounting.summary()) + "\nHistory: "
+                            + QString::number(undoStack.size()) + " undo, "
+                            + QString::number(redoStack.size()) + " redo");
+}
+
 // --------------------------------------------
 void MainWindow::openImage() {
-    QString fileName = QFileDialog::getOpenFileName(this, "Open Image", "", "Images (*.png *.jpg *.jpeg *.bmp)");
+    QString fileName = QFileDialog::getOpenFileName(this, "Open Image", "", "Images (*.png *.jpg *.jpeg *.bmp *.tga *.ppm *.PNG *.JPG *.JPEG *.BMP)");
     if (fileName.isEmpty()) return;
-    if (!customImage.loadNewImage(fileName.toStdString())) {
-        QMessageBox::warning(this, "Error", "Failed to load image.");
+    loadImageAsync(fileName, "✅ Loaded: ");
+}
+
+// Decodes once, on a worker thread, straight into the Image the filters edit;
+// the label is drawn from that same buffer, so no second (Qt) decode is needed.
+// Large images first get a reduced decode sized for the label (JPEGs at 1/2 to
+// 1/8 in the DCT domain), shown while the full resolution is still decoding.
+void MainWindow::loadImageAsync(const QString &fileName, const QString &loadedMessage) {
+    auto decoded = std::make_shared<Image>();
+    auto decodeMs = std::make_shared<double>(0);
+    auto error = std::make_shared<QString>();
+    int generation = ++loadGeneration;
+    loadingImage = true;
+    QSize target = imageLabel->size();
+    QPointer<MainWindow> self(this);
+
+    QThread *loader = QThread::create([=, path = fileName.toStdString()]() {
+        try {
+            ImageHeader header = probeImage(path);
+            int scale = previewScaleFor(header.width, header.height, target.width(), target.height());
+            if (scale > 1) {
+                auto preview = std::make_shared<const Image>(decodeImageScaled(path, scale));
+                preview->setOwner(memory::Owner::Display);
+                QMetaObject::invokeMethod(self, [=]() {
+                    if (!self || generation != loadGeneration) return;
+                    loadingPreview = preview;
+                    refreshDisplay();
+                }, Qt::QueuedConnection);
+            }
+            trace::Scope scope("decode", "load");
+            *decoded = decodeImage(path);
+            *decodeMs = scope.stop();
+        } catch (const std::exception &e) {
+            *error = QString::fromStdString(e.what());
+        }
+    });
+    connect(loader, &QThread::finished, this, [=]() {
+        loader->deleteLater();
+        if (generation != loadGeneration) return;
+        loadingImage = false;
+        loadingPreview.reset();
+        if (!error->isEmpty()) {
+            if (customImage.width == 0) imageLabel->clear();
+            refreshDisplay();
+            statusLabel->setText("Ready");
+            QMessageBox::warning(this, "Error", "Failed to load image.");
+            return;
+        }
+
+        // Move, not copy: the filters keep a reference to customImage itself.
+        customImage = std::move(*decoded);
+        clearSelection();
+        originalImage.reset();
+        undoStack.clear();
+        redoStack.clear();
+
+        double wScaleRatio = (double(imageLabel->size().width())/customImage.width);
+        double hScaleRatio = (double(imageLabel->size().height())/customImage.height);
+        int labelWidth =  wScaleRatio * customImage.width;
+        int labelHeight =  hScaleRatio * customImage.height;
+        imageLabel->setFixedSize(labelWidth, labelHeight);
+
+        refreshDisplay();
+        updateMemoryStatus();
+        statusLabel->setText(loadedMessage + QFileInfo(fileName).fileName() + timingSuffix(*decodeMs));
+    });
+
+    statusLabel->setText("⏳ Loading " + QFileInfo(fileName).fileName() + "...");
+    loader->start();
+}
+
+// Scales straight from the Image's pixels; QImage only wraps the buffer.
+void MainWindow::showImage(const Image &img) {
+    if (img.width == 0) return;
+    QImage qimg((uchar*)img.imageData, img.width, img.height,
+                img.width * 3, QImage::Format_RGB888);
+    trace::Scope scaling("scale", "view scale");
+    QImage scaled = qimg.scaled(imageLabel->size(), Qt::KeepAspectRatio, Qt::SmoothTransformation);
+    scaling.stop();
+    trace::Scope conversion("display", "to pixmap");
+    imageLabel->setPixmap(QPixmap::fromImage(scaled));
+    displayCharge.reset(size_t(scaled.sizeInBytes()));
+}
+
+void MainWindow::refreshDisplay() {
+    showImage(loadingPreview ? *loadingPreview : customImage);
+    updateSelectionBand();
+}
+
+// --------------------------------------------
+// Where the scaled image sits inside the label (centred, aspect kept).
+QRect MainWindow::shownImageRect() const {
+    if (customImage.width == 0) return QRect();
+    QSize shown = QSize(customImage.width, customImage.height).scaled(imageLabel->size(), Qt::KeepAspectRatio);
+    return QRect(QPoint((imageLabel->width() - shown.width()) / 2, (imageLabel->height() - shown.height()) / 2), shown);
+}
+
+// The pixel edge nearest to a label point, clamped to the image.
+QPoint MainWindow::labelToImage(const QPoint &point) const {
+    QRect shown = shownImageRect();
+    if (shown.isEmpty()) return QPoint();
+    int x = int(std::lround(double(point.x() - shown.left()) * customImage.width / shown.width()));
+    int y = int(std::lround(double(point.y() - shown.top()) * customImage.height / shown.height()));
+    return QPoint(std::clamp(x, 0, customImage.width), std::clamp(y, 0, customImage.height));
+}
+
+void MainWindow::updateSelectionBand() {
+    QRect shown = shownImageRect();
+    if (selection.isEmpty() || shown.isEmpty()) {
+        selectionBand->hide();
         return;
     }
-    currentImage.load(fileName);
-    originalImage = customImage;
-
-    double wScaleRatio = (double(imageLabel->size().width())/customImage.width);
-    double hScaleRatio = (double(imageLabel->size().height())/customImage.height);
-    int labelWidth =  wScaleRatio * customImage.width;
-    int labelHeight =  hScaleRatio * customImage.height;
-    imageLabel->setFixedSize(labelWidth, labelHeight);
+    double sx = double(shown.width()) / customImage.width, sy = double(shown.height()) / customImage.height;
+    selectionBand->setGeometry(QRect(shown.left() + int(selection.x() * sx), shown.top() + int(selection.y() * sy),
+                                     std::max(1, int(selection.width() * sx)), std::max(1, int(selection.height() * sy))));
+    selectionBand->show();
+}
 
-    imageLabel->setPixmap(currentImage.scaled(imageLabel->size(), Qt::KeepAspectRatio, Qt::SmoothTransformation));
-    undoStack = std::stack<Image>();
-    redoStack = std::stack<Image>();
-    statusLabel->setText("✅ Loaded: " + QFileInfo(fileName).fileName());
+void MainWindow::clearSelection() {
+    selection = QRect();
+    cropping = false;
+    selectionBand->hide();
 }
 
+// Encodes a copy of the image on a worker thread, so a large PNG does not
+// freeze the editor; edits made meanwhile do not end up in the file.
 void MainWindow::saveImage() {
-    QString fileName = QFileDialog::getSaveFileName(this, "Save Image", "", "Images (*.png *.jpg *.bmp)");
+    if (customImage.width == 0) {
+        QMessageBox::warning(this, "Warning", "Load an image first!");
+        return;
+    }
+    QString fileName = QFileDialog::getSaveFileName(this, "Save Image", "", "Images (*.png *.jpg *.jpeg *.bmp *.tga)");
     if (fileName.isEmpty()) return;
-    customImage.saveImage(fileName.toStdString());
-    statusLabel->setText("💾 Saved successfully!");
+
+    bool ok = true;
+    QString ext = QFileInfo(fileName).suffix().toLower();
+    if (ext == "jpg" || ext == "jpeg") {
+        saveOptions.jpegQuality = QInputDialog::getInt(this, tr("JPEG Quality"), tr("Quality (1-100):"),
+                                                       saveOptions.jpegQuality, 1, 100, 1, &ok);
+    } else if (ext == "png") {
+        saveOptions.pngCompression = QInputDialog::getInt(this, tr("PNG Compression"),
+                                                          tr("Compression (0 = fastest, 9 = smallest):"),
+                                                          saveOptions.pngCompression, 0, 9, 1, &ok);
+    }
+    if (!ok) return;
+
+    auto snapshot = std::make_shared<const Image>(customImage);
+    auto error = std::make_shared<QString>();
+    auto encodeMs = std::make_shared<double>(0);
+    QThread *saver = QThread::create([=, options = saveOptions, path = fileName.toStdString()]() {
+        try {
+            trace::Scope scope("encode", "save");
+            encodeImage(*snapshot, path, options);
+            *encodeMs = scope.stop();
+        } catch (const std::exception &e) {
+            *error = QString::fromStdString(e.what());
+        }
+    });
+    connect(saver, &QThread::finished, this, [=]() {
+        saver->deleteLater();
+        if (!error->isEmpty()) {
+            statusLabel->setText("Ready");
+            QMessageBox::warning(this, "Error", "Failed to save image: " + *error);
+            return;
+        }
+        statusLabel->setText("💾 Saved: " + QFileInfo(fileName).fileName() + timingSuffix(*encodeMs));
+    });
+
+    statusLabel->setText("⏳ Saving " + QFileInfo(fileName).fileName() + "...");
+    saver->start();
 }
 
 void MainWindow::undoStackTrigger() {
     if (!undoStack.empty()) {
-        redoStack.push(customImage);
-        customImage = undoStack.top();
-        undoStack.pop();
-        QImage qimg((uchar*)customImage.imageData, customImage.width, customImage.height,
-                    customImage.width * 3, QImage::Format_RGB888);
-        imageLabel->setPixmap(QPixmap::fromImage(qimg).scaled(
-            imageLabel->size(), Qt::KeepAspectRatio, Qt::SmoothTransformation));
+        redoStack.push_back(std::make_shared<Image>(std::move(customImage)));
+        // Copied, since the bottom snapshot is also originalImage.
+        customImage = *undoStack.back();
+        undoStack.pop_back();
+        if (!QRect(0, 0, customImage.width, customImage.height).contains(selection)) clearSelection();
+        tagHistory();
+        trimHistory(0);
+        refreshDisplay();
         statusLabel->setText("↩️ Undo");
     }
 }
 
 void MainWindow::redoStackTrigger() {
     if (!redoStack.empty()) {
-        undoStack.push(customImage);
-        customImage = redoStack.top();
-        redoStack.pop();
-        QImage qimg((uchar*)customImage.imageData, customImage.width, customImage.height,
-                    customImage.width * 3, QImage::Format_RGB888);
-        imageLabel->setPixmap(QPixmap::fromImage(qimg).scaled(
-            imageLabel->size(), Qt::KeepAspectRatio, Qt::SmoothTransformation));
+        undoStack.push_back(std::make_shared<Image>(std::move(customImage)));
+        customImage = std::move(*redoStack.back());
+        redoStack.pop_back();
+        if (!QRect(0, 0, customImage.width, customImage.height).contains(selection)) clearSelection();
+        tagHistory();
+        trimHistory(0);
+        refreshDisplay();
         statusLabel->setText("↪️ Redo");
     }
 }
 
 // --------------------------------------------
 void MainWindow::applyFilter(const string &filterId, const string &name, bool skipNeeds) {
+    if (loadingImage) {
+        statusLabel->setText("⏳ Still loading the full-resolution image...");
+        return;
+    }
     if (customImage.width == 0) {
         QMessageBox::warning(this, "Warning", "Load an image first!");
         return;
@@ -244,6 +524,19 @@ void MainWindow::applyFilter(const string &filterId, const string &name, bool sk
     auto filter = getFilter(filterId);
     if (!filter) return;
 
+    // With a selection, Crop keeps it and any other filter applies to it alone.
+    bool cropToSelection = false;
+    if (!selection.isEmpty()) {
+        if (auto *crop = dynamic_cast<Crop *>(filter.get())) {
+            crop->setCropParams(selection.x(), selection.y(), selection.width(), selection.height());
+            cropToSelection = skipNeeds = true;
+        } else if (!dynamic_cast<PointFilter *>(filter.get()) && filter->tileHalo() < 0) {
+            QMessageBox::information(this, "Selection", QString::fromStdString(name)
+                                     + " works on the whole image. Clear the selection (Esc) to apply it.");
+            return;
+        }
+    }
+
     if (!skipNeeds) {
         auto needs = filter->getNeeds();
         for (auto &param : needs) {
@@ -265,7 +558,12 @@ void MainWindow::applyFilter(const string &filterId, const string &name, bool sk
                 if (fileName.isEmpty()) return;
 
                 Image overlayImg;
-                overlayImg.loadNewImage(fileName.toStdString());
+                try {
+                    overlayImg = decodeImage(fileName.toStdString(), PixelFormat::RGBA8);
+                } catch (const std::exception &) {
+                    QMessageBox::warning(this, "Error", "Failed to load image.");
+                    return;
+                }
                 filter->setParam(param.name, overlayImg);
             }
             else if (param.type == "color") {
@@ -279,9 +577,30 @@ void MainWindow::applyFilter(const string &filterId, const string &name, bool sk
         }
     }
 
-    undoStack.push(customImage);
-    redoStack = std::stack<Image>();
-    filter->apply();
+    // Room for the snapshot and about one image of filter temporaries.
+    int dropped = trimHistory(2 * int64_t(customImage.byteSize()));
+    auto snapshot = std::make_shared<Image>(customImage);
+    trace::Scope scope("filter", name);
+    try {
+        if (!selection.isEmpty() && !cropToSelection) {
+            applyToView(*filter, ImageView::of(customImage).region(selection.x(), selection.y(),
+                                                                   selection.width(), selection.height()));
+        } else {
+            filter->apply();
+        }
+    } catch (const std::exception &e) {
+        customImage = std::move(*snapshot);
+        refreshDisplay();
+        statusLabel->setText("Ready");
+        QMessageBox::warning(this, "Error", QString::fromStdString(name) + " failed: " + e.what());
+        return;
+    }
+    double applyMs = scope.stop();
+    if (cropToSelection) clearSelection();
+    if (!originalImage) originalImage = snapshot;
+    undoStack.push_back(snapshot);
+    redoStack.clear();
+    tagHistory();
 
     double wScaleRatio = (double(imageLabel->size().width())/customImage.width);
     double hScaleRatio = (double(imageLabel->size().height())/customImage.height);
@@ -289,12 +608,14 @@ void MainWindow::applyFilter(const string &filterId, const string &name, bool sk
     int labelHeight =  hScaleRatio * customImage.height;
     imageLabel->setFixedSize(labelWidth, labelHeight);
 
-    QImage qimg((uchar *)customImage.imageData, customImage.width, customImage.height,
-                customImage.width * 3, QImage::Format_RGB888);
-    imageLabel->setPixmap(QPixmap::fromImage(qimg).scaled(
-        imageLabel->size(), Qt::KeepAspectRatio, Qt::SmoothTransformation));
+    refreshDisplay();
 
-    statusLabel->setText("✅ Applied: " + QString::fromStdString(name));
+    dropped += trimHistory(0);
+    QString status = "✅ Applied: " + QString::fromStdString(name) + timingSuffix(applyMs);
+    if (dropped > 0)
+        status += " — dropped " + QString::number(dropped) + " history step(s) to stay under the memory limit";
+    statusLabel->setText(status);
+    updateMemoryStatus();
 }
 
 // --------------------------------------------
@@ -319,20 +640,45 @@ bool MainWindow::eventFilter(QObject *obj, QEvent *event) {
         }
     }
 
+    // ✂ Dragging out the selection while Select is on
+    if (obj == imageLabel && croppingMode && customImage.width > 0) {
+        auto *mouse = dynamic_cast<QMouseEvent *>(event);
+        if (event->type() == QEvent::MouseButtonPress && mouse->button() == Qt::LeftButton) {
+            cropping = true;
+            cropStart = cropEnd = mouse->position().toPoint();
+            selectionBand->setGeometry(QRect(cropStart, QSize()));
+            selectionBand->show();
+            return true;
+        } else if (event->type() == QEvent::MouseMove && cropping) {
+            cropEnd = mouse->position().toPoint();
+            selectionBand->setGeometry(QRect(cropStart, cropEnd).normalized());
+            return true;
+        } else if (event->type() == QEvent::MouseButtonRelease && cropping) {
+            cropping = false;
+            QPoint a = labelToImage(cropStart), b = labelToImage(mouse->position().toPoint());
+            selection = QRect(QPoint(std::min(a.x(), b.x()), std::min(a.y(), b.y())),
+                              QSize(std::abs(a.x() - b.x()), std::abs(a.y() - b.y())));
+            if (selection.isEmpty()) {
+                clearSelection();
+                statusLabel->setText("✂ Drag on the image to select");
+            } else {
+                updateSelectionBand();
+                statusLabel->setText(QString("✂ Selection %1 x %2 at (%3, %4): filters apply to it, Crop keeps it")
+                                         .arg(selection.width()).arg(selection.height())
+                                         .arg(selection.x()).arg(selection.y()));
+            }
+            return true;
+        }
+    }
+
     // 👇 الضغط المستمر لعرض الصورة الأصلية
     if (obj == imageLabel && customImage.width > 0) {
         if (event->type() == QEvent::MouseButtonPress) {
-            QImage qimg((uchar*)originalImage.imageData, originalImage.width, originalImage.height,
-                        originalImage.width * 3, QImage::Format_RGB888);
-            imageLabel->setPixmap(QPixmap::fromImage(qimg).scaled(
-                imageLabel->size(), Qt::KeepAspectRatio, Qt::SmoothTransformation));
+            showImage(originalImage ? *originalImage : customImage);
             statusLabel->setText("👁️ Showing Original");
             return true;
         } else if (event->type() == QEvent::MouseButtonRelease) {
-            QImage qimg((uchar*)customImage.imageData, customImage.width, customImage.height,
-                        customImage.width * 3, QImage::Format_RGB888);
-            imageLabel->setPixmap(QPixmap::fromImage(qimg).scaled(
-                imageLabel->size(), Qt::KeepAspectRatio, Qt::SmoothTransformation));
+            refreshDisplay();
             statusLabel->setText("🎨 Showing Edited");
             return true;
         }
@@ -347,26 +693,13 @@ void MainWindow::dropEvent(QDropEvent *event) {
     if (mimeData->hasUrls()) {
         QString fileName = mimeData->urls().first().toLocalFile();
         if (fileName.isEmpty()) return;
-        if (!customImage.loadNewImage(fileName.toStdString())) {
-            QMessageBox::warning(this, "Error", "Failed to load image.");
-            return;
-        }
-        currentImage.load(fileName);
-        originalImage = customImage;
-        undoStack = std::stack<Image>();
-        redoStack = std::stack<Image>();
-        imageLabel->setPixmap(currentImage.scaled(
-            imageLabel->size(), Qt::KeepAspectRatio, Qt::SmoothTransformation));
-        statusLabel->setText("✅ Loaded via Drag & Drop: " + QFileInfo(fileName).fileName());
+        loadImageAsync(fileName, "✅ Loaded via Drag & Drop: ");
     }
 }
 
 void MainWindow::resizeEvent(QResizeEvent *event) {
     QMainWindow::resizeEvent(event);
-    if (!currentImage.isNull()) {
-        imageLabel->setPixmap(currentImage.scaled(
-            imageLabel->size(), Qt::KeepAspectRatio, Qt::SmoothTransformation));
-    }
+    refreshDisplay();
 }
 
 void MainWindow::dragEnterEvent(QDragEnterEvent *event) {
@@ -1,10 +1,18 @@
 #pragma once
 #include <QMainWindow>
 #include <QLabel>
-#include <stack>
+#include <deque>
 #include <vector>
 #include <memory>
 #include "Filters.h"
+#include "ImageInput.h"
+#include "ImageOutput.h"
+#include "MemoryAccounting.h"
+#include "Trace.h"
+
+class QDockWidget;
+class QRubberBand;
+class QTableWidget;
 
 QT_BEGIN_NAMESPACE
 namespace Ui { class MainWindow; }
@@ -32,27 +40,50 @@ private:
     Ui::MainWindow *ui;
     QLabel *imageLabel;
     QLabel *statusLabel;
+    QDockWidget *timingsDock = nullptr;   ///< Rolling per-operation timings, see setupTimingsPanel
+    QTableWidget *timingsTable = nullptr;
+    QAction *timingsAct = nullptr;
+    QLabel *memoryLabel = nullptr;        ///< Live / peak image memory, breakdown in the tooltip
 
     Image customImage;
-    Image originalImage;
-    QPixmap currentImage;
+    std::shared_ptr<const Image> originalImage; ///< First undo snapshot; null until the first edit
     QString originalImagePath;
-    void displayScaledImage(const QImage &img);
+    int loadGeneration = 0; ///< Bumped per open so a slow, superseded decode is dropped
+    bool loadingImage = false;
+    std::shared_ptr<const Image> loadingPreview; ///< Reduced decode shown until the full image arrives
+    EncodeOptions saveOptions; ///< Last JPEG quality / PNG compression picked when saving
+    void loadImageAsync(const QString &fileName, const QString &loadedMessage);
+    void showImage(const Image &img);
+    void refreshDisplay();
+    memory::Charge displayCharge{memory::Owner::Display}; ///< The label's pixmap
 
-    // ✅ Crop logic
+    // ✅ Crop logic: a rectangle dragged on the image while Select is on becomes
+    // the selection; filters then apply to it alone and Crop keeps just it.
     bool croppingMode = false;
     bool cropping = false;
-    QPoint cropStart, cropEnd;
+    QPoint cropStart, cropEnd;        ///< Drag corners, label coordinates
+    QRect selection;                  ///< Image pixels; empty = whole image
+    QRubberBand *selectionBand = nullptr;
+    QAction *selectAct = nullptr;
+    QRect shownImageRect() const;
+    QPoint labelToImage(const QPoint &point) const;
+    void updateSelectionBand();
+    void clearSelection();
 
     // ✅ Before/After logic
     bool showingOriginal = false;
 
-    // Undo/Redo + Filters
-    std::stack<Image> undoStack, redoStack;
+    // Undo/Redo + Filters; newest step at the back, the front is dropped first
+    std::deque<std::shared_ptr<Image>> undoStack, redoStack;
     std::vector<std::pair<std::string, std::shared_ptr<Filter>>> filters;
 
     // 🧩 Methods
     void setupToolbar();
+    void setupTimingsPanel();
+    void refreshTimings();
+    void updateMemoryStatus();
+    int trimHistory(int64_t incoming);
+    void tagHistory();
     void applyFilter(const std::string &filterId, const std::string &name, bool skipNeeds = false);
     std::shared_ptr<Filter> getFilter(const std::string &name);
 };
@@ -32,6 +32,20 @@
 
 #include <iostream>
 #include <exception>
+#include <cctype>
+#include <cstring>
+#include <utility>
+
+#include "../MemoryAccounting.h"
+
+
+/**
+ * @brief Layout of the samples at Image::imageData.
+ *
+ * RGB8 is what every filter is written for. RGBA8 adds an alpha byte per
+ * pixel; RGB16 stores native-endian 16-bit samples for higher precision.
+ */
+enum class PixelFormat { RGB8, RGBA8, RGB16 };
 
 
 /**
@@ -63,7 +77,12 @@ private:
      * @return The type of image format.
      */
 
-    short getExtensionType(const char* extension) {
+    short getExtensionType(const char* mixedCaseExtension) {
+        char extension[8] = {};
+        for (int i = 0; i < 7 && mixedCaseExtension[i] != '\0'; i++) {
+            extension[i] = static_cast<char>(tolower(static_cast<unsigned char>(mixedCaseExtension[i])));
+        }
+
         if (strcmp(extension, ".png") == 0) {
             return PNG_TYPE;
         }
@@ -77,7 +96,7 @@ private:
             return JPG_TYPE;
         }
 
-        std::cerr << "Unsupported image format: " << extension << std::endl;
+        std::cerr << "Unsupported image format: " << mixedCaseExtension << std::endl;
         return UNSUPPORTED_TYPE;
     }
 
@@ -88,8 +107,35 @@ public:
     int width = 0; ///< Width of the image.
     int height = 0; ///< Height of the image.
     int channels = 3; ///< Number of color channels in the image.
+    PixelFormat format = PixelFormat::RGB8; ///< Sample layout of imageData.
     unsigned char* imageData = nullptr; ///< Pointer to the image data.
 
+    /// Accounts imageData's bytes (see MemoryAccounting.h). Bookkeeping, not
+    /// content: tagging a snapshot held as const is allowed.
+    mutable memory::Charge charge;
+
+    /**
+     * @brief Counts this image's buffer toward owner from now on. Copies and
+     *        moves do not inherit the owner; assignments keep the target's.
+     */
+    void setOwner(memory::Owner owner) const {
+        charge.setOwner(owner);
+    }
+
+    /**
+     * @brief Bytes per sample: 2 for RGB16, otherwise 1.
+     */
+    int bytesPerSample() const {
+        return format == PixelFormat::RGB16 ? 2 : 1;
+    }
+
+    /**
+     * @brief Size of the pixel buffer in bytes.
+     */
+    size_t byteSize() const {
+        return size_t(width) * height * channels * bytesPerSample();
+    }
+
     /**
      * @brief Default constructor for the Image class.
      */
@@ -113,7 +159,24 @@ public:
     Image(int mWidth, int mHeight) {
         this->width = mWidth;
         this->height = mHeight;
-        this->imageData = (unsigned char*)malloc(mWidth * mHeight * this->channels);
+        this->imageData = (unsigned char*)malloc(byteSize());
+        charge.reset(imageData ? byteSize() : 0);
+    }
+
+    /**
+     * @brief Constructor that creates an uninitialised image in the given format.
+     *
+     * @param mWidth The width of the image.
+     * @param mHeight The height of the image.
+     * @param mFormat The pixel format of the buffer.
+     */
+    Image(int mWidth, int mHeight, PixelFormat mFormat) {
+        this->width = mWidth;
+        this->height = mHeight;
+        this->format = mFormat;
+        this->channels = mFormat == PixelFormat::RGBA8 ? 4 : 3;
+        this->imageData = static_cast<unsigned char*>(malloc(byteSize()));
+        charge.reset(imageData ? byteSize() : 0);
     }
 
     /**
@@ -144,12 +207,51 @@ public:
         this->width = image.width;
         this->height = image.height;
         this->channels = image.channels;
-        imageData = static_cast<unsigned char*>(malloc(width * height * channels));
+        this->format = image.format;
+        imageData = static_cast<unsigned char*>(malloc(byteSize()));
+        if (image.imageData != nullptr) {
+            memcpy(this->imageData, image.imageData, byteSize());
+        }
+        charge.reset(imageData ? byteSize() : 0);
+
+        return *this;
+    }
 
-        for (int i = 0; i < image.width * image.height * this->channels; i++) {
-            this->imageData[i] = image.imageData[i];
+    /**
+     * @brief Constructor that takes over another image's pixel buffer.
+     *
+     * @param other The Image we want to move from; it is left empty.
+     */
+    Image(Image&& other) noexcept {
+        *this = std::move(other);
+    }
+
+    /**
+     * @brief Move assignment: takes over the pixel buffer instead of copying it.
+     *
+     * @param image The Image we want to move from; it is left empty.
+     *
+     * @return *this after taking the data.
+     */
+    Image& operator=(Image&& image) noexcept {
+        if (this == &image){
+            return *this;
         }
 
+        stbi_image_free(this->imageData);
+
+        this->width = image.width;
+        this->height = image.height;
+        this->channels = image.channels;
+        this->format = image.format;
+        this->imageData = image.imageData;
+        charge.reset(image.charge.bytes());
+
+        image.width = 0;
+        image.height = 0;
+        image.imageData = nullptr;
+        image.charge.reset(0);
+
         return *this;
     }
 
@@ -163,6 +265,7 @@ public:
         this->width = 0;
         this->height = 0;
         this->imageData = nullptr;
+        charge.reset(0);
     }
 
     /**
@@ -188,7 +291,11 @@ public:
             stbi_image_free(imageData);
         }
 
-        imageData = stbi_load(filename.c_str(), &width, &height, &channels, STBI_rgb);
+        int fileChannels = 0;
+        imageData = stbi_load(filename.c_str(), &width, &height, &fileChannels, STBI_rgb);
+        channels = 3;
+        format = PixelFormat::RGB8;
+        charge.reset(imageData ? byteSize() : 0);
 
         if (imageData == nullptr) {
             std::cerr << "File Doesn't Exist" << '\n';
@@ -198,6 +305,41 @@ public:
         return true;
     }
 
+    /**
+     * @brief Decodes an encoded image (PNG, JPEG, BMP, ...) held in memory.
+     *
+     * @param data The encoded file contents.
+     * @param size Number of bytes at data.
+     * @param pixelFormat The format to decode into; alpha is dropped or made
+     *        opaque and samples are widened or narrowed to match.
+     * @return True if the image is decoded successfully.
+     * @throws std::invalid_argument If the data is not a supported image.
+     */
+    bool loadFromMemory(const unsigned char* data, size_t size, PixelFormat pixelFormat = PixelFormat::RGB8) {
+        if (imageData != nullptr) {
+            stbi_image_free(imageData);
+        }
+
+        int fileChannels = 0;
+        format = pixelFormat;
+        channels = pixelFormat == PixelFormat::RGBA8 ? 4 : 3;
+        if (pixelFormat == PixelFormat::RGB16) {
+            imageData = reinterpret_cast<unsigned char*>(
+                stbi_load_16_from_memory(data, static_cast<int>(size), &width, &height, &fileChannels, STBI_rgb));
+        } else {
+            imageData = stbi_load_from_memory(data, static_cast<int>(size), &width, &height, &fileChannels, channels);
+        }
+        charge.reset(imageData ? byteSize() : 0);
+
+        if (imageData == nullptr) {
+            width = height = 0;
+            std::cerr << "Couldn't Decode Image" << '\n';
+            throw std::invalid_argument(std::string("Couldn't decode image: ") + stbi_failure_reason());
+        }
+
+        return true;
+    }
+
     /**
      * @brief Saves the image to the specified output filename.
      *
@@ -207,6 +349,9 @@ public:
      */
 
     bool saveImage(const std::string& outputFilename) {
+        if (format == PixelFormat::RGB16) {
+            throw std::invalid_argument("16-bit images are saved with encodeImage()");
+        }
         if (!isValidFilename(outputFilename)) {
             std::cerr << "Not Supported Format" << '\n';
             throw std::invalid_argument("The file extension does not exist");
@@ -221,16 +366,16 @@ public:
         }
 
         if (extensionType == PNG_TYPE) {
-            stbi_write_png(outputFilename.c_str(), width, height, STBI_rgb, imageData, width * 3);
+            stbi_write_png(outputFilename.c_str(), width, height, channels, imageData, width * channels);
         }
         else if (extensionType == BMP_TYPE) {
-            stbi_write_bmp(outputFilename.c_str(), width, height, STBI_rgb, imageData);
+            stbi_write_bmp(outputFilename.c_str(), width, height, channels, imageData);
         }
         else if (extensionType == TGA_TYPE) {
-            stbi_write_tga(outputFilename.c_str(), width, height, STBI_rgb, imageData);
+            stbi_write_tga(outputFilename.c_str(), width, height, channels, imageData);
         }
         else if (extensionType == JPG_TYPE) {
-            stbi_write_jpg(outputFilename.c_str(), width, height, STBI_rgb, imageData, 90);
+            stbi_write_jpg(outputFilename.c_str(), width, height, channels, imageData, 90);
         }
 
         return true;
@@ -246,11 +391,11 @@ public:
      * @throws std::out_of_range If the coordinates or channel index is out of bounds.
      */
     unsigned char& getPixel(int x, int y, int c) {
-        if (x > width || x < 0) {
+        if (x >= width || x < 0) {
             std::cerr << "Out of width bounds" << '\n';
             throw std::out_of_range("Out of bounds, Cannot exceed width value");
         }
-        if (y > height || y < 0) {
+        if (y >= height || y < 0) {
             std::cerr << "Out of height bounds" << '\n';
             throw std::out_of_range("Out of bounds, Cannot exceed height value");
         }
@@ -263,11 +408,11 @@ public:
     }
 
     const unsigned char& getPixel(int x, int y, int c) const {
-        if (x > width || x < 0) {
+        if (x >= width || x < 0) {
             std::cerr << "Out of width bounds" << '\n';
             throw std::out_of_range("Out of bounds, Cannot exceed width value");
         }
-        if (y > height || y < 0) {
+        if (y >= height || y < 0) {
             std::cerr << "Out of height bounds" << '\n';
             throw std::out_of_range("Out of bounds, Cannot exceed height value");
         }
@@ -288,11 +433,11 @@ public:
      * @throws std::out_of_range If the coordinates or channel index is out of bounds.
      */
     void setPixel(int x, int y, int c, unsigned char value) {
-        if (x > width || x < 0) {
+        if (x >= width || x < 0) {
             std::cerr << "Out of width bounds" << '\n';
             throw std::out_of_range("Out of bounds, Cannot exceed width value");
         }
-        if (y > height || y < 0) {
+        if (y >= height || y < 0) {
             std::cerr << "Out of height bounds" << '\n';
             throw std::out_of_range("Out of bounds, Cannot exceed height value");
         }